@@ -0,0 +1,28 @@
+/*******************************************************************************
+* FILE: mult.c
+* The compute kernel of the matrix multiplication. Plain C without DSP/BIOS,
+* so the same source runs in the DSP image (tskMult.c) and in the host
+* benchmark (emu/kernel_bench).
+*******************************************************************************/
+
+#include "mult.h"
+
+/*******************************************************************************
+* PROCEDURE: mult_rows
+* PURPOSE: Multiply the rows row_start to row_end of a with b into the same
+* rows of c.
+*******************************************************************************/
+void mult_rows(const int *a, const int *b, int *c, int size, int stride, int row_start, int row_end)
+{
+    int i, j, k, sum;
+
+    for (i = row_start; i < row_end; i++) {
+        for (j = 0; j < size; j++) {
+            sum = 0;
+            for (k = 0; k < size; k++) {
+                sum += a[i * stride + k] * b[k * stride + j];
+            }
+            c[i * stride + j] = sum;
+        }
+    }
+}
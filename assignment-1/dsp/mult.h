@@ -0,0 +1,12 @@
+#if !defined (mult_H)
+#define mult_H
+
+/* The compute kernel of the matrix multiplication, without DSP/BIOS: it builds
+ * for the DSP and for the host (emu/kernel_bench). The matrices are size x
+ * size, stored in rows of stride elements. */
+
+/* The rows row_start to row_end of c = a * b */
+void mult_rows(const int *a, const int *b, int *c, int size, int stride, int row_start, int row_end);
+
+
+#endif /* !defined (mult_H) */
@@ -27,6 +27,7 @@
 /*  ----------------------------------- Sample Headers              */
 #include <matrixMult_config.h>
 #include <tskMult.h>
+#include <mult.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -138,8 +139,7 @@ Int TSKMULT_create(TSKMULT_TransferInfo** infoPtr)
 Int TSKMULT_execute(TSKMULT_TransferInfo* info)
 {
     Int status = SYS_OK;
-    ControlMsg *msg, *first_message, *ret_matrix;
-    int i, j, k;
+    ControlMsg *msg, *first_message = NULL, *ret_matrix;
 
     /* Allocate the result message */
     status = MSGQ_alloc(SAMPLE_POOL_ID, (MSGQ_Msg*) &ret_matrix, APP_BUFFER_SIZE);
@@ -182,15 +182,8 @@ Int TSKMULT_execute(TSKMULT_TransferInfo* info)
         if (MSGQ_getMsgId((MSGQ_Msg) msg) == 0x2)
         {
             /* Do the matrix calculation */
-            for (i = matrix_size * percentage / 100;i < matrix_size; i++)
-            {
-                for (j = 0; j < matrix_size; j++)
-                {
-                    ret_matrix->matrix[i][j]=0;
-                    for(k=0; k < matrix_size; k++)
-                        ret_matrix->matrix[i][j] = ret_matrix->matrix[i][j] + first_message->matrix[i][k] * msg->matrix[k][j];
-                }
-            }
+            mult_rows(&first_message->matrix[0][0], &msg->matrix[0][0], &ret_matrix->matrix[0][0],
+                      matrix_size, MATRIX_SIZE, matrix_size * percentage / 100, matrix_size);
 
             /* Send the message back to the GPP */
             status = MSGQ_put(info->locatedMsgq,(MSGQ_Msg) ret_matrix);
@@ -0,0 +1,192 @@
+/*******************************************************************************
+* FILE: kernels.c
+* The compute kernels of the DSP stages: the gaussian, the derivatives and the
+* magnitude of a range of rows. Plain C without DSP/BIOS, so the same source
+* runs in the DSP image (task.c) and in the host benchmark (emu/kernel_bench).
+*******************************************************************************/
+
+#include <stddef.h>
+
+#include "kernels.h"
+
+/* A one dimensional gaussian kernel, normalized to fixed point. */
+static const unsigned short int kernel[] = {
+    416,  1177,  2837,  5830, 10206,
+    15226, 19356, 20969, 19356, 15226,
+    10206,  5830,  2837,  1177,  416
+};
+
+/*******************************************************************************
+* PROCEDURE: kernel_gaussian
+* PURPOSE: Blur the rows row_start to row_end of the image with the fixed point
+* gaussian, first in x into tmpim (the rows and GAUSSIAN_HALO rows around
+* them), then in y into smoothedim. When halo is not NULL the row below the
+* band is smoothed as well and written to halo instead.
+*******************************************************************************/
+void kernel_gaussian(const unsigned char *image, short int *smoothedim, unsigned int *tmpim,
+                     int rows, int cols, int row_start, int row_end, short int *halo)
+{
+    int r, c, rr, cc,
+        windowsize,       /* Dimension of the gaussian kernel. */
+        center,
+        rows_start,
+        rows_end,
+        blur_rows;
+    unsigned int dot,     /* Dot product summing variable. */
+             sum,            /* Sum of the kernel weights variable. */
+             temp;
+
+    windowsize = 15;
+    center = windowsize / 2;
+
+    /* When the GPP does all rows we don't need to do anything */
+    if (row_end <= row_start) {
+        return;
+    }
+
+    /* The row below the band goes to the halo */
+    blur_rows = row_end;
+    if (halo != NULL && row_end < rows) {
+        blur_rows++;
+    }
+
+    /* Calculate start and end for x blurring */
+    rows_start = (row_start > GAUSSIAN_HALO) ? row_start - GAUSSIAN_HALO : 0;
+    rows_end = blur_rows;
+    if(rows_end >= rows-GAUSSIAN_HALO)
+      rows_end = rows;
+    else
+      rows_end += GAUSSIAN_HALO;
+
+    /* Blur in x */
+    for (r = rows_start; r < rows_end; r++) {
+        for (c = 0; c < cols; c++) {
+            dot = 0;
+            sum = 0;
+            for (cc = (-center); cc <= center; cc++) {
+                if (((c + cc) >= 0) && ((c + cc) < cols)) {
+                    dot += image[r * cols + (c + cc)] * kernel[center + cc];
+                    sum += kernel[center + cc];
+                }
+            }
+            tmpim[r * cols + c] = dot * 90 / sum;
+        }
+    }
+
+    /* Blur in y */
+    for (c = 0; c < cols; c++) {
+        for (r = row_start; r < blur_rows; r++) {
+            sum = 0;
+            dot = 0;
+            for (rr = (-center); rr <= center; rr++) {
+                if (((r + rr) >= 0) && ((r + rr) < rows)) {
+                    dot += tmpim[(r + rr) * cols + c] * kernel[center + rr];
+                    sum += kernel[center + rr];
+                }
+            }
+            temp = (dot / sum) + 0.5;
+            if (r < row_end)
+              smoothedim[r * cols + c] = temp;
+            else
+              halo[c] = temp;
+        }
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: kernel_derivative
+* PURPOSE: The x and y derivatives of the rows row_start to row_end. The first
+* and last column and row of the image take themselves as the neighbour, the
+* last row of the band takes halo as the row below it when it is not NULL.
+*******************************************************************************/
+void kernel_derivative(const short int *smoothedim, short int *delta_x, short int *delta_y,
+                       int rows, int cols, int row_start, int row_end, const short int *halo)
+{
+    int r, c, pos;
+    const short int *up, *down;
+
+    /* Calculate the X direction */
+    for (r = row_start; r < row_end; r++) {
+        pos = r * cols;
+        delta_x[pos] = smoothedim[pos + 1] - smoothedim[pos];
+        pos++;
+        for (c = 1; c < (cols - 1); c++, pos++) {
+            delta_x[pos] = smoothedim[pos + 1] - smoothedim[pos - 1];
+        }
+        delta_x[pos] = smoothedim[pos] - smoothedim[pos - 1];
+    }
+
+    /* Calculate the Y direction */
+    for (r = row_start; r < row_end; r++) {
+        pos = r * cols;
+        up = smoothedim + ((r == 0) ? pos : pos - cols);
+        if (r == rows - 1)
+          down = smoothedim + pos;
+        else if (halo != NULL && r == row_end - 1)
+          down = halo;
+        else
+          down = smoothedim + pos + cols;
+        for (c = 0; c < cols; c++, pos++) {
+            delta_y[pos] = down[c] - up[c];
+        }
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: kernel_magnitude
+* PURPOSE: The magnitude of the rows row_start to row_end, rounded like the
+* magnitude of the GPP.
+*******************************************************************************/
+void kernel_magnitude(const short int *delta_x, const short int *delta_y, short int *magnitude,
+                      int rows, int cols, int row_start, int row_end)
+{
+    int r, c, pos;
+    unsigned int sq1, sq2;
+
+    (void)rows;
+    for (r = row_start, pos = row_start * cols; r < row_end; r++) {
+        for (c = 0; c < cols; c++, pos++) {
+            sq1 = (int)delta_x[pos] * (int)delta_x[pos];
+            sq2 = (int)delta_y[pos] * (int)delta_y[pos];
+            magnitude[pos] = (short int)kernel_sqrt(sq1 + sq2);
+        }
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: kernel_sqrt
+* PURPOSE: The rounded square root of n, (short)(0.5 + sqrt((float)n)) of the
+* GPP without the floating point: n is first rounded to the 24 bits of a float
+* (to nearest, ties to even), then the root is taken digit by digit with shifts
+* and subtractions, the C64x has no divider for a Newton iteration.
+*******************************************************************************/
+unsigned int kernel_sqrt(unsigned int n)
+{
+    unsigned int root = 0, bit = 1u << 30, rem, half, shift = 0;
+
+    while ((n >> shift) >= (1u << 24)) {
+        shift++;
+    }
+    if (shift > 0) {
+        rem = n & ((1u << shift) - 1);
+        half = 1u << (shift - 1);
+        n >>= shift;
+        if (rem > half || (rem == half && (n & 1))) {
+            n++;
+        }
+        n <<= shift;
+    }
+
+    for (rem = n; bit > rem; bit >>= 2);
+    for (; bit != 0; bit >>= 2) {
+        if (rem >= root + bit) {
+            rem -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+
+    /* n - root^2 is left, round up from root + 0.5 */
+    return (rem > root) ? root + 1 : root;
+}
@@ -0,0 +1,28 @@
+#if !defined (kernels_H)
+#define kernels_H
+
+/* The compute kernels of the DSP stages, without DSP/BIOS: they build for the
+ * DSP and for the host (emu/kernel_bench). Every kernel works on the rows
+ * row_start to row_end of an image of rows x cols, the buffers are whole
+ * images. The cache maintenance of the rows is up to the caller. */
+
+#define GAUSSIAN_HALO 8                 ///< Image rows the gaussian reads past its band
+
+/* Smooth the rows of the image, and the row below them into halo when it is
+ * not NULL. tmpim holds the x blur of the rows and GAUSSIAN_HALO rows around them */
+void kernel_gaussian(const unsigned char *image, short int *smoothedim, unsigned int *tmpim,
+                     int rows, int cols, int row_start, int row_end, short int *halo);
+
+/* The derivatives of the rows, the row below them is taken from halo when it is not NULL */
+void kernel_derivative(const short int *smoothedim, short int *delta_x, short int *delta_y,
+                       int rows, int cols, int row_start, int row_end, const short int *halo);
+
+/* The magnitude of the rows, the rounded square root of the sum of the squares */
+void kernel_magnitude(const short int *delta_x, const short int *delta_y, short int *magnitude,
+                      int rows, int cols, int row_start, int row_end);
+
+/* The rounded square root of n, the same as (short)(0.5 + sqrt((float)n)) on the GPP */
+unsigned int kernel_sqrt(unsigned int n);
+
+
+#endif /* !defined (kernels_H) */
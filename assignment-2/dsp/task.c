@@ -13,19 +13,15 @@
 #include <platform.h>
 #include <notify.h>
 #include <bcache.h>
+#include <mpcs.h>
 /*  ----------------------------------- Sample Headers              */
 #include <canny_edge_config.h>
 #include <task.h>
+#include <kernels.h>
 
 /* Buffer defines */
 #define NUM_BUF_SIZES                    6 ///< Amount of pools to be configured
-#define NUM_BUF_POOL0                    1 ///< Amount of buffers in the first pool
-#define NUM_BUF_POOL1                    1 ///< Amount of buffers in the second pool
-#define NUM_BUF_POOL2                    1 ///< Amount of buffers in the thrid pool
-#define NUM_BUF_POOL3                    1 ///< Amount of buffers in the fourth pool
-#define NUM_BUF_POOL4                    1 ///< Amount of buffers in the fifth pool
-#define NUM_BUF_POOL5                    1 ///< Amount of buffers in the sixth pool
-#define NUM_BUF_MAX                      1 ///< Maximum amount of buffers in pool
+#define NUM_BUF_MAX                      4 ///< Maximum amount of buffers in pool (frames in flight)
 
 enum {
     canny_edge_INIT,                    ///< Initialization stage
@@ -33,14 +29,62 @@ enum {
     canny_edge_WRITEBACK,               ///< Simple write back program
     canny_edge_GAUSSIAN,                ///< Calculate the Gaussian
     canny_edge_DERIVATIVE,              ///< Calculate the derivatives
-    canny_edge_MAGNITUDE                ///< Calculate the magnitude
+    canny_edge_MAGNITUDE,               ///< Calculate the magnitude
+    canny_edge_SETSIZE,                 ///< Take the image size from the control block
+    canny_edge_CHAIN,                   ///< Run the DSP bands of the first stages back to back
+    canny_edge_PING                     ///< Only take over the rows of the image and give them back
 };
 
-Uint32 pool_sizes[] = {NUM_BUF_POOL0, NUM_BUF_POOL1, NUM_BUF_POOL2, NUM_BUF_POOL3, NUM_BUF_POOL4, NUM_BUF_POOL5};
+/* The control block shared with the GPP, the GPP fills in the geometry and the
+ * buffer table and adds the commands to a ring. Keep in sync with the GPP. */
+#define canny_edge_CTRL_MAGIC   0x43414E59  ///< "CANY"
+#define canny_edge_CTRL_VERSION 4           ///< Bumped on every change of the layout
+#define canny_edge_CTRL_SLOTS   16          ///< Commands in the ring
+#define canny_edge_CTRL_LINE    128         ///< Cache line, the sides never write the same line
+#define canny_edge_TILE_LOCK    "CANNY_TILES" ///< Critical section of the tile counters
+
+typedef struct {
+    Uint32 seq;                         ///< Sequence number of the command, the first one is 1
+    Uint32 cmd;                         ///< The command
+    Uint32 buf;                         ///< The frame slot of the buffers
+    Uint32 row_start, row_end;          ///< Rows the DSP does
+    Uint32 stages;                      ///< Stages of a chain: 2 up to the derivative, 3 up to the magnitude
+    Uint32 tile_rows;                   ///< Rows per tile when the rows are pulled from the tile counter, or 0
+} canny_edge_Cmd;
+
+typedef struct {
+    /* Written by the DSP */
+    Uint32 done;                                        ///< Sequence number of the last finished command
+    Int32 status;                                       ///< SYS_OK, or the failure of the block or a command
+    Int32 results[canny_edge_CTRL_SLOTS];               ///< SYS_OK, or the failure of a command, by sequence number
+    Uint32 dsp_pad[canny_edge_CTRL_LINE / 4 - 2 - canny_edge_CTRL_SLOTS];
+    /* Written by both sides, only in the tile lock */
+    Uint32 tiles[NUM_BUF_MAX];                          ///< Next tile of the tiled command per frame slot
+    Uint32 tiles_pad[canny_edge_CTRL_LINE / 4 - NUM_BUF_MAX];
+    /* Written by the GPP */
+    Uint32 magic, version, size;                        ///< Identify the layout of the block
+    Uint32 rows, cols, depth;                           ///< The image size and the frame slots
+    Uint32 buffers[NUM_BUF_SIZES][NUM_BUF_MAX];         ///< Buffer addresses on the DSP
+    Uint32 buffer_sizes[NUM_BUF_SIZES];                 ///< The buffer sizes
+    Uint32 head;                                        ///< Sequence number of the last command written
+    canny_edge_Cmd cmds[canny_edge_CTRL_SLOTS];         ///< The ring of commands, by sequence number
+} canny_edge_Ctrl;
+
+/* The part of the control block written by the GPP */
+#define CTRL_GPP(ctrl)          ((Ptr)&(ctrl)->magic)
+#define CTRL_GPP_SIZE           (sizeof(canny_edge_Ctrl) - 2 * canny_edge_CTRL_LINE)
+
 Void *dsp_buffers[NUM_BUF_SIZES][NUM_BUF_MAX];      ///< Buffer addresses on the DSP
 Uint32 buffer_sizes[NUM_BUF_SIZES];                 ///< The buffer sizes
 Uint16 canny_edge_rows = 0;           ///< Columns of the image
 Uint16 canny_edge_cols = 0;           ///< Rows of the image
+Uint16 canny_edge_depth = 0;          ///< Buffers per pool (frames in flight)
+canny_edge_Ctrl *canny_edge_ctrl = NULL;    ///< The control block of the GPP
+Uint32 canny_edge_next = 1;           ///< Sequence number of the next command to run
+Bool canny_edge_rejected = FALSE;     ///< The control block has another layout, ignore the GPP
+short int *canny_edge_halo = NULL;    ///< Smoothed row below the band of a chain, private to the DSP
+Uint16 canny_edge_max_cols = 0;       ///< Columns the halo row is allocated for
+MPCS_Handle canny_edge_tile_lock = NULL;    ///< Critical section of the tile counters, made by the GPP
 
 
 static Void Task_notify(Uint32 eventNo, Ptr arg, Ptr info) ;
@@ -106,24 +150,53 @@ Int Task_create(Task_TransferInfo **infoPtr)
     return status ;
 }
 
-Void Task_writeback(Void)
+/* Invalidate the rows row_start to row_end (bpp bytes per pixel) of a buffer,
+ * clipped to the image, only the rows the GPP handed over are read */
+static Void Task_invRows(Ptr buffer, Uint32 bpp, Int row_start, Int row_end)
+{
+    if (row_start < 0) {
+        row_start = 0;
+    }
+    if (row_end > canny_edge_rows) {
+        row_end = canny_edge_rows;
+    }
+    if (row_end > row_start) {
+        BCACHE_inv((Uint8 *)buffer + row_start * canny_edge_cols * bpp,
+                   (row_end - row_start) * canny_edge_cols * bpp, TRUE);
+    }
+}
+
+/* Write back and invalidate the rows row_start to row_end (bpp bytes per
+ * pixel) of a buffer, the rows the DSP wrote */
+static Void Task_wbInvRows(Ptr buffer, Uint32 bpp, Int row_start, Int row_end)
+{
+    if (row_start < 0) {
+        row_start = 0;
+    }
+    if (row_end > canny_edge_rows) {
+        row_end = canny_edge_rows;
+    }
+    if (row_end > row_start) {
+        BCACHE_wbInv((Uint8 *)buffer + row_start * canny_edge_cols * bpp,
+                     (row_end - row_start) * canny_edge_cols * bpp, TRUE);
+    }
+}
+
+Void Task_writeback(Uint16 buf)
 {
     Uint32 i;
-    unsigned char *buf = (unsigned char *)dsp_buffers[0][0];
+    unsigned char *image = (unsigned char *)dsp_buffers[0][buf];
 
     /* Invalidate cache */
-    BCACHE_inv(dsp_buffers[0][0], buffer_sizes[0], TRUE);
+    BCACHE_inv(dsp_buffers[0][buf], buffer_sizes[0], TRUE);
 
     /* Add 1 to each pixel */
     for (i = 0; i < buffer_sizes[0]; i++) {
-        buf[i]++;
+        image[i]++;
     }
 
     /* Write back and invalidate */
-    BCACHE_wbInv(dsp_buffers[0][0], buffer_sizes[0], TRUE);
-
-    /* Notify the result */
-    NOTIFY_notify(ID_GPP, MPCSXFER_IPS_ID, MPCSXFER_IPS_EVENTNO, canny_edge_WRITEBACK);
+    BCACHE_wbInv(dsp_buffers[0][buf], buffer_sizes[0], TRUE);
 }
 
 Int Task_execute(Task_TransferInfo *info)
@@ -147,6 +220,16 @@ Int Task_delete(Task_TransferInfo *info)
                                (FnNotifyCbck) Task_notify,
                                info) ;
 
+    /* Close the tile lock and free the halo row of the chains */
+    if (canny_edge_tile_lock != NULL) {
+        MPCS_close(ID_GPP, canny_edge_tile_lock);
+        canny_edge_tile_lock = NULL;
+    }
+    if (canny_edge_halo != NULL) {
+        MEM_free(DSPLINK_SEGID, canny_edge_halo, canny_edge_max_cols * sizeof(short int));
+        canny_edge_halo = NULL;
+    }
+
     /* Free the info structure */
     MEM_free(DSPLINK_SEGID,
              info,
@@ -156,230 +239,231 @@ Int Task_delete(Task_TransferInfo *info)
     return status ;
 }
 
-Void Task_gaussian(Void)
+/* The kernels on the buffers of frame slot buf, see kernels.h */
+static Void Task_gaussian(Uint16 buf, Uint32 row_start, Uint32 row_end, short int *halo)
 {
-    int r, c, rr, cc,
-        windowsize,       /* Dimension of the gaussian kernel. */
-        center;
-    unsigned int dot,     /* Dot product summing variable. */
-             sum,            /* Sum of the kernel weights variable. */
-             temp,
-             rows_end;
-
-
-    int rows = canny_edge_rows;
-    int cols = canny_edge_cols;
-    unsigned char *image = (unsigned char *)dsp_buffers[0][0];
-    short int *smoothedim = (short int *)dsp_buffers[1][0];
-    unsigned int *tmpim = (unsigned int *)dsp_buffers[4][0];
-    short int *percentage = (short int *)dsp_buffers[5][0];
-
-    // unsigned char *tmpim;
-    // tmpim = (unsigned char *) malloc(rows*cols* sizeof(unsigned char));
-
-    /* A one dimensional gaussian kernel, normalized to fixed point. */
-    static unsigned short int kernel[] = {
-        416,  1177,  2837,  5830, 10206,
-        15226, 19356, 20969, 19356, 15226,
-        10206,  5830,  2837,  1177,  416
-    };
-    windowsize = 15;
-    center = windowsize / 2;
+    kernel_gaussian((unsigned char *)dsp_buffers[0][buf], (short int *)dsp_buffers[1][buf],
+                    (unsigned int *)dsp_buffers[4][buf], canny_edge_rows, canny_edge_cols, row_start, row_end, halo);
+}
 
-    /* Invalidate cache */
-    BCACHE_inv(dsp_buffers[0][0], buffer_sizes[0], TRUE);
-    BCACHE_inv(dsp_buffers[5][0], buffer_sizes[5], TRUE);
+static Void Task_derivative(Uint16 buf, Uint32 row_start, Uint32 row_end, short int *halo)
+{
+    kernel_derivative((short int *)dsp_buffers[1][buf], (short int *)dsp_buffers[2][buf],
+                      (short int *)dsp_buffers[3][buf], canny_edge_rows, canny_edge_cols, row_start, row_end, halo);
+}
 
-    /* When percentage is 100 we don't need to do anything */
-    if (*percentage >= 100) {
-        NOTIFY_notify(ID_GPP, MPCSXFER_IPS_ID, MPCSXFER_IPS_EVENTNO, canny_edge_GAUSSIAN);
-        return;
-    }
+static Void Task_magnitude(Uint16 buf, Uint32 row_start, Uint32 row_end)
+{
+    kernel_magnitude((short int *)dsp_buffers[2][buf], (short int *)dsp_buffers[3][buf],
+                     (short int *)dsp_buffers[5][buf], canny_edge_rows, canny_edge_cols, row_start, row_end);
+}
 
-    /* Calculate end for x blurring */
-    rows_end = rows * (100 - *percentage) / 100;
-    if(rows_end >= rows-8)
-      rows_end = rows;
-    else
-      rows_end += 8;
-
-    /* Blur in x */
-    for (r = 0; r < rows_end; r++) {
-        for (c = 0; c < cols; c++) {
-            dot = 0;
-            sum = 0;
-            for (cc = (-center); cc <= center; cc++) {
-                if (((c + cc) >= 0) && ((c + cc) < cols)) {
-                    dot += image[r * cols + (c + cc)] * kernel[center + cc];
-                    sum += kernel[center + cc];
-                }
-            }
-            tmpim[r * cols + c] = dot * 90 / sum;
-        }
-    }
+/* Run the bands of the gaussian up to the derivative or the magnitude back to
+ * back. The DSP smooths the row below its band itself, so nothing but the
+ * last smoothed row of the band has to go back to the GPP, and only the
+ * inputs and outputs of the chain go through the cache maintenance. */
+static Void Task_chain(Uint16 buf, Uint32 dsp_rows, Uint32 stages)
+{
+    short int *smoothedim = (short int *)dsp_buffers[1][buf];
 
-    /* Blur in y */
-    for (c = 0; c < cols; c++) {
-        for (r = 0; r < rows * (100 - *percentage) / 100; r++) {
-            sum = 0;
-            dot = 0;
-            for (rr = (-center); rr <= center; rr++) {
-                if (((r + rr) >= 0) && ((r + rr) < rows)) {
-                    dot += tmpim[(r + rr) * cols + c] * kernel[center + rr];
-                    sum += kernel[center + rr];
-                }
-            }
-            temp = (dot / sum) + 0.5;
-            smoothedim[r * cols + c] = temp;
-        }
+    if (dsp_rows == 0) {
+        return;
     }
 
-    /* Write back and invalidate */
-    BCACHE_wbInv(dsp_buffers[1][0], buffer_sizes[1], TRUE);
+    /* The x blur reads the halo rows of the image, one more for the halo of the derivative */
+    Task_invRows(dsp_buffers[0][buf], sizeof(unsigned char), 0, dsp_rows + 1 + GAUSSIAN_HALO);
+    Task_gaussian(buf, 0, dsp_rows, canny_edge_halo);
+    Task_derivative(buf, 0, dsp_rows, canny_edge_halo);
+    if (stages >= 3) {
+        Task_magnitude(buf, 0, dsp_rows);
+        Task_wbInvRows(dsp_buffers[5][buf], sizeof(short int), 0, dsp_rows);
+    }
 
-    /* Notify the GPP that DSP is done */
-    NOTIFY_notify(ID_GPP, MPCSXFER_IPS_ID, MPCSXFER_IPS_EVENTNO, canny_edge_GAUSSIAN);
+    /* The GPP takes the last smoothed row of the band and the derivatives */
+    Task_wbInvRows(smoothedim, sizeof(short int), 0, dsp_rows);
+    Task_wbInvRows(dsp_buffers[2][buf], sizeof(short int), 0, dsp_rows);
+    Task_wbInvRows(dsp_buffers[3][buf], sizeof(short int), 0, dsp_rows);
 }
 
-Void Task_derivative(Void)
+/* Run the rows row_start to row_end of a stage, with the cache maintenance of
+ * the rows it reads (the halo rows included) and writes */
+static Void Task_stage(Uint16 buf, Uint32 cmd, Int row_start, Int row_end)
 {
-    int r, c, pos, new_rows;
-    short int *smoothedim = (short int *)dsp_buffers[1][0];
-    short int *delta_x = (short int *)dsp_buffers[2][0];
-    short int *delta_y = (short int *)dsp_buffers[3][0];
-    short int *percentage = (short int *)dsp_buffers[5][0];
-
-    /* Invalidate cache */
-    BCACHE_inv(dsp_buffers[1][0], buffer_sizes[1], TRUE);
-    BCACHE_inv(dsp_buffers[5][0], buffer_sizes[5], TRUE);
-
-    new_rows = canny_edge_rows * (100 - *percentage) / 100;
-    if (*percentage >= 100 || new_rows < 1) {
-        NOTIFY_notify(ID_GPP, MPCSXFER_IPS_ID, MPCSXFER_IPS_EVENTNO, canny_edge_DERIVATIVE);
+    if (row_end <= row_start) {
         return;
     }
+    if (cmd == canny_edge_GAUSSIAN) {
+        /* Only the rows that are blurred in x are read */
+        Task_invRows(dsp_buffers[0][buf], sizeof(unsigned char), row_start - GAUSSIAN_HALO,
+                     row_end + GAUSSIAN_HALO);
+        Task_gaussian(buf, row_start, row_end, NULL);
+        Task_wbInvRows(dsp_buffers[1][buf], sizeof(short int), row_start, row_end);
+    } else if (cmd == canny_edge_DERIVATIVE) {
+        /* The rows and the rows above and below them are read */
+        Task_invRows(dsp_buffers[1][buf], sizeof(short int), row_start - 1, row_end + 1);
+        Task_derivative(buf, row_start, row_end, NULL);
+        Task_wbInvRows(dsp_buffers[2][buf], sizeof(short int), row_start, row_end);
+        Task_wbInvRows(dsp_buffers[3][buf], sizeof(short int), row_start, row_end);
+    } else {
+        Task_invRows(dsp_buffers[2][buf], sizeof(short int), row_start, row_end);
+        Task_invRows(dsp_buffers[3][buf], sizeof(short int), row_start, row_end);
+        Task_magnitude(buf, row_start, row_end);
+        Task_wbInvRows(dsp_buffers[5][buf], sizeof(short int), row_start, row_end);
+    }
+}
+
+/* Take the next tile of frame slot buf from the counter shared with the GPP */
+static Uint32 Task_claim(Uint16 buf)
+{
+    Uint32 tile;
+
+    MPCS_enter(canny_edge_tile_lock);
+    BCACHE_inv(canny_edge_ctrl->tiles, canny_edge_CTRL_LINE, TRUE);
+    tile = canny_edge_ctrl->tiles[buf]++;
+    BCACHE_wb(canny_edge_ctrl->tiles, canny_edge_CTRL_LINE, TRUE);
+    MPCS_leave(canny_edge_tile_lock);
+    return tile;
+}
+
+/* Run the tiles of a stage until the counter is past the last row. The GPP
+ * takes tiles of the same counter, whichever side is faster takes more. The
+ * GPP rounds tile_rows up to whole cache lines of the short images, so the
+ * write back of a tile never covers rows of the other side. */
+static Void Task_tiles(Uint16 buf, Uint32 cmd, Uint32 tile_rows)
+{
+    Uint32 row_start, row_end;
 
-    /* Calculate the X direction */
-    for (r = 0; r < new_rows; r++) {
-        pos = r * canny_edge_cols;
-        delta_x[pos] = smoothedim[pos + 1] - smoothedim[pos];
-        pos++;
-        for (c = 1; c < (canny_edge_cols - 1); c++, pos++) {
-            delta_x[pos] = smoothedim[pos + 1] - smoothedim[pos - 1];
+    while ((row_start = Task_claim(buf) * tile_rows) < canny_edge_rows) {
+        row_end = row_start + tile_rows;
+        if (row_end > canny_edge_rows) {
+            row_end = canny_edge_rows;
         }
-        delta_x[pos] = smoothedim[pos] - smoothedim[pos - 1];
+        Task_stage(buf, cmd, row_start, row_end);
     }
+}
 
-    /* Calculate the Y direction */
-    for (c = 0; c < canny_edge_cols; c++) {
-        pos = c;
-        delta_y[pos] = smoothedim[pos + canny_edge_cols] - smoothedim[pos];
-        pos += canny_edge_cols;
-        for (r = 1; r < (new_rows - 1); r++, pos += canny_edge_cols) {
-            delta_y[pos] = smoothedim[pos + canny_edge_cols] - smoothedim[pos - canny_edge_cols];
+/* Take the control block of the GPP: check that it has the layout of this
+ * image and copy the image size and the buffer table. The GPP waits for the
+ * INIT and reads the status to see if the block was taken. */
+static Bool Task_attach(canny_edge_Ctrl *ctrl)
+{
+    Uint16 i, j;
+    Int status = SYS_OK;
+
+    BCACHE_inv(CTRL_GPP(ctrl), CTRL_GPP_SIZE, TRUE);
+    if (ctrl->magic != canny_edge_CTRL_MAGIC || ctrl->version != canny_edge_CTRL_VERSION ||
+        ctrl->size != sizeof(canny_edge_Ctrl) || ctrl->depth < 1 || ctrl->depth > NUM_BUF_MAX) {
+        status = SYS_EINVAL;
+    } else {
+        canny_edge_rows = ctrl->rows;
+        canny_edge_cols = ctrl->cols;
+        canny_edge_depth = ctrl->depth;
+
+        // The image size only shrinks after the start, the halo row of a chain fits any size
+        canny_edge_max_cols = canny_edge_cols;
+        canny_edge_halo = MEM_alloc(DSPLINK_SEGID, canny_edge_max_cols * sizeof(short int), 0);
+        if (canny_edge_halo == NULL) {
+            status = SYS_EALLOC;
+        } else {
+            status = MPCS_open(ID_GPP, canny_edge_TILE_LOCK, &canny_edge_tile_lock);
+        }
+        for (i = 0; i < NUM_BUF_SIZES; i++) {
+            buffer_sizes[i] = ctrl->buffer_sizes[i];
+            for (j = 0; j < canny_edge_depth; j++) {
+                dsp_buffers[i][j] = (Void *)ctrl->buffers[i][j];
+            }
         }
-        if(new_rows < canny_edge_rows)
-          delta_y[pos] = smoothedim[pos + canny_edge_cols] - smoothedim[pos - canny_edge_cols];
-        else
-          delta_y[pos] = smoothedim[pos] - smoothedim[pos - canny_edge_cols];
     }
-    
-    /* Write back and invalidate */
-    BCACHE_wbInv(dsp_buffers[2][0], buffer_sizes[2], TRUE);
-    BCACHE_wbInv(dsp_buffers[3][0], buffer_sizes[3], TRUE);
 
-    /* Notify the GPP that DSP is done */
-    NOTIFY_notify(ID_GPP, MPCSXFER_IPS_ID, MPCSXFER_IPS_EVENTNO, canny_edge_DERIVATIVE);
+    ctrl->done = 0;
+    ctrl->status = status;
+    BCACHE_wb(ctrl, canny_edge_CTRL_LINE, TRUE);
+    NOTIFY_notify(ID_GPP, MPCSXFER_IPS_ID, MPCSXFER_IPS_EVENTNO, canny_edge_INIT);
+    return (status == SYS_OK);
 }
 
-Void Task_magnitude(Void)
+/* A band of the split ends on a cache line of the short images (split_row on
+ * the GPP), otherwise the line across the split is written back by both sides */
+static Bool Task_lineBand(canny_edge_Cmd *cmd)
 {
-    Uint32 r, c, pos, sq1, sq2;
-    short int *delta_x = (short int *)dsp_buffers[2][0];
-    short int *delta_y = (short int *)dsp_buffers[3][0];
-    int *magnitude_sq = (int *)dsp_buffers[4][0];
-    short int *percentage = (short int *)dsp_buffers[5][0];
+    if (cmd->tile_rows > 0 || cmd->row_end >= canny_edge_rows ||
+        !((cmd->cmd >= canny_edge_GAUSSIAN && cmd->cmd <= canny_edge_MAGNITUDE) || cmd->cmd == canny_edge_CHAIN)) {
+        return TRUE;
+    }
+    return (cmd->row_end * canny_edge_cols * sizeof(short int)) % canny_edge_CTRL_LINE == 0;
+}
 
-    /* Invalidate cache */
-    BCACHE_inv(dsp_buffers[2][0], buffer_sizes[2], TRUE);
-    BCACHE_inv(dsp_buffers[3][0], buffer_sizes[3], TRUE);
-    BCACHE_inv(dsp_buffers[5][0], buffer_sizes[5], TRUE);
-
-    for (r = 0, pos = 0; r < ((100 - *percentage) * canny_edge_rows / 100); r++) {
-        for (c = 0; c < canny_edge_cols; c++, pos++) {
-            sq1 = (int)delta_x[pos] * (int)delta_x[pos];
-            sq2 = (int)delta_y[pos] * (int)delta_y[pos];
-            magnitude_sq[pos] = (int) sq1 + sq2; //(0.5 + sqrt((float)sq1 + (float)sq2));
-        }
+/* Run a command of the ring and acknowledge it with its sequence number, its
+ * status is kept in the result of its slot until the slot is used again */
+static Void Task_run(Task_TransferInfo *mpcsInfo, canny_edge_Cmd *cmd)
+{
+    Int status = SYS_OK;
+    Uint16 buf = (Uint16)cmd->buf;
+
+    if (cmd->cmd == canny_edge_DELETE) {
+        SEM_post(&(mpcsInfo->notifySemObj));
+        return;
     }
 
-    /* Write back and invalidate */
-    BCACHE_wbInv(dsp_buffers[4][0], buffer_sizes[4], TRUE);
+    if (buf >= canny_edge_depth || cmd->row_end > canny_edge_rows) {
+        status = SYS_EINVAL;
+    } else if (!Task_lineBand(cmd)) {
+        status = SYS_EINVAL;
+    } else if (cmd->cmd == canny_edge_SETSIZE) {
+        canny_edge_rows = canny_edge_ctrl->rows;
+        canny_edge_cols = canny_edge_ctrl->cols;
+    } else if (cmd->cmd == canny_edge_WRITEBACK) {
+        Task_writeback(buf);
+    } else if (cmd->cmd >= canny_edge_GAUSSIAN && cmd->cmd <= canny_edge_MAGNITUDE) {
+        /* A band of the first rows, or the tiles the DSP gets from the counter */
+        if (cmd->tile_rows > 0) {
+            Task_tiles(buf, cmd->cmd, cmd->tile_rows);
+        } else {
+            Task_stage(buf, cmd->cmd, 0, cmd->row_end);
+        }
+    } else if (cmd->cmd == canny_edge_CHAIN) {
+        Task_chain(buf, cmd->row_end, cmd->stages);
+    } else if (cmd->cmd == canny_edge_PING) {
+        /* The cache maintenance of a band without the work, for the IPC benchmark */
+        Task_invRows(dsp_buffers[0][buf], sizeof(unsigned char), cmd->row_start, cmd->row_end);
+        Task_wbInvRows(dsp_buffers[0][buf], sizeof(unsigned char), cmd->row_start, cmd->row_end);
+    } else {
+        status = SYS_EINVAL;
+    }
 
-    /* Notify the result */
-    NOTIFY_notify(ID_GPP, MPCSXFER_IPS_ID, MPCSXFER_IPS_EVENTNO, canny_edge_MAGNITUDE);
+    canny_edge_ctrl->results[cmd->seq % canny_edge_CTRL_SLOTS] = status;
+    canny_edge_ctrl->done = cmd->seq;
+    canny_edge_ctrl->status = status;
+    BCACHE_wb(canny_edge_ctrl, canny_edge_CTRL_LINE, TRUE);
+    NOTIFY_notify(ID_GPP, MPCSXFER_IPS_ID, MPCSXFER_IPS_EVENTNO, cmd->seq);
 }
 
 static Void Task_notify(Uint32 eventNo, Ptr arg, Ptr info)
 {
-    static Uint16 pool_cnt = 0;
-    static Uint16 buffer_cnt = 0;
-    static Uint8 got_address = 0;
     Task_TransferInfo *mpcsInfo = (Task_TransferInfo *) arg;
+    canny_edge_Ctrl *ctrl = canny_edge_ctrl;
     (void) eventNo; // Avoid warning
 
-    // Check if we got columns, rows information
-    if (canny_edge_cols == 0) {
-        canny_edge_cols = (int)info;
+    if (canny_edge_rejected) {
         return;
     }
 
-    if (canny_edge_rows == 0) {
-        canny_edge_rows = (int)info;
-        return;
-    }
-
-    // Check if we received all the pool information
-    if (pool_cnt < NUM_BUF_SIZES) {
-
-        // We received an address
-        if (got_address == 0) {
-            dsp_buffers[pool_cnt][buffer_cnt] = info;
-            got_address = 1;
-        }
-
-        // We received the buffer size
-        else if (got_address == 1) {
-            buffer_sizes[pool_cnt] = (int)info;
-            got_address = 0;
-
-            // Go to the next pool or next buffer
-            if (buffer_cnt >= (pool_sizes[pool_cnt] - 1)) {
-                pool_cnt++;
-                buffer_cnt = 0;
-            } else {
-                buffer_cnt++;
-            }
+    // The first notify after the INIT carries the address of the control block
+    if (ctrl == NULL) {
+        if (Task_attach((canny_edge_Ctrl *)info)) {
+            canny_edge_ctrl = (canny_edge_Ctrl *)info;
+            SEM_post(&(mpcsInfo->notifySemObj));
+        } else {
+            canny_edge_rejected = TRUE;
         }
+        return;
     }
 
-    // Check we if received the last buffer
-    if (pool_cnt == NUM_BUF_SIZES) {
-        SEM_post(&(mpcsInfo->notifySemObj));
-        pool_cnt++;
-    } else if (pool_cnt > NUM_BUF_SIZES) {
-
-        // Execute a task
-        if ((Uint32)info == canny_edge_DELETE) {
-            SEM_post(&(mpcsInfo->notifySemObj));
-        } else if ((Uint32)info == canny_edge_WRITEBACK) {
-            Task_writeback();
-        } else if ((Uint32)info == canny_edge_GAUSSIAN) {
-            Task_gaussian();
-        } else if ((Uint32)info == canny_edge_DERIVATIVE) {
-            Task_derivative();
-        } else if ((Uint32)info == canny_edge_MAGNITUDE) {
-            Task_magnitude();
-        }
+    // A doorbell: run the commands the GPP added to the ring, a doorbell can
+    // find them already done by an earlier one
+    BCACHE_inv(CTRL_GPP(ctrl), CTRL_GPP_SIZE, TRUE);
+    while ((Int32)(ctrl->head - canny_edge_next) >= 0) {
+        Task_run(mpcsInfo, &ctrl->cmds[canny_edge_next % canny_edge_CTRL_SLOTS]);
+        canny_edge_next++;
     }
 }
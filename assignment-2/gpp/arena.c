@@ -0,0 +1,82 @@
+/*******************************************************************************
+* FILE: arena.c
+* Workspace arena for the per frame buffers. The block is sized once for an
+* image geometry, so repeated frames do not malloc, free or page fault.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/*******************************************************************************
+* PROCEDURE: arena_init
+* PURPOSE: Allocate an ARENA_ALIGN aligned block of size bytes. The block is
+* cleared so all its pages are mapped before the first frame. Upon failure,
+* this function returns 0, upon sucess it returns 1.
+*******************************************************************************/
+int arena_init(canny_arena *arena, size_t size)
+{
+    void *base;
+
+    arena->base = NULL;
+    arena->size = ARENA_SIZE(size);
+    arena->used = 0;
+    if (posix_memalign(&base, ARENA_ALIGN, arena->size) != 0) {
+        fprintf(stderr, "Error allocating the workspace arena of %lu bytes.\n", (unsigned long)arena->size);
+        return (0);
+    }
+    arena->base = (unsigned char *)base;
+    memset(arena->base, 0, arena->size);
+    return (1);
+}
+
+/*******************************************************************************
+* PROCEDURE: arena_alloc
+* PURPOSE: Take a buffer of size bytes from the arena, aligned to ARENA_ALIGN.
+* Returns NULL when the arena is too small, which means it was sized wrong.
+*******************************************************************************/
+void *arena_alloc(canny_arena *arena, size_t size)
+{
+    void *buf;
+
+    if (arena->used + ARENA_SIZE(size) > arena->size) {
+        fprintf(stderr, "Workspace arena too small for %lu bytes (%lu of %lu used).\n",
+                (unsigned long)size, (unsigned long)arena->used, (unsigned long)arena->size);
+        return (NULL);
+    }
+    buf = arena->base + arena->used;
+    arena->used += ARENA_SIZE(size);
+    return (buf);
+}
+
+/*******************************************************************************
+* PROCEDURE: arena_mark
+* PURPOSE: Get the current position of the arena, to release to later.
+*******************************************************************************/
+size_t arena_mark(canny_arena *arena)
+{
+    return (arena->used);
+}
+
+/*******************************************************************************
+* PROCEDURE: arena_release
+* PURPOSE: Give back all the buffers taken from the arena after the mark.
+*******************************************************************************/
+void arena_release(canny_arena *arena, size_t mark)
+{
+    arena->used = mark;
+}
+
+/*******************************************************************************
+* PROCEDURE: arena_free
+* PURPOSE: Free the block of the arena.
+*******************************************************************************/
+void arena_free(canny_arena *arena)
+{
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+}
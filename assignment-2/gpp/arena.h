@@ -0,0 +1,36 @@
+#if !defined (arena_H)
+#define arena_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 64                  ///< Alignment of all buffers (cache line and SIMD loads)
+
+/* Size of a buffer in the arena, rounded up to the alignment */
+#define ARENA_SIZE(size) (((size_t)(size) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
+
+/* Workspace arena: a single block allocated once, from which the buffers of a
+ * frame are taken in order. Buffers are given back all at once by releasing
+ * the arena to a mark taken before they were allocated. */
+typedef struct canny_arena {
+    unsigned char *base;                ///< The aligned block
+    size_t size;                        ///< Size of the block
+    size_t used;                        ///< Bytes in use from the start of the block
+} canny_arena;
+
+/* Allocate the block and touch all its pages */
+int arena_init(canny_arena *arena, size_t size);
+
+/* Take an aligned buffer from the arena */
+void *arena_alloc(canny_arena *arena, size_t size);
+
+/* Get the current position of the arena */
+size_t arena_mark(canny_arena *arena);
+
+/* Give back all buffers taken after the mark */
+void arena_release(canny_arena *arena, size_t mark);
+
+/* Free the block */
+void arena_free(canny_arena *arena);
+
+
+#endif /* !defined (arena_H) */
@@ -0,0 +1,202 @@
+/*******************************************************************************
+* FILE: backend.c
+* Runtime selection of the backend of the canny edge stages. The kernels of
+* every instruction set the compiler supports are built in, the CPU features
+* decide at startup which of them can run. A specification string (from the
+* command line or the CANNY_BACKEND environment variable) overrides the
+* defaults per stage.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "backend.h"
+
+static const char *backend_names[BACKEND_NUM] = { "scalar", "neon", "sse4", "avx2", "auto" };
+static const char *stage_names[STAGE_NUM] = { "gaussian", "derivative", "magnitude" };
+
+#if defined (__ARM_NEON__)
+/*******************************************************************************
+* PROCEDURE: cpu_has_neon
+* PURPOSE: Look for neon in the features of /proc/cpuinfo. When it can not be
+* read the CPU is assumed to have NEON, the binary is built for it anyway.
+*******************************************************************************/
+static int cpu_has_neon(void)
+{
+    static int has_neon = -1;
+    char line[512];
+    FILE *fp;
+
+    if (has_neon >= 0) return (has_neon);
+
+    if ((fp = fopen("/proc/cpuinfo", "r")) == NULL) {
+        return (has_neon = 1);
+    }
+    has_neon = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "Features", 8) == 0 && strstr(line, " neon") != NULL) {
+            has_neon = 1;
+            break;
+        }
+    }
+    fclose(fp);
+    return (has_neon);
+}
+#endif
+
+/*******************************************************************************
+* PROCEDURE: backend_supported
+* PURPOSE: Check if the kernels of a backend are compiled in and if the CPU
+* supports them. Returns 1 when they can run.
+*******************************************************************************/
+int backend_supported(int backend)
+{
+    switch (backend) {
+    case BACKEND_SCALAR:
+        return (1);
+#if defined (__ARM_NEON__)
+    case BACKEND_NEON:
+        return (cpu_has_neon());
+#endif
+#if defined (__i386__) || defined (__x86_64__)
+    case BACKEND_SSE4:
+        __builtin_cpu_init();
+        return (__builtin_cpu_supports("sse4.1") != 0);
+    case BACKEND_AVX2:
+        __builtin_cpu_init();
+        return (__builtin_cpu_supports("avx2") != 0);
+#endif
+    default:
+        return (0);
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: backend_best
+* PURPOSE: The widest SIMD backend the CPU supports.
+*******************************************************************************/
+int backend_best(void)
+{
+    if (backend_supported(BACKEND_AVX2)) return (BACKEND_AVX2);
+    if (backend_supported(BACKEND_SSE4)) return (BACKEND_SSE4);
+    if (backend_supported(BACKEND_NEON)) return (BACKEND_NEON);
+    return (BACKEND_SCALAR);
+}
+
+/*******************************************************************************
+* PROCEDURE: backend_parse
+* PURPOSE: Override the backends with a specification. It is a list of items
+* separated by commas or spaces. An item is [<stage>=]<kernel>[+dsp], where
+* the stage is gaussian, derivative or magnitude (all stages when left out)
+* and the kernel is scalar, neon, sse4, avx2 or auto. "dsp" alone is short
+* for "auto+dsp". Upon an unknown item this function returns 0, upon sucess
+* it returns 1.
+*******************************************************************************/
+int backend_parse(const char *spec, canny_backends *backends)
+{
+    char item[64], *kernel, *plus;
+    int s, k, first, last, dsp;
+    size_t len;
+
+    while (*spec != '\0') {
+        /* Take the next item */
+        len = strcspn(spec, ", ");
+        if (len == 0) {
+            spec++;
+            continue;
+        }
+        if (len >= sizeof(item)) {
+            fprintf(stderr, "Backend '%.*s' is too long.\n", (int)len, spec);
+            return (0);
+        }
+        memcpy(item, spec, len);
+        item[len] = '\0';
+        spec += len;
+
+        /* The stage, or all stages */
+        first = 0;
+        last = STAGE_NUM - 1;
+        if ((kernel = strchr(item, '=')) != NULL) {
+            *kernel++ = '\0';
+            for (s = 0; s < STAGE_NUM && strcmp(item, stage_names[s]) != 0; s++);
+            if (s == STAGE_NUM) {
+                fprintf(stderr, "Unknown stage '%s', expected gaussian, derivative or magnitude.\n", item);
+                return (0);
+            }
+            first = last = s;
+        } else {
+            kernel = item;
+        }
+
+        /* The kernel and the DSP split */
+        dsp = 0;
+        if ((plus = strchr(kernel, '+')) != NULL) {
+            if (strcmp(plus, "+dsp") != 0) {
+                fprintf(stderr, "Unknown backend option '%s', expected +dsp.\n", plus);
+                return (0);
+            }
+            *plus = '\0';
+            dsp = 1;
+        }
+        if (strcmp(kernel, "dsp") == 0) {
+            k = BACKEND_AUTO;
+            dsp = 1;
+        } else {
+            for (k = 0; k < BACKEND_NUM && strcmp(kernel, backend_names[k]) != 0; k++);
+            if (k == BACKEND_NUM) {
+                fprintf(stderr, "Unknown backend '%s', expected scalar, neon, sse4, avx2, auto or dsp.\n",
+                        kernel);
+                return (0);
+            }
+        }
+
+        for (s = first; s <= last; s++) {
+            backends->kernel[s] = k;
+            backends->dsp[s] = dsp;
+        }
+    }
+    return (1);
+}
+
+/*******************************************************************************
+* PROCEDURE: backend_resolve
+* PURPOSE: Replace the auto kernels by the best one of the CPU. A kernel the
+* binary or the CPU does not support falls back to the best one as well. The
+* DSP split is dropped when the DSP is not loaded.
+*******************************************************************************/
+void backend_resolve(canny_backends *backends, int dsp)
+{
+    int s;
+
+    for (s = 0; s < STAGE_NUM; s++) {
+        if (backends->kernel[s] != BACKEND_AUTO && !backend_supported(backends->kernel[s])) {
+            fprintf(stderr, "The %s backend is not supported for the %s, using the best one.\n",
+                    backend_names[backends->kernel[s]], stage_names[s]);
+            backends->kernel[s] = BACKEND_AUTO;
+        }
+        if (backends->kernel[s] == BACKEND_AUTO) {
+            backends->kernel[s] = backend_best();
+        }
+        if (!dsp) {
+            backends->dsp[s] = 0;
+        }
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: backend_describe
+* PURPOSE: Write the backends in the specification format, so the output can
+* be passed back as an override.
+*******************************************************************************/
+void backend_describe(canny_backends *backends, char *str, size_t len)
+{
+    int s;
+    size_t used = 0;
+
+    str[0] = '\0';
+    for (s = 0; s < STAGE_NUM && used < len; s++) {
+        used += snprintf(str + used, len - used, "%s%s=%s%s", (s > 0) ? "," : "", stage_names[s],
+                         backend_names[backends->kernel[s]], backends->dsp[s] ? "+dsp" : "");
+    }
+}
@@ -0,0 +1,48 @@
+#if !defined (backend_H)
+#define backend_H
+
+#include <stddef.h>
+
+/* The GPP kernels a stage can run on */
+enum {
+    BACKEND_SCALAR,                     ///< Plain C
+    BACKEND_NEON,                       ///< ARM NEON
+    BACKEND_SSE4,                       ///< x86 SSE4.1
+    BACKEND_AVX2,                       ///< x86 AVX2
+    BACKEND_AUTO,                       ///< The best kernel of the CPU
+    BACKEND_NUM
+};
+
+/* The stages with a choice of backend */
+enum {
+    STAGE_GAUSSIAN,
+    STAGE_DERIVATIVE,
+    STAGE_MAGNITUDE,
+    STAGE_NUM
+};
+
+/* The backend of every stage: the kernel for the GPP rows and whether the DSP
+ * does its band of the rows in parallel */
+typedef struct canny_backends {
+    int kernel[STAGE_NUM];              ///< BACKEND_* of the GPP rows
+    int dsp[STAGE_NUM];                 ///< The DSP does (100 - percentage)% of the rows
+} canny_backends;
+
+/* Check if a kernel is compiled in and supported by the CPU */
+int backend_supported(int backend);
+
+/* The fastest kernel supported by the CPU */
+int backend_best(void);
+
+/* Override the backends with a specification like "neon" or
+ * "gaussian=neon+dsp,magnitude=scalar" */
+int backend_parse(const char *spec, canny_backends *backends);
+
+/* Replace auto and unsupported kernels by the best one, drop the DSP when it is not loaded */
+void backend_resolve(canny_backends *backends, int dsp);
+
+/* Describe the backends like "gaussian=neon+dsp,derivative=neon+dsp,magnitude=neon" */
+void backend_describe(canny_backends *backends, char *str, size_t len);
+
+
+#endif /* !defined (backend_H) */
@@ -0,0 +1,212 @@
+/*******************************************************************************
+* FILE: balance.c
+* Online load balancing of the GPP/DSP row split of a stage, and the profile
+* file that keeps the split per image size over runs. Both sides work on a
+* band of rows at the same time, so the frame is done when the slowest side
+* is done. The balancer measures both sides every frame and moves the split
+* to where they are expected to finish together, the tuner searches the split
+* offline by timing probes.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "balance.h"
+
+#define PROFILE_MAX_STAGES 16
+#define GOLDEN_RATIO 0.6180339887498949
+
+/*******************************************************************************
+* PROCEDURE: balance_init
+* PURPOSE: Initialize the balancing of a stage. A new frame weighs smoothing
+* in the measured rates, so a single slow frame does not move the split much.
+* The split changes at most max_step percent per frame, and is only changed
+* when the optimum is at least deadband percent away, so it does not swing
+* between two neighbouring values. It stays in min to max.
+*******************************************************************************/
+void balance_init(balance_stage *stage, double smoothing, int max_step, double deadband, int min, int max)
+{
+    stage->smoothing = smoothing;
+    stage->max_step = max_step;
+    stage->deadband = deadband;
+    stage->min = min;
+    stage->max = max;
+    balance_reset(stage);
+}
+
+/*******************************************************************************
+* PROCEDURE: balance_reset
+* PURPOSE: Forget the measured rates.
+*******************************************************************************/
+void balance_reset(balance_stage *stage)
+{
+    stage->gpp_rate = stage->dsp_rate = stage->offset = 0.0;
+    stage->gpp_valid = stage->dsp_valid = 0;
+}
+
+/*******************************************************************************
+* PROCEDURE: balance_update
+* PURPOSE: Add the timing of a frame that did perc% of the rows on the GPP
+* (from gpp_start to gpp_end) and the rest on the DSP (from dsp_start to
+* dsp_end). With the time per percent of rows g and d of the GPP and DSP and
+* the DSP starting offset later, both finish together when
+*
+*        g * p = offset + d * (100 - p)  =>  p = (offset + 100 * d) / (g + d)
+*
+* Returns the split for the next frame.
+*******************************************************************************/
+int balance_update(balance_stage *stage, int perc, long long gpp_start, long long gpp_end,
+                   long long dsp_start, long long dsp_end)
+{
+    double w = stage->smoothing, target;
+    int next;
+
+    /* Take the new frame into the rates, a side without rows tells nothing */
+    if (perc > 0) {
+        target = (double)(gpp_end - gpp_start) / perc;
+        stage->gpp_rate = stage->gpp_valid ? (1.0 - w) * stage->gpp_rate + w * target : target;
+        stage->gpp_valid = 1;
+    }
+    if (perc < 100) {
+        target = (double)(dsp_end - dsp_start) / (100 - perc);
+        stage->dsp_rate = stage->dsp_valid ? (1.0 - w) * stage->dsp_rate + w * target : target;
+        stage->offset = stage->dsp_valid ? (1.0 - w) * stage->offset + w * (dsp_start - gpp_start)
+                                         : (double)(dsp_start - gpp_start);
+        stage->dsp_valid = 1;
+    }
+    if (!stage->gpp_valid || !stage->dsp_valid || stage->gpp_rate + stage->dsp_rate <= 0.0) {
+        return (perc);
+    }
+
+    /* Move towards the point where both sides finish together */
+    target = (stage->offset + 100.0 * stage->dsp_rate) / (stage->gpp_rate + stage->dsp_rate);
+    if (fabs(target - perc) < stage->deadband) {
+        return (perc);
+    }
+    next = (int)floor(target + 0.5);
+    if (next > perc + stage->max_step) next = perc + stage->max_step;
+    if (next < perc - stage->max_step) next = perc - stage->max_step;
+    if (next > stage->max) next = stage->max;
+    if (next < stage->min) next = stage->min;
+    return (next);
+}
+
+/*******************************************************************************
+* PROCEDURE: tune_golden
+* PURPOSE: Find the split in lo to hi with the lowest cost, assuming the cost
+* has a single minimum (the slowest of the GPP and DSP side first goes down
+* and then up). The interval is narrowed by the golden ratio, so one of the
+* two probes is reused every step. The costs are kept per split, so a split
+* is measured only once. The last few splits are all probed. Returns the best
+* split, its cost is stored in best_cost.
+*******************************************************************************/
+int tune_golden(int lo, int hi, tune_cost_fn cost, void *arg, double *best_cost)
+{
+    double *costs;
+    int a = lo, b = hi, c, d, x, best;
+
+    if ((costs = (double *)malloc(sizeof(double) * (hi - lo + 1))) == NULL) {
+        fprintf(stderr, "Error allocating the tuning costs.\n");
+        return (lo);
+    }
+    for (x = 0; x <= hi - lo; x++) costs[x] = -1.0;
+
+    while (b - a > 2) {
+        d = a + (int)floor((b - a) * GOLDEN_RATIO + 0.5);
+        c = b - (int)floor((b - a) * GOLDEN_RATIO + 0.5);
+        if (c >= d) d = c + 1;
+        if (costs[c - lo] < 0.0) costs[c - lo] = cost(arg, c);
+        if (costs[d - lo] < 0.0) costs[d - lo] = cost(arg, d);
+
+        /* The minimum is not beyond the worse probe */
+        if (costs[c - lo] <= costs[d - lo]) b = d;
+        else a = c;
+    }
+
+    best = a;
+    for (x = a; x <= b; x++) {
+        if (costs[x - lo] < 0.0) costs[x - lo] = cost(arg, x);
+        if (costs[x - lo] < costs[best - lo]) best = x;
+    }
+    *best_cost = costs[best - lo];
+    free(costs);
+    return (best);
+}
+
+/*******************************************************************************
+* PROCEDURE: profile_load
+* PURPOSE: Look up the split of num_stages stages for an image of rows x cols
+* in a profile file. Every line holds the rows, the cols and the percentage
+* per stage, lines starting with # are comments. Returns 1 when the size is
+* found, 0 otherwise.
+*******************************************************************************/
+int profile_load(char *filename, int rows, int cols, int *perc, int num_stages)
+{
+    FILE *fp;
+    char line[256], *pos;
+    int r, c, s, n, value[PROFILE_MAX_STAGES], found = 0;
+
+    if (num_stages > PROFILE_MAX_STAGES || (fp = fopen(filename, "r")) == NULL) return (0);
+
+    while (!found && fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%d %d%n", &r, &c, &n) != 2 || r != rows || c != cols) continue;
+
+        /* The percentages follow the size */
+        pos = line + n;
+        for (s = 0; s < num_stages && sscanf(pos, "%d%n", &value[s], &n) == 1; s++) {
+            pos += n;
+        }
+        if (s == num_stages) {
+            memcpy(perc, value, sizeof(int) * num_stages);
+            found = 1;
+        }
+    }
+    fclose(fp);
+    return (found);
+}
+
+/*******************************************************************************
+* PROCEDURE: profile_save
+* PURPOSE: Store the split of num_stages stages for an image of rows x cols in
+* a profile file, replacing the line of that size. The file is rewritten to a
+* temporary file that is renamed, so it is never left half written. Upon
+* failure, this function returns 0, upon sucess it returns 1.
+*******************************************************************************/
+int profile_save(char *filename, int rows, int cols, int *perc, int num_stages)
+{
+    FILE *in, *out;
+    char line[256], tmpname[256];
+    int r, c, s;
+
+    if (snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename) >= (int)sizeof(tmpname)) return (0);
+    if ((out = fopen(tmpname, "w")) == NULL) {
+        fprintf(stderr, "Error writing the profile %s.\n", tmpname);
+        return (0);
+    }
+
+    /* Keep the other sizes */
+    if ((in = fopen(filename, "r")) != NULL) {
+        while (fgets(line, sizeof(line), in) != NULL) {
+            if (line[0] != '#' && sscanf(line, "%d %d", &r, &c) == 2 && r == rows && c == cols) continue;
+            fputs(line, out);
+        }
+        fclose(in);
+    } else {
+        fprintf(out, "# rows cols gaussian derivative magnitude (percentage of the rows on the GPP)\n");
+    }
+
+    fprintf(out, "%d %d", rows, cols);
+    for (s = 0; s < num_stages; s++) {
+        fprintf(out, " %d", perc[s]);
+    }
+    fprintf(out, "\n");
+
+    if (fclose(out) != 0 || rename(tmpname, filename) != 0) {
+        fprintf(stderr, "Error writing the profile %s.\n", filename);
+        remove(tmpname);
+        return (0);
+    }
+    return (1);
+}
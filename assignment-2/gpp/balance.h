@@ -0,0 +1,41 @@
+#if !defined (balance_H)
+#define balance_H
+
+/* Online balancing of the rows of a stage between the GPP and the DSP. The
+ * time per percent of the rows of both sides is measured every frame, the
+ * split moves to where both are expected to finish at the same time. */
+typedef struct balance_stage {
+    double gpp_rate;                    ///< GPP time per percent of the rows (us)
+    double dsp_rate;                    ///< DSP time per percent of the rows (us)
+    double offset;                      ///< Start of the DSP after the start of the GPP (us)
+    int gpp_valid, dsp_valid;           ///< The rates have been measured
+    double smoothing;                   ///< Weight of a new frame in the rates
+    int max_step;                       ///< Largest change of the split per frame
+    double deadband;                    ///< Keep the split when the optimum is closer than this
+    int min, max;                       ///< Range of the split
+} balance_stage;
+
+/* Initialize the balancing of a stage */
+void balance_init(balance_stage *stage, double smoothing, int max_step, double deadband, int min, int max);
+
+/* Forget the measurements, for example when the image size changes */
+void balance_reset(balance_stage *stage);
+
+/* Add the timing of a frame done with perc% of the rows on the GPP and return the next split */
+int balance_update(balance_stage *stage, int perc, long long gpp_start, long long gpp_end,
+                   long long dsp_start, long long dsp_end);
+
+/* The cost of a split, measured by the caller */
+typedef double (*tune_cost_fn)(void *arg, int perc);
+
+/* Golden-section search of the split with the lowest cost in lo to hi */
+int tune_golden(int lo, int hi, tune_cost_fn cost, void *arg, double *best_cost);
+
+/* Look up the split of the stages for an image size in a profile file */
+int profile_load(char *filename, int rows, int cols, int *perc, int num_stages);
+
+/* Store the split of the stages for an image size in a profile file */
+int profile_save(char *filename, int rows, int cols, int *perc, int num_stages);
+
+
+#endif /* !defined (balance_H) */
@@ -2,6 +2,7 @@
 #include<stdio.h>
 
 #include <semaphore.h>
+#include <pthread.h>
 /*  ----------------------------------- DSP/BIOS Link                   */
 #include <dsplink.h>
 
@@ -19,10 +20,25 @@
 #include <canny_edge.h>
 #include <math.h>
 #include <string.h>
-#include <arm_neon.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#if defined (__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+#if defined (__i386__) || defined (__x86_64__)
+#include <immintrin.h>
+#endif
 #include "pgm_io.h"
 #include "hysteresis.h"
+#include "fused.h"
+#include "stream.h"
+#include "arena.h"
+#include "backend.h"
+#include "balance.h"
 
 
 #if defined (__cplusplus)
@@ -32,14 +48,21 @@ extern "C" {
 /* Enable / Disable DSP/NEON */
 #define DO_WRITEBACK 0 /* Write back the image from the DSP with 1 added to each pixel */
 
-#define GAUSSIAN_PARALLEL 1         /* Enable to use DSP & GPP/NEON in parallel */
-#define GAUSSIAN_NEON 1             /* Enable to use NEON instead of GPP */
+/* Default backend per stage: the GPP kernel (scalar, neon, sse4, avx2 or auto for the best one of the
+ * CPU) and +dsp to do a band of the rows on the DSP in parallel. Overridden by CANNY_BACKEND and -b. */
+#define BACKENDS "gaussian=auto+dsp,derivative=auto+dsp,magnitude=auto"
 
-#define MAGNITUDE_PARALLEL 0        /* Enable to use DSP & GPP/NEON in parallel */
-#define MAGNITUDE_NEON 1            /* Enable to use NEON instead of GPP */
+#define EDGE_CHAINS 0               /* Enable to output edge chains instead of an edge image */
+#define THRESHOLD_REUSE 0           /* Enable to reuse the hysteresis thresholds over frames */
+#define FUSED_PIPELINE 0            /* Enable to run Gaussian to NMS fused over cache sized strips (GPP/NEON only) */
 
-#define DERIVATIVE_PARALLEL 1       /* Enable to use DSP & GPP/NEON in parallel */
-#define DERIVATIVE_NEON 1           /* Enable to use NEON instead of GPP */
+#define PIPELINE_DEPTH 2            /* Frames in flight between GPP and DSP for a sequence of frames (1 to NUM_BUF_MAX) */
+#define DSP_CHAIN 1                 /* Enable to run the DSP bands of the gaussian up to the derivative (and the
+                                       magnitude) as one command, with the split of the gaussian. Only when
+                                       their percentages are auto or the same as the gaussian's */
+#define TILE_ROWS 0                 /* Rows of a tile to share the DSP stages in tiles both sides take from a
+                                       counter in the pool instead of the split, 0 for the split. Overridden by
+                                       CANNY_TILE_ROWS */
 
 /* Enable verbose printing by default */
 #ifndef VERBOSE
@@ -47,6 +70,11 @@ extern "C" {
 #endif
 #define VPRINT if(VERBOSE) printf
 
+/* Enable benchmarking of alternative code paths (makes it slower) */
+#ifndef BENCHMARK
+#define BENCHMARK 0
+#endif
+
 /* Enable verify by default (makes it slower) */
 #ifndef VERIFY
 #define VERIFY 0
@@ -55,13 +83,7 @@ extern "C" {
 /* Pool and message defines */
 #define SAMPLE_POOL_ID                   0 ///< Pool number used for data transfers
 #define NUM_BUF_SIZES                    6 ///< Amount of pools to be configured
-#define NUM_BUF_POOL0                    1 ///< Amount of buffers in the first pool
-#define NUM_BUF_POOL1                    1 ///< Amount of buffers in the second pool
-#define NUM_BUF_POOL2                    1 ///< Amount of buffers in the thrid pool
-#define NUM_BUF_POOL3                    1 ///< Amount of buffers in the fourth pool
-#define NUM_BUF_POOL4                    1 ///< Amount of buffers in the fifth pool
-#define NUM_BUF_POOL5                    1 ///< Amount of buffers in the sixth pool
-#define NUM_BUF_MAX                      1 ///< Maximum amount of buffers in pool
+#define NUM_BUF_MAX                      4 ///< Maximum amount of buffers in pool (frames in flight)
 #define canny_edge_IPS_ID                0 ///< IPS ID used for sending notifications to the DPS
 #define canny_edge_IPS_EVENTNO           5 ///< Event number used for notifications to the DSP
 
@@ -71,17 +93,178 @@ enum {
     canny_edge_WRITEBACK,               ///< Simple write back program
     canny_edge_GAUSSIAN,                ///< Calculate the Gaussian
     canny_edge_DERIVATIVE,              ///< Calculate the derivatives
-    canny_edge_MAGNITUDE                ///< Calculate the magnitude
+    canny_edge_MAGNITUDE,               ///< Calculate the magnitude
+    canny_edge_SETSIZE,                 ///< Take the image size from the control block
+    canny_edge_CHAIN,                   ///< Run the DSP bands of the first stages back to back
+    canny_edge_PING                     ///< Only take over the rows of the image and give them back
+};
+
+/* The control block shared with the DSP. The GPP fills in the geometry and the
+ * buffer table once and adds the commands to a ring, a notify is only the
+ * doorbell. The DSP acknowledges a command with its sequence number and keeps
+ * its own fields on a cache line of their own. Keep in sync with dsp/task.c. */
+#define canny_edge_CTRL_MAGIC   0x43414E59  ///< "CANY"
+#define canny_edge_CTRL_VERSION 4           ///< Bumped on every change of the layout
+#define canny_edge_CTRL_SLOTS   16          ///< Commands in the ring, at least the commands in flight
+#define canny_edge_CTRL_LINE    128         ///< Cache line of the DSP, the sides never write the same line
+#define canny_edge_TILE_LOCK    "CANNY_TILES" ///< Critical section of the tile counters
+#define CTRL_POOL               NUM_BUF_SIZES ///< Entry of the control block in the pool
+#define TILE_POOL               (NUM_BUF_SIZES + 1) ///< Entry of the shared object of the tile lock in the pool
+
+typedef struct {
+    Uint32 seq;                         ///< Sequence number of the command, the first one is 1
+    Uint32 cmd;                         ///< The command
+    Uint32 buf;                         ///< The frame slot of the buffers
+    Uint32 row_start, row_end;          ///< Rows the DSP does
+    Uint32 stages;                      ///< Stages of a chain: 2 up to the derivative, 3 up to the magnitude
+    Uint32 tile_rows;                   ///< Rows per tile when the rows are pulled from the tile counter, or 0
+} canny_edge_Cmd;
+
+typedef struct {
+    /* Written by the DSP */
+    Uint32 done;                                        ///< Sequence number of the last finished command
+    Int32 status;                                       ///< 0, or the failure of the block or a command
+    Int32 results[canny_edge_CTRL_SLOTS];               ///< 0, or the failure of a command, by sequence number
+    Uint32 dsp_pad[canny_edge_CTRL_LINE / 4 - 2 - canny_edge_CTRL_SLOTS];
+    /* Written by both sides, only in the tile lock */
+    Uint32 tiles[NUM_BUF_MAX];                          ///< Next tile of the tiled command per frame slot
+    Uint32 tiles_pad[canny_edge_CTRL_LINE / 4 - NUM_BUF_MAX];
+    /* Written by the GPP */
+    Uint32 magic, version, size;                        ///< Identify the layout of the block
+    Uint32 rows, cols, depth;                           ///< The image size and the frame slots
+    Uint32 buffers[NUM_BUF_SIZES][NUM_BUF_MAX];         ///< Buffer addresses on the DSP
+    Uint32 buffer_sizes[NUM_BUF_SIZES];                 ///< The buffer sizes
+    Uint32 head;                                        ///< Sequence number of the last command written
+    canny_edge_Cmd cmds[canny_edge_CTRL_SLOTS];         ///< The ring of commands, by sequence number
+} canny_edge_Ctrl;
+
+/* The GPP kernels of the split stages, they do the last percentage% of the rows */
+typedef void (*gaussian_fn)(unsigned char *image, short int *smoothedim, int rows, int cols, float *kernel,
+                            int windowsize, short int *percentage, canny_arena *arena);
+typedef void (*gaussian16_fn)(unsigned short int *image, int maxval, short int *smoothedim, int rows, int cols,
+                              float *kernel, int windowsize, short int *percentage, canny_arena *arena);
+typedef void (*derivative_fn)(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
+                              short int *percentage);
+typedef void (*magnitude_fn)(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
+                             short int *percentage, canny_arena *arena);
+
+/* Kernels that are not compiled in for the target */
+#if defined (__ARM_NEON__)
+#define NEON_KERNEL(fn) fn
+#else
+#define NEON_KERNEL(fn) NULL
+#endif
+#if defined (__i386__) || defined (__x86_64__)
+#define X86_KERNEL(fn) fn
+#else
+#define X86_KERNEL(fn) NULL
+#endif
+
+/* Specific canny edge variables */
+#define BOOSTBLURFACTOR 90.0
+#define SIGMA 2.5
+#define TLOW 0.5
+#define THIGH 0.5
+#define GAUSSIAN16_BOOST(maxval) (BOOSTBLURFACTOR * 255.0 / (maxval)) ///< Boost of 16-bit images, to the 8-bit range
+
+/* Hysteresis threshold reuse over the frames of a stream */
+#define THRESHOLD_REFRESH 30        ///< Recompute the full histogram at least every N frames
+#define THRESHOLD_SUBSAMPLE 8       ///< Row and column step of the drift detector histogram
+#define THRESHOLD_DRIFT 0.05        ///< Relative drift of the subsampled threshold forcing a refresh
+#define THRESHOLD_SMOOTHING 1.0     ///< Weight of the new thresholds on a refresh (1.0 is no smoothing)
+
+/* Online balancing of the stages with an "auto" percentage */
+#define BALANCE_START 50            ///< Percentage of the first frame without a profile
+#define BALANCE_SMOOTHING 0.25      ///< Weight of a new frame in the measured rates
+#define BALANCE_STEP 10             ///< Largest change of the percentage per frame
+#define BALANCE_DEADBAND 1.0        ///< Keep the percentage when the optimum is closer than this
+#define BALANCE_MIN 1               ///< Lowest percentage on the GPP, of the balancer, the tuner and the profile
+#define BALANCE_MAX 99              ///< Highest percentage on the GPP, of the balancer, the tuner and the profile
+#define PROFILE_FILE "canny_profile.txt" ///< Balanced percentages per image size, overridden by CANNY_PROFILE
+#define SEQ_RING 16                 ///< Command timestamps kept, more than the commands in flight
+#define DSP_GAUSSIAN_HALO 8         ///< Image rows the DSP gaussian reads past its band (see dsp/task.c)
+
+/* Offline tuning of the split (canny_edge_Autotune) */
+#define TUNE_REPS 5                 ///< Default timed repetitions per probe, the median is used
+#define TUNE_REPS_MAX 31            ///< Most repetitions per probe
+#define TUNE_ROUNDS 3               ///< Most rounds over the stages, stops earlier when no stage moves
+
+/* IPC benchmark (canny_edge_IpcBench) */
+#define IPC_ITERATIONS 1000         ///< Default timed round trips per measurement
+#define IPC_ITERATIONS_MAX 100000   ///< Most round trips per measurement
+
+/* Batch mode (canny_edge_Batch) */
+#define BATCH_WORKERS 3             ///< Worker threads, one reads and writes, overridden by CANNY_BATCH_WORKERS
+#define BATCH_WORKERS_MAX 16        ///< Most worker threads
+#define BATCH_READAHEAD 4           ///< Most images read and waiting for a context
+
+/* Fused pipeline */
+#define FUSED_CACHE_BYTES (128 * 1024)  ///< Bytes of ring buffers per strip (Cortex-A8 L2 is 256kB)
+
+/* The state of a single canny edge detection pipeline */
+struct canny_ctx {
+    Uint8 processorId;                                  ///< Id of the DSP processor
+    Bool dsp;                                           ///< The DSP is loaded and used by this context
+    int rows, cols;                                     ///< The image width and height
+    int max_rows, max_cols;                             ///< The size the buffers are allocated for
+    int perc[STAGE_NUM];                                ///< Percentage of the rows done on the GPP/NEON per stage
+    Bool balanced[STAGE_NUM];                           ///< The percentage of the stage is balanced online
+    balance_stage balancer[STAGE_NUM];                  ///< Measured GPP and DSP rates per stage
+    int balance_updates;                                ///< Frames balanced since the profile was loaded
+    Char8 *profile;                                     ///< File keeping the balanced split per image size
+    canny_backends backends;                            ///< The backend of each stage
+    char backends_str[128];                             ///< The backends as a specification
+    gaussian_fn gaussian;                               ///< GPP kernel of the gaussian
+    gaussian16_fn gaussian16;                           ///< GPP kernel of the gaussian of 16-bit images
+    derivative_fn derivative;                           ///< GPP kernel of the derivatives
+    magnitude_fn magnitude_kernel;                      ///< GPP kernel of the magnitude
+    pnm_gray_fn luma;                                   ///< GPP kernel of the luminance of color images
+    float tlow, thigh;                                  ///< Hysteresis threshold fractions
+    float *kernel;                                      ///< The gaussian kernel
+    int windowsize;                                     ///< Dimension of the gaussian kernel
+    sem_t sem;                                          ///< Semaphore of the INIT handshake with the DSP
+    pthread_mutex_t ack_lock;                           ///< Protects dsp_acked, ack_usec and dsp_result
+    pthread_cond_t ack_cond;                            ///< Signalled on every acknowledged command
+    Uint32 dsp_sent;                                    ///< Commands sent to the DSP
+    Uint32 dsp_acked;                                   ///< Last command acknowledged by the DSP (callback side)
+    long long send_usec[SEQ_RING];                      ///< Time a command was sent, by sequence number
+    long long ack_usec[SEQ_RING];                       ///< Time a command was acknowledged, by sequence number
+    Int32 dsp_result[SEQ_RING];                         ///< Status of an acknowledged command, by sequence number
+    int depth;                                          ///< Frames in flight, one buffer of each pool per frame
+    Bool slot_busy[NUM_BUF_MAX];                        ///< The frame slot holds a submitted request
+    Bool slot_failed[NUM_BUF_MAX];                      ///< A DSP command of the frame in the slot failed
+    int requests;                                       ///< Requests submitted and not waited for
+    short int percentage[NUM_BUF_MAX];                  ///< Percentage of the rows on the GPP per frame slot
+    unsigned short int *image16[NUM_BUF_MAX];           ///< 16-bit image of a frame slot (canny_edge_Submit16)
+    int maxval[NUM_BUF_MAX];                            ///< Largest sample of the 16-bit image per frame slot
+    Uint32 gaussian_seq[NUM_BUF_MAX];                   ///< Command of a queued DSP gaussian band per frame slot
+    Uint32 pool_sizes[NUM_BUF_SIZES + 2];               ///< The amount of buffers per pool, the control block and lock
+    Uint32 buffer_sizes[NUM_BUF_SIZES + 2];             ///< The buffer sizes, the control block and lock
+    canny_edge_Ctrl *ctrl;                              ///< The control block shared with the DSP
+    Bool dsp_attached;                                  ///< The DSP took the control block
+    Bool chain;                                         ///< The DSP bands run as one command (DSP_CHAIN)
+    int tile_rows;                                      ///< Rows per tile of the DSP stages, 0 for the split
+    int tile_rows_min;                                  ///< TILE_ROWS or CANNY_TILE_ROWS, tile_rows is rounded up
+    MPCS_ShObj *tile_obj;                               ///< Shared object of the tile lock, in the pool
+    MPCS_Handle tile_lock;                              ///< Critical section of the tile counters
+    long long skew_usec[STAGE_NUM];                     ///< Summed gap between the GPP and DSP finish per stage
+    long long skew_max[STAGE_NUM];                      ///< Largest gap between the GPP and DSP finish per stage
+    int skew_frames[STAGE_NUM];                         ///< Frames in the finish gaps per stage
+    Void *buffers[NUM_BUF_SIZES][NUM_BUF_MAX];          ///< The buffers
+    Void *dsp_buffers[NUM_BUF_SIZES][NUM_BUF_MAX];      ///< Buffer addresses on the DSP
+    canny_arena arena;                                  ///< Workspace of the frame buffers
+    unsigned char *nms;                                 ///< The non maximum suppression image
+    unsigned char *edge;                                ///< The edge image of a sequence of frames
+    edge_chains chains;                                 ///< The edge chains of a sequence of frames
+    hysteresis_stream hyst_stream;                      ///< Thresholds of the previous frames
+#if FUSED_PIPELINE
+    fused_pipeline fused;                               ///< Ring buffers of the fused pipeline
+#endif
 };
 
 /* General variables */
-sem_t sem;                                              ///< Semaphore used for synchronising events
-unsigned char *canny_edge_image;                        ///< The canny edge input image
-int canny_edge_rows, canny_edge_cols;                   ///< The canny edge input width and height
-Uint32 pool_sizes[] = {NUM_BUF_POOL0, NUM_BUF_POOL1, NUM_BUF_POOL2, NUM_BUF_POOL3, NUM_BUF_POOL4, NUM_BUF_POOL5};   ///< The pool sizes
-Uint32 buffer_sizes[NUM_BUF_SIZES];                     ///< The buffer sizes
-Void *buffers[NUM_BUF_SIZES][NUM_BUF_MAX];              ///< The buffers
-Void *dsp_buffers[NUM_BUF_SIZES][NUM_BUF_MAX];          ///< Buffer addresses on the DSP
+pthread_mutex_t dsp_lock = PTHREAD_MUTEX_INITIALIZER;   ///< Protects dsp_owner
+canny_ctx *dsp_owner = NULL;                            ///< The context that loaded the DSP (only one can)
 
 /* Precomputed kernel values for the Gaussian smooth function */
 float gaussian_kernel[] = { 0.0031742106657475233078003,  /* kernel[0] */
@@ -99,62 +282,364 @@ float gaussian_kernel[] = { 0.0031742106657475233078003,  /* kernel[0] */
                             0.0216511301696300506591797,  /* kernel[12] */
                             0.0089805237948894500732422,  /* kernel[13] */
                             0.0031742106657475233078003   /* kernel[14] */
-                          }; 
+                          };
 int windowsize_kernel = 15; /* Dimension of the gaussian kernel. */
 
 
-/* Specific canny edge variables */
-#define BOOSTBLURFACTOR 90.0
-#define SIGMA 2.5
-#define TLOW 0.5
-#define THIGH 0.5
-
 /* Used DSP functions */
 STATIC Void canny_edge_Notify(Uint32 eventNo, Pvoid arg, Pvoid info);
-STATIC Void canny_edge_Writeback(unsigned char *image, int rows, int cols, Uint8 processorId);
-STATIC Void canny_edge_Gaussian(unsigned char *image, int rows, int cols, short int *smoothedim, short int *percentage, Uint8 processorId);
-STATIC Void canny_edge_Derivative(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
-                                  short int *percentage, Uint8 processorId);
-STATIC Void canny_edge_Magnitude(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
-                                 short int *percentage, Uint8 processorId);
+STATIC DSP_STATUS canny_edge_StartDsp(canny_ctx *ctx, IN Char8 *dspExecutable);
+STATIC size_t canny_edge_WorkspaceSize(canny_ctx *ctx);
+STATIC Void canny_edge_LoadProfile(canny_ctx *ctx);
+STATIC Void canny_edge_SaveProfile(canny_ctx *ctx);
+STATIC Uint32 canny_edge_Send(canny_ctx *ctx, Uint32 cmd, int buf, int perc);
+STATIC Uint32 canny_edge_SendRows(canny_ctx *ctx, Uint32 cmd, int buf, int row_start, int row_end);
+STATIC int canny_edge_DspRows(canny_ctx *ctx, int perc);
+STATIC Void canny_edge_WritebackRows(canny_ctx *ctx, Void *buffer, int bpp, int row_start, int row_end);
+STATIC Void canny_edge_InvalidateRows(canny_ctx *ctx, Void *buffer, int bpp, int row_start, int row_end);
+STATIC DSP_STATUS canny_edge_WaitSeq(canny_ctx *ctx, Uint32 seq);
+STATIC Bool canny_edge_PollSeq(canny_ctx *ctx, Uint32 seq);
+#if !FUSED_PIPELINE || DO_WRITEBACK
+STATIC Void canny_edge_WaitFrame(canny_ctx *ctx, int buf, Uint32 seq);
+#endif
+#if !FUSED_PIPELINE
+STATIC Void canny_edge_Balance(canny_ctx *ctx, int stage, int perc, long long gpp_start, long long gpp_end,
+                               Uint32 seq);
+STATIC Uint32 canny_edge_Claim(canny_ctx *ctx, int buf);
+STATIC Void canny_edge_Skew(canny_ctx *ctx, int stage, long long gpp_end, Uint32 seq);
+#endif
+#if DO_WRITEBACK
+STATIC Void canny_edge_Writeback(canny_ctx *ctx, int buf, unsigned char *image, unsigned char *original);
+#endif
+#if !FUSED_PIPELINE
+STATIC Void canny_edge_SubmitGaussian(canny_ctx *ctx, int buf);
+STATIC Void canny_edge_Gaussian(canny_ctx *ctx, int buf, unsigned char *image, short int *smoothedim,
+                                short int *percentage);
+STATIC Void canny_edge_Derivative(canny_ctx *ctx, int buf, short int *smoothedim, short int *delta_x,
+                                  short int *delta_y, short int *percentage);
+STATIC Void canny_edge_Magnitude(canny_ctx *ctx, int buf, short int *delta_x, short int *delta_y,
+                                 short int *magnitude, short int *percentage);
+STATIC Void canny_edge_Chain(canny_ctx *ctx, int buf, unsigned char *image, short int *smoothedim,
+                             short int *delta_x, short int *delta_y, short int *magnitude, short int *percentage);
+STATIC Void canny_edge_Tiles(canny_ctx *ctx, int stage, int buf);
+#endif
+STATIC Bool canny_edge_Chained(canny_ctx *ctx, int stage);
+STATIC int canny_edge_TileRows(int tile_rows, int cols);
+STATIC int canny_edge_TakeSlot(canny_ctx *ctx);
+STATIC Void canny_edge_Load(canny_ctx *ctx, int buf);
+STATIC Void canny_edge_Bands(canny_ctx *ctx, int buf);
+STATIC DSP_STATUS canny_edge_Finish(canny_ctx *ctx, int buf, unsigned char *edge, edge_chains *chains);
+STATIC Bool canny_edge_SessionSource(void *arg, int frame, unsigned char *image);
+STATIC Void canny_edge_SessionSink(void *arg, int frame, unsigned char *edge, edge_chains *chains);
+STATIC double canny_edge_TuneCost(void *arg, int perc);
+STATIC int canny_edge_CompareName(const void *a, const void *b);
+STATIC int canny_edge_ListImages(Char8 *strDir, Char8 ***strImages);
+STATIC void *canny_edge_BatchWorker(void *arg);
+STATIC int canny_edge_CompareTime(const void *a, const void *b);
+STATIC Void canny_edge_Percentiles(long long *times, int n, long long *p);
+STATIC char *canny_edge_FormatPercentiles(long long *p, char *text);
+#if BENCHMARK && !FUSED_PIPELINE
+STATIC Void canny_edge_BenchChains(short int *magnitude, short int *delta_x, short int *delta_y, int rows, int cols,
+                                  canny_arena *arena);
+#endif
+#if BENCHMARK
+STATIC Void canny_edge_BenchFused(unsigned char *image, int rows, int cols, float *kernel, int windowsize,
+                                  canny_arena *arena);
+#endif
 
 /* Used neon functions */
-STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, Uint16 rows, Uint16 cols, short int *percentage);
+#if defined (__ARM_NEON__)
+STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, int rows, int cols, float *kernel,
+                                 int windowsize, short int *percentage, canny_arena *arena);
+STATIC void gaussian_smooth16_neon(unsigned short int *image, int maxval, short int *smoothedim, int rows, int cols,
+                                   float *kernel, int windowsize, short int *percentage, canny_arena *arena);
+STATIC void gaussian_neon(unsigned char *image, unsigned short int *image16, double boost, short int *smoothedim,
+                          int rows, int cols, float *kernel, short int *percentage, canny_arena *arena);
 STATIC void derivative_x_y_neon(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
                                 short int *percentage);
 STATIC void magnitude_x_y_neon(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
-                               short int *percentage);
+                               short int *percentage, canny_arena *arena);
+STATIC void rgb_to_gray_neon(const unsigned char *rgb, unsigned char *gray, int pixels);
+#endif
+
+/* Used SSE4 and AVX2 functions */
+#if defined (__i386__) || defined (__x86_64__)
+STATIC void gaussian_smooth_sse4(unsigned char *image, short int *smoothedim, int rows, int cols, float *kernel,
+                                 int windowsize, short int *percentage, canny_arena *arena);
+STATIC void gaussian_smooth16_sse4(unsigned short int *image, int maxval, short int *smoothedim, int rows, int cols,
+                                   float *kernel, int windowsize, short int *percentage, canny_arena *arena);
+STATIC void gaussian_y_sse4(float *tempim, short int *smoothedim, int rows, int cols, float *kernel, int center,
+                            int row_start, double boost);
+STATIC void derivative_x_y_sse4(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
+                                short int *percentage);
+STATIC void magnitude_x_y_sse4(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
+                               short int *percentage, canny_arena *arena);
+STATIC void gaussian_smooth_avx2(unsigned char *image, short int *smoothedim, int rows, int cols, float *kernel,
+                                 int windowsize, short int *percentage, canny_arena *arena);
+STATIC void gaussian_smooth16_avx2(unsigned short int *image, int maxval, short int *smoothedim, int rows, int cols,
+                                   float *kernel, int windowsize, short int *percentage, canny_arena *arena);
+STATIC void gaussian_y_avx2(float *tempim, short int *smoothedim, int rows, int cols, float *kernel, int center,
+                            int row_start, double boost);
+STATIC void derivative_x_y_avx2(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
+                                short int *percentage);
+STATIC void magnitude_x_y_avx2(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
+                               short int *percentage, canny_arena *arena);
+STATIC void rgb_to_gray_sse4(const unsigned char *rgb, unsigned char *gray, int pixels);
+#endif
 
 /* Used GPP functions */
 STATIC long long get_usec(void);
-STATIC void gaussian_smooth(unsigned char *image, short int *smoothedim, int rows, int cols, short int *percentage);
+STATIC long long get_nsec(void);
+STATIC void gaussian_smooth(unsigned char *image, short int *smoothedim, int rows, int cols, float *kernel,
+                            int windowsize, short int *percentage, canny_arena *arena);
+STATIC void gaussian_smooth16(unsigned short int *image, int maxval, short int *smoothedim, int rows, int cols,
+                              float *kernel, int windowsize, short int *percentage, canny_arena *arena);
+STATIC void gaussian_smooth_y(float *tempim, short int *smoothedim, int rows, int cols, float *kernel, int center,
+                              int row_start, double boost);
+#if VERIFY
 STATIC void make_gaussian_kernel(float sigma, float **kernel, int *windowsize);
+#endif
 STATIC void magnitude_x_y(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
-                          short int *percentage);
+                          short int *percentage, canny_arena *arena);
 STATIC void derivative_x_y(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
                            short int *percentage);
-STATIC double angle_radians(double x, double y);
+STATIC void rgb_to_gray(const unsigned char *rgb, unsigned char *gray, int pixels);
+STATIC int line_rows(int cols);
+STATIC int split_row(int rows, int cols, int perc);
+
+/* The GPP kernels per backend (BACKEND_*) */
+STATIC gaussian_fn gaussian_kernels[BACKEND_AUTO] = {
+    gaussian_smooth, NEON_KERNEL(gaussian_smooth_neon), X86_KERNEL(gaussian_smooth_sse4),
+    X86_KERNEL(gaussian_smooth_avx2)
+};
+STATIC gaussian16_fn gaussian16_kernels[BACKEND_AUTO] = {
+    gaussian_smooth16, NEON_KERNEL(gaussian_smooth16_neon), X86_KERNEL(gaussian_smooth16_sse4),
+    X86_KERNEL(gaussian_smooth16_avx2)
+};
+STATIC derivative_fn derivative_kernels[BACKEND_AUTO] = {
+    derivative_x_y, NEON_KERNEL(derivative_x_y_neon), X86_KERNEL(derivative_x_y_sse4),
+    X86_KERNEL(derivative_x_y_avx2)
+};
+STATIC magnitude_fn magnitude_kernels[BACKEND_AUTO] = {
+    magnitude_x_y, NEON_KERNEL(magnitude_x_y_neon), X86_KERNEL(magnitude_x_y_sse4),
+    X86_KERNEL(magnitude_x_y_avx2)
+};
+/* The luminance takes the backend of the gaussian it feeds, AVX2 has no
+ * shuffle across its two lanes for the interleaved samples and uses SSE4 */
+STATIC pnm_gray_fn luma_kernels[BACKEND_AUTO] = {
+    rgb_to_gray, NEON_KERNEL(rgb_to_gray_neon), X86_KERNEL(rgb_to_gray_sse4), X86_KERNEL(rgb_to_gray_sse4)
+};
+
+
+/** ============================================================================
+ *  @func   canny_edge_DefaultConfig
+ *
+ *  @desc   Fill the configuration with the defaults: GPP only with the
+ *          default hysteresis thresholds.
+ *
+ *  @modif  config
+ *  ============================================================================
+ */
+NORMAL_API Void canny_edge_DefaultConfig(OUT canny_config *config)
+{
+    config->dspExecutable = NULL;
+    config->processorId = ID_PROCESSOR;
+    config->gaussianPerc = 100;
+    config->derivativePerc = 100;
+    config->magnitudePerc = 100;
+    config->pipelineDepth = PIPELINE_DEPTH;
+    config->backends = NULL;
+    config->tlow = TLOW;
+    config->thigh = THIGH;
+}
 
 
 /** ============================================================================
  *  @func   canny_edge_Create
  *
- *  @desc   This function allocates and initializes resources used by
- *          this application.
+ *  @desc   This function allocates and initializes the resources of a canny
+ *          edge context for images of rows x cols. When a DSP executable is
+ *          given the DSP is loaded and the buffers are allocated from its
+ *          pool, otherwise the context runs on the GPP only.
  *
- *  @modif  None
+ *  @modif  ctx
  *  ============================================================================
  */
-NORMAL_API DSP_STATUS canny_edge_Create(IN Char8 *dspExecutable,
-                                        IN Char8 *strImage,
-                                        IN Uint8   processorId)
+NORMAL_API DSP_STATUS canny_edge_Create(OUT canny_ctx **pctx, IN canny_config *config, IN int rows, IN int cols)
 {
     DSP_STATUS      status     = DSP_SOK;
-    SMAPOOL_Attrs   poolAttrs;
-    Uint16          i, j;
+    canny_ctx       *ctx;
+    Uint16          i;
+    char            *spec;
+#if VERIFY
+    int             windowsize;
+    float           *kernel;
+#endif
 
     VPRINT("Entered canny_edge_Create ()\n") ;
-    sem_init(&sem, 0, 0);
+
+    /* Allocate the context, it is returned also on failure so it can be deleted */
+    if ((*pctx = ctx = (canny_ctx *)calloc(1, sizeof(canny_ctx))) == NULL) {
+        fprintf(stderr, "Error allocating the canny edge context.\n");
+        return DSP_EFAIL;
+    }
+    ctx->processorId = config->processorId;
+    ctx->rows = ctx->max_rows = rows;
+    ctx->cols = ctx->max_cols = cols;
+    ctx->tlow = config->tlow;
+    ctx->thigh = config->thigh;
+    sem_init(&ctx->sem, 0, 0);
+    pthread_mutex_init(&ctx->ack_lock, NULL);
+    pthread_cond_init(&ctx->ack_cond, NULL);
+    init_hysteresis_stream(&ctx->hyst_stream, THRESHOLD_REFRESH, THRESHOLD_SUBSAMPLE, THRESHOLD_DRIFT,
+                           THRESHOLD_SMOOTHING);
+
+    /* Without the DSP the GPP/NEON does all the rows */
+    if (config->dspExecutable != NULL) {
+        ctx->perc[STAGE_GAUSSIAN] = config->gaussianPerc;
+        ctx->perc[STAGE_DERIVATIVE] = config->derivativePerc;
+        ctx->perc[STAGE_MAGNITUDE] = config->magnitudePerc;
+        ctx->depth = config->pipelineDepth;
+        if (ctx->depth < 1 || ctx->depth > NUM_BUF_MAX) {
+            fprintf(stderr, "Pipeline depth %d is not in 1 to %d.\n", ctx->depth, NUM_BUF_MAX);
+            return DSP_EFAIL;
+        }
+    } else {
+        ctx->perc[STAGE_GAUSSIAN] = ctx->perc[STAGE_DERIVATIVE] = ctx->perc[STAGE_MAGNITUDE] = 100;
+        ctx->depth = 1;
+    }
+    for (i = 0; i < NUM_BUF_SIZES; i++) {
+        ctx->pool_sizes[i] = ctx->depth;
+    }
+
+    /* Copy the precomputed kernel (the DSP and NEON code are made for this kernel) */
+    ctx->windowsize = windowsize_kernel;
+    if ((ctx->kernel = (float *)malloc(ctx->windowsize * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error allocating the gaussian kernel.\n");
+        return DSP_EFAIL;
+    }
+    memcpy(ctx->kernel, gaussian_kernel, ctx->windowsize * sizeof(float));
+
+#if VERIFY
+    /* Verify pre-computed (harcoded) kernel values */
+    VPRINT(" Verifying pre-computed kernel values.. \r \n");
+    make_gaussian_kernel(SIGMA, &kernel, &windowsize);
+    for (i = 0; i < windowsize; i++) {
+        if (ctx->kernel[i] != kernel[i]) {
+            fprintf(stderr, "Incorrect kernel value! Expected %f, Got %f (i: %d)\r\n", kernel[i], ctx->kernel[i], i);
+        }
+    }
+    free(kernel);
+#endif
+
+    VPRINT("Start allocating buffer \n");
+    /* Set the buffer sizes based on image size */
+    ctx->buffer_sizes[0] = DSPLINK_ALIGN(sizeof(unsigned char) * rows * cols, DSPLINK_BUF_ALIGN); //image
+    ctx->buffer_sizes[1] = DSPLINK_ALIGN(sizeof(short int) * rows * cols, DSPLINK_BUF_ALIGN); //smoothedim
+    ctx->buffer_sizes[2] = DSPLINK_ALIGN(sizeof(short int) * rows * cols, DSPLINK_BUF_ALIGN); //delta_x
+    ctx->buffer_sizes[3] = DSPLINK_ALIGN(sizeof(short int) * rows * cols, DSPLINK_BUF_ALIGN); //delta_y
+    ctx->buffer_sizes[4] = DSPLINK_ALIGN(sizeof(int) * rows * cols, DSPLINK_BUF_ALIGN); //temporary smooth x (DSP)
+    ctx->buffer_sizes[5] = DSPLINK_ALIGN(sizeof(short int) * rows * cols, DSPLINK_BUF_ALIGN); //magnitude
+
+    /* Only one context at a time can own the DSP */
+    if (config->dspExecutable != NULL) {
+        pthread_mutex_lock(&dsp_lock);
+        if (dsp_owner == NULL) {
+            dsp_owner = ctx;
+            ctx->dsp = TRUE;
+        }
+        pthread_mutex_unlock(&dsp_lock);
+
+        if (!ctx->dsp) {
+            fprintf(stderr, "The DSP is already in use by another canny edge context.\n");
+            return DSP_EFAIL;
+        }
+    }
+
+    /* Select the backend of each stage: the defaults, CANNY_BACKEND and the configuration */
+    if (!backend_parse(BACKENDS, &ctx->backends) ||
+        ((spec = getenv("CANNY_BACKEND")) != NULL && !backend_parse(spec, &ctx->backends)) ||
+        (config->backends != NULL && !backend_parse(config->backends, &ctx->backends))) {
+        return DSP_EFAIL;
+    }
+    backend_resolve(&ctx->backends, ctx->dsp);
+    backend_describe(&ctx->backends, ctx->backends_str, sizeof(ctx->backends_str));
+    VPRINT("Backends: %s\n", ctx->backends_str);
+    ctx->gaussian = gaussian_kernels[ctx->backends.kernel[STAGE_GAUSSIAN]];
+    ctx->gaussian16 = gaussian16_kernels[ctx->backends.kernel[STAGE_GAUSSIAN]];
+    ctx->derivative = derivative_kernels[ctx->backends.kernel[STAGE_DERIVATIVE]];
+    ctx->magnitude_kernel = magnitude_kernels[ctx->backends.kernel[STAGE_MAGNITUDE]];
+    ctx->luma = luma_kernels[ctx->backends.kernel[STAGE_GAUSSIAN]];
+    ctx->tile_rows = ((spec = getenv("CANNY_TILE_ROWS")) != NULL) ? atoi(spec) : TILE_ROWS;
+    if (ctx->tile_rows < 0 || !ctx->dsp) {
+        ctx->tile_rows = 0;
+    }
+    ctx->tile_rows_min = ctx->tile_rows;
+    ctx->tile_rows = canny_edge_TileRows(ctx->tile_rows_min, ctx->cols);
+    ctx->chain = DSP_CHAIN && ctx->tile_rows == 0 && ctx->backends.dsp[STAGE_GAUSSIAN] &&
+                 ctx->backends.dsp[STAGE_DERIVATIVE];
+
+    /* The chain runs its stages with the split of the gaussian, a stage with a split of its own runs alone */
+    for (i = STAGE_DERIVATIVE; i < STAGE_NUM && ctx->chain; i++) {
+        if (ctx->backends.dsp[i] && ctx->perc[i] != CANNY_PERC_AUTO && ctx->perc[i] != ctx->perc[STAGE_GAUSSIAN]) {
+            ctx->chain = FALSE;
+        }
+    }
+
+    /* A stage without the DSP does all its rows on the GPP, an "auto" stage is balanced online. The
+     * stages in the chain take the split of the gaussian */
+    for (i = 0; i < STAGE_NUM; i++) {
+        balance_init(&ctx->balancer[i], BALANCE_SMOOTHING, BALANCE_STEP, BALANCE_DEADBAND, BALANCE_MIN,
+                     BALANCE_MAX);
+        if (!ctx->backends.dsp[i]) {
+            ctx->perc[i] = 100;
+        } else if (canny_edge_Chained(ctx, i)) {
+            ctx->perc[i] = ctx->perc[STAGE_GAUSSIAN];
+        } else if (ctx->perc[i] == CANNY_PERC_AUTO) {
+            ctx->balanced[i] = TRUE;
+            ctx->perc[i] = BALANCE_START;
+        }
+    }
+    if ((ctx->profile = getenv("CANNY_PROFILE")) == NULL) {
+        ctx->profile = PROFILE_FILE;
+    }
+    canny_edge_LoadProfile(ctx);
+
+    /* Allocate the workspace once, the frames only take buffers from it */
+    if (!arena_init(&ctx->arena, canny_edge_WorkspaceSize(ctx))) {
+        return DSP_EFAIL;
+    }
+    ctx->nms = (unsigned char *)arena_alloc(&ctx->arena, sizeof(unsigned char) * rows * cols);
+    ctx->edge = (unsigned char *)arena_alloc(&ctx->arena, sizeof(unsigned char) * rows * cols);
+#if FUSED_PIPELINE
+    if (!fused_init(&ctx->fused, rows, cols, ctx->kernel, ctx->windowsize, BOOSTBLURFACTOR,
+                    fused_strip_rows(cols, ctx->windowsize, FUSED_CACHE_BYTES))) {
+        return DSP_EFAIL;
+    }
+#endif
+
+    if (!ctx->dsp) {
+        /* Only the GPP uses the buffers */
+        for (i = 0; i < NUM_BUF_SIZES; i++) {
+            ctx->buffers[i][0] = arena_alloc(&ctx->arena, ctx->buffer_sizes[i]);
+        }
+    } else {
+        status = canny_edge_StartDsp(ctx, config->dspExecutable);
+    }
+
+    VPRINT("Leaving canny_edge_Create ()\n");
+    return status;
+}
+
+/* Load the DSP, allocate the buffers in its pool and send them to the DSP */
+STATIC DSP_STATUS canny_edge_StartDsp(canny_ctx *ctx, IN Char8 *dspExecutable)
+{
+    DSP_STATUS      status     = DSP_SOK;
+    SMAPOOL_Attrs   poolAttrs;
+    MPCS_Attrs      attrs;
+    Uint8           processorId = ctx->processorId;
+    Void            *dsp_ctrl;
+    Uint16          i, j;
 
     /*
      *  Create and initialize the proc object.
@@ -176,30 +661,16 @@ NORMAL_API DSP_STATUS canny_edge_Create(IN Char8 *dspExecutable,
     }
 
     /*
-     *  Open the PGM image
-     */
-    VPRINT("Reading the image %s.\n", strImage);
-    if (read_pgm_image(strImage, &canny_edge_image, &canny_edge_rows, &canny_edge_cols) == 0) {
-        fprintf(stderr, "Error reading the input image, %s.\n", strImage);
-        return DSP_EFAIL;
-    }
-
-    VPRINT("Start allocating buffer \n");
-    /* Set the buffer sizes based on image size */
-    buffer_sizes[0] = DSPLINK_ALIGN(sizeof(unsigned char) * canny_edge_rows * canny_edge_cols, DSPLINK_BUF_ALIGN); //image
-    buffer_sizes[1] = DSPLINK_ALIGN(sizeof(short int) * canny_edge_rows * canny_edge_cols, DSPLINK_BUF_ALIGN); //smoothedim
-    buffer_sizes[2] = DSPLINK_ALIGN(sizeof(short int) * canny_edge_rows * canny_edge_cols, DSPLINK_BUF_ALIGN); //delta_x
-    buffer_sizes[3] = DSPLINK_ALIGN(sizeof(short int) * canny_edge_rows * canny_edge_cols, DSPLINK_BUF_ALIGN); //delta_y
-    buffer_sizes[4] = DSPLINK_ALIGN(sizeof(int) * canny_edge_rows * canny_edge_cols,
-                                    DSPLINK_BUF_ALIGN); //magnitude squared (temporary smooth x)
-    buffer_sizes[5] = DSPLINK_ALIGN(sizeof(short int), DSPLINK_BUF_ALIGN); //percentage
-
-    /*
-     *  Open the pool.
+     *  Open the pool, with a buffer for the control block and one for the tile
+     *  lock after the frame buffers.
      */
-    poolAttrs.bufSizes      = (Uint32 *) &buffer_sizes ;
-    poolAttrs.numBuffers    = (Uint32 *) &pool_sizes ;
-    poolAttrs.numBufPools   = NUM_BUF_SIZES ;
+    ctx->pool_sizes[CTRL_POOL] = 1;
+    ctx->buffer_sizes[CTRL_POOL] = DSPLINK_ALIGN(sizeof(canny_edge_Ctrl), DSPLINK_BUF_ALIGN);
+    ctx->pool_sizes[TILE_POOL] = 1;
+    ctx->buffer_sizes[TILE_POOL] = DSPLINK_ALIGN(sizeof(MPCS_ShObj), DSPLINK_BUF_ALIGN);
+    poolAttrs.bufSizes      = (Uint32 *) &ctx->buffer_sizes ;
+    poolAttrs.numBuffers    = (Uint32 *) &ctx->pool_sizes ;
+    poolAttrs.numBufPools   = NUM_BUF_SIZES + 2 ;
     poolAttrs.exactMatchReq = TRUE ;
     status = POOL_open(POOL_makePoolId(processorId, SAMPLE_POOL_ID), &poolAttrs) ;
     if (DSP_FAILED(status)) {
@@ -213,11 +684,11 @@ NORMAL_API DSP_STATUS canny_edge_Create(IN Char8 *dspExecutable,
      *  Go through all buffers to initialize them
      */
     for (i = 0; i < NUM_BUF_SIZES; i++) {
-        for (j = 0; j < pool_sizes[i]; j++) {
+        for (j = 0; j < ctx->pool_sizes[i]; j++) {
             /* Allocate the buffer */
             status = POOL_alloc(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                                (Void **) &buffers[i][j],
-                                buffer_sizes[i]) ;
+                                (Void **) &ctx->buffers[i][j],
+                                ctx->buffer_sizes[i]) ;
             if (DSP_FAILED(status)) {
                 fprintf(stderr, "POOL_alloc() DataBuf failed. Status = [0x%x]\n", (int)status);
                 return status;
@@ -226,9 +697,9 @@ NORMAL_API DSP_STATUS canny_edge_Create(IN Char8 *dspExecutable,
             /* Get the translated DSP address to be sent to the DSP. */
             status = POOL_translateAddr(
                          POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                         &dsp_buffers[i][j],
+                         &ctx->dsp_buffers[i][j],
                          AddrType_Dsp,
-                         (Void *) buffers[i][j],
+                         (Void *) ctx->buffers[i][j],
                          AddrType_Usr) ;
 
             if (DSP_FAILED(status)) {
@@ -238,6 +709,57 @@ NORMAL_API DSP_STATUS canny_edge_Create(IN Char8 *dspExecutable,
         }
     }
 
+    /*
+     *  Allocate the control block and fill in the image size and the buffer table.
+     */
+    status = POOL_alloc(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
+                        (Void **) &ctx->ctrl,
+                        ctx->buffer_sizes[CTRL_POOL]) ;
+    if (DSP_SUCCEEDED(status)) {
+        status = POOL_translateAddr(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
+                                    &dsp_ctrl,
+                                    AddrType_Dsp,
+                                    (Void *) ctx->ctrl,
+                                    AddrType_Usr) ;
+    }
+    if (DSP_FAILED(status)) {
+        fprintf(stderr, "Allocating the control block failed. Status = [0x%x]\n", (int)status);
+        return status;
+    }
+    memset(ctx->ctrl, 0, sizeof(canny_edge_Ctrl));
+    ctx->ctrl->magic = canny_edge_CTRL_MAGIC;
+    ctx->ctrl->version = canny_edge_CTRL_VERSION;
+    ctx->ctrl->size = sizeof(canny_edge_Ctrl);
+    ctx->ctrl->rows = ctx->rows;
+    ctx->ctrl->cols = ctx->cols;
+    ctx->ctrl->depth = ctx->depth;
+    for (i = 0; i < NUM_BUF_SIZES; i++) {
+        ctx->ctrl->buffer_sizes[i] = ctx->buffer_sizes[i];
+        for (j = 0; j < ctx->pool_sizes[i]; j++) {
+            ctx->ctrl->buffers[i][j] = (Uint32) ctx->dsp_buffers[i][j];
+        }
+    }
+    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID), ctx->ctrl, sizeof(canny_edge_Ctrl));
+
+    /*
+     *  Create the critical section of the tile counters in the pool, the DSP
+     *  opens it when it takes the control block.
+     */
+    status = POOL_alloc(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
+                        (Void **) &ctx->tile_obj,
+                        ctx->buffer_sizes[TILE_POOL]) ;
+    if (DSP_SUCCEEDED(status)) {
+        attrs.poolId = POOL_makePoolId(processorId, SAMPLE_POOL_ID);
+        status = MPCS_create(processorId, canny_edge_TILE_LOCK, ctx->tile_obj, &attrs);
+    }
+    if (DSP_SUCCEEDED(status)) {
+        status = MPCS_open(processorId, canny_edge_TILE_LOCK, &ctx->tile_lock);
+    }
+    if (DSP_FAILED(status)) {
+        fprintf(stderr, "Creating the tile lock failed. Status = [0x%x]\n", (int)status);
+        return status;
+    }
+
     /*
      *  Register for notification that the DSP-side application setup is
      *  complete.
@@ -246,7 +768,7 @@ NORMAL_API DSP_STATUS canny_edge_Create(IN Char8 *dspExecutable,
                              canny_edge_IPS_ID,
                              canny_edge_IPS_EVENTNO,
                              (FnNotifyCbck) canny_edge_Notify,
-                             0/* vladms XFER_SemPtr*/) ;
+                             (Pvoid) ctx) ;
     if (DSP_FAILED(status)) {
         fprintf(stderr, "NOTIFY_register () failed Status = [0x%x]\n", (int)status);
         return status;
@@ -275,60 +797,118 @@ NORMAL_API DSP_STATUS canny_edge_Create(IN Char8 *dspExecutable,
      *  setup. The DSP-side application sends notification of the IPS event
      *  when it is ready to proceed with further execution of the application.
      */
-    sem_wait(&sem);
+    sem_wait(&ctx->sem);
 
     /*
-     * Send the image cols and rows
+     *  Hand the control block to the DSP, it acknowledges with an INIT after
+     *  checking the layout and taking the buffer table.
      */
     status = NOTIFY_notify(processorId,
                            canny_edge_IPS_ID,
                            canny_edge_IPS_EVENTNO,
-                           (Uint32) canny_edge_cols);
+                           (Uint32) dsp_ctrl);
     if (DSP_FAILED(status)) {
-        fprintf(stderr, "NOTIFY_notify () DataBuf failed. Status = [0x%x]\n", (int)status);
+        fprintf(stderr, "NOTIFY_notify () control block failed. Status = [0x%x]\n", (int)status);
         return status;
     }
+    sem_wait(&ctx->sem);
 
-    status = NOTIFY_notify(processorId,
-                           canny_edge_IPS_ID,
-                           canny_edge_IPS_EVENTNO,
-                           (Uint32) canny_edge_rows);
-    if (DSP_FAILED(status)) {
-        fprintf(stderr, "NOTIFY_notify () DataBuf failed. Status = [0x%x]\n", (int)status);
-        return status;
+    POOL_invalidate(POOL_makePoolId(processorId, SAMPLE_POOL_ID), ctx->ctrl, canny_edge_CTRL_LINE);
+    if (ctx->ctrl->status != 0) {
+        fprintf(stderr, "The DSP rejected the control block version %d. Status = [0x%x]\n",
+                canny_edge_CTRL_VERSION, (int)ctx->ctrl->status);
+        return DSP_EFAIL;
     }
+    ctx->dsp_attached = TRUE;
 
+    return status;
+}
 
-    /*
-     *  Go through all buffers to initialize them on the DSP
-     */
-    for (i = 0; i < NUM_BUF_SIZES; i++) {
-        for (j = 0; j < pool_sizes[i]; j++) {
-            /* Send DSP address of the buffer to the DSP */
-            status = NOTIFY_notify(processorId,
-                                   canny_edge_IPS_ID,
-                                   canny_edge_IPS_EVENTNO,
-                                   (Uint32) dsp_buffers[i][j]);
-            if (DSP_FAILED(status)) {
-                fprintf(stderr, "NOTIFY_notify () DataBuf failed. Status = [0x%x]\n", (int)status);
-                return status;
-            }
+/* Size of the workspace arena of a context: the images that live during the
+ * whole frame plus the largest scratch buffers a single stage takes (and gives
+ * back before the next stage) */
+STATIC size_t canny_edge_WorkspaceSize(canny_ctx *ctx)
+{
+    size_t pixels = (size_t)ctx->max_rows * ctx->max_cols;
+    size_t frame, scratch;
+#if BENCHMARK
+    size_t bench;
+#endif
+    int i;
 
-            /* Send the size of the buffer to the DSP */
-            status = NOTIFY_notify(processorId,
-                                   canny_edge_IPS_ID,
-                                   canny_edge_IPS_EVENTNO,
-                                   (Uint32) buffer_sizes[i]);
-            if (DSP_FAILED(status)) {
-                fprintf(stderr, "NOTIFY_notify () DataBuf failed. Status = [0x%x]\n", (int)status);
-                return status;
+    /* Nms and edge, plus the stage buffers and the magnitude when they are not in the DSP pool */
+    frame = 2 * ARENA_SIZE(sizeof(unsigned char) * pixels);
+    for (i = 0; i < NUM_BUF_SIZES && !ctx->dsp; i++) {
+        frame += ARENA_SIZE(ctx->buffer_sizes[i]);
+    }
+
+    /* gaussian_smooth_neon is the largest stage: tempim and the padded row and column images */
+    scratch = ARENA_SIZE(sizeof(float) * pixels) +
+              ARENA_SIZE(sizeof(float) * (ctx->max_cols + 16) * ctx->max_rows) +
+              ARENA_SIZE(sizeof(float) * (ctx->max_rows + 16) * ctx->max_cols);
+    if (ctx->tile_rows > 0) {
+        /* canny_edge_Tiles: the tiles taken and two tile images with their halo, the tile rows of
+         * a single column are whole lines for any width */
+        scratch += ARENA_SIZE(ctx->max_rows) +
+                   2 * ARENA_SIZE(sizeof(short int) * (canny_edge_TileRows(ctx->tile_rows_min, 1) +
+                                                       2 * DSP_GAUSSIAN_HALO) * ctx->max_cols);
+    }
+#if BENCHMARK
+    /* canny_edge_BenchFused: five short and two char images plus gaussian_smooth */
+    bench = 5 * ARENA_SIZE(sizeof(short int) * pixels) + 2 * ARENA_SIZE(sizeof(unsigned char) * pixels) +
+            ARENA_SIZE(sizeof(float) * pixels);
+    if (bench > scratch) {
+        scratch = bench;
+    }
+#endif
+
+    return frame + scratch;
+}
+
+/* Start the balanced stages from the split stored in the profile for the
+ * current image size, the measurements of another size do not apply */
+STATIC Void canny_edge_LoadProfile(canny_ctx *ctx)
+{
+    int i, perc[STAGE_NUM];
+
+    if (profile_load(ctx->profile, ctx->rows, ctx->cols, perc, STAGE_NUM)) {
+        for (i = 0; i < STAGE_NUM; i++) {
+            if (ctx->balanced[i] && perc[i] >= BALANCE_MIN && perc[i] <= BALANCE_MAX) {
+                ctx->perc[i] = perc[i];
             }
         }
+        VPRINT("Loaded the split %d %d %d for %d x %d from %s.\n", ctx->perc[STAGE_GAUSSIAN],
+               ctx->perc[STAGE_DERIVATIVE], ctx->perc[STAGE_MAGNITUDE], ctx->cols, ctx->rows, ctx->profile);
     }
+    for (i = 0; i < STAGE_NUM; i++) {
+        if (canny_edge_Chained(ctx, i)) {
+            ctx->perc[i] = ctx->perc[STAGE_GAUSSIAN];
+        }
+        balance_reset(&ctx->balancer[i]);
+    }
+    ctx->balance_updates = 0;
+}
 
+/* Store the split the balanced stages converged to for the current image size.
+ * The other stages, and those in the chain, keep the percentages the profile
+ * has for them. */
+STATIC Void canny_edge_SaveProfile(canny_ctx *ctx)
+{
+    int i, perc[STAGE_NUM];
 
-    VPRINT("Leaving canny_edge_Create ()\n");
-    return status;
+    if (ctx->balance_updates == 0) {
+        return;
+    }
+    if (!profile_load(ctx->profile, ctx->rows, ctx->cols, perc, STAGE_NUM)) {
+        memcpy(perc, ctx->perc, sizeof(perc));
+    }
+    for (i = 0; i < STAGE_NUM; i++) {
+        if (ctx->balanced[i]) {
+            perc[i] = ctx->perc[i];
+        }
+    }
+    profile_save(ctx->profile, ctx->rows, ctx->cols, perc, STAGE_NUM);
+    ctx->balance_updates = 0;
 }
 
 /* Get the time in nano seconds */
@@ -341,130 +921,497 @@ STATIC long long get_usec(void)
     return r;
 }
 
+/* Get the monotonic time in nano seconds, for the short intervals of the IPC benchmark */
+STATIC long long get_nsec(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
 
 /** ============================================================================
- *  @func   canny_edge_Execute
+ *  @func   canny_edge_SetSize
  *
- *  @desc   This function implements the execute phase for this application.
+ *  @desc   This function changes the size of the next images of a context,
+ *          within the size it was created with. The DSP keeps running and
+ *          only gets the new cols and rows.
  *
- *  @modif  None
+ *  @modif  ctx
  *  ============================================================================
  */
-NORMAL_API DSP_STATUS canny_edge_Execute(Uint8 processorId, IN Char8 *strImage)
+NORMAL_API DSP_STATUS canny_edge_SetSize(IN canny_ctx *ctx, IN int rows, IN int cols)
 {
     DSP_STATUS  status = DSP_SOK;
-    long long start_time;
-    unsigned char *image = (unsigned char *)buffers[0][0];
-    short int *smoothedim = (short int *)buffers[1][0];
-    short int *delta_x = (short int *)buffers[2][0];
-    short int *delta_y = (short int *)buffers[3][0];
-    short int *magnitude = (short int *)malloc(sizeof(short int) * canny_edge_rows * canny_edge_cols);
-    unsigned char *nms = (unsigned char *)malloc(sizeof(unsigned char) * canny_edge_rows * canny_edge_cols);
-    unsigned char *edge = (unsigned char *)malloc(sizeof(unsigned char) * canny_edge_rows * canny_edge_cols);
-    short int *percentage = (short int *)buffers[5][0];
-    char outfilename[128];    /* Name of the output "edge" image */
-#if VERIFY
-    int i, windowsize;
-    float *kernel;
+    Uint32      seq;
+
+    if (rows == ctx->rows && cols == ctx->cols) {
+        return status;
+    }
+    if (rows < 3 || cols < 3 || rows > ctx->max_rows || cols > ctx->max_cols) {
+        fprintf(stderr, "Image of %d x %d does not fit in the context of %d x %d.\n", cols, rows,
+                ctx->max_cols, ctx->max_rows);
+        return DSP_EFAIL;
+    }
+
+    if (ctx->dsp) {
+        /* The DSP takes the new cols and rows from the control block when it
+         * gets to the command, the commands before it still use the old size */
+        ctx->ctrl->rows = rows;
+        ctx->ctrl->cols = cols;
+        POOL_writeback(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID), &ctx->ctrl->rows, 2 * sizeof(Uint32));
+        seq = canny_edge_Send(ctx, canny_edge_SETSIZE, 0, 100);
+        if (DSP_FAILED(canny_edge_WaitSeq(ctx, seq))) {
+            return DSP_EFAIL;
+        }
+    }
+
+    canny_edge_SaveProfile(ctx);
+    ctx->rows = rows;
+    ctx->cols = cols;
+    ctx->tile_rows = canny_edge_TileRows(ctx->tile_rows_min, cols);
+    canny_edge_LoadProfile(ctx);
+#if FUSED_PIPELINE
+    fused_resize(&ctx->fused, rows, cols);
 #endif
-    /* Distribute PERCENTAGE_GPP of the rows to GPP and 100-PERCENTAGE_GPP to the DSP */
+    return status;
+}
 
-    VPRINT("Entered canny_edge_Execute ()\n");
+/* Take a free frame slot for a request, -1 when all of them are in flight */
+STATIC int canny_edge_TakeSlot(canny_ctx *ctx)
+{
+    int buf;
 
-    /* Copy the open image (since this is generated by PGM IO) */
-    memcpy(image, canny_edge_image, buffer_sizes[0]);
+    for (buf = 0; buf < ctx->depth && ctx->slot_busy[buf]; buf++);
+    if (buf == ctx->depth) {
+        fprintf(stderr, "All %d frame slots have a request in flight.\n", ctx->depth);
+        return -1;
+    }
+    ctx->slot_busy[buf] = TRUE;
+    ctx->requests++;
+    return buf;
+}
 
-    /* Start the timer */
-    start_time = get_usec();
+/* Start a frame that is in the (DSP shared) input buffer of frame slot buf.
+ * When the DSP does a part of the gaussian its band is queued right away, so
+ * it can run while the GPP is still busy with the previous frame. */
+STATIC Void canny_edge_Load(canny_ctx *ctx, int buf)
+{
+    ctx->slot_failed[buf] = FALSE;
 
 #if DO_WRITEBACK
-    /* Do a writeback test */
-    VPRINT(" Starting writeback\r\n");
-    canny_edge_Writeback(image, canny_edge_rows, canny_edge_cols, processorId);
+    unsigned char *image = (unsigned char *)ctx->buffers[0][buf];
+    size_t mark = arena_mark(&ctx->arena);
+    unsigned char *original = (unsigned char *)arena_alloc(&ctx->arena, sizeof(unsigned char) * ctx->rows * ctx->cols);
+
+    /* Do a writeback test, against a copy of the frame */
+    if (ctx->dsp) {
+        VPRINT(" Starting writeback\r\n");
+        memcpy(original, image, sizeof(unsigned char) * ctx->rows * ctx->cols);
+        canny_edge_Writeback(ctx, buf, image, original);
+    }
+    arena_release(&ctx->arena, mark);
 #endif
 
-#if VERIFY
-    /* Verify pre-computed (harcoded) kernel values */
-    VPRINT(" Verifying pre-computed kernel values.. \r \n");
-    make_gaussian_kernel(SIGMA, &kernel, &windowsize);
-    for (i = 0; i < windowsize; i++) {
-        if (gaussian_kernel[i] != kernel[i]) {
-            fprintf(stderr, "Incorrect kernel value! Expected %f, Got %f (i: %d)\r\n", kernel[i], gaussian_kernel[i], i);
+#if !FUSED_PIPELINE
+    if (ctx->backends.dsp[STAGE_GAUSSIAN]) {
+        canny_edge_SubmitGaussian(ctx, buf);
+    }
+#endif
+}
+
+/* The GPP/DSP split stages of the frame in slot buf, from the gaussian up to
+ * the magnitude (or up to the non maximal suppression when fused) */
+STATIC Void canny_edge_Bands(canny_ctx *ctx, int buf)
+{
+    int rows = ctx->rows, cols = ctx->cols;
+    unsigned char *image = (unsigned char *)ctx->buffers[0][buf];
+#if !FUSED_PIPELINE
+    short int *smoothedim = (short int *)ctx->buffers[1][buf];
+    short int *delta_x = (short int *)ctx->buffers[2][buf];
+    short int *delta_y = (short int *)ctx->buffers[3][buf];
+    short int *percentage = &ctx->percentage[buf];
+#endif
+    short int *magnitude = (short int *)ctx->buffers[5][buf];
+    unsigned short int *image16 = ctx->image16[buf];
+
+#if FUSED_PIPELINE
+    /* Gaussian smoothing up to the non maximal suppression in cache sized strips */
+    VPRINT(" Starting fused gaussian to non maximal suppression\r\n");
+    canny_fused_run(&ctx->fused, image, magnitude, ctx->nms);
+    (void) rows;
+    (void) cols;
+    (void) image16;
+#else
+    if (image16 != NULL) {
+        /* The DSP only smooths 8-bit images, the GPP does all rows of a 16-bit one */
+        VPRINT(" Starting gaussian smoothing of the 16-bit image\r\n");
+        *percentage = 100;
+        ctx->gaussian16(image16, ctx->maxval[buf], smoothedim, rows, cols, ctx->kernel, ctx->windowsize, percentage,
+                        &ctx->arena);
+    }
+
+    if (ctx->tile_rows > 0) {
+        /* The DSP stages in tiles, the GPP only stages as a whole */
+        VPRINT(" Starting the tiles of the gaussian smoothing up to the magnitude\r\n");
+        *percentage = 100;
+        if (image16 != NULL) {
+            VPRINT("  Gaussian of the 16-bit image done\r\n");
+        } else if (ctx->backends.dsp[STAGE_GAUSSIAN]) {
+            canny_edge_Tiles(ctx, STAGE_GAUSSIAN, buf);
+        } else {
+            ctx->gaussian(image, smoothedim, rows, cols, ctx->kernel, ctx->windowsize, percentage, &ctx->arena);
+        }
+        if (ctx->backends.dsp[STAGE_DERIVATIVE]) {
+            canny_edge_Tiles(ctx, STAGE_DERIVATIVE, buf);
+        } else {
+            ctx->derivative(smoothedim, rows, cols, delta_x, delta_y, percentage);
+        }
+    } else if (ctx->chain && image16 == NULL) {
+        /* The DSP bands of the stages as one command */
+        VPRINT(" Starting the chain of the gaussian smoothing and derivative x, y\r\n");
+        canny_edge_Chain(ctx, buf, image, smoothedim, delta_x, delta_y, magnitude, percentage);
+    } else {
+        /* Do the gaussian smoothing */
+        VPRINT(" Starting gaussian smoothing\r\n");
+        if (image16 != NULL) {
+            VPRINT("  Gaussian of the 16-bit image done\r\n");
+        } else if (ctx->backends.dsp[STAGE_GAUSSIAN]) {
+            canny_edge_Gaussian(ctx, buf, image, smoothedim, percentage);
+        } else {
+            *percentage = ctx->perc[STAGE_GAUSSIAN];
+            ctx->gaussian(image, smoothedim, rows, cols, ctx->kernel, ctx->windowsize, percentage, &ctx->arena);
+        }
+
+        /* Calculate the derivatives */
+        VPRINT(" Starting derivative x, y\r\n");
+        *percentage = ctx->perc[STAGE_DERIVATIVE];
+        if (ctx->backends.dsp[STAGE_DERIVATIVE]) {
+            canny_edge_Derivative(ctx, buf, smoothedim, delta_x, delta_y, percentage);
+        } else {
+            ctx->derivative(smoothedim, rows, cols, delta_x, delta_y, percentage);
         }
     }
 
-    if (DSP_SUCCEEDED(status)) {
-        VPRINT("Precomputed kernel values are correct!\r\n");
+    /* Compute the magnitude, unless the chain did */
+    VPRINT(" Starting magnitude x, y\r\n");
+    *percentage = ctx->perc[STAGE_MAGNITUDE];
+    if (ctx->chain && image16 == NULL && ctx->backends.dsp[STAGE_MAGNITUDE]) {
+        VPRINT("  Magnitude done in the chain\r\n");
+    } else if (ctx->tile_rows > 0 && ctx->backends.dsp[STAGE_MAGNITUDE]) {
+        canny_edge_Tiles(ctx, STAGE_MAGNITUDE, buf);
+    } else if (ctx->backends.dsp[STAGE_MAGNITUDE]) {
+        canny_edge_Magnitude(ctx, buf, delta_x, delta_y, magnitude, percentage);
+    } else {
+        ctx->magnitude_kernel(delta_x, delta_y, rows, cols, magnitude, percentage, &ctx->arena);
     }
 #endif
 
-    /* Do the gaussian smoothing */
-    VPRINT(" Starting gaussian smoothing\r\n");
-    *percentage = gaussianPerc;
-    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID), percentage, buffer_sizes[5]);
-#if GAUSSIAN_PARALLEL
-    canny_edge_Gaussian(image, canny_edge_rows, canny_edge_cols, smoothedim, percentage, processorId);
-#elif GAUSSIAN_NEON
-    gaussian_smooth_neon(image, smoothedim, canny_edge_rows, canny_edge_cols, percentage);
-#else
-    gaussian_smooth(image, smoothedim, canny_edge_rows, canny_edge_cols, percentage);
+#if BENCHMARK
+#if !FUSED_PIPELINE
+    canny_edge_BenchChains(magnitude, delta_x, delta_y, rows, cols, &ctx->arena);
 #endif
-
-    /* Calculate the derivatives */
-    VPRINT(" Starting derivative x, y\r\n");
-    *percentage = derivativePerc;
-    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID), percentage, buffer_sizes[5]);
-#if DERIVATIVE_PARALLEL
-    canny_edge_Derivative(smoothedim, canny_edge_rows, canny_edge_cols, delta_x, delta_y, percentage, processorId);
-#elif DERIVATIVE_NEON
-    derivative_x_y_neon(smoothedim, canny_edge_rows, canny_edge_cols, delta_x, delta_y, percentage);
-#else
-    derivative_x_y(smoothedim, canny_edge_rows, canny_edge_cols, delta_x, delta_y, percentage);
+    if (image16 == NULL) {
+        canny_edge_BenchFused(image, rows, cols, ctx->kernel, ctx->windowsize, &ctx->arena);
+    }
 #endif
+}
 
-    /* Compute the magnitude */
-    VPRINT(" Starting magnitude x, y\r\n");
-    *percentage = magnitudePerc;
-    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID), percentage, buffer_sizes[5]);
-#if MAGNITUDE_PARALLEL
-    canny_edge_Magnitude(delta_x, delta_y, canny_edge_rows, canny_edge_cols, magnitude, percentage, processorId);
-#elif MAGNITUDE_NEON
-    magnitude_x_y_neon(delta_x, delta_y, canny_edge_rows, canny_edge_cols, magnitude, percentage);
-#else
-    magnitude_x_y(delta_x, delta_y, canny_edge_rows, canny_edge_cols, magnitude, percentage);
-#endif
+/* The GPP only stages of the frame in slot buf: the non maximal suppression
+ * and the hysteresis */
+STATIC DSP_STATUS canny_edge_Finish(canny_ctx *ctx, int buf, unsigned char *edge, edge_chains *chains)
+{
+    DSP_STATUS  status = DSP_SOK;
+    int rows = ctx->rows, cols = ctx->cols;
+    short int *magnitude = (short int *)ctx->buffers[5][buf];
 
+#if !FUSED_PIPELINE
     /* Do the Non maximal suppression */
     VPRINT(" Starting non maximal suppression \r\n");
-    non_max_supp(magnitude, delta_x, delta_y, canny_edge_rows, canny_edge_cols, nms);
+    non_max_supp(magnitude, (short int *)ctx->buffers[2][buf], (short int *)ctx->buffers[3][buf],
+                 rows, cols, ctx->nms);
+#endif
 
     /* Apply the hysteresis */
     VPRINT(" Starting hysteresis \r\n");
-    apply_hysteresis(magnitude, nms, canny_edge_rows, canny_edge_cols, TLOW, THIGH, edge);
-
-    /* Stop the timer and return */
-    if(VERBOSE) printf("Canny edge took %lld us.\n", (get_usec() - start_time));
-    else printf("%d, %d, %d, %lld\r\n", gaussianPerc, derivativePerc, magnitudePerc, (get_usec() - start_time));
-
-    /* Save the image */
-    sprintf(outfilename, "%s_out.pgm", strImage);
-    if (write_pgm_image(outfilename, edge, canny_edge_rows, canny_edge_cols, "", 255) == 0) {
-        fprintf(stderr, "Error writing the edge image, %s.\n", outfilename);
+    if (chains != NULL) {
+        if (apply_hysteresis_chains(THRESHOLD_REUSE ? &ctx->hyst_stream : NULL, magnitude, ctx->nms,
+                                    rows, cols, ctx->tlow, ctx->thigh, chains) == 0) {
+            fprintf(stderr, "Error allocating the edge chains.\n");
+            status = DSP_EFAIL;
+        }
+    } else {
+        apply_hysteresis_stream(THRESHOLD_REUSE ? &ctx->hyst_stream : NULL, magnitude, ctx->nms,
+                                rows, cols, ctx->tlow, ctx->thigh, edge);
+    }
+
+    return status;
+}
+
+/** ============================================================================
+ *  @func   canny_edge_Execute
+ *
+ *  @desc   This function runs the canny edge detection of a context on an
+ *          image. The edges are written to the edge image, or traced into
+ *          chains when chains is not NULL.
+ *
+ *  @modif  edge, chains
+ *  ============================================================================
+ */
+NORMAL_API DSP_STATUS canny_edge_Execute(IN canny_ctx *ctx, IN unsigned char *image_in,
+                                         OUT unsigned char *edge, OUT edge_chains *chains)
+{
+    DSP_STATUS  status;
+    canny_request request;
+
+    VPRINT("Entered canny_edge_Execute ()\n");
+
+    status = canny_edge_Submit(ctx, image_in, &request);
+    if (DSP_SUCCEEDED(status)) {
+        status = canny_edge_Wait(ctx, &request, edge, chains);
+    }
+    return status;
+}
+
+/** ============================================================================
+ *  @func   canny_edge_Submit
+ *
+ *  @desc   This function puts an image in flight in a free frame slot. The
+ *          DSP band of the first stages is queued right away, the caller can
+ *          do other work until it waits for the request.
+ *
+ *  @modif  request
+ *  ============================================================================
+ */
+NORMAL_API DSP_STATUS canny_edge_Submit(IN canny_ctx *ctx, IN unsigned char *image_in, OUT canny_request *request)
+{
+    int buf;
+
+    request->slot = -1;
+    request->seq = 0;
+    if ((buf = canny_edge_TakeSlot(ctx)) < 0) {
+        return DSP_EFAIL;
+    }
+
+    /* The image of the caller is copied into the input buffer of the slot */
+    memcpy(ctx->buffers[0][buf], image_in, sizeof(unsigned char) * ctx->rows * ctx->cols);
+    canny_edge_Load(ctx, buf);
+    request->slot = buf;
+    request->seq = ctx->gaussian_seq[buf];
+    return DSP_SOK;
+}
+
+/** ============================================================================
+ *  @func   canny_edge_SubmitRgb
+ *
+ *  @desc   This function puts a color image in flight in a free frame slot.
+ *          The luminance of the interleaved samples is written straight
+ *          into the input buffer of the slot, the gaussian of the GPP and of
+ *          the DSP read it from there as for canny_edge_Submit.
+ *
+ *  @modif  request
+ *  ============================================================================
+ */
+NORMAL_API DSP_STATUS canny_edge_SubmitRgb(IN canny_ctx *ctx, IN unsigned char *rgb_in, OUT canny_request *request)
+{
+    int buf;
+
+    request->slot = -1;
+    request->seq = 0;
+    if ((buf = canny_edge_TakeSlot(ctx)) < 0) {
+        return DSP_EFAIL;
+    }
+
+    ctx->luma(rgb_in, ctx->buffers[0][buf], ctx->rows * ctx->cols);
+    canny_edge_Load(ctx, buf);
+    request->slot = buf;
+    request->seq = ctx->gaussian_seq[buf];
+    return DSP_SOK;
+}
+
+/** ============================================================================
+ *  @func   canny_edge_Submit16
+ *
+ *  @desc   This function puts a 16-bit image in flight in a free frame slot.
+ *          The GPP smooths all its rows when the request is waited for, the
+ *          later stages are split with the DSP as for 8-bit images.
+ *
+ *  @modif  request
+ *  ============================================================================
+ */
+NORMAL_API DSP_STATUS canny_edge_Submit16(IN canny_ctx *ctx, IN unsigned short int *image_in, IN int maxval,
+                                          OUT canny_request *request)
+{
+    int buf;
+
+    request->slot = -1;
+    request->seq = 0;
+    if (FUSED_PIPELINE || maxval < 1 || maxval > 65535) {
+        fprintf(stderr, "16-bit images need a maxval of 1 to 65535 and no FUSED_PIPELINE.\n");
+        return DSP_EFAIL;
+    }
+    if ((buf = canny_edge_TakeSlot(ctx)) < 0) {
+        return DSP_EFAIL;
+    }
+
+    /* The image stays with the caller, only the gaussian reads it */
+    ctx->image16[buf] = image_in;
+    ctx->maxval[buf] = maxval;
+    request->slot = buf;
+    return DSP_SOK;
+}
+
+/** ============================================================================
+ *  @func   canny_edge_Poll
+ *
+ *  @desc   This function checks without blocking if the DSP finished the
+ *          work queued for a request, so waiting for it starts on the GPP
+ *          right away.
+ *
+ *  @modif  None
+ *  ============================================================================
+ */
+NORMAL_API Bool canny_edge_Poll(IN canny_ctx *ctx, IN canny_request *request)
+{
+    return (request->seq == 0) || canny_edge_PollSeq(ctx, request->seq);
+}
+
+/** ============================================================================
+ *  @func   canny_edge_Wait
+ *
+ *  @desc   This function completes a request: the GPP does its part of the
+ *          split stages, waits for the DSP where it needs its rows and does
+ *          the non maximum suppression and hysteresis. The frame slot is
+ *          free again when it returns. Requests can be waited for in any
+ *          order.
+ *
+ *  @modif  edge, chains, request
+ *  ============================================================================
+ */
+NORMAL_API DSP_STATUS canny_edge_Wait(IN canny_ctx *ctx, IN canny_request *request, OUT unsigned char *edge,
+                                      OUT edge_chains *chains)
+{
+    DSP_STATUS  status;
+    int buf = request->slot;
+
+    if (buf < 0 || buf >= ctx->depth || !ctx->slot_busy[buf]) {
+        fprintf(stderr, "The request is not in flight.\n");
+        return DSP_EFAIL;
+    }
+
+    canny_edge_Bands(ctx, buf);
+    status = canny_edge_Finish(ctx, buf, edge, chains);
+    if (ctx->slot_failed[buf]) {
         status = DSP_EFAIL;
     }
+    ctx->image16[buf] = NULL;
+    ctx->slot_busy[buf] = FALSE;
+    ctx->requests--;
+    request->slot = -1;
+    request->seq = 0;
+    return status;
+}
 
-    /* Free buffers */
-    free(magnitude);
-    free(nms);
-    free(edge);
-#if VERIFY
-    free(kernel);
-#endif
+/** ============================================================================
+ *  @func   canny_edge_ExecuteFrames
+ *
+ *  @desc   This function runs the canny edge detection of a context on a
+ *          sequence of frames. Frame f uses buffer slot f % depth. As soon as
+ *          the split stages of a frame are done the next frames are loaded,
+ *          so the DSP works on their gaussian band while the GPP does the
+ *          non maximal suppression and hysteresis.
+ *
+ *  @modif  None
+ *  ============================================================================
+ */
+NORMAL_API DSP_STATUS canny_edge_ExecuteFrames(IN canny_ctx *ctx, IN canny_frame_source source,
+                                               IN canny_frame_sink sink, IN void *arg, IN int numFrames,
+                                               IN Bool chains)
+{
+    DSP_STATUS  status = DSP_SOK;
+    int frame, buf, loaded = 0;
+
+    VPRINT("Entered canny_edge_ExecuteFrames ()\n");
+
+    /* The frames take all slots */
+    if (ctx->requests > 0) {
+        fprintf(stderr, "canny_edge_ExecuteFrames with %d requests in flight.\n", ctx->requests);
+        return DSP_EFAIL;
+    }
+
+    for (frame = 0; frame < numFrames; frame++) {
+        buf = frame % ctx->depth;
+
+        /* Load the frame when it is not in flight yet, the source writes it into the slot */
+        if (loaded == frame) {
+            if (!source(arg, frame, (unsigned char *)ctx->buffers[0][buf])) {
+                status = DSP_EFAIL;
+                break;
+            }
+            canny_edge_Load(ctx, buf);
+            loaded++;
+        }
 
+        canny_edge_Bands(ctx, buf);
+
+        /* Put the next frames in flight, their slots are no longer used */
+        while (loaded < numFrames && loaded < frame + ctx->depth) {
+            if (!source(arg, loaded, (unsigned char *)ctx->buffers[0][loaded % ctx->depth])) {
+                status = DSP_EFAIL;
+                numFrames = loaded;
+                break;
+            }
+            canny_edge_Load(ctx, loaded % ctx->depth);
+            loaded++;
+        }
+
+        if (DSP_FAILED(canny_edge_Finish(ctx, buf, ctx->edge, chains ? &ctx->chains : NULL)) ||
+            ctx->slot_failed[buf]) {
+            status = DSP_EFAIL;
+        }
+        sink(arg, frame, chains ? NULL : ctx->edge, chains ? &ctx->chains : NULL);
+    }
+
+    /* Nothing may be left on the DSP */
+    if (ctx->dsp) {
+        canny_edge_WaitSeq(ctx, ctx->dsp_sent);
+        memset(ctx->gaussian_seq, 0, sizeof(ctx->gaussian_seq));
+    }
 
     return status;
 }
 
+/** ============================================================================
+ *  @func   canny_edge_Backends
+ *
+ *  @desc   This function returns the backends selected by the context.
+ *
+ *  @modif  None
+ *  ============================================================================
+ */
+NORMAL_API Char8 *canny_edge_Backends(IN canny_ctx *ctx)
+{
+    return (Char8 *)ctx->backends_str;
+}
+
+/** ============================================================================
+ *  @func   canny_edge_GetSplit
+ *
+ *  @desc   This function returns the percentage of the rows the next frame
+ *          does on the GPP per stage.
+ *
+ *  @modif  gaussianPerc, derivativePerc, magnitudePerc
+ *  ============================================================================
+ */
+NORMAL_API Void canny_edge_GetSplit(IN canny_ctx *ctx, OUT int *gaussianPerc, OUT int *derivativePerc,
+                                    OUT int *magnitudePerc)
+{
+    *gaussianPerc = ctx->perc[STAGE_GAUSSIAN];
+    *derivativePerc = ctx->perc[STAGE_DERIVATIVE];
+    *magnitudePerc = ctx->perc[STAGE_MAGNITUDE];
+}
+
 
 /** ============================================================================
  *  @func   canny_edge_Delete
@@ -478,119 +1425,1089 @@ NORMAL_API DSP_STATUS canny_edge_Execute(Uint8 processorId, IN Char8 *strImage)
  *  @modif  None
  *  ============================================================================
  */
-NORMAL_API Void canny_edge_Delete(Uint8 processorId)
+NORMAL_API Void canny_edge_Delete(IN canny_ctx *ctx)
 {
     DSP_STATUS status    = DSP_SOK;
+    Uint8 processorId;
     Uint16 i, j;
 
     VPRINT("Entered canny_edge_Delete ()\n") ;
+    if (ctx == NULL) {
+        return;
+    }
+    processorId = ctx->processorId;
+    canny_edge_SaveProfile(ctx);
 
-    /* Send DSP to stop */
-    status = NOTIFY_notify(processorId,
-                           canny_edge_IPS_ID,
-                           canny_edge_IPS_EVENTNO,
-                           (Uint32) canny_edge_DELETE);
-    if (DSP_FAILED(status)) {
-        fprintf(stderr, "NOTIFY_notify () DataBuf failed. Status = [0x%x]\n", (int)status);
+    if (ctx->dsp) {
+        /* Send DSP to stop, when it took the control block */
+        if (ctx->ctrl != NULL && ctx->dsp_attached) {
+            canny_edge_Send(ctx, canny_edge_DELETE, 0, 100);
+        }
+
+        /*
+         *  Stop execution on DSP.
+         */
+        status = PROC_stop(processorId) ;
+        if (DSP_FAILED(status)) {
+            fprintf(stderr, "PROC_stop () failed. Status = [0x%x]\n", (int)status);
+        }
+
+        /*
+         *  Unregister for notification of event registered earlier.
+         */
+        status = NOTIFY_unregister(processorId,
+                                   canny_edge_IPS_ID,
+                                   canny_edge_IPS_EVENTNO,
+                                   (FnNotifyCbck) canny_edge_Notify,
+                                   (Pvoid) ctx) ;
+        if (DSP_FAILED(status)) {
+            fprintf(stderr, "NOTIFY_unregister () failed Status = [0x%x]\n", (int)status);
+        }
+
+        /*
+         *  Free the memory allocated for the data buffer.
+         */
+        for (i = 0; i < NUM_BUF_SIZES; i++) {
+            for (j = 0; j < ctx->pool_sizes[i]; j++) {
+                if (ctx->buffers[i][j] == NULL) {
+                    continue;
+                }
+                status = POOL_free(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
+                                   (Void *) ctx->buffers[i][j],
+                                   ctx->buffer_sizes[i]) ;
+                if (DSP_FAILED(status)) {
+                    fprintf(stderr, "POOL_free () DataBuf failed. Status = [0x%x]\n", (int)status);
+                }
+            }
+        }
+        if (ctx->ctrl != NULL) {
+            status = POOL_free(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
+                               (Void *) ctx->ctrl,
+                               ctx->buffer_sizes[CTRL_POOL]) ;
+            if (DSP_FAILED(status)) {
+                fprintf(stderr, "POOL_free () control block failed. Status = [0x%x]\n", (int)status);
+            }
+        }
+
+        /*
+         *  Delete the tile lock, the DSP closed it when it stopped.
+         */
+        if (ctx->tile_lock != NULL) {
+            MPCS_close(processorId, ctx->tile_lock);
+            status = MPCS_delete(processorId, canny_edge_TILE_LOCK);
+            if (DSP_FAILED(status)) {
+                fprintf(stderr, "MPCS_delete () failed. Status = [0x%x]\n", (int)status);
+            }
+        }
+        if (ctx->tile_obj != NULL) {
+            status = POOL_free(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
+                               (Void *) ctx->tile_obj,
+                               ctx->buffer_sizes[TILE_POOL]) ;
+            if (DSP_FAILED(status)) {
+                fprintf(stderr, "POOL_free () tile lock failed. Status = [0x%x]\n", (int)status);
+            }
+        }
+
+        /*
+         *  Close the pool
+         */
+        status = POOL_close(POOL_makePoolId(processorId, SAMPLE_POOL_ID)) ;
+        if (DSP_FAILED(status)) {
+            fprintf(stderr, "POOL_close () failed. Status = [0x%x]\n", (int)status);
+        }
+
+        /*
+         *  Detach from the processor
+         */
+        status = PROC_detach(processorId) ;
+        if (DSP_FAILED(status)) {
+            fprintf(stderr, "PROC_detach () failed. Status = [0x%x]\n", (int)status);
+        }
+
+        /*
+         *  Destroy the PROC object.
+         */
+        status = PROC_destroy() ;
+        if (DSP_FAILED(status)) {
+            fprintf(stderr, "PROC_destroy () failed. Status = [0x%x]\n", (int)status);
+        }
+
+        /* Release the DSP for other contexts */
+        pthread_mutex_lock(&dsp_lock);
+        dsp_owner = NULL;
+        pthread_mutex_unlock(&dsp_lock);
+    }
+
+#if FUSED_PIPELINE
+    fused_free(&ctx->fused);
+#endif
+    free_edge_chains(&ctx->chains);
+    arena_free(&ctx->arena);
+    free(ctx->kernel);
+    sem_destroy(&ctx->sem);
+    pthread_cond_destroy(&ctx->ack_cond);
+    pthread_mutex_destroy(&ctx->ack_lock);
+    free(ctx);
+
+    VPRINT("Leaving canny_edge_Delete ()\n");
+}
+
+
+/** ============================================================================
+ *  @func   canny_edge_Stream
+ *
+ *  @desc   Canny edge detection on the GPP with bounded memory, for images
+ *          that do not fit in memory. The image is read and the edge image
+ *          is written in strips of rows.
+ *
+ *  @modif  None
+ *  ============================================================================
+ */
+NORMAL_API DSP_STATUS canny_edge_Stream(IN Char8 *strImage)
+{
+    DSP_STATUS status = DSP_SOK;
+    long long start_time, end_time;
+    char outfilename[128];    /* Name of the output "edge" image */
+
+    VPRINT("Entered canny_edge_Stream ()\n");
+    sprintf(outfilename, "%s_out.pgm", strImage);
+
+    start_time = get_usec();
+    if (canny_stream(strImage, outfilename, gaussian_kernel, windowsize_kernel, BOOSTBLURFACTOR,
+                     TLOW, THIGH, FUSED_CACHE_BYTES) == 0) {
+        fprintf(stderr, "Error streaming the image %s.\n", strImage);
+        status = DSP_EFAIL;
+    }
+    end_time = get_usec();
+
+    if(VERBOSE) printf("Streaming canny edge took %lld us.\n", (end_time - start_time));
+    else printf("%lld\r\n", (end_time - start_time));
+
+    return status;
+}
+
+
+/* The images of a session run by canny_edge_Main, handed to the frame source
+ * and sink of canny_edge_ExecuteFrames */
+typedef struct canny_session {
+    Char8 **strImages;              ///< The images of the session
+    int first;                      ///< First image of the current run of equal sized images
+    int rows, cols;                 ///< Size of the current run
+    long long *start_time;          ///< Per frame in flight the time its image was read
+    int depth;                      ///< Frames in flight
+    canny_ctx *ctx;                 ///< The context, for the split of the output lines
+    int perc[3];                    ///< The GPP percentages after the frame, for the output lines
+    int done;                       ///< Images done
+    long long latency;              ///< Sum of the latencies of the images
+} canny_session;
+
+/* Frame source of a session: read the next image from its file straight into
+ * the input buffer of the context, a color image as its luminance */
+STATIC Bool canny_edge_SessionSource(void *arg, int frame, unsigned char *image)
+{
+    canny_session *session = (canny_session *)arg;
+    Char8 *strImage = session->strImages[session->first + frame];
+
+    session->start_time[frame % session->depth] = get_usec();
+    VPRINT("Reading the image %s.\n", strImage);
+    if (read_pnm_gray_into(strImage, image, session->rows, session->cols, session->cols, session->ctx->luma) == 0) {
+        fprintf(stderr, "Error reading the input image, %s.\n", strImage);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Frame sink of a session: report the latency and write the edges of an image */
+STATIC Void canny_edge_SessionSink(void *arg, int frame, unsigned char *edge, edge_chains *chains)
+{
+    canny_session *session = (canny_session *)arg;
+    Char8 *strImage = session->strImages[session->first + frame];
+    long long latency = get_usec() - session->start_time[frame % session->depth];
+    char outfilename[128];    /* Name of the output "edge" image */
+
+    session->latency += latency;
+    session->done++;
+    canny_edge_GetSplit(session->ctx, &session->perc[0], &session->perc[1], &session->perc[2]);
+    if(VERBOSE) printf("Canny edge of %s took %lld us.\n", strImage, latency);
+    else printf("%d, %d, %d, %lld\r\n", session->perc[0], session->perc[1], session->perc[2], latency);
+
+    if (chains != NULL) {
+        /* Save the chains */
+        VPRINT("Found %d edge chains with %d points.\n", chains->num_chains, chains->num_points);
+        sprintf(outfilename, "%s_chains.txt", strImage);
+        if (write_edge_chains(outfilename, chains) == 0) {
+            fprintf(stderr, "Error writing the edge chains, %s.\n", outfilename);
+        }
+    } else {
+        /* Save the image */
+        sprintf(outfilename, "%s_out.pgm", strImage);
+        if (write_pgm_image(outfilename, edge, session->rows, session->cols, "", 255) == 0) {
+            fprintf(stderr, "Error writing the edge image, %s.\n", outfilename);
+        }
+    }
+}
+
+/* A 16-bit image of a session: read with read_pgm_image16 and run on its own,
+ * the edges go to the sink like those of the other images */
+STATIC DSP_STATUS canny_edge_SessionImage16(canny_session *session, int index)
+{
+    canny_ctx *ctx = session->ctx;
+    Char8 *strImage = session->strImages[index];
+    unsigned short int *image = NULL;
+    int rows, cols, maxval;
+    canny_request request;
+    DSP_STATUS status;
+
+    session->first = index;
+    session->start_time[0] = get_usec();
+    VPRINT("Reading the 16-bit image %s.\n", strImage);
+    if (read_pgm_image16(strImage, &image, &rows, &cols, &maxval) == 0) {
+        fprintf(stderr, "Error reading the input image, %s.\n", strImage);
+        return DSP_EFAIL;
+    }
+
+    status = canny_edge_Submit16(ctx, image, maxval, &request);
+    if (DSP_SUCCEEDED(status)) {
+        status = canny_edge_Wait(ctx, &request, ctx->edge, EDGE_CHAINS ? &ctx->chains : NULL);
+        canny_edge_SessionSink(session, 0, EDGE_CHAINS ? NULL : ctx->edge, EDGE_CHAINS ? &ctx->chains : NULL);
+    }
+    free(image);
+    return status;
+}
+
+/** ============================================================================
+ *  @func   canny_edge_Main
+ *
+ *  @desc   Entry point for the application, a client of the canny edge
+ *          context: it runs a session of one context over the images and
+ *          writes the edge image (or edge chains) of each. The context is
+ *          created for the largest image, so the DSP is loaded and the pools
+ *          are mapped only once. Runs of equal sized images are pipelined,
+ *          the next images are read and smoothed by the DSP while the GPP
+ *          finishes the current one.
+ *
+ *  @modif  None
+ *  ============================================================================
+ */
+NORMAL_API Void canny_edge_Main(IN Char8 *dspExecutable, IN Char8 **strImages, IN int numImages,
+                                IN int gaussianPerc, IN int derivativePerc, IN int magnitudePerc,
+                                IN Char8 *backends)
+{
+    DSP_STATUS status       = DSP_SOK ;
+    canny_config config;
+    canny_ctx *ctx = NULL;
+    canny_session session;
+    int i, run, max_rows = 0, max_cols = 0;
+    int *rows = NULL, *cols = NULL, *maxvals = NULL;
+    long long start_time, startup_time, session_time;
+    pnm_image pnm;
+
+    VPRINT("========== Application : canny_edge ==========\n");
+
+    if (dspExecutable == NULL || strImages == NULL || numImages < 1) {
+        fprintf(stderr, "ERROR! Invalid arguments specified for canny_edge application\n");
+        return;
+    }
+
+    /*
+     *  The context is made for the largest image of the session
+     */
+    rows = (int *)malloc(sizeof(int) * numImages);
+    cols = (int *)malloc(sizeof(int) * numImages);
+    maxvals = (int *)malloc(sizeof(int) * numImages);
+    if (rows == NULL || cols == NULL || maxvals == NULL) {
+        fprintf(stderr, "Error allocating the image sizes.\n");
+        free(rows);
+        free(cols);
+        free(maxvals);
+        return;
+    }
+    for (i = 0; i < numImages; i++) {
+        /* Only the header is read, the raster is not touched. Color images are 8-bit only */
+        if (!map_pnm_image(strImages[i], &pnm) || (pnm.channels != 1 && pnm.maxval > 255)) {
+            fprintf(stderr, "Error reading the input image, %s.\n", strImages[i]);
+            unmap_pnm_image(&pnm);
+            free(rows);
+            free(cols);
+            free(maxvals);
+            return;
+        }
+        rows[i] = pnm.rows;
+        cols[i] = pnm.cols;
+        maxvals[i] = pnm.maxval;
+        unmap_pnm_image(&pnm);
+        max_rows = (rows[i] > max_rows) ? rows[i] : max_rows;
+        max_cols = (cols[i] > max_cols) ? cols[i] : max_cols;
+    }
+
+    canny_edge_DefaultConfig(&config);
+    config.dspExecutable = dspExecutable;
+    config.gaussianPerc = gaussianPerc;
+    config.derivativePerc = derivativePerc;
+    config.magnitudePerc = magnitudePerc;
+    config.backends = backends;
+    start_time = get_usec();
+    status = canny_edge_Create(&ctx, &config, max_rows, max_cols);
+    startup_time = get_usec() - start_time;
+    if (DSP_SUCCEEDED(status)) {
+        /* On stderr, the timings on stdout stay one line per image */
+        fprintf(stderr, "Backends: %s\n", canny_edge_Backends(ctx));
+    }
+    if (numImages > 1 || VERBOSE) {
+        printf("Startup (DSP load, pools, handshake) took %lld us.\n", startup_time);
+    }
+
+    memset(&session, 0, sizeof(canny_session));
+    session.strImages = strImages;
+    session.depth = config.pipelineDepth;
+    session.ctx = ctx;
+    session.start_time = (long long *)malloc(sizeof(long long) * session.depth);
+    if (session.start_time == NULL) {
+        fprintf(stderr, "Error allocating the session.\n");
+        status = DSP_EFAIL;
+    }
+
+    /*
+     *  Pipeline every run of 8-bit images with the same size, 16-bit images
+     *  run one at a time
+     */
+    start_time = get_usec();
+    for (i = 0; i < numImages && DSP_SUCCEEDED(status); i += run) {
+        for (run = 1; i + run < numImages && maxvals[i] <= 255; run++) {
+            if (rows[i + run] != rows[i] || cols[i + run] != cols[i] || maxvals[i + run] > 255) {
+                break;
+            }
+        }
+
+        session.first = i;
+        session.rows = rows[i];
+        session.cols = cols[i];
+        status = canny_edge_SetSize(ctx, rows[i], cols[i]);
+        if (DSP_SUCCEEDED(status) && maxvals[i] > 255) {
+            status = canny_edge_SessionImage16(&session, i);
+        } else if (DSP_SUCCEEDED(status)) {
+            status = canny_edge_ExecuteFrames(ctx, canny_edge_SessionSource, canny_edge_SessionSink, &session,
+                                              run, EDGE_CHAINS);
+        }
+    }
+    session_time = get_usec() - start_time;
+
+    if (numImages > 1 && session.done > 0) {
+        printf("Session of %d images: %lld us latency per image, %.2f images/s with %d in flight, "
+               "after the startup of %lld us.\n", session.done, session.latency / session.done,
+               session.done * 1000000.0 / session_time, session.depth, startup_time);
+    }
+    if ((numImages > 1 || VERBOSE) && ctx != NULL && ctx->dsp) {
+        /* The time the side that finished a stage first waited, the tail of the frame */
+        printf("GPP/DSP finish gap with %s (mean/max us):", (ctx->tile_rows > 0) ? "tiles" : "the split");
+        for (i = 0; i < STAGE_NUM; i++) {
+            if (ctx->skew_frames[i] > 0) {
+                printf(" %s %lld/%lld", (i == STAGE_GAUSSIAN) ? "gaussian" : (i == STAGE_DERIVATIVE) ?
+                       "derivative" : "magnitude", ctx->skew_usec[i] / ctx->skew_frames[i], ctx->skew_max[i]);
+            }
+        }
+        printf("\n");
+    }
+
+    canny_edge_Delete(ctx);
+    free(session.start_time);
+    free(rows);
+    free(cols);
+    free(maxvals);
+
+    VPRINT("====================================================\n");
+}
+
+/* The stages of an image in the batch of canny_edge_Batch */
+enum {
+    BATCH_QUEUED,                   ///< Not read yet
+    BATCH_READING,
+    BATCH_READ,                     ///< Read ahead, waiting for a context
+    BATCH_COMPUTING,
+    BATCH_COMPUTED,                 ///< The edges wait for the writer
+    BATCH_WRITING,
+    BATCH_DONE
+};
+
+/* An image of the batch */
+typedef struct canny_batch_job {
+    Char8 *strImage;                ///< The image file
+    dev_t dev;                      ///< The device and inode of the file, an image listed twice runs once
+    ino_t ino;
+    int state;                      ///< BATCH_* stage the image is in
+    Bool failed;                    ///< A stage failed, the later ones skip the image
+    int rows, cols, maxval;         ///< From the header
+    int channels;                   ///< 1 for PGM, 3 for PPM
+    unsigned char *image;           ///< The image when maxval <= 255
+    unsigned short int *image16;    ///< The image when maxval > 255
+    pnm_image rgb;                  ///< The mapped PPM, its luminance goes straight into the context
+    unsigned char *edge;            ///< The edge image
+    edge_chains chains;             ///< The edge chains (EDGE_CHAINS)
+    long long start_time;           ///< When the read started, in ns
+    long long latency;              ///< From the start of the read to the end of the write, in ns
+} canny_batch_job;
+
+/* The batch shared by the workers of canny_edge_Batch, in lock */
+typedef struct canny_batch {
+    canny_batch_job *jobs;          ///< The images, read in order
+    int numJobs;
+    int next_read;                  ///< Next image to read
+    int first_open;                 ///< First image that is not written yet
+    int ahead;                      ///< Images read or being read and not computed yet
+    int done;                       ///< Images written or failed
+    canny_ctx **ctxs;               ///< The contexts, the first one has the DSP
+    Bool *ctx_busy;                 ///< The context computes an image
+    int numCtxs;
+    long long stage_time[3];        ///< Summed time of the read, compute and write stages, in ns
+    pthread_mutex_t lock;
+    pthread_cond_t cond;            ///< Signalled when an image moves to the next stage
+} canny_batch;
+
+/* Compare two image names for qsort */
+STATIC int canny_edge_CompareName(const void *a, const void *b)
+{
+    return strcmp(*(Char8 * const *)a, *(Char8 * const *)b);
+}
+
+/* The PGM and PPM images of a directory, sorted by name, without the outputs
+ * of earlier runs. Returns the amount of images, -1 when the directory can not
+ * be read. */
+STATIC int canny_edge_ListImages(Char8 *strDir, Char8 ***strImages)
+{
+    DIR *dir;
+    struct dirent *entry;
+    Char8 **list = NULL, **grown;
+    int num = 0, max = 0;
+    size_t len;
+
+    if ((dir = opendir(strDir)) == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        len = strlen(entry->d_name);
+        if (len < 4 || (strcmp(entry->d_name + len - 4, ".pgm") != 0 && strcmp(entry->d_name + len - 4, ".ppm") != 0) ||
+            (len >= 8 && strcmp(entry->d_name + len - 8, "_out.pgm") == 0)) {
+            continue;
+        }
+        if (num == max) {
+            max = (max == 0) ? 64 : 2 * max;
+            if ((grown = (Char8 **)realloc(list, max * sizeof(Char8 *))) == NULL) {
+                break;
+            }
+            list = grown;
+        }
+        if ((list[num] = (Char8 *)malloc(strlen(strDir) + len + 2)) == NULL) {
+            break;
+        }
+        sprintf(list[num++], "%s/%s", strDir, entry->d_name);
+    }
+    closedir(dir);
+
+    qsort(list, num, sizeof(Char8 *), canny_edge_CompareName);
+    *strImages = list;
+    return num;
+}
+
+/* Reader stage: the image from its file into memory, a PPM is only mapped */
+STATIC Void canny_edge_BatchRead(canny_batch_job *job)
+{
+    int rows, cols, maxval;
+
+    if (job->failed) {
+        return;
+    }
+    VPRINT("Reading the image %s.\n", job->strImage);
+    if (job->channels == 3) {
+        /* The pages are read by the kernel while the image waits for a context */
+        job->failed = !map_pnm_image(job->strImage, &job->rgb) || job->rgb.channels != 3 || job->rgb.maxval > 255;
+        if (!job->failed) {
+            madvise(job->rgb.base, job->rgb.length, MADV_WILLNEED);
+        }
+        rows = job->rgb.rows;
+        cols = job->rgb.cols;
+    } else if (job->maxval > 255) {
+        job->failed = !read_pgm_image16(job->strImage, &job->image16, &rows, &cols, &maxval);
+    } else {
+        job->failed = !read_pgm_image(job->strImage, &job->image, &rows, &cols);
+    }
+    if (job->failed) {
+        fprintf(stderr, "Error reading the input image, %s.\n", job->strImage);
+    } else if (rows != job->rows || cols != job->cols) {
+        fprintf(stderr, "The image %s changed during the batch.\n", job->strImage);
+        job->failed = TRUE;
+    }
+}
+
+/* Compute stage: the edges of the image with a context of its own */
+STATIC Void canny_edge_BatchCompute(canny_ctx *ctx, canny_batch_job *job)
+{
+    canny_request request;
+    DSP_STATUS status;
+
+    if (!job->failed) {
+        job->edge = (unsigned char *)malloc(sizeof(unsigned char) * job->rows * job->cols);
+        status = (job->edge == NULL) ? DSP_EFAIL : canny_edge_SetSize(ctx, job->rows, job->cols);
+        if (DSP_SUCCEEDED(status) && job->image16 != NULL) {
+            status = canny_edge_Submit16(ctx, job->image16, job->maxval, &request);
+            if (DSP_SUCCEEDED(status)) {
+                status = canny_edge_Wait(ctx, &request, job->edge, EDGE_CHAINS ? &job->chains : NULL);
+            }
+        } else if (DSP_SUCCEEDED(status) && job->rgb.base != NULL) {
+            status = canny_edge_SubmitRgb(ctx, job->rgb.raster, &request);
+            if (DSP_SUCCEEDED(status)) {
+                status = canny_edge_Wait(ctx, &request, job->edge, EDGE_CHAINS ? &job->chains : NULL);
+            }
+        } else if (DSP_SUCCEEDED(status)) {
+            status = canny_edge_Execute(ctx, job->image, job->edge, EDGE_CHAINS ? &job->chains : NULL);
+        }
+        if (DSP_FAILED(status)) {
+            fprintf(stderr, "Error computing the edges of %s.\n", job->strImage);
+            job->failed = TRUE;
+        }
+    }
+    free(job->image);
+    free(job->image16);
+    unmap_pnm_image(&job->rgb);
+    job->image = NULL;
+    job->image16 = NULL;
+}
+
+/* Writer stage: the edge image (or chains) next to the image */
+STATIC Void canny_edge_BatchWrite(canny_batch_job *job)
+{
+    char outfilename[PATH_MAX + 16];
+
+    if (!job->failed && EDGE_CHAINS) {
+        sprintf(outfilename, "%s_chains.txt", job->strImage);
+        if (write_edge_chains(outfilename, &job->chains) == 0) {
+            fprintf(stderr, "Error writing the edge chains, %s.\n", outfilename);
+        }
+    } else if (!job->failed) {
+        sprintf(outfilename, "%s_out.pgm", job->strImage);
+        if (write_pgm_image(outfilename, job->edge, job->rows, job->cols, "", 255) == 0) {
+            fprintf(stderr, "Error writing the edge image, %s.\n", outfilename);
+        }
+    }
+    free(job->edge);
+    job->edge = NULL;
+    free_edge_chains(&job->chains);
+}
+
+/* A worker of the batch. It takes the most advanced stage that has work:
+ * writing an image, computing one when a context is free, or reading the
+ * next one while fewer than BATCH_READAHEAD wait for a context. So the
+ * images in memory stay bounded and the reads overlap the compute. */
+STATIC void *canny_edge_BatchWorker(void *arg)
+{
+    canny_batch *batch = (canny_batch *)arg;
+    canny_batch_job *job;
+    long long start, end;
+    int i, c;
+
+    pthread_mutex_lock(&batch->lock);
+    while (batch->done < batch->numJobs) {
+        /* Write */
+        for (i = batch->first_open; i < batch->next_read && batch->jobs[i].state != BATCH_COMPUTED; i++);
+        if (i < batch->next_read) {
+            job = &batch->jobs[i];
+            job->state = BATCH_WRITING;
+            pthread_mutex_unlock(&batch->lock);
+            start = get_nsec();
+            canny_edge_BatchWrite(job);
+            end = get_nsec();
+            job->latency = end - job->start_time;
+            pthread_mutex_lock(&batch->lock);
+            batch->stage_time[2] += end - start;
+            job->state = BATCH_DONE;
+            batch->done++;
+            while (batch->first_open < batch->numJobs && batch->jobs[batch->first_open].state == BATCH_DONE) {
+                batch->first_open++;
+            }
+            pthread_cond_broadcast(&batch->cond);
+            continue;
+        }
+
+        /* Compute */
+        for (c = 0; c < batch->numCtxs && batch->ctx_busy[c]; c++);
+        for (i = batch->first_open; i < batch->next_read && batch->jobs[i].state != BATCH_READ; i++);
+        if (c < batch->numCtxs && i < batch->next_read) {
+            job = &batch->jobs[i];
+            job->state = BATCH_COMPUTING;
+            batch->ctx_busy[c] = TRUE;
+            pthread_mutex_unlock(&batch->lock);
+            start = get_nsec();
+            canny_edge_BatchCompute(batch->ctxs[c], job);
+            end = get_nsec();
+            pthread_mutex_lock(&batch->lock);
+            batch->stage_time[1] += end - start;
+            batch->ctx_busy[c] = FALSE;
+            batch->ahead--;
+            job->state = BATCH_COMPUTED;
+            pthread_cond_broadcast(&batch->cond);
+            continue;
+        }
+
+        /* Read ahead */
+        if (batch->next_read < batch->numJobs && batch->ahead < BATCH_READAHEAD) {
+            job = &batch->jobs[batch->next_read++];
+            job->state = BATCH_READING;
+            batch->ahead++;
+            pthread_mutex_unlock(&batch->lock);
+            job->start_time = get_nsec();
+            canny_edge_BatchRead(job);
+            end = get_nsec();
+            pthread_mutex_lock(&batch->lock);
+            batch->stage_time[0] += end - job->start_time;
+            job->state = BATCH_READ;
+            pthread_cond_broadcast(&batch->cond);
+            continue;
+        }
+
+        pthread_cond_wait(&batch->cond, &batch->lock);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+/** ============================================================================
+ *  @func   canny_edge_Batch
+ *
+ *  @desc   Run the canny edge detector over a directory or list of images
+ *          on a pool of worker threads. Every worker reads, computes or
+ *          writes, the next images are read ahead while the earlier ones are
+ *          computed. The first context has the DSP, the others are GPP only.
+ *          Prints the images per second and the latency percentiles.
+ *
+ *  @modif  None
+ *  ============================================================================
+ */
+NORMAL_API DSP_STATUS canny_edge_Batch(IN Char8 *dspExecutable, IN Char8 **strImages, IN int numImages,
+                                       IN Char8 *backends)
+{
+    DSP_STATUS status = DSP_SOK;
+    canny_config config;
+    canny_batch batch;
+    pthread_t threads[BATCH_WORKERS_MAX];
+    Char8 **list = NULL, *spec;
+    long long start_time, batch_time, p[4], *latencies = NULL;
+    canny_batch_job *job;
+    int i, j, listed = 0, workers = BATCH_WORKERS, started = 0, failed = 0, max_rows = 0, max_cols = 0;
+    pnm_image pnm;
+    struct stat st;
+    char text[64];
+
+    if (numImages == 1 && stat(strImages[0], &st) == 0 && S_ISDIR(st.st_mode)) {
+        if ((numImages = canny_edge_ListImages(strImages[0], &list)) < 0) {
+            fprintf(stderr, "Error reading the directory %s.\n", strImages[0]);
+            return DSP_EFAIL;
+        }
+        strImages = list;
+        listed = numImages;
     }
-
-
-    /* Free the canny edge image */
-    free(canny_edge_image);
-
-    /*
-     *  Stop execution on DSP.
-     */
-    status = PROC_stop(processorId) ;
-    if (DSP_FAILED(status)) {
-        fprintf(stderr, "PROC_stop () failed. Status = [0x%x]\n", (int)status);
+    if (numImages < 1) {
+        fprintf(stderr, "No images in the batch.\n");
+        free(list);
+        return DSP_EFAIL;
     }
-
-    /*
-     *  Unregister for notification of event registered earlier.
-     */
-    status = NOTIFY_unregister(processorId,
-                               canny_edge_IPS_ID,
-                               canny_edge_IPS_EVENTNO,
-                               (FnNotifyCbck) canny_edge_Notify,
-                               0/* vladms canny_edge_SemPtr*/) ;
-    if (DSP_FAILED(status)) {
-        fprintf(stderr, "NOTIFY_unregister () failed Status = [0x%x]\n", (int)status);
+    if ((spec = getenv("CANNY_BATCH_WORKERS")) != NULL) {
+        workers = atoi(spec);
+    }
+    workers = (workers < 2) ? 2 : (workers > BATCH_WORKERS_MAX) ? BATCH_WORKERS_MAX : workers;
+
+    memset(&batch, 0, sizeof(canny_batch));
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.cond, NULL);
+    batch.numCtxs = workers - 1;
+    batch.jobs = (canny_batch_job *)calloc(numImages, sizeof(canny_batch_job));
+    batch.ctxs = (canny_ctx **)calloc(batch.numCtxs, sizeof(canny_ctx *));
+    batch.ctx_busy = (Bool *)calloc(batch.numCtxs, sizeof(Bool));
+    latencies = (long long *)malloc(numImages * sizeof(long long));
+    if (batch.jobs == NULL || batch.ctxs == NULL || batch.ctx_busy == NULL || latencies == NULL) {
+        fprintf(stderr, "Error allocating the batch.\n");
+        status = DSP_EFAIL;
     }
 
     /*
-     *  Free the memory allocated for the data buffer.
+     *  The headers give the size of the contexts, the rasters are read by the
+     *  workers. An image that can not be read is skipped by the stages. The
+     *  same file twice would have two writers of its edge image at once.
      */
-    for (i = 0; i < NUM_BUF_SIZES; i++) {
-        for (j = 0; j < pool_sizes[i]; j++) {
-            status = POOL_free(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                               (Void *) buffers[i][j],
-                               buffer_sizes[i]) ;
-            if (DSP_FAILED(status)) {
-                fprintf(stderr, "POOL_free () DataBuf failed. Status = [0x%x]\n", (int)status);
+    for (i = 0; i < numImages && DSP_SUCCEEDED(status); i++) {
+        job = &batch.jobs[batch.numJobs];
+        job->strImage = strImages[i];
+        if (stat(strImages[i], &st) == 0) {
+            job->dev = st.st_dev;
+            job->ino = st.st_ino;
+            for (j = 0; j < batch.numJobs && (batch.jobs[j].dev != st.st_dev || batch.jobs[j].ino != st.st_ino); j++);
+            if (j < batch.numJobs) {
+                fprintf(stderr, "The image %s is in the batch more than once, it is run once.\n", strImages[i]);
+                continue;
             }
         }
+        batch.numJobs++;
+        if (!map_pnm_image(strImages[i], &pnm) || (pnm.channels != 1 && pnm.maxval > 255)) {
+            fprintf(stderr, "Error reading the input image, %s.\n", strImages[i]);
+            job->failed = TRUE;
+        }
+        job->channels = pnm.channels;
+        job->rows = pnm.rows;
+        job->cols = pnm.cols;
+        job->maxval = pnm.maxval;
+        max_rows = (pnm.rows > max_rows) ? pnm.rows : max_rows;
+        max_cols = (pnm.cols > max_cols) ? pnm.cols : max_cols;
+        unmap_pnm_image(&pnm);
+    }
+    if (DSP_SUCCEEDED(status) && max_rows == 0) {
+        fprintf(stderr, "None of the images can be read.\n");
+        status = DSP_EFAIL;
     }
 
     /*
-     *  Close the pool
+     *  One context per compute worker, only the first one can have the DSP
      */
-    status = POOL_close(POOL_makePoolId(processorId, SAMPLE_POOL_ID)) ;
-    if (DSP_FAILED(status)) {
-        fprintf(stderr, "POOL_close () failed. Status = [0x%x]\n", (int)status);
+    canny_edge_DefaultConfig(&config);
+    config.gaussianPerc = config.derivativePerc = config.magnitudePerc = CANNY_PERC_AUTO;
+    config.backends = backends;
+    config.pipelineDepth = 1;
+    for (i = 0; i < batch.numCtxs && DSP_SUCCEEDED(status); i++) {
+        config.dspExecutable = (i == 0) ? dspExecutable : NULL;
+        status = canny_edge_Create(&batch.ctxs[i], &config, max_rows, max_cols);
+    }
+    if (DSP_SUCCEEDED(status)) {
+        fprintf(stderr, "Backends: %s (DSP context), %d GPP contexts\n", canny_edge_Backends(batch.ctxs[0]),
+                batch.numCtxs - 1);
     }
 
     /*
-     *  Detach from the processor
+     *  The workers run until every image is written
      */
-    status = PROC_detach(processorId) ;
-    if (DSP_FAILED(status)) {
-        fprintf(stderr, "PROC_detach () failed. Status = [0x%x]\n", (int)status);
+    start_time = get_nsec();
+    for (started = 0; started < workers && DSP_SUCCEEDED(status); started++) {
+        if (pthread_create(&threads[started], NULL, canny_edge_BatchWorker, &batch) != 0) {
+            fprintf(stderr, "Error starting the batch workers.\n");
+            status = DSP_EFAIL;
+            break;
+        }
+    }
+    if (DSP_FAILED(status) && started > 0) {
+        /* The started workers finish the batch on their own */
+        status = DSP_SOK;
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    batch_time = get_nsec() - start_time;
+
+    if (started > 0) {
+        /* The failed images are left out of the rate and the latencies */
+        numImages = batch.numJobs;
+        for (i = 0; i < numImages; i++) {
+            if (batch.jobs[i].failed) {
+                failed++;
+            } else {
+                latencies[i - failed] = batch.jobs[i].latency;
+            }
+        }
+        printf("Batch of %d images (%d failed) with %d workers and %d contexts: %.2f images/s\n", numImages,
+               failed, started, batch.numCtxs, (numImages - failed) * 1e9 / batch_time);
+        if (failed < numImages) {
+            canny_edge_Percentiles(latencies, numImages - failed, p);
+            printf("Latency per image (p50/p90/p99/max us): %s\n", canny_edge_FormatPercentiles(p, text));
+            printf("Mean per image (read/compute/write us): %.1f/%.1f/%.1f\n",
+                   batch.stage_time[0] / 1e3 / (numImages - failed), batch.stage_time[1] / 1e3 / (numImages - failed),
+                   batch.stage_time[2] / 1e3 / (numImages - failed));
+        }
+        status = (failed > 0) ? DSP_EFAIL : DSP_SOK;
     }
 
-    /*
-     *  Destroy the PROC object.
-     */
-    status = PROC_destroy() ;
-    if (DSP_FAILED(status)) {
-        fprintf(stderr, "PROC_destroy () failed. Status = [0x%x]\n", (int)status);
+    for (i = 0; i < batch.numCtxs && batch.ctxs != NULL; i++) {
+        canny_edge_Delete(batch.ctxs[i]);
+    }
+    pthread_cond_destroy(&batch.cond);
+    pthread_mutex_destroy(&batch.lock);
+    free(batch.jobs);
+    free(batch.ctxs);
+    free(batch.ctx_busy);
+    free(latencies);
+    for (i = 0; i < listed; i++) {
+        free(list[i]);
     }
+    free(list);
+    return status;
+}
 
-    VPRINT("Leaving canny_edge_Delete ()\n");
+/* A stage being tuned by canny_edge_Autotune, handed to the cost function */
+typedef struct canny_tune {
+    canny_ctx *ctx;                 ///< The context, with the DSP loaded
+    int stage;                      ///< The stage whose split is probed
+    unsigned char *image;           ///< The image that is timed
+    unsigned char *edge;            ///< The edge image
+    int reps;                       ///< Timed repetitions per probe
+    int probes;                     ///< Probes done
+} canny_tune;
+
+/* Sort the times of the repetitions of a probe */
+STATIC int canny_edge_CompareTime(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Print the percentiles of canny_edge_Percentiles in ns as us into text */
+STATIC char *canny_edge_FormatPercentiles(long long *p, char *text)
+{
+    sprintf(text, "%6.1f/%6.1f/%6.1f/%6.1f", p[0] / 1e3, p[1] / 1e3, p[2] / 1e3, p[3] / 1e3);
+    return text;
 }
 
+/* Sort n times and take the median, the 90th and 99th percentile and the maximum into p */
+STATIC Void canny_edge_Percentiles(long long *times, int n, long long *p)
+{
+    qsort(times, n, sizeof(long long), canny_edge_CompareTime);
+    p[0] = times[(n - 1) * 50 / 100];
+    p[1] = times[(n - 1) * 90 / 100];
+    p[2] = times[(n - 1) * 99 / 100];
+    p[3] = times[n - 1];
+}
+
+/* Cost of a split of the stage being tuned: the median frame time over the
+ * repetitions, after one untimed frame that settles the caches */
+STATIC double canny_edge_TuneCost(void *arg, int perc)
+{
+    canny_tune *tune = (canny_tune *)arg;
+    long long times[TUNE_REPS_MAX], start;
+    int i;
+
+    tune->ctx->perc[tune->stage] = perc;
+    canny_edge_Execute(tune->ctx, tune->image, tune->edge, NULL);
+    for (i = 0; i < tune->reps; i++) {
+        start = get_usec();
+        canny_edge_Execute(tune->ctx, tune->image, tune->edge, NULL);
+        times[i] = get_usec() - start;
+    }
+    qsort(times, tune->reps, sizeof(long long), canny_edge_CompareTime);
+    tune->probes++;
+    VPRINT("  Probe %d%% on the GPP: %lld us\n", perc, times[tune->reps / 2]);
+    return (double)times[tune->reps / 2];
+}
 
 /** ============================================================================
- *  @func   canny_edge_Main
+ *  @func   canny_edge_Autotune
  *
- *  @desc   Entry point for the application
+ *  @desc   This function searches the split of every stage with the DSP for
+ *          an image and stores it in the profile file, where the stages with
+ *          an "auto" percentage start from. The stages are tuned jointly: a
+ *          golden-section search per stage with the others at their best
+ *          split so far, in rounds until no stage moves to a faster
+ *          split.
  *
  *  @modif  None
  *  ============================================================================
  */
-NORMAL_API Void canny_edge_Main(IN Char8 *dspExecutable, IN Char8 *strImage)
+NORMAL_API DSP_STATUS canny_edge_Autotune(IN Char8 *dspExecutable, IN Char8 *strImage, IN int reps,
+                                          IN Char8 *backends)
 {
-    DSP_STATUS status       = DSP_SOK ;
-
-    VPRINT("========== Application : canny_edge ==========\n");
+    DSP_STATUS status = DSP_SOK;
+    canny_config config;
+    canny_ctx *ctx = NULL;
+    canny_tune tune;
+    int rows, cols, round, rounds, stage, perc, moved;
+    double cost = 0.0, best_cost[STAGE_NUM], frame_cost = 0.0;
+    static const char *names[STAGE_NUM] = { "gaussian", "derivative", "magnitude" };
+
+    memset(&tune, 0, sizeof(canny_tune));
+    if (reps == 0) {
+        reps = TUNE_REPS;
+    }
+    if (reps < 1 || reps > TUNE_REPS_MAX) {
+        fprintf(stderr, "Repetitions %d is not in 1 to %d.\n", reps, TUNE_REPS_MAX);
+        return DSP_EFAIL;
+    }
+    if (read_pgm_image(strImage, &tune.image, &rows, &cols) == 0) {
+        fprintf(stderr, "Error reading the input image, %s.\n", strImage);
+        return DSP_EFAIL;
+    }
 
-    if (dspExecutable != NULL && strImage != NULL) {
-        /*
-         *  Specify the dsp executable file name and the buffer size for
-         *  canny_edge creation phase.
-         */
-        status = canny_edge_Create(dspExecutable, strImage, ID_PROCESSOR);
+    /* Fixed percentages, the tuner sets them itself */
+    canny_edge_DefaultConfig(&config);
+    config.dspExecutable = dspExecutable;
+    config.gaussianPerc = config.derivativePerc = config.magnitudePerc = BALANCE_START;
+    config.backends = backends;
+    status = canny_edge_Create(&ctx, &config, rows, cols);
+    if (DSP_SUCCEEDED(status) && (tune.edge = (unsigned char *)malloc(rows * cols)) == NULL) {
+        fprintf(stderr, "Error allocating the edge image.\n");
+        status = DSP_EFAIL;
+    }
+    if (DSP_SUCCEEDED(status)) {
+        fprintf(stderr, "Backends: %s\n", canny_edge_Backends(ctx));
+        tune.ctx = ctx;
+        tune.reps = reps;
+
+        /* One stage alone has no others to move, a single search suffices */
+        for (stage = 0, rounds = 0; stage < STAGE_NUM; stage++) {
+            best_cost[stage] = -1.0;
+            rounds += (ctx->backends.dsp[stage] && !canny_edge_Chained(ctx, stage));
+        }
+        rounds = (rounds > 1) ? TUNE_ROUNDS : 1;
+
+        /* A stage keeps its best split over the rounds, it only moves when the frame gets faster */
+        for (round = 0, moved = 1; round < rounds && moved; round++) {
+            moved = 0;
+            for (stage = 0; stage < STAGE_NUM; stage++) {
+                if (!ctx->backends.dsp[stage] || canny_edge_Chained(ctx, stage)) {
+                    continue;
+                }
+                tune.stage = stage;
+                perc = ctx->perc[stage];
+                ctx->perc[stage] = tune_golden(BALANCE_MIN, BALANCE_MAX, canny_edge_TuneCost, &tune, &cost);
+                if (best_cost[stage] < 0.0 || cost < best_cost[stage]) {
+                    moved |= (ctx->perc[stage] != perc);
+                    best_cost[stage] = frame_cost = cost;
+                } else {
+                    ctx->perc[stage] = perc;
+                }
+                printf("Round %d, %s: %d%% on the GPP, %.0f us per frame.\n", round + 1, names[stage],
+                       ctx->perc[stage], best_cost[stage]);
+            }
+        }
 
-        if (DSP_SUCCEEDED(status)) {
-            status = canny_edge_Execute(ID_PROCESSOR, strImage);
+        for (stage = 0; stage < STAGE_NUM; stage++) {
+            if (canny_edge_Chained(ctx, stage)) {
+                ctx->perc[stage] = ctx->perc[STAGE_GAUSSIAN];
+            }
+        }
+        if (profile_save(ctx->profile, rows, cols, ctx->perc, STAGE_NUM) == 0) {
+            status = DSP_EFAIL;
         }
+        printf("Tuned %s (%d x %d) with %d probes: %d, %d, %d, %.0f us per frame, stored in %s.\n", strImage,
+               cols, rows, tune.probes, ctx->perc[STAGE_GAUSSIAN], ctx->perc[STAGE_DERIVATIVE],
+               ctx->perc[STAGE_MAGNITUDE], frame_cost, ctx->profile);
+    }
 
-        canny_edge_Delete(ID_PROCESSOR);
-    } else {
-        fprintf(stderr, "ERROR! Invalid arguments specified for canny_edge application\n");
+    canny_edge_Delete(ctx);
+    free(tune.image);
+    free(tune.edge);
+    return status;
+}
+
+/** ============================================================================
+ *  @func   canny_edge_IpcBench
+ *
+ *  @desc   This function measures the cost of handing work to the DSP on
+ *          the buffers of an image: the round trip of a command that does
+ *          nothing, the writeback and invalidate of the pool per size, and
+ *          the round trip of a command that takes over a number of image
+ *          rows and gives them back (writeback, command, invalidate). Every
+ *          measurement is repeated and printed as percentiles.
+ *
+ *  @modif  None
+ *  ============================================================================
+ */
+NORMAL_API DSP_STATUS canny_edge_IpcBench(IN Char8 *dspExecutable, IN Char8 *strImage, IN int iterations)
+{
+    DSP_STATUS status = DSP_SOK;
+    canny_config config;
+    canny_ctx *ctx = NULL;
+    unsigned char *image = NULL;
+    long long *times = NULL, *extra = NULL, start, ping[4], wb[4], inv[4], offload[4], extra_p[4];
+    char text[3][48];
+    int rows, cols, i, band, bytes;
+    Uint32 pool;
+
+    if (iterations == 0) {
+        iterations = IPC_ITERATIONS;
     }
+    if (iterations < 1 || iterations > IPC_ITERATIONS_MAX) {
+        fprintf(stderr, "Iterations %d is not in 1 to %d.\n", iterations, IPC_ITERATIONS_MAX);
+        return DSP_EFAIL;
+    }
+    if (read_pgm_image(strImage, &image, &rows, &cols) == 0) {
+        fprintf(stderr, "Error reading the input image, %s.\n", strImage);
+        return DSP_EFAIL;
+    }
+    free(image);
 
-    VPRINT("====================================================\n");
+    canny_edge_DefaultConfig(&config);
+    config.dspExecutable = dspExecutable;
+    status = canny_edge_Create(&ctx, &config, rows, cols);
+    if (DSP_SUCCEEDED(status) && (times = (long long *)malloc(2 * iterations * sizeof(long long))) == NULL) {
+        fprintf(stderr, "Error allocating the times.\n");
+        status = DSP_EFAIL;
+    }
+    if (DSP_SUCCEEDED(status)) {
+        extra = times + iterations;
+        image = (unsigned char *)ctx->buffers[0][0];
+        pool = POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID);
+        printf("IPC of %s (%d x %d), %d iterations, us as p50/p90/p99/max:\n", strImage, cols, rows, iterations);
+
+        /* The round trip of a command without rows */
+        for (i = 0; i < iterations && DSP_SUCCEEDED(status); i++) {
+            start = get_nsec();
+            status = canny_edge_WaitSeq(ctx, canny_edge_SendRows(ctx, canny_edge_PING, 0, 0, 0));
+            times[i] = get_nsec() - start;
+        }
+    }
+    if (DSP_SUCCEEDED(status)) {
+        canny_edge_Percentiles(times, iterations, ping);
+        printf("Command round trip: %.1f/%.1f/%.1f/%.1f us\n", ping[0] / 1e3, ping[1] / 1e3, ping[2] / 1e3,
+               ping[3] / 1e3);
+
+        /* Bands of rows doubling up to the image, the rows are written before
+         * every writeback so the cache has them dirty like a stage would */
+        printf("%10s %27s %9s %27s %9s %27s %9s\n", "Bytes", "Writeback", "MB/s", "Invalidate", "MB/s",
+               "Offload", "us/KB");
+        for (band = 1; ; band = (band * 2 < rows) ? band * 2 : rows) {
+            bytes = band * cols;
+            for (i = 0; i < iterations; i++) {
+                memset(image, i, bytes);
+                start = get_nsec();
+                POOL_writeback(pool, image, bytes);
+                times[i] = get_nsec() - start;
+            }
+            canny_edge_Percentiles(times, iterations, wb);
+            for (i = 0; i < iterations; i++) {
+                start = get_nsec();
+                POOL_invalidate(pool, image, bytes);
+                times[i] = get_nsec() - start;
+            }
+            canny_edge_Percentiles(times, iterations, inv);
+            /* Every offload follows an empty command, the cost beyond it is
+             * taken per iteration so the two medians are not mixed up */
+            for (i = 0; i < iterations && DSP_SUCCEEDED(status); i++) {
+                memset(image, i, bytes);
+                start = get_nsec();
+                status = canny_edge_WaitSeq(ctx, canny_edge_SendRows(ctx, canny_edge_PING, 0, 0, 0));
+                extra[i] = get_nsec() - start;
+                start = get_nsec();
+                canny_edge_WritebackRows(ctx, image, sizeof(unsigned char), 0, band);
+                if (DSP_SUCCEEDED(status)) {
+                    status = canny_edge_WaitSeq(ctx, canny_edge_SendRows(ctx, canny_edge_PING, 0, 0, band));
+                }
+                canny_edge_InvalidateRows(ctx, image, sizeof(unsigned char), 0, band);
+                times[i] = get_nsec() - start;
+                extra[i] = (times[i] > extra[i]) ? times[i] - extra[i] : 0;
+            }
+            if (DSP_FAILED(status)) {
+                break;
+            }
+            canny_edge_Percentiles(times, iterations, offload);
+            canny_edge_Percentiles(extra, iterations, extra_p);
+
+            /* The rate and the cost per KB beyond the empty command are taken at the median */
+            printf("%10d %s %9.1f %s %9.1f %s %9.2f\n", bytes,
+                   canny_edge_FormatPercentiles(wb, text[0]), (double)bytes * 1e3 / (wb[0] > 0 ? wb[0] : 1),
+                   canny_edge_FormatPercentiles(inv, text[1]), (double)bytes * 1e3 / (inv[0] > 0 ? inv[0] : 1),
+                   canny_edge_FormatPercentiles(offload, text[2]), extra_p[0] / 1e3 * 1024 / bytes);
+            if (band == rows) {
+                break;
+            }
+        }
+    }
+
+    canny_edge_Delete(ctx);
+    free(times);
+    return status;
 }
 
 /** ----------------------------------------------------------------------------
@@ -598,51 +2515,244 @@ NORMAL_API Void canny_edge_Main(IN Char8 *dspExecutable, IN Char8 *strImage)
  *
  *  @desc   This function implements the event callback registered with the
  *          NOTIFY component to receive notification indicating that the DSP-
- *          side application has completed its setup phase.
+ *          side application has completed its setup phase. The argument is
+ *          the context that registered the callback.
  *
  *  @modif  None
  *  ----------------------------------------------------------------------------
  */
 STATIC Void canny_edge_Notify(Uint32 eventNo, Pvoid arg, Pvoid info)
 {
-    VPRINT("Notification event: %lu, info: %8d \r\n", eventNo, (int)info);
+    canny_ctx *ctx = (canny_ctx *)arg;
+    Uint32 seq;
+
+    VPRINT("Notification event: %lu, info: %8d \r\n", (unsigned long)eventNo, (int)info);
     /* Post the semaphore for initialization. */
-    if ((int)info == canny_edge_INIT) {
-        sem_post(&sem);
-    } else if ((int)info == canny_edge_WRITEBACK) {
-        sem_post(&sem);
-    } else if ((int)info == canny_edge_GAUSSIAN) {
-        sem_post(&sem);
-    } else if ((int)info == canny_edge_DERIVATIVE) {
-        sem_post(&sem);
-    } else if ((int)info == canny_edge_MAGNITUDE) {
-        sem_post(&sem);
+    if ((Uint32)info == canny_edge_INIT) {
+        sem_post(&ctx->sem);
+        return;
+    }
+
+    /* The payload is the sequence number of the finished command, stamp it for
+     * the balancing, keep the status of it and of the commands finished before
+     * it and wake the waiters, each checks its own command */
+    pthread_mutex_lock(&ctx->ack_lock);
+    POOL_invalidate(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID), ctx->ctrl, canny_edge_CTRL_LINE);
+    for (seq = ctx->dsp_acked + 1; (Int32)((Uint32)info - seq) >= 0; seq++) {
+        ctx->dsp_result[seq % SEQ_RING] = ctx->ctrl->results[seq % canny_edge_CTRL_SLOTS];
     }
+    ctx->dsp_acked = (Uint32)info;
+    ctx->ack_usec[ctx->dsp_acked % SEQ_RING] = get_usec();
+    pthread_cond_broadcast(&ctx->ack_cond);
+    pthread_mutex_unlock(&ctx->ack_lock);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////// DSP ////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 
+/* Send a command on the buffers of frame slot buf to the DSP, the DSP does the
+ * rows the GPP leaves with perc percent */
+STATIC Uint32 canny_edge_Send(canny_ctx *ctx, Uint32 cmd, int buf, int perc)
+{
+    return canny_edge_SendRows(ctx, cmd, buf, 0, canny_edge_DspRows(ctx, perc));
+}
+
+/* Send a command on the rows row_start to row_end of frame slot buf to the
+ * DSP. The command goes into the ring of the control block and the notify only
+ * rings the doorbell. The DSP runs the commands in order, the returned
+ * sequence number is used to wait for it. */
+STATIC Uint32 canny_edge_SendRows(canny_ctx *ctx, Uint32 cmd, int buf, int row_start, int row_end)
+{
+    Uint32 seq = ctx->dsp_sent + 1;
+    canny_edge_Cmd *entry = &ctx->ctrl->cmds[seq % canny_edge_CTRL_SLOTS];
+
+    /* Do not overwrite a command the DSP did not finish */
+    if (seq > canny_edge_CTRL_SLOTS) {
+        canny_edge_WaitSeq(ctx, seq - canny_edge_CTRL_SLOTS);
+    }
+
+    entry->seq = seq;
+    entry->cmd = cmd;
+    entry->buf = buf;
+    entry->row_start = row_start;
+    entry->row_end = row_end;
+    entry->stages = (cmd == canny_edge_CHAIN) ? (ctx->backends.dsp[STAGE_MAGNITUDE] ? 3 : 2) : 0;
+    entry->tile_rows = (cmd >= canny_edge_GAUSSIAN && cmd <= canny_edge_MAGNITUDE) ? ctx->tile_rows : 0;
+
+    /* A tiled command starts from the first tile. The DSP can be taking the
+     * tiles of another slot, the line of the counters is only written in the lock. */
+    if (entry->tile_rows > 0) {
+        MPCS_enter(ctx->tile_lock);
+        POOL_invalidate(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID), ctx->ctrl->tiles, canny_edge_CTRL_LINE);
+        ctx->ctrl->tiles[buf] = 0;
+        POOL_writeback(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID), ctx->ctrl->tiles, canny_edge_CTRL_LINE);
+        MPCS_leave(ctx->tile_lock);
+    }
+    POOL_writeback(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID), entry, sizeof(canny_edge_Cmd));
+    ctx->ctrl->head = seq;
+    POOL_writeback(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID), &ctx->ctrl->head, sizeof(Uint32));
+
+    ctx->send_usec[seq % SEQ_RING] = get_usec();
+    NOTIFY_notify(ctx->processorId, canny_edge_IPS_ID, canny_edge_IPS_EVENTNO, seq);
+    return ctx->dsp_sent = seq;
+}
+
+/* Wait until the DSP finished the command with sequence number seq. The DSP
+ * runs the commands in order, so the ones before it are finished too. The
+ * status of the command is kept for SEQ_RING commands, like its timestamps. */
+STATIC DSP_STATUS canny_edge_WaitSeq(canny_ctx *ctx, Uint32 seq)
+{
+    Int32 result;
+
+    pthread_mutex_lock(&ctx->ack_lock);
+    while ((Int32)(ctx->dsp_acked - seq) < 0) {
+        pthread_cond_wait(&ctx->ack_cond, &ctx->ack_lock);
+    }
+    result = ctx->dsp_result[seq % SEQ_RING];
+    pthread_mutex_unlock(&ctx->ack_lock);
+
+    if (result != 0) {
+        fprintf(stderr, "The DSP failed the command %lu. Status = [0x%x]\n", (unsigned long)seq, (int)result);
+        return DSP_EFAIL;
+    }
+    return DSP_SOK;
+}
+
+#if !FUSED_PIPELINE || DO_WRITEBACK
+/* Wait for a command of the frame in slot buf, a failure fails the frame */
+STATIC Void canny_edge_WaitFrame(canny_ctx *ctx, int buf, Uint32 seq)
+{
+    if (DSP_FAILED(canny_edge_WaitSeq(ctx, seq))) {
+        ctx->slot_failed[buf] = TRUE;
+    }
+}
+#endif
+
+/* Check without blocking if the DSP finished the command with sequence number seq */
+STATIC Bool canny_edge_PollSeq(canny_ctx *ctx, Uint32 seq)
+{
+    Bool done;
+
+    pthread_mutex_lock(&ctx->ack_lock);
+    done = ((Int32)(ctx->dsp_acked - seq) >= 0);
+    pthread_mutex_unlock(&ctx->ack_lock);
+    return done;
+}
+
+#if !FUSED_PIPELINE
+/* Take the next tile of frame slot buf from the counter shared with the DSP */
+STATIC Uint32 canny_edge_Claim(canny_ctx *ctx, int buf)
+{
+    Uint32 tile;
+
+    MPCS_enter(ctx->tile_lock);
+    POOL_invalidate(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID), ctx->ctrl->tiles, canny_edge_CTRL_LINE);
+    tile = ctx->ctrl->tiles[buf]++;
+    POOL_writeback(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID), ctx->ctrl->tiles, canny_edge_CTRL_LINE);
+    MPCS_leave(ctx->tile_lock);
+    return tile;
+}
+#endif
+
+/* The rows the DSP does when the GPP does perc percent, the first ones */
+STATIC int canny_edge_DspRows(canny_ctx *ctx, int perc)
+{
+    return split_row(ctx->rows, ctx->cols, perc);
+}
+
+/* Write back the rows row_start to row_end (bpp bytes per pixel) of a pool
+ * buffer, clipped to the image, only the rows the DSP reads are handed over */
+STATIC Void canny_edge_WritebackRows(canny_ctx *ctx, Void *buffer, int bpp, int row_start, int row_end)
+{
+    if (row_start < 0) {
+        row_start = 0;
+    }
+    if (row_end > ctx->rows) {
+        row_end = ctx->rows;
+    }
+    if (row_end > row_start) {
+        POOL_writeback(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID),
+                       (Uint8 *)buffer + row_start * ctx->cols * bpp, (row_end - row_start) * ctx->cols * bpp);
+    }
+}
+
+/* Invalidate the rows row_start to row_end (bpp bytes per pixel) of a pool
+ * buffer, clipped to the image, only the rows the DSP wrote */
+STATIC Void canny_edge_InvalidateRows(canny_ctx *ctx, Void *buffer, int bpp, int row_start, int row_end)
+{
+    if (row_start < 0) {
+        row_start = 0;
+    }
+    if (row_end > ctx->rows) {
+        row_end = ctx->rows;
+    }
+    if (row_end > row_start) {
+        POOL_invalidate(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID),
+                        (Uint8 *)buffer + row_start * ctx->cols * bpp, (row_end - row_start) * ctx->cols * bpp);
+    }
+}
+
+#if !FUSED_PIPELINE
+/* Balance a stage with the timing of its last frame: the GPP band ran from
+ * gpp_start to gpp_end, the DSP band was command seq. The DSP started it when
+ * it was sent or when the command before it finished, whichever was later. */
+STATIC Void canny_edge_Balance(canny_ctx *ctx, int stage, int perc, long long gpp_start, long long gpp_end,
+                               Uint32 seq)
+{
+    long long dsp_start = ctx->send_usec[seq % SEQ_RING];
+    long long dsp_end = ctx->ack_usec[seq % SEQ_RING];
+
+    canny_edge_Skew(ctx, stage, gpp_end, seq);
+    if (!ctx->balanced[stage]) {
+        return;
+    }
+    if (ctx->ack_usec[(seq - 1) % SEQ_RING] > dsp_start) {
+        dsp_start = ctx->ack_usec[(seq - 1) % SEQ_RING];
+    }
+    ctx->perc[stage] = balance_update(&ctx->balancer[stage], perc, gpp_start, gpp_end, dsp_start, dsp_end);
+    ctx->balance_updates++;
+    VPRINT("  Balanced stage %d: GPP %lld us, DSP %lld us, next %d%%\r\n", stage, gpp_end - gpp_start,
+           dsp_end - dsp_start, ctx->perc[stage]);
+}
+
+/* Account the gap between the end of the GPP part of a stage and the end of
+ * DSP command seq, the time the side that finished first was idle */
+STATIC Void canny_edge_Skew(canny_ctx *ctx, int stage, long long gpp_end, Uint32 seq)
+{
+    long long skew = ctx->ack_usec[seq % SEQ_RING] - gpp_end;
+
+    if (skew < 0) {
+        skew = -skew;
+    }
+    ctx->skew_usec[stage] += skew;
+    ctx->skew_frames[stage]++;
+    if (skew > ctx->skew_max[stage]) {
+        ctx->skew_max[stage] = skew;
+    }
+}
+#endif /* !FUSED_PIPELINE */
+
+#if DO_WRITEBACK
 /* Simple function which transmits the image and expects it back with each pixel +1 */
-STATIC Void canny_edge_Writeback(unsigned char *image, int rows, int cols, Uint8 processorId)
+STATIC Void canny_edge_Writeback(canny_ctx *ctx, int buf, unsigned char *image, unsigned char *original)
 {
+    int rows = ctx->rows, cols = ctx->cols;
 #if VERIFY
     int i, status;
 #endif
 
     /* Send the image */
-    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
+    POOL_writeback(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID),
                    image,
                    sizeof(unsigned char) * rows * cols);
-    NOTIFY_notify(processorId, canny_edge_IPS_ID, canny_edge_IPS_EVENTNO, canny_edge_WRITEBACK);
     VPRINT("  Writeback send, waiting for response...\r\n");
 
     /* Wait for the response */
-    sem_wait(&sem);
+    canny_edge_WaitFrame(ctx, buf, canny_edge_Send(ctx, canny_edge_WRITEBACK, buf, 0));
 
     /* Invalidate the result */
-    POOL_invalidate(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
+    POOL_invalidate(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID),
                     image,
                     sizeof(unsigned char) * rows * cols);
 
@@ -650,9 +2760,8 @@ STATIC Void canny_edge_Writeback(unsigned char *image, int rows, int cols, Uint8
 #if VERIFY
     status = DSP_SOK;
     for (i = 0; i < (rows * cols); i++) {
-        canny_edge_image[i]++;
-        if (image[i] != canny_edge_image[i]) {
-            fprintf(stderr, "Got incorrect image back! Expected %d, Got %d (i: %d)\r\n", canny_edge_image[i], image[i], i);
+        if (image[i] != (unsigned char)(original[i] + 1)) {
+            fprintf(stderr, "Got incorrect image back! Expected %d, Got %d (i: %d)\r\n", (unsigned char)(original[i] + 1), image[i], i);
             status = DSP_EFAIL;
         }
     }
@@ -660,46 +2769,95 @@ STATIC Void canny_edge_Writeback(unsigned char *image, int rows, int cols, Uint8
     if (DSP_SUCCEEDED(status)) {
         VPRINT("Writeback was succesfull!\r\n");
     }
+#else
+    (void) original;
 #endif
 }
+#endif /* DO_WRITEBACK */
+
+/* The stage runs in the DSP chain, with the split of the gaussian */
+STATIC Bool canny_edge_Chained(canny_ctx *ctx, int stage)
+{
+    return ctx->chain && (stage == STAGE_DERIVATIVE || (stage == STAGE_MAGNITUDE && ctx->backends.dsp[stage]));
+}
+
+/* The rows of a tile rounded up so a tile of the short images is whole cache
+ * lines: the GPP and the DSP write their tiles in non coherent caches, a line
+ * across a tile boundary would be written back by both sides */
+STATIC int canny_edge_TileRows(int tile_rows, int cols)
+{
+    int step = line_rows(cols);
+
+    if (tile_rows <= 0) {
+        return 0;
+    }
+    return (tile_rows + step - 1) / step * step;
+}
+
+#if !FUSED_PIPELINE
+/* Queue the DSP band of the gaussian of the frame in slot buf, or the chain of
+ * the DSP bands */
+STATIC Void canny_edge_SubmitGaussian(canny_ctx *ctx, int buf)
+{
+    short int *percentage = &ctx->percentage[buf];
+    int dsp_rows;
+
+    /* The DSP smooths its band in x with a halo of rows, and only reads those. A
+     * chain smooths one more row for the derivative. */
+    *percentage = ctx->perc[STAGE_GAUSSIAN];
+    dsp_rows = canny_edge_DspRows(ctx, *percentage);
+    if (ctx->tile_rows > 0) {
+        /* The DSP can take any tile */
+        dsp_rows = ctx->rows;
+    }
+    if (dsp_rows > 0) {
+        canny_edge_WritebackRows(ctx, ctx->buffers[0][buf], sizeof(unsigned char), 0,
+                                 dsp_rows + DSP_GAUSSIAN_HALO + (ctx->chain ? 1 : 0));
+    }
+
+    /* Notify DSP */
+    ctx->gaussian_seq[buf] = canny_edge_Send(ctx, ctx->chain ? canny_edge_CHAIN : canny_edge_GAUSSIAN, buf,
+                                             *percentage);
+    VPRINT("  DSP_Gaussian send\r\n");
+}
 
-STATIC Void canny_edge_Gaussian(unsigned char *image, int rows, int cols, short int *smoothedim, short int *percentage, Uint8 processorId)
+STATIC Void canny_edge_Gaussian(canny_ctx *ctx, int buf, unsigned char *image, short int *smoothedim,
+                                short int *percentage)
 {
+    int rows = ctx->rows, cols = ctx->cols;
+    long long gpp_start, gpp_end;
 #if VERIFY
     short int diff, max_diff;
     unsigned int i, sq_sum;
     float mse;
     int status = DSP_SOK;
-    short int *verify_smoothedim = (short int *) malloc(sizeof(short int) * rows * cols);
+    size_t mark = arena_mark(&ctx->arena);
+    short int *verify_smoothedim = (short int *) arena_alloc(&ctx->arena, sizeof(short int) * rows * cols);
 #endif
 
-    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                   image,
-                   buffer_sizes[0]);
-
-    /* Notify DSP */
-    NOTIFY_notify(processorId, canny_edge_IPS_ID, canny_edge_IPS_EVENTNO, canny_edge_GAUSSIAN);
-    VPRINT("  DSP_Gaussian send, waiting for response...\r\n");
+    /* The DSP band is queued when the frame is loaded */
+    if (ctx->gaussian_seq[buf] == 0) {
+        canny_edge_SubmitGaussian(ctx, buf);
+    }
+    VPRINT("  DSP_Gaussian waiting for response...\r\n");
 
     /* Do the GPP in parallel */
-#if GAUSSIAN_NEON
-    gaussian_smooth_neon(image, smoothedim, rows, cols, percentage);
-#else
-    gaussian_smooth(image, smoothedim, rows, cols, percentage);
-#endif
+    gpp_start = get_usec();
+    ctx->gaussian(image, smoothedim, rows, cols, ctx->kernel, ctx->windowsize, percentage, &ctx->arena);
+    gpp_end = get_usec();
 
     /* Wait for the response */
-    sem_wait(&sem);
+    canny_edge_WaitFrame(ctx, buf, ctx->gaussian_seq[buf]);
+    canny_edge_Balance(ctx, STAGE_GAUSSIAN, *percentage, gpp_start, gpp_end, ctx->gaussian_seq[buf]);
+    ctx->gaussian_seq[buf] = 0;
 
-    /* Invalidate the result */
-    POOL_invalidate(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                    smoothedim,
-                    buffer_sizes[1]);
+    /* Invalidate the rows of the DSP */
+    canny_edge_InvalidateRows(ctx, smoothedim, sizeof(short int), 0, canny_edge_DspRows(ctx, *percentage));
 
 #if VERIFY
     /* Verify gaussian smooth dsp using the GPP code */
     *percentage = 100;
-    gaussian_smooth(image, verify_smoothedim, canny_edge_rows, canny_edge_cols, percentage);
+    gaussian_smooth(image, verify_smoothedim, rows, cols, ctx->kernel, ctx->windowsize, percentage, &ctx->arena);
 
     /* Check if it matches */
     sq_sum = 0;
@@ -722,49 +2880,47 @@ STATIC Void canny_edge_Gaussian(unsigned char *image, int rows, int cols, short
         mse = (float)sq_sum / (rows * cols);
         fprintf(stderr, "Execution of canny_edge_Gaussian FAILED (MSE: %.10f, MSE: %d / %d, max_diff: %d)!\r\n", mse, sq_sum, (rows * cols), max_diff);
     }
-    free(verify_smoothedim);
+    arena_release(&ctx->arena, mark);
 #endif
 }
 
-STATIC Void canny_edge_Derivative(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
-                                  short int *percentage, Uint8 processorId)
+STATIC Void canny_edge_Derivative(canny_ctx *ctx, int buf, short int *smoothedim, short int *delta_x,
+                                  short int *delta_y, short int *percentage)
 {
+    Uint32 seq;
+    int rows = ctx->rows, cols = ctx->cols;
+    int dsp_rows;
+    long long gpp_start, gpp_end;
 #if VERIFY
     int i;
     int status = DSP_SOK;
-    short int *verify_delta_x = (short int *) malloc(sizeof(short int) * rows * cols);
-    short int *verify_delta_y = (short int *) malloc(sizeof(short int) * rows * cols);
+    size_t mark = arena_mark(&ctx->arena);
+    short int *verify_delta_x = (short int *) arena_alloc(&ctx->arena, sizeof(short int) * rows * cols);
+    short int *verify_delta_y = (short int *) arena_alloc(&ctx->arena, sizeof(short int) * rows * cols);
 #endif
 
-    /* Send smoothedim */
-    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                   smoothedim,
-                   buffer_sizes[1]);
-    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                   percentage,
-                   buffer_sizes[5]);
+    /* Send the rows of smoothedim the DSP reads, its band and the row below */
+    dsp_rows = canny_edge_DspRows(ctx, *percentage);
+    if (dsp_rows > 0) {
+        canny_edge_WritebackRows(ctx, smoothedim, sizeof(short int), 0, dsp_rows + 1);
+    }
 
     /* Notify DSP */
-    NOTIFY_notify(processorId, canny_edge_IPS_ID, canny_edge_IPS_EVENTNO, canny_edge_DERIVATIVE);
+    seq = canny_edge_Send(ctx, canny_edge_DERIVATIVE, buf, *percentage);
     VPRINT("  canny_edge_Derivative send, waiting for response...\r\n");
 
     /* Calculate on GPP in parallel */
-#if DERIVATIVE_NEON
-    derivative_x_y_neon(smoothedim, rows, cols, delta_x, delta_y, percentage);
-#else
-    derivative_x_y(smoothedim, rows, cols, delta_x, delta_y, percentage);
-#endif
+    gpp_start = get_usec();
+    ctx->derivative(smoothedim, rows, cols, delta_x, delta_y, percentage);
+    gpp_end = get_usec();
 
     /* Wait for the response */
-    sem_wait(&sem);
+    canny_edge_WaitFrame(ctx, buf, seq);
+    canny_edge_Balance(ctx, STAGE_DERIVATIVE, *percentage, gpp_start, gpp_end, seq);
 
-    /* Invalidate the result */
-    POOL_invalidate(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                    delta_x,
-                    buffer_sizes[2]);
-    POOL_invalidate(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                    delta_y,
-                    buffer_sizes[3]);
+    /* Invalidate the rows of the DSP */
+    canny_edge_InvalidateRows(ctx, delta_x, sizeof(short int), 0, dsp_rows);
+    canny_edge_InvalidateRows(ctx, delta_y, sizeof(short int), 0, dsp_rows);
 
 #if VERIFY
     /* verify with GPP function */
@@ -794,59 +2950,47 @@ STATIC Void canny_edge_Derivative(short int *smoothedim, int rows, int cols, sho
         fprintf(stderr, "Execution of canny_edge_Derivative was FAILED!\r\n");
     }
 
-    free(verify_delta_x);
-    free(verify_delta_y);
+    arena_release(&ctx->arena, mark);
 #endif
 }
 
-STATIC Void canny_edge_Magnitude(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
-                                 short int *percentage, Uint8 processorId)
+STATIC Void canny_edge_Magnitude(canny_ctx *ctx, int buf, short int *delta_x, short int *delta_y,
+                                 short int *magnitude, short int *percentage)
 {
-    int i;
-    int *magnitude_square = (int *)buffers[4][0];
+    int rows = ctx->rows, cols = ctx->cols;
+    int dsp_rows = canny_edge_DspRows(ctx, *percentage);
+    Uint32 seq;
+    long long gpp_start, gpp_end;
 #if VERIFY
+    int i;
     int status = DSP_SOK;
-    short int *gpp_magnitude = (short int *)malloc(sizeof(short int) * canny_edge_rows * canny_edge_cols);
+    size_t mark = arena_mark(&ctx->arena);
+    short int *gpp_magnitude = (short int *)arena_alloc(&ctx->arena, sizeof(short int) * rows * cols);
 #endif
 
-    /* Send the input data */
-    /* Send delta_x */
-    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                   delta_x,
-                   buffer_sizes[2]);
-    /* Send delta_y */
-    POOL_writeback(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                   delta_y,
-                   buffer_sizes[3]);
+    /* Send the rows of delta_x and delta_y the DSP reads */
+    canny_edge_WritebackRows(ctx, delta_x, sizeof(short int), 0, dsp_rows);
+    canny_edge_WritebackRows(ctx, delta_y, sizeof(short int), 0, dsp_rows);
 
-
-    NOTIFY_notify(processorId, canny_edge_IPS_ID, canny_edge_IPS_EVENTNO, canny_edge_MAGNITUDE);
+    seq = canny_edge_Send(ctx, canny_edge_MAGNITUDE, buf, *percentage);
     VPRINT("  canny_edge_Magnitude send, waiting for response (percentage: %d)...\r\n", *percentage);
 
     /* Calculate GPP in parallel */
-#if MAGNITUDE_NEON
-    magnitude_x_y_neon(delta_x, delta_y, canny_edge_rows, canny_edge_cols, magnitude, percentage);
-#else
-    magnitude_x_y(delta_x, delta_y, canny_edge_rows, canny_edge_cols, magnitude, percentage);
-#endif
+    gpp_start = get_usec();
+    ctx->magnitude_kernel(delta_x, delta_y, rows, cols, magnitude, percentage, &ctx->arena);
+    gpp_end = get_usec();
 
     /* Wait for the response */
-    sem_wait(&sem);
-
-    /* Invalidate the result */
-    POOL_invalidate(POOL_makePoolId(processorId, SAMPLE_POOL_ID),
-                    magnitude,
-                    buffer_sizes[4]);
+    canny_edge_WaitFrame(ctx, buf, seq);
+    canny_edge_Balance(ctx, STAGE_MAGNITUDE, *percentage, gpp_start, gpp_end, seq);
 
-    /* Do sqrt on GPP */
-    for (i = 0; i < ((100 - *percentage) * rows / 100)*cols; i++) {
-        magnitude[i] = (short)(0.5 + sqrt((float)magnitude_square[i]));
-    }
+    /* Invalidate the rows of the DSP, it rounds the square roots itself */
+    canny_edge_InvalidateRows(ctx, magnitude, sizeof(short int), 0, dsp_rows);
 
 #if VERIFY
     /* Verify magnitude using the GPP code */
     *percentage = 100;
-    magnitude_x_y(delta_x, delta_y, canny_edge_rows, canny_edge_cols, gpp_magnitude, percentage);
+    magnitude_x_y(delta_x, delta_y, rows, cols, gpp_magnitude, percentage, &ctx->arena);
 
     /* Check if it matches */
     for (i = 0; i < rows * cols; i++) {
@@ -862,16 +3006,296 @@ STATIC Void canny_edge_Magnitude(short int *delta_x, short int *delta_y, int row
     } else {
         fprintf(stderr, "Execution of canny_edge_Magnitude FAILED!\r\n");
     }
-    free(gpp_magnitude);
-#endif
+    arena_release(&ctx->arena, mark);
+#endif
+}
+
+/* The gaussian, the derivatives and, when the DSP does the magnitude, the
+ * magnitude of the frame in slot buf with a single DSP command, all with the
+ * split of the gaussian. Neither side waits for the other between the stages:
+ * the DSP smooths the row below its band itself, and the first GPP row in y,
+ * which needs the last smoothed row of the DSP, is redone when the chain is
+ * done. */
+STATIC Void canny_edge_Chain(canny_ctx *ctx, int buf, unsigned char *image, short int *smoothedim,
+                             short int *delta_x, short int *delta_y, short int *magnitude, short int *percentage)
+{
+    int c, pos, sq1, sq2;
+    int rows = ctx->rows, cols = ctx->cols;
+    Bool with_magnitude = ctx->backends.dsp[STAGE_MAGNITUDE];
+    int dsp_rows;
+    Uint32 seq;
+    long long gpp_start, gpp_end;
+
+    /* The DSP chain is queued when the frame is loaded */
+    if (ctx->gaussian_seq[buf] == 0) {
+        canny_edge_SubmitGaussian(ctx, buf);
+    }
+    seq = ctx->gaussian_seq[buf];
+    dsp_rows = canny_edge_DspRows(ctx, *percentage);
+
+    /* Do the GPP bands in parallel */
+    gpp_start = get_usec();
+    ctx->gaussian(image, smoothedim, rows, cols, ctx->kernel, ctx->windowsize, percentage, &ctx->arena);
+    ctx->derivative(smoothedim, rows, cols, delta_x, delta_y, percentage);
+    if (with_magnitude) {
+        ctx->magnitude_kernel(delta_x, delta_y, rows, cols, magnitude, percentage, &ctx->arena);
+    }
+    gpp_end = get_usec();
+
+    /* Wait for the response, the chain is balanced as the gaussian */
+    canny_edge_WaitFrame(ctx, buf, seq);
+    canny_edge_Balance(ctx, STAGE_GAUSSIAN, *percentage, gpp_start, gpp_end, seq);
+    ctx->gaussian_seq[buf] = 0;
+    ctx->perc[STAGE_DERIVATIVE] = ctx->perc[STAGE_GAUSSIAN];
+    if (with_magnitude) {
+        ctx->perc[STAGE_MAGNITUDE] = ctx->perc[STAGE_GAUSSIAN];
+    }
+
+    /* Invalidate the rows of the DSP */
+    canny_edge_InvalidateRows(ctx, delta_x, sizeof(short int), 0, dsp_rows);
+    canny_edge_InvalidateRows(ctx, delta_y, sizeof(short int), 0, dsp_rows);
+    if (with_magnitude) {
+        canny_edge_InvalidateRows(ctx, magnitude, sizeof(short int), 0, dsp_rows);
+    }
+
+    /* Redo the first GPP row in y with the last smoothed row of the DSP */
+    if (dsp_rows > 0 && dsp_rows < rows) {
+        POOL_invalidate(POOL_makePoolId(ctx->processorId, SAMPLE_POOL_ID),
+                        smoothedim + (dsp_rows - 1) * cols,
+                        sizeof(short int) * cols);
+        for (c = 0, pos = dsp_rows * cols; c < cols; c++, pos++) {
+            delta_y[pos] = ((dsp_rows + 1 < rows) ? smoothedim[pos + cols] : smoothedim[pos]) - smoothedim[pos - cols];
+            if (with_magnitude) {
+                sq1 = (int)delta_x[pos] * (int)delta_x[pos];
+                sq2 = (int)delta_y[pos] * (int)delta_y[pos];
+                magnitude[pos] = (short)(0.5 + sqrt((float)sq1 + (float)sq2));
+            }
+        }
+    }
+}
+
+/* A DSP stage of the frame in slot buf in tiles of tile_rows rows. The GPP and
+ * the DSP take the tiles from the same counter until the image is done, so a
+ * side that is held up takes fewer tiles and both finish at about the same
+ * time without a split to tune. The GPP runs its kernel on a tile with the
+ * halo rows around it into scratch images and keeps only the rows of the
+ * tile. The tiles it did not take are the DSP's. */
+STATIC Void canny_edge_Tiles(canny_ctx *ctx, int stage, int buf)
+{
+    int rows = ctx->rows, cols = ctx->cols, tile_rows = ctx->tile_rows;
+    int num_tiles = (rows + tile_rows - 1) / tile_rows;
+    unsigned char *image = (unsigned char *)ctx->buffers[0][buf];
+    short int *smoothedim = (short int *)ctx->buffers[1][buf];
+    short int *delta_x = (short int *)ctx->buffers[2][buf];
+    short int *delta_y = (short int *)ctx->buffers[3][buf];
+    short int *magnitude = (short int *)ctx->buffers[5][buf];
+    short int all_rows = 100;
+    int halo, row_start, row_end, tile_start, tile_end, gpp_rows = 0;
+    Uint32 tile, seq;
+    long long gpp_end;
+    size_t mark = arena_mark(&ctx->arena);
+    unsigned char *gpp_tiles = (unsigned char *)arena_alloc(&ctx->arena, num_tiles);
+    size_t tile_size = sizeof(short int) * (tile_rows + 2 * DSP_GAUSSIAN_HALO) * cols;
+    short int *tile_a = (short int *)arena_alloc(&ctx->arena, tile_size);
+    short int *tile_b = (short int *)arena_alloc(&ctx->arena, tile_size);
+
+    memset(gpp_tiles, 0, num_tiles);
+
+    /* Hand over all rows of the input, the DSP can take any tile */
+    if (stage == STAGE_GAUSSIAN) {
+        if (ctx->gaussian_seq[buf] == 0) {
+            canny_edge_SubmitGaussian(ctx, buf);
+        }
+        seq = ctx->gaussian_seq[buf];
+        ctx->gaussian_seq[buf] = 0;
+        halo = ctx->windowsize / 2;
+    } else if (stage == STAGE_DERIVATIVE) {
+        canny_edge_WritebackRows(ctx, smoothedim, sizeof(short int), 0, rows);
+        seq = canny_edge_Send(ctx, canny_edge_DERIVATIVE, buf, 100);
+        halo = 1;
+    } else {
+        canny_edge_WritebackRows(ctx, delta_x, sizeof(short int), 0, rows);
+        canny_edge_WritebackRows(ctx, delta_y, sizeof(short int), 0, rows);
+        seq = canny_edge_Send(ctx, canny_edge_MAGNITUDE, buf, 100);
+        halo = 0;
+    }
+
+    /* Take tiles until there are none left */
+    while ((tile = canny_edge_Claim(ctx, buf)) < (Uint32)num_tiles) {
+        tile_start = tile * tile_rows;
+        tile_end = (tile_start + tile_rows < rows) ? tile_start + tile_rows : rows;
+        row_start = (tile_start > halo) ? tile_start - halo : 0;
+        row_end = (tile_end + halo < rows) ? tile_end + halo : rows;
+        if (stage == STAGE_GAUSSIAN) {
+            ctx->gaussian(image + row_start * cols, tile_a, row_end - row_start, cols, ctx->kernel, ctx->windowsize,
+                          &all_rows, &ctx->arena);
+            memcpy(smoothedim + tile_start * cols, tile_a + (tile_start - row_start) * cols,
+                   sizeof(short int) * (tile_end - tile_start) * cols);
+        } else if (stage == STAGE_DERIVATIVE) {
+            ctx->derivative(smoothedim + row_start * cols, row_end - row_start, cols, tile_a, tile_b, &all_rows);
+            memcpy(delta_x + tile_start * cols, tile_a + (tile_start - row_start) * cols,
+                   sizeof(short int) * (tile_end - tile_start) * cols);
+            memcpy(delta_y + tile_start * cols, tile_b + (tile_start - row_start) * cols,
+                   sizeof(short int) * (tile_end - tile_start) * cols);
+        } else {
+            ctx->magnitude_kernel(delta_x + tile_start * cols, delta_y + tile_start * cols, tile_end - tile_start,
+                                  cols, magnitude + tile_start * cols, &all_rows, &ctx->arena);
+        }
+        gpp_tiles[tile] = 1;
+        gpp_rows += tile_end - tile_start;
+    }
+    gpp_end = get_usec();
+
+    /* Wait for the last tiles of the DSP */
+    canny_edge_WaitFrame(ctx, buf, seq);
+    canny_edge_Skew(ctx, stage, gpp_end, seq);
+
+    /* Invalidate the tiles of the DSP */
+    for (tile = 0; tile < (Uint32)num_tiles; tile++) {
+        if (gpp_tiles[tile]) {
+            continue;
+        }
+        tile_start = tile * tile_rows;
+        tile_end = (tile_start + tile_rows < rows) ? tile_start + tile_rows : rows;
+        if (stage == STAGE_GAUSSIAN) {
+            canny_edge_InvalidateRows(ctx, smoothedim, sizeof(short int), tile_start, tile_end);
+        } else if (stage == STAGE_DERIVATIVE) {
+            canny_edge_InvalidateRows(ctx, delta_x, sizeof(short int), tile_start, tile_end);
+            canny_edge_InvalidateRows(ctx, delta_y, sizeof(short int), tile_start, tile_end);
+        } else {
+            canny_edge_InvalidateRows(ctx, magnitude, sizeof(short int), tile_start, tile_end);
+        }
+    }
+
+    /* The share the GPP took is reported as the split of the stage */
+    ctx->perc[stage] = gpp_rows * 100 / rows;
+    VPRINT("  Tiles of stage %d: GPP %d of %d rows\r\n", stage, gpp_rows, rows);
+    arena_release(&ctx->arena, mark);
+}
+#endif /* !FUSED_PIPELINE */
+
+#if BENCHMARK && !FUSED_PIPELINE
+/* Compare the edge chains from hysteresis against an edge image followed by a contour scan */
+STATIC Void canny_edge_BenchChains(short int *magnitude, short int *delta_x, short int *delta_y, int rows, int cols,
+                                  canny_arena *arena)
+{
+    long long raster_time, chains_time;
+    size_t mark = arena_mark(arena);
+    unsigned char *nms = (unsigned char *)arena_alloc(arena, sizeof(unsigned char) * rows * cols);
+    unsigned char *edge = (unsigned char *)arena_alloc(arena, sizeof(unsigned char) * rows * cols);
+    edge_chains scan_chains, direct_chains;
+
+    memset(&scan_chains, 0, sizeof(edge_chains));
+    memset(&direct_chains, 0, sizeof(edge_chains));
+
+    /* Edge image and an external contour scan */
+    non_max_supp(magnitude, delta_x, delta_y, rows, cols, nms);
+    raster_time = get_usec();
+    apply_hysteresis(magnitude, nms, rows, cols, TLOW, THIGH, edge);
+    trace_edge_chains(edge, rows, cols, &scan_chains);
+    raster_time = get_usec() - raster_time;
+
+    /* Chains directly from the hysteresis */
+    non_max_supp(magnitude, delta_x, delta_y, rows, cols, nms);
+    chains_time = get_usec();
+    apply_hysteresis_chains(NULL, magnitude, nms, rows, cols, TLOW, THIGH, &direct_chains);
+    chains_time = get_usec() - chains_time;
+
+    printf("Edge chains: raster + scan %lld us (%d chains), direct %lld us (%d chains), %d points\r\n",
+           raster_time, scan_chains.num_chains, chains_time, direct_chains.num_chains, direct_chains.num_points);
+    if (scan_chains.num_points - scan_chains.num_chains != direct_chains.num_points - direct_chains.num_chains) {
+        fprintf(stderr, "Edge chains do not cover the same edges!\r\n");
+    }
+
+    free_edge_chains(&scan_chains);
+    free_edge_chains(&direct_chains);
+    arena_release(arena, mark);
+}
+#endif /* BENCHMARK && !FUSED_PIPELINE */
+
+#if BENCHMARK
+/* Compare the stage at a time pipeline against the fused pipeline on the GPP.
+ * The memory traffic is modelled, not measured: stage at a time each intermediate
+ * image goes to memory and back: image read (1B), tempim written and read (2*4B),
+ * smoothed (2*2B), dx/dy written and read by magnitude and NMS (3*4B), magnitude
+ * written and read (2*2B) and nms written (1B). Fused only the image is read and
+ * the magnitude and nms are written. */
+#define STAGE_BYTES_PER_PIXEL   (1 + 2 * 4 + 2 * 2 + 3 * 4 + 2 * 2 + 1)
+#define FUSED_BYTES_PER_PIXEL   (1 + 2 + 1)
+STATIC Void canny_edge_BenchFused(unsigned char *image, int rows, int cols, float *kernel, int windowsize,
+                                  canny_arena *arena)
+{
+    long long stage_time, fused_time;
+    int i, mismatch = 0;
+    short int perc = 100;
+    double pixels = (double)rows * cols;
+    size_t mark = arena_mark(arena);
+    short int *smoothedim = (short int *)arena_alloc(arena, sizeof(short int) * rows * cols);
+    short int *delta_x = (short int *)arena_alloc(arena, sizeof(short int) * rows * cols);
+    short int *delta_y = (short int *)arena_alloc(arena, sizeof(short int) * rows * cols);
+    short int *stage_mag = (short int *)arena_alloc(arena, sizeof(short int) * rows * cols);
+    short int *fused_mag = (short int *)arena_alloc(arena, sizeof(short int) * rows * cols);
+    unsigned char *stage_nms = (unsigned char *)arena_alloc(arena, sizeof(unsigned char) * rows * cols);
+    unsigned char *fused_nms = (unsigned char *)arena_alloc(arena, sizeof(unsigned char) * rows * cols);
+
+    /* Stage at a time on the GPP */
+    stage_time = get_usec();
+    gaussian_smooth(image, smoothedim, rows, cols, kernel, windowsize, &perc, arena);
+    derivative_x_y(smoothedim, rows, cols, delta_x, delta_y, &perc);
+    magnitude_x_y(delta_x, delta_y, rows, cols, stage_mag, &perc, arena);
+    non_max_supp(stage_mag, delta_x, delta_y, rows, cols, stage_nms);
+    stage_time = get_usec() - stage_time;
+
+    /* Fused over strips */
+    fused_time = get_usec();
+    canny_fused(image, rows, cols, kernel, windowsize, BOOSTBLURFACTOR,
+                FUSED_CACHE_BYTES, fused_mag, fused_nms);
+    fused_time = get_usec() - fused_time;
+
+    for (i = 0; i < rows * cols; i++) {
+        if (stage_mag[i] != fused_mag[i] || stage_nms[i] != fused_nms[i]) {
+            mismatch++;
+        }
+    }
+
+    printf("Stage at a time: %lld us, %.2f Mpixel/s, modelled %d B/pixel (%.1f MB/s modelled)\r\n", stage_time,
+           pixels / stage_time, STAGE_BYTES_PER_PIXEL, pixels * STAGE_BYTES_PER_PIXEL / stage_time);
+    printf("Fused (%d rows/strip): %lld us, %.2f Mpixel/s, modelled %d B/pixel (%.1f MB/s modelled)\r\n",
+           fused_strip_rows(cols, windowsize, FUSED_CACHE_BYTES), fused_time,
+           pixels / fused_time, FUSED_BYTES_PER_PIXEL, pixels * FUSED_BYTES_PER_PIXEL / fused_time);
+    if (mismatch) {
+        fprintf(stderr, "Fused pipeline differs in %d pixels!\r\n", mismatch);
+    }
+
+    arena_release(arena, mark);
 }
+#endif /* BENCHMARK */
 
 //////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////// NEON ////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
+#if defined (__ARM_NEON__)
+
+/* Guassian smooth on Neon (made for the precomputed kernel of 15) */
+STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, int rows, int cols, float *kernel,
+                                 int windowsize, short int *percentage, canny_arena *arena)
+{
+    (void) windowsize;
+    gaussian_neon(image, NULL, BOOSTBLURFACTOR, smoothedim, rows, cols, kernel, percentage, arena);
+}
+
+/* Guassian smooth of a 16-bit image on Neon, scaled to the 8-bit range */
+STATIC void gaussian_smooth16_neon(unsigned short int *image, int maxval, short int *smoothedim, int rows, int cols,
+                                   float *kernel, int windowsize, short int *percentage, canny_arena *arena)
+{
+    (void) windowsize;
+    gaussian_neon(NULL, image, GAUSSIAN16_BOOST(maxval), smoothedim, rows, cols, kernel, percentage, arena);
+}
 
-/* Guassian smooth on Neon */
-STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, Uint16 rows, Uint16 cols, short int *percentage)
+/* The Neon gaussian of the 8-bit image, or of image16 when image is NULL.
+ * Both are widened to float before the blur, the result is multiplied by boost */
+STATIC void gaussian_neon(unsigned char *image, unsigned short int *image16, double boost, short int *smoothedim,
+                          int rows, int cols, float *kernel, short int *percentage, canny_arena *arena)
 {
     float *tempim;                          /* Intermediate storing memory for x-direction*/
     float *rows_image;                     /* Image for x-smoothing*/
@@ -886,13 +3310,13 @@ STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, Ui
     float dot = 0.0f;             /* The sum of pixel values */
     float Referkernel = 0.0f;      /* Intermediate sum of filter values considering boundary situation */
     float sum = 0.0f;             /* The sum of filter values */
-    unsigned int row_start = rows * (100 - *percentage) / 100;
+    unsigned int row_start = split_row(rows, cols, *percentage);
+    size_t mark = arena_mark(arena);
 
     /****************************************************************************
-    * Allocate a temporary buffer image and the smoothed image.
+    * Take a temporary buffer image from the workspace.
     ****************************************************************************/
-    if ((tempim = (float *) malloc(rows * cols * sizeof(float))) == NULL) {
-        fprintf(stderr, "Error allocating the buffer image.\n");
+    if ((tempim = (float *) arena_alloc(arena, rows * cols * sizeof(float))) == NULL) {
         exit(1);
     }
 
@@ -902,7 +3326,7 @@ STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, Ui
 
     for (b = 0; b <= 16; b++) {
         if (b > 0 && b < 16) {
-            neon_kernel[b] = gaussian_kernel[b - 1];
+            neon_kernel[b] = kernel[b - 1];
         } else {
             neon_kernel[b] = 0;
         }
@@ -916,7 +3340,7 @@ STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, Ui
     ****************************************************************************/
     VPRINT("   Bluring the image in the X-direction.\n");
     /* Allocate the memory to new image and set the boundary value as 0. */
-    rows_image = (float *)malloc(neon_cols * rows * sizeof(float));
+    rows_image = (float *)arena_alloc(arena, neon_cols * rows * sizeof(float));
     i = row_start - 8;
     if(i < 0)
         i = 0;
@@ -924,8 +3348,14 @@ STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, Ui
         /* Set the front end 8 pixels' value as 0*/
         memset(&rows_image[i * neon_cols], 0, 8 * sizeof(float));
 
-        for (k = 0; k < cols; k++) {
-            rows_image[i * neon_cols + 8 + k] = (float)image[i * cols + k];
+        if (image != NULL) {
+            for (k = 0; k < cols; k++) {
+                rows_image[i * neon_cols + 8 + k] = (float)image[i * cols + k];
+            }
+        } else {
+            for (k = 0; k < cols; k++) {
+                rows_image[i * neon_cols + 8 + k] = (float)image16[i * cols + k];
+            }
         }
         /* Set the back end 8 pixels' value as 0*/
         memset(&rows_image[i * neon_cols + 8 + cols], 0, 8 * sizeof(float));
@@ -975,7 +3405,7 @@ STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, Ui
     ****************************************************************************/
     VPRINT("   Bluring the image in the Y-direction.\n");
     /* Allocate the memory to new image and set the boundary value as 0. The image is stored in unit of cols for convient y-direction smoothing*/
-    cols_image = (float *)malloc(neon_rows * cols * sizeof(float));
+    cols_image = (float *)arena_alloc(arena, neon_rows * cols * sizeof(float));
     for (i = 0; i < cols; i++) {
         /* Set the front end 8 pixels' value as 0*/
         memset(&cols_image[i * neon_rows], 0, 8 * sizeof(float));
@@ -1038,14 +3468,12 @@ STATIC void gaussian_smooth_neon(unsigned char *image, short int *smoothedim, Ui
             dot += vgetq_lane_f32(temp_dot, 3);
             dot += cols_image[c * neon_rows + r + 8] * neon_kernel[8];
             /* Assign the pixel value to the smoothedim and the dot as 0 again.*/
-            smoothedim[r * cols + c] = (short int)(dot * BOOSTBLURFACTOR / sum + 0.5);
+            smoothedim[r * cols + c] = (short int)(dot * boost / sum + 0.5);
         }
     }
 
-    /* Free the memory zone*/
-    free(rows_image);
-    free(cols_image);
-    free(tempim);
+    /* Give the memory zone back to the workspace*/
+    arena_release(arena, mark);
 }
 
 STATIC void derivative_x_y_neon(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
@@ -1054,7 +3482,7 @@ STATIC void derivative_x_y_neon(short int *smoothedim, int rows, int cols, short
     int r, c, pos, new_rows;
     int16x4_t vector_smoothedim_1, vector_smoothedim_2, vector_delta_x;
     int16x4_t vector_smoothedim_3, vector_smoothedim_4, vector_delta_y;
-    new_rows = rows * (100 - *percentage) / 100;
+    new_rows = split_row(rows, cols, *percentage);
 
     if(*percentage <= 0 || new_rows >= rows)
         return;
@@ -1118,13 +3546,14 @@ STATIC void derivative_x_y_neon(short int *smoothedim, int rows, int cols, short
 }
 
 STATIC void magnitude_x_y_neon(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
-                               short int *percentage)
+                               short int *percentage, canny_arena *arena)
 {
     int r, c, pos;
-    int *magnitude_square = (int *)malloc(sizeof(int) * rows * cols);
+    size_t mark = arena_mark(arena);
+    int *magnitude_square = (int *)arena_alloc(arena, sizeof(int) * rows * cols);
 
     /* Compute the squared magnitude */
-    for (r = ((100 - *percentage) * rows / 100), pos = ((100 - *percentage) * rows / 100) * cols; r < rows; r++) {
+    for (r = split_row(rows, cols, *percentage), pos = split_row(rows, cols, *percentage) * cols; r < rows; r++) {
         for (c = 0; c < cols; c += 4, pos += 4) {
             int16x4_t vector_delta_x, vector_delta_y;
             int32x4_t vector_delta_x_sq, vector_delta_y_sq, vector_magnitude_square;
@@ -1138,41 +3567,584 @@ STATIC void magnitude_x_y_neon(short int *delta_x, short int *delta_y, int rows,
     }
 
     /* Do sqrt on GPP */
-    for (pos = ((100 - *percentage) * rows / 100) * cols; pos < rows * cols; pos++) {
+    for (pos = split_row(rows, cols, *percentage) * cols; pos < rows * cols; pos++) {
         magnitude[pos] = (short)(0.5 + sqrt((float)magnitude_square[pos]));
     }
 
-    free(magnitude_square);
+    arena_release(arena, mark);
+}
+
+/* The luminance of 8 pixels at once, vld3 splits the interleaved samples */
+STATIC void rgb_to_gray_neon(const unsigned char *rgb, unsigned char *gray, int pixels)
+{
+    int i;
+
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        uint8x8x3_t vector_rgb;
+        uint16x8_t vector_sum;
+        vector_rgb = vld3_u8(&(rgb[3 * i]));
+        vector_sum = vmull_u8(vector_rgb.val[0], vdup_n_u8(LUMA_RED));
+        vector_sum = vmlal_u8(vector_sum, vector_rgb.val[1], vdup_n_u8(LUMA_GREEN));
+        vector_sum = vmlal_u8(vector_sum, vector_rgb.val[2], vdup_n_u8(LUMA_BLUE));
+        vst1_u8(&(gray[i]), vrshrn_n_u16(vector_sum, LUMA_SHIFT));
+    }
+    rgb_to_gray(&(rgb[3 * i]), &(gray[i]), pixels - i);
+}
+
+#endif /* defined (__ARM_NEON__) */
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////// SSE4 / AVX2 /////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////
+#if defined (__i386__) || defined (__x86_64__)
+
+/* The x86 kernels give the same results as the GPP code: the lanes are columns
+ * and every lane does the same float operations in the same order. The borders
+ * and the last columns that do not fill a vector are done as on the GPP. */
+
+/* One pixel of the gaussian in the x-direction, the kernel cut off at the borders */
+STATIC float gaussian_x_pixel(unsigned char *image, int r, int c, int cols, float *kernel, int center)
+{
+    int cc;
+    float dot = 0.0, sum = 0.0;
+
+    for (cc = (-center); cc <= center; cc++) {
+        if (((c + cc) >= 0) && ((c + cc) < cols)) {
+            dot += (float)image[r * cols + (c + cc)] * kernel[center + cc];
+            sum += kernel[center + cc];
+        }
+    }
+    return dot / sum;
+}
+
+/* One pixel of the gaussian of a 16-bit image in the x-direction */
+STATIC float gaussian_x_pixel16(unsigned short int *image, int r, int c, int cols, float *kernel, int center)
+{
+    int cc;
+    float dot = 0.0, sum = 0.0;
+
+    for (cc = (-center); cc <= center; cc++) {
+        if (((c + cc) >= 0) && ((c + cc) < cols)) {
+            dot += (float)image[r * cols + (c + cc)] * kernel[center + cc];
+            sum += kernel[center + cc];
+        }
+    }
+    return dot / sum;
+}
+
+/* Guassian smooth on SSE4 */
+STATIC __attribute__((target("sse4.1")))
+void gaussian_smooth_sse4(unsigned char *image, short int *smoothedim, int rows, int cols, float *kernel,
+                          int windowsize, short int *percentage, canny_arena *arena)
+{
+    int r, c, k, pixels;
+    int center = windowsize / 2;
+    int row_start = split_row(rows, cols, *percentage);
+    float *tempim, full_sum = 0.0;
+    __m128 vdot;
+    size_t mark = arena_mark(arena);
+
+    if ((tempim = (float *) arena_alloc(arena, rows * cols * sizeof(float))) == NULL) {
+        exit(1);
+    }
+    for (k = 0; k < windowsize; k++) {
+        full_sum += kernel[k];
+    }
+
+    /* Blur in the x - direction, 4 columns at a time between the borders */
+    VPRINT("   Bluring the image in the X-direction.\n");
+    for (r = (row_start - 8 < 0) ? 0 : row_start - 8; r < rows; r++) {
+        for (c = 0; c < center && c < cols; c++) {
+            tempim[r * cols + c] = gaussian_x_pixel(image, r, c, cols, kernel, center);
+        }
+        for (; c + 4 <= cols - center; c += 4) {
+            vdot = _mm_setzero_ps();
+            for (k = 0; k < windowsize; k++) {
+                memcpy(&pixels, &image[r * cols + c - center + k], sizeof(int));
+                vdot = _mm_add_ps(vdot, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(pixels))),
+                                                   _mm_set1_ps(kernel[k])));
+            }
+            _mm_storeu_ps(&tempim[r * cols + c], _mm_div_ps(vdot, _mm_set1_ps(full_sum)));
+        }
+        for (; c < cols; c++) {
+            tempim[r * cols + c] = gaussian_x_pixel(image, r, c, cols, kernel, center);
+        }
+    }
+
+    gaussian_y_sse4(tempim, smoothedim, rows, cols, kernel, center, row_start, BOOSTBLURFACTOR);
+
+    arena_release(arena, mark);
+}
+
+/* Guassian smooth of a 16-bit image on SSE4, the samples widen to 32 bits */
+STATIC __attribute__((target("sse4.1")))
+void gaussian_smooth16_sse4(unsigned short int *image, int maxval, short int *smoothedim, int rows, int cols,
+                            float *kernel, int windowsize, short int *percentage, canny_arena *arena)
+{
+    int r, c, k;
+    int center = windowsize / 2;
+    int row_start = split_row(rows, cols, *percentage);
+    float *tempim, full_sum = 0.0;
+    __m128 vdot;
+    size_t mark = arena_mark(arena);
+
+    if ((tempim = (float *) arena_alloc(arena, rows * cols * sizeof(float))) == NULL) {
+        exit(1);
+    }
+    for (k = 0; k < windowsize; k++) {
+        full_sum += kernel[k];
+    }
+
+    /* Blur in the x - direction, 4 columns at a time between the borders */
+    VPRINT("   Bluring the image in the X-direction.\n");
+    for (r = (row_start - 8 < 0) ? 0 : row_start - 8; r < rows; r++) {
+        for (c = 0; c < center && c < cols; c++) {
+            tempim[r * cols + c] = gaussian_x_pixel16(image, r, c, cols, kernel, center);
+        }
+        for (; c + 4 <= cols - center; c += 4) {
+            vdot = _mm_setzero_ps();
+            for (k = 0; k < windowsize; k++) {
+                vdot = _mm_add_ps(vdot, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(
+                                                       _mm_loadl_epi64((__m128i *)&image[r * cols + c - center + k]))),
+                                                   _mm_set1_ps(kernel[k])));
+            }
+            _mm_storeu_ps(&tempim[r * cols + c], _mm_div_ps(vdot, _mm_set1_ps(full_sum)));
+        }
+        for (; c < cols; c++) {
+            tempim[r * cols + c] = gaussian_x_pixel16(image, r, c, cols, kernel, center);
+        }
+    }
+
+    gaussian_y_sse4(tempim, smoothedim, rows, cols, kernel, center, row_start, GAUSSIAN16_BOOST(maxval));
+
+    arena_release(arena, mark);
+}
+
+/* The y-direction blur of the SSE4 gaussian, 4 columns at a time, from the
+ * x-direction blur in tempim into the rows from row_start, times boost */
+STATIC __attribute__((target("sse4.1")))
+void gaussian_y_sse4(float *tempim, short int *smoothedim, int rows, int cols, float *kernel, int center,
+                     int row_start, double boost)
+{
+    int r, c, rr;
+    float dot, sum;
+    __m128 vdot;
+    __m128d lo, hi;
+    __m128i values;
+
+    VPRINT("   Bluring the image in the Y-direction.\n");
+    for (r = row_start; r < rows; r++) {
+        sum = 0.0;
+        for (rr = (-center); rr <= center; rr++) {
+            if (((r + rr) >= 0) && ((r + rr) < rows)) {
+                sum += kernel[center + rr];
+            }
+        }
+        for (c = 0; c + 4 <= cols; c += 4) {
+            vdot = _mm_setzero_ps();
+            for (rr = (-center); rr <= center; rr++) {
+                if (((r + rr) >= 0) && ((r + rr) < rows)) {
+                    vdot = _mm_add_ps(vdot, _mm_mul_ps(_mm_loadu_ps(&tempim[(r + rr) * cols + c]),
+                                                       _mm_set1_ps(kernel[center + rr])));
+                }
+            }
+            lo = _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_cvtps_pd(vdot), _mm_set1_pd(boost)),
+                                       _mm_set1_pd(sum)), _mm_set1_pd(0.5));
+            hi = _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(vdot, vdot)),
+                                                  _mm_set1_pd(boost)), _mm_set1_pd(sum)), _mm_set1_pd(0.5));
+            values = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+            _mm_storel_epi64((__m128i *)&smoothedim[r * cols + c], _mm_packs_epi32(values, values));
+        }
+        for (; c < cols; c++) {
+            dot = 0.0;
+            for (rr = (-center); rr <= center; rr++) {
+                if (((r + rr) >= 0) && ((r + rr) < rows)) {
+                    dot += tempim[(r + rr) * cols + c] * kernel[center + rr];
+                }
+            }
+            smoothedim[r * cols + c] = (short int)(dot * boost / sum + 0.5);
+        }
+    }
+}
+
+/* Guassian smooth on AVX2 */
+STATIC __attribute__((target("avx2")))
+void gaussian_smooth_avx2(unsigned char *image, short int *smoothedim, int rows, int cols, float *kernel,
+                          int windowsize, short int *percentage, canny_arena *arena)
+{
+    int r, c, k;
+    int center = windowsize / 2;
+    int row_start = split_row(rows, cols, *percentage);
+    float *tempim, full_sum = 0.0;
+    __m256 vdot;
+    size_t mark = arena_mark(arena);
+
+    if ((tempim = (float *) arena_alloc(arena, rows * cols * sizeof(float))) == NULL) {
+        exit(1);
+    }
+    for (k = 0; k < windowsize; k++) {
+        full_sum += kernel[k];
+    }
+
+    /* Blur in the x - direction, 8 columns at a time between the borders */
+    VPRINT("   Bluring the image in the X-direction.\n");
+    for (r = (row_start - 8 < 0) ? 0 : row_start - 8; r < rows; r++) {
+        for (c = 0; c < center && c < cols; c++) {
+            tempim[r * cols + c] = gaussian_x_pixel(image, r, c, cols, kernel, center);
+        }
+        for (; c + 8 <= cols - center; c += 8) {
+            vdot = _mm256_setzero_ps();
+            for (k = 0; k < windowsize; k++) {
+                vdot = _mm256_add_ps(vdot, _mm256_mul_ps(
+                    _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+                        _mm_loadl_epi64((__m128i *)&image[r * cols + c - center + k]))),
+                    _mm256_set1_ps(kernel[k])));
+            }
+            _mm256_storeu_ps(&tempim[r * cols + c], _mm256_div_ps(vdot, _mm256_set1_ps(full_sum)));
+        }
+        for (; c < cols; c++) {
+            tempim[r * cols + c] = gaussian_x_pixel(image, r, c, cols, kernel, center);
+        }
+    }
+
+    gaussian_y_avx2(tempim, smoothedim, rows, cols, kernel, center, row_start, BOOSTBLURFACTOR);
+
+    arena_release(arena, mark);
+}
+
+/* Guassian smooth of a 16-bit image on AVX2, the samples widen to 32 bits */
+STATIC __attribute__((target("avx2")))
+void gaussian_smooth16_avx2(unsigned short int *image, int maxval, short int *smoothedim, int rows, int cols,
+                            float *kernel, int windowsize, short int *percentage, canny_arena *arena)
+{
+    int r, c, k;
+    int center = windowsize / 2;
+    int row_start = split_row(rows, cols, *percentage);
+    float *tempim, full_sum = 0.0;
+    __m256 vdot;
+    size_t mark = arena_mark(arena);
+
+    if ((tempim = (float *) arena_alloc(arena, rows * cols * sizeof(float))) == NULL) {
+        exit(1);
+    }
+    for (k = 0; k < windowsize; k++) {
+        full_sum += kernel[k];
+    }
+
+    /* Blur in the x - direction, 8 columns at a time between the borders */
+    VPRINT("   Bluring the image in the X-direction.\n");
+    for (r = (row_start - 8 < 0) ? 0 : row_start - 8; r < rows; r++) {
+        for (c = 0; c < center && c < cols; c++) {
+            tempim[r * cols + c] = gaussian_x_pixel16(image, r, c, cols, kernel, center);
+        }
+        for (; c + 8 <= cols - center; c += 8) {
+            vdot = _mm256_setzero_ps();
+            for (k = 0; k < windowsize; k++) {
+                vdot = _mm256_add_ps(vdot, _mm256_mul_ps(
+                    _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+                        _mm_loadu_si128((__m128i *)&image[r * cols + c - center + k]))),
+                    _mm256_set1_ps(kernel[k])));
+            }
+            _mm256_storeu_ps(&tempim[r * cols + c], _mm256_div_ps(vdot, _mm256_set1_ps(full_sum)));
+        }
+        for (; c < cols; c++) {
+            tempim[r * cols + c] = gaussian_x_pixel16(image, r, c, cols, kernel, center);
+        }
+    }
+
+    gaussian_y_avx2(tempim, smoothedim, rows, cols, kernel, center, row_start, GAUSSIAN16_BOOST(maxval));
+
+    arena_release(arena, mark);
+}
+
+/* The y-direction blur of the AVX2 gaussian, 8 columns at a time, from the
+ * x-direction blur in tempim into the rows from row_start, times boost */
+STATIC __attribute__((target("avx2")))
+void gaussian_y_avx2(float *tempim, short int *smoothedim, int rows, int cols, float *kernel, int center,
+                     int row_start, double boost)
+{
+    int r, c, rr;
+    float dot, sum;
+    __m256 vdot;
+    __m256d lo, hi;
+
+    VPRINT("   Bluring the image in the Y-direction.\n");
+    for (r = row_start; r < rows; r++) {
+        sum = 0.0;
+        for (rr = (-center); rr <= center; rr++) {
+            if (((r + rr) >= 0) && ((r + rr) < rows)) {
+                sum += kernel[center + rr];
+            }
+        }
+        for (c = 0; c + 8 <= cols; c += 8) {
+            vdot = _mm256_setzero_ps();
+            for (rr = (-center); rr <= center; rr++) {
+                if (((r + rr) >= 0) && ((r + rr) < rows)) {
+                    vdot = _mm256_add_ps(vdot, _mm256_mul_ps(_mm256_loadu_ps(&tempim[(r + rr) * cols + c]),
+                                                             _mm256_set1_ps(kernel[center + rr])));
+                }
+            }
+            lo = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(vdot)),
+                                                           _mm256_set1_pd(boost)), _mm256_set1_pd(sum)),
+                               _mm256_set1_pd(0.5));
+            hi = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(vdot, 1)),
+                                                           _mm256_set1_pd(boost)), _mm256_set1_pd(sum)),
+                               _mm256_set1_pd(0.5));
+            _mm_storeu_si128((__m128i *)&smoothedim[r * cols + c],
+                             _mm_packs_epi32(_mm256_cvttpd_epi32(lo), _mm256_cvttpd_epi32(hi)));
+        }
+        for (; c < cols; c++) {
+            dot = 0.0;
+            for (rr = (-center); rr <= center; rr++) {
+                if (((r + rr) >= 0) && ((r + rr) < rows)) {
+                    dot += tempim[(r + rr) * cols + c] * kernel[center + rr];
+                }
+            }
+            smoothedim[r * cols + c] = (short int)(dot * boost / sum + 0.5);
+        }
+    }
+}
+
+/* The rows above and below row r used for the y-derivative */
+#define DERIVATIVE_UP(r) (((r) == 0) ? (r) : (r) - 1)
+#define DERIVATIVE_DOWN(r, rows) (((r) == (rows) - 1) ? (r) : (r) + 1)
+
+STATIC __attribute__((target("sse4.1")))
+void derivative_x_y_sse4(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
+                         short int *percentage)
+{
+    int r, c, pos, up, down;
+    int new_rows = split_row(rows, cols, *percentage);
+
+    if(*percentage <= 0 || new_rows >= rows)
+        return;
+
+    for (r = new_rows; r < rows; r++) {
+        /* Calculate the derivative in X direction, 8 columns at a time */
+        pos = r * cols;
+        delta_x[pos] = smoothedim[pos + 1] - smoothedim[pos];
+        for (c = 1; c + 8 <= cols - 1; c += 8) {
+            _mm_storeu_si128((__m128i *)&delta_x[pos + c],
+                             _mm_sub_epi16(_mm_loadu_si128((__m128i *)&smoothedim[pos + c + 1]),
+                                           _mm_loadu_si128((__m128i *)&smoothedim[pos + c - 1])));
+        }
+        for (; c < cols - 1; c++) {
+            delta_x[pos + c] = smoothedim[pos + c + 1] - smoothedim[pos + c - 1];
+        }
+        delta_x[pos + cols - 1] = smoothedim[pos + cols - 1] - smoothedim[pos + cols - 2];
+
+        /* Calculate the derivative in Y direction, 8 columns at a time */
+        up = DERIVATIVE_UP(r) * cols;
+        down = DERIVATIVE_DOWN(r, rows) * cols;
+        for (c = 0; c + 8 <= cols; c += 8) {
+            _mm_storeu_si128((__m128i *)&delta_y[pos + c],
+                             _mm_sub_epi16(_mm_loadu_si128((__m128i *)&smoothedim[down + c]),
+                                           _mm_loadu_si128((__m128i *)&smoothedim[up + c])));
+        }
+        for (; c < cols; c++) {
+            delta_y[pos + c] = smoothedim[down + c] - smoothedim[up + c];
+        }
+    }
+}
+
+STATIC __attribute__((target("avx2")))
+void derivative_x_y_avx2(short int *smoothedim, int rows, int cols, short int *delta_x, short int *delta_y,
+                         short int *percentage)
+{
+    int r, c, pos, up, down;
+    int new_rows = split_row(rows, cols, *percentage);
+
+    if(*percentage <= 0 || new_rows >= rows)
+        return;
+
+    for (r = new_rows; r < rows; r++) {
+        /* Calculate the derivative in X direction, 16 columns at a time */
+        pos = r * cols;
+        delta_x[pos] = smoothedim[pos + 1] - smoothedim[pos];
+        for (c = 1; c + 16 <= cols - 1; c += 16) {
+            _mm256_storeu_si256((__m256i *)&delta_x[pos + c],
+                                _mm256_sub_epi16(_mm256_loadu_si256((__m256i *)&smoothedim[pos + c + 1]),
+                                                 _mm256_loadu_si256((__m256i *)&smoothedim[pos + c - 1])));
+        }
+        for (; c < cols - 1; c++) {
+            delta_x[pos + c] = smoothedim[pos + c + 1] - smoothedim[pos + c - 1];
+        }
+        delta_x[pos + cols - 1] = smoothedim[pos + cols - 1] - smoothedim[pos + cols - 2];
+
+        /* Calculate the derivative in Y direction, 16 columns at a time */
+        up = DERIVATIVE_UP(r) * cols;
+        down = DERIVATIVE_DOWN(r, rows) * cols;
+        for (c = 0; c + 16 <= cols; c += 16) {
+            _mm256_storeu_si256((__m256i *)&delta_y[pos + c],
+                                _mm256_sub_epi16(_mm256_loadu_si256((__m256i *)&smoothedim[down + c]),
+                                                 _mm256_loadu_si256((__m256i *)&smoothedim[up + c])));
+        }
+        for (; c < cols; c++) {
+            delta_y[pos + c] = smoothedim[down + c] - smoothedim[up + c];
+        }
+    }
+}
+
+/* Round the square roots of 4 magnitudes squared (as floats) to the low 16
+ * bits of the result, which is what the (short) cast of the GPP code keeps */
+STATIC __attribute__((target("sse4.1")))
+__m128i magnitude_sqrt_sse4(__m128 sq)
+{
+    __m128d lo = _mm_add_pd(_mm_sqrt_pd(_mm_cvtps_pd(sq)), _mm_set1_pd(0.5));
+    __m128d hi = _mm_add_pd(_mm_sqrt_pd(_mm_cvtps_pd(_mm_movehl_ps(sq, sq))), _mm_set1_pd(0.5));
+
+    return _mm_and_si128(_mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi)), _mm_set1_epi32(0xFFFF));
+}
+
+STATIC __attribute__((target("sse4.1")))
+void magnitude_x_y_sse4(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
+                        short int *percentage, canny_arena *arena)
+{
+    int pos, end = rows * cols, sq1, sq2;
+    __m128i dx, dy, m0, m1;
+
+    (void) arena;
+
+    /* The rows are contiguous, so do them as one run of 8 pixels at a time */
+    for (pos = split_row(rows, cols, *percentage) * cols; pos + 8 <= end; pos += 8) {
+        dx = _mm_loadu_si128((__m128i *)&delta_x[pos]);
+        dy = _mm_loadu_si128((__m128i *)&delta_y[pos]);
+        m0 = magnitude_sqrt_sse4(_mm_add_ps(
+            _mm_cvtepi32_ps(_mm_mullo_epi32(_mm_cvtepi16_epi32(dx), _mm_cvtepi16_epi32(dx))),
+            _mm_cvtepi32_ps(_mm_mullo_epi32(_mm_cvtepi16_epi32(dy), _mm_cvtepi16_epi32(dy)))));
+        dx = _mm_srli_si128(dx, 8);
+        dy = _mm_srli_si128(dy, 8);
+        m1 = magnitude_sqrt_sse4(_mm_add_ps(
+            _mm_cvtepi32_ps(_mm_mullo_epi32(_mm_cvtepi16_epi32(dx), _mm_cvtepi16_epi32(dx))),
+            _mm_cvtepi32_ps(_mm_mullo_epi32(_mm_cvtepi16_epi32(dy), _mm_cvtepi16_epi32(dy)))));
+        _mm_storeu_si128((__m128i *)&magnitude[pos], _mm_packus_epi32(m0, m1));
+    }
+    for (; pos < end; pos++) {
+        sq1 = (int)delta_x[pos] * (int)delta_x[pos];
+        sq2 = (int)delta_y[pos] * (int)delta_y[pos];
+        magnitude[pos] = (short)(0.5 + sqrt((float)sq1 + (float)sq2));
+    }
+}
+
+/* Round the square roots of 8 magnitudes squared, see magnitude_sqrt_sse4 */
+STATIC __attribute__((target("avx2")))
+__m128i magnitude_sqrt_avx2(__m256 sq)
+{
+    __m256d lo = _mm256_add_pd(_mm256_sqrt_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(sq))), _mm256_set1_pd(0.5));
+    __m256d hi = _mm256_add_pd(_mm256_sqrt_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(sq, 1))), _mm256_set1_pd(0.5));
+
+    return _mm_packus_epi32(_mm_and_si128(_mm256_cvttpd_epi32(lo), _mm_set1_epi32(0xFFFF)),
+                            _mm_and_si128(_mm256_cvttpd_epi32(hi), _mm_set1_epi32(0xFFFF)));
+}
+
+STATIC __attribute__((target("avx2")))
+void magnitude_x_y_avx2(short int *delta_x, short int *delta_y, int rows, int cols, short int *magnitude,
+                        short int *percentage, canny_arena *arena)
+{
+    int pos, end = rows * cols, sq1, sq2;
+    __m256i dx, dy;
+
+    (void) arena;
+
+    /* The rows are contiguous, so do them as one run of 8 pixels at a time */
+    for (pos = split_row(rows, cols, *percentage) * cols; pos + 8 <= end; pos += 8) {
+        dx = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)&delta_x[pos]));
+        dy = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)&delta_y[pos]));
+        _mm_storeu_si128((__m128i *)&magnitude[pos], magnitude_sqrt_avx2(_mm256_add_ps(
+            _mm256_cvtepi32_ps(_mm256_mullo_epi32(dx, dx)), _mm256_cvtepi32_ps(_mm256_mullo_epi32(dy, dy)))));
+    }
+    for (; pos < end; pos++) {
+        sq1 = (int)delta_x[pos] * (int)delta_x[pos];
+        sq2 = (int)delta_y[pos] * (int)delta_y[pos];
+        magnitude[pos] = (short)(0.5 + sqrt((float)sq1 + (float)sq2));
+    }
+}
+
+/* The pshufb masks that gather the red, green and blue samples of 16 pixels
+ * from the 3 vectors of their 48 interleaved bytes, -1 leaves a zero */
+STATIC const signed char rgb_masks_sse4[3][3][16] = {
+    { { 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13 } },
+    { { 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14 } },
+    { { 2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15 } }
+};
+
+/* The luminance of 8 pixels, their red, green and blue samples in 16 bits */
+STATIC __attribute__((target("sse4.1")))
+__m128i rgb_luma_sse4(__m128i r, __m128i g, __m128i b)
+{
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(LUMA_RED)),
+                                _mm_mullo_epi16(g, _mm_set1_epi16(LUMA_GREEN)));
+
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(LUMA_BLUE)));
+    sum = _mm_add_epi16(sum, _mm_set1_epi16(1 << (LUMA_SHIFT - 1)));
+    return _mm_srli_epi16(sum, LUMA_SHIFT);
+}
+
+/* The luminance of 16 pixels at once: each color is gathered from the
+ * interleaved samples with pshufb, the weighted sum is done in 16 bits,
+ * which holds 256 * 255 + 128 */
+STATIC __attribute__((target("sse4.1")))
+void rgb_to_gray_sse4(const unsigned char *rgb, unsigned char *gray, int pixels)
+{
+    int i, k;
+    __m128i in[3], color[3], zero = _mm_setzero_si128();
+
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        for (k = 0; k < 3; k++) {
+            in[k] = _mm_loadu_si128((const __m128i *)&(rgb[3 * i + 16 * k]));
+        }
+        for (k = 0; k < 3; k++) {
+            color[k] = _mm_or_si128(_mm_or_si128(
+                           _mm_shuffle_epi8(in[0], _mm_loadu_si128((const __m128i *)rgb_masks_sse4[k][0])),
+                           _mm_shuffle_epi8(in[1], _mm_loadu_si128((const __m128i *)rgb_masks_sse4[k][1]))),
+                           _mm_shuffle_epi8(in[2], _mm_loadu_si128((const __m128i *)rgb_masks_sse4[k][2])));
+        }
+        _mm_storeu_si128((__m128i *)&(gray[i]), _mm_packus_epi16(
+            rgb_luma_sse4(_mm_cvtepu8_epi16(color[0]), _mm_cvtepu8_epi16(color[1]), _mm_cvtepu8_epi16(color[2])),
+            rgb_luma_sse4(_mm_unpackhi_epi8(color[0], zero), _mm_unpackhi_epi8(color[1], zero),
+                          _mm_unpackhi_epi8(color[2], zero))));
+    }
+    rgb_to_gray(&(rgb[3 * i]), &(gray[i]), pixels - i);
 }
 
+#endif /* defined (__i386__) || defined (__x86_64__) */
+
 //////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////// GPP ////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////
 
 /*******************************************************************************
-* FUNCTION: angle_radians
-* PURPOSE: This procedure computes the angle of a vector with components x and
-* y. It returns this angle in radians with the answer being in the range
-* 0 <= angle <2*PI.
+* PROCEDURE: line_rows
+* PURPOSE: The fewest rows of a short image of cols columns that are whole
+* cache lines of the DSP (canny_edge_CTRL_LINE bytes).
 *******************************************************************************/
-STATIC double angle_radians(double x, double y)
+STATIC int line_rows(int cols)
 {
-    double xu, yu, ang;
-
-    xu = fabs(x);
-    yu = fabs(y);
+    int rows;
 
-    if ((xu == 0) && (yu == 0)) { return (0); }
+    for (rows = 1; (rows * cols * sizeof(short int)) % canny_edge_CTRL_LINE != 0; rows++);
+    return rows;
+}
 
-    ang = atan(yu / xu);
+/*******************************************************************************
+* PROCEDURE: split_row
+* PURPOSE: The first row of the GPP when it does perc percent of the rows, the
+* DSP does the rows before it. The row is rounded to whole cache lines of the
+* short images, the GPP and the DSP write their rows in non coherent caches
+* and a line across the split would be written back by both sides.
+*******************************************************************************/
+STATIC int split_row(int rows, int cols, int perc)
+{
+    int row = rows * (100 - perc) / 100, step = line_rows(cols);
 
-    if (x >= 0) {
-        if (y >= 0) { return (ang); }
-        else { return (2 * M_PI - ang); }
-    } else {
-        if (y >= 0) { return (M_PI - ang); }
-        else { return (M_PI + ang); }
-    }
+    row = (row + step / 2) / step * step;
+    return (row < rows) ? row : rows;
 }
 
 /*******************************************************************************
@@ -1183,11 +4155,13 @@ STATIC double angle_radians(double x, double y)
 * DATE: 2/15/96
 *******************************************************************************/
 STATIC void magnitude_x_y(short int *delta_x, short int *delta_y, int rows, int cols,
-                          short int *magnitude, short int *percentage)
+                          short int *magnitude, short int *percentage, canny_arena *arena)
 {
     int r, c, pos, sq1, sq2;
 
-    for (r = ((100 - *percentage) * rows / 100), pos = ((100 - *percentage) * rows / 100) * cols; r < rows; r++) {
+    (void) arena;
+
+    for (r = split_row(rows, cols, *percentage), pos = split_row(rows, cols, *percentage) * cols; r < rows; r++) {
         for (c = 0; c < cols; c++, pos++) {
             sq1 = (int)delta_x[pos] * (int)delta_x[pos];
             sq2 = (int)delta_y[pos] * (int)delta_y[pos];
@@ -1215,7 +4189,7 @@ STATIC void derivative_x_y(short int *smoothedim, int rows, int cols, short int
     /*   Percentage indicates how many rows will be calculated on the GPP. The GPP will    */
     /*   be given an offset when not all calculations are done on the GPP (percentage<100) */
     int r, c, pos, new_rows;
-    new_rows = rows * (100 - *percentage) / 100;
+    new_rows = split_row(rows, cols, *percentage);
 
     if(*percentage <= 0 || new_rows >= rows)
         return;
@@ -1252,22 +4226,23 @@ STATIC void derivative_x_y(short int *smoothedim, int rows, int cols, short int
 * NAME: Mike Heath
 * DATE: 2/15/96
 *******************************************************************************/
-STATIC void gaussian_smooth(unsigned char *image, short int *smoothedim, int rows, int cols, short int *percentage)
+STATIC void gaussian_smooth(unsigned char *image, short int *smoothedim, int rows, int cols, float *kernel,
+                            int windowsize, short int *percentage, canny_arena *arena)
 {
-    int r, c, rr, cc,     /* Counter variables. */
+    int r, c, cc,         /* Counter variables. */
         center;            /* Half of the windowsize. */
     float *tempim,        /* Buffer for separable filter gaussian smoothing. */
           dot,            /* Dot product summing variable. */
           sum;            /* Sum of the kernel weights variable. */
+    size_t mark = arena_mark(arena);
 
-    center = windowsize_kernel / 2;
+    center = windowsize / 2;
 
 
     /****************************************************************************
-    * Allocate a temporary buffer image
+    * Take a temporary buffer image from the workspace
     ****************************************************************************/
-    if ((tempim = (float *) malloc(rows * cols * sizeof(float))) == NULL) {
-        fprintf(stderr, "Error allocating the buffer image.\n");
+    if ((tempim = (float *) arena_alloc(arena, rows * cols * sizeof(float))) == NULL) {
         exit(1);
     }
 
@@ -1284,8 +4259,61 @@ STATIC void gaussian_smooth(unsigned char *image, short int *smoothedim, int row
             sum = 0.0;
             for (cc = (-center); cc <= center; cc++) {
                 if (((c + cc) >= 0) && ((c + cc) < cols)) {
-                    dot += (float)image[r * cols + (c + cc)] * gaussian_kernel[center + cc];
-                    sum += gaussian_kernel[center + cc];
+                    dot += (float)image[r * cols + (c + cc)] * kernel[center + cc];
+                    sum += kernel[center + cc];
+                }
+            }
+            tempim[r * cols + c] = dot / sum;
+        }
+    }
+
+    /****************************************************************************
+    * Blur in the y - direction.
+    ****************************************************************************/
+    gaussian_smooth_y(tempim, smoothedim, rows, cols, kernel, center, rows*(100- *percentage)/100,
+                      BOOSTBLURFACTOR);
+
+    arena_release(arena, mark);
+}
+
+/*******************************************************************************
+* PROCEDURE: gaussian_smooth16
+* PURPOSE: Blur a 16-bit image with a gaussian filter. The samples are scaled
+* by 255 / maxval, so the smoothed image has the range of an 8-bit image but
+* keeps the fractions of the extra bits.
+*******************************************************************************/
+STATIC void gaussian_smooth16(unsigned short int *image, int maxval, short int *smoothedim, int rows, int cols,
+                              float *kernel, int windowsize, short int *percentage, canny_arena *arena)
+{
+    int r, c, cc,         /* Counter variables. */
+        center;            /* Half of the windowsize. */
+    float *tempim,        /* Buffer for separable filter gaussian smoothing. */
+          dot,            /* Dot product summing variable. */
+          sum;            /* Sum of the kernel weights variable. */
+    size_t mark = arena_mark(arena);
+
+    center = windowsize / 2;
+
+    if ((tempim = (float *) arena_alloc(arena, rows * cols * sizeof(float))) == NULL) {
+        exit(1);
+    }
+
+    /****************************************************************************
+    * Blur in the x - direction, the float accumulator holds the 16-bit
+    * products exactly enough.
+    ****************************************************************************/
+    VPRINT("   Bluring the 16-bit image in the X-direction.\n");
+    r = rows*(100- *percentage)/100 -8;
+    if(r < 0)
+        r = 0;
+    for (; r < rows; r++) {
+        for (c = 0; c < cols; c++) {
+            dot = 0.0;
+            sum = 0.0;
+            for (cc = (-center); cc <= center; cc++) {
+                if (((c + cc) >= 0) && ((c + cc) < cols)) {
+                    dot += (float)image[r * cols + (c + cc)] * kernel[center + cc];
+                    sum += kernel[center + cc];
                 }
             }
             tempim[r * cols + c] = dot / sum;
@@ -1295,24 +4323,56 @@ STATIC void gaussian_smooth(unsigned char *image, short int *smoothedim, int row
     /****************************************************************************
     * Blur in the y - direction.
     ****************************************************************************/
+    gaussian_smooth_y(tempim, smoothedim, rows, cols, kernel, center, rows*(100- *percentage)/100,
+                      GAUSSIAN16_BOOST(maxval));
+
+    arena_release(arena, mark);
+}
+
+/*******************************************************************************
+* PROCEDURE: gaussian_smooth_y
+* PURPOSE: The y-direction blur of gaussian_smooth, from the x-direction blur
+* in tempim into the rows from row_start of smoothedim, multiplied by boost.
+*******************************************************************************/
+STATIC void gaussian_smooth_y(float *tempim, short int *smoothedim, int rows, int cols, float *kernel, int center,
+                              int row_start, double boost)
+{
+    int r, c, rr;
+    float dot, sum;
+
     VPRINT("   Bluring the image in the Y-direction.\n");
     for (c = 0; c < cols; c++) {
-        for (r = rows*(100- *percentage)/100; r < rows; r++) {
+        for (r = row_start; r < rows; r++) {
             sum = 0.0;
             dot = 0.0;
             for (rr = (-center); rr <= center; rr++) {
                 if (((r + rr) >= 0) && ((r + rr) < rows)) {
-                    dot += tempim[(r + rr) * cols + c] * gaussian_kernel[center + rr];
-                    sum += gaussian_kernel[center + rr];
+                    dot += tempim[(r + rr) * cols + c] * kernel[center + rr];
+                    sum += kernel[center + rr];
                 }
             }
-            smoothedim[r * cols + c] = (short int)(dot * BOOSTBLURFACTOR / sum + 0.5);
+            smoothedim[r * cols + c] = (short int)(dot * boost / sum + 0.5);
         }
     }
+}
+
+/*******************************************************************************
+* PROCEDURE: rgb_to_gray
+* PURPOSE: Convert pixels of interleaved red, green and blue samples to their
+* luminance, with the fixed point weights LUMA_RED, LUMA_GREEN and LUMA_BLUE
+* that add up to 1 << LUMA_SHIFT, rounded to nearest.
+*******************************************************************************/
+STATIC void rgb_to_gray(const unsigned char *rgb, unsigned char *gray, int pixels)
+{
+    int i;
 
-    free(tempim);
+    for (i = 0; i < pixels; i++, rgb += 3) {
+        gray[i] = (unsigned char)((LUMA_RED * rgb[0] + LUMA_GREEN * rgb[1] + LUMA_BLUE * rgb[2] +
+                                   (1 << (LUMA_SHIFT - 1))) >> LUMA_SHIFT);
+    }
 }
 
+#if VERIFY
 /*******************************************************************************
 * PROCEDURE: make_gaussian_kernel
 * PURPOSE: Create a one dimensional gaussian kernel.
@@ -1348,6 +4408,7 @@ STATIC void make_gaussian_kernel(float sigma, float **kernel, int *windowsize)
         }
     }
 }
+#endif /* VERIFY */
 
 
 #if defined (__cplusplus)
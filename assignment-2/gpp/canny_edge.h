@@ -4,7 +4,9 @@
 /*  ----------------------------------- DSP/BIOS Link                 */
 #include <dsplink.h>
 
-extern int gaussianPerc, derivativePerc, magnitudePerc;
+/*  ----------------------------------- Application Header            */
+#include "hysteresis.h"
+
 
 /** ============================================================================
  *  @const  ID_PROCESSOR
@@ -15,23 +17,145 @@ extern int gaussianPerc, derivativePerc, magnitudePerc;
 #define ID_PROCESSOR       0
 
 
+/** ============================================================================
+ *  @const  CANNY_PERC_AUTO
+ *
+ *  @desc   Percentage of a stage that is balanced online between the GPP and
+ *          the DSP instead of fixed.
+ *  ============================================================================
+ */
+#define CANNY_PERC_AUTO    -1
+
+
+/** ============================================================================
+ *  @name   canny_ctx
+ *
+ *  @desc   A canny edge detection pipeline. It owns the buffers, the gaussian
+ *          kernel, the GPP/DSP split and the synchronization with the DSP,
+ *          so independent contexts can run concurrently on different threads.
+ *          Only one context at a time can use the DSP, any amount of GPP only
+ *          contexts can run next to it.
+ *  ============================================================================
+ */
+typedef struct canny_ctx canny_ctx;
+
+
+/** ============================================================================
+ *  @name   canny_config
+ *
+ *  @desc   The configuration of a canny edge context.
+ *
+ *  @field  dspExecutable
+ *              DSP executable name, NULL to run on the GPP only.
+ *  @field  processorId
+ *              Id of the DSP Processor.
+ *  @field  gaussianPerc, derivativePerc, magnitudePerc
+ *              Percentage of the rows done on the GPP/NEON, the rest is done
+ *              on the DSP. Ignored without a DSP executable. CANNY_PERC_AUTO
+ *              measures both sides every frame and moves the split to where
+ *              they finish together, the split is kept per image size in the
+ *              profile file (canny_profile.txt or CANNY_PROFILE).
+ *  @field  pipelineDepth
+ *              Frames in flight in canny_edge_ExecuteFrames, each has its own
+ *              buffers in the DSP pools. Ignored without a DSP executable.
+ *  @field  backends
+ *              Backend per stage like "gaussian=neon+dsp,magnitude=scalar",
+ *              it overrides the CANNY_BACKEND environment variable and the
+ *              defaults. NULL to keep those.
+ *  @field  tlow, thigh
+ *              Hysteresis threshold fractions.
+ *  ============================================================================
+ */
+typedef struct canny_config {
+    Char8 *dspExecutable;
+    Uint8 processorId;
+    int gaussianPerc;
+    int derivativePerc;
+    int magnitudePerc;
+    int pipelineDepth;
+    Char8 *backends;
+    float tlow;
+    float thigh;
+} canny_config;
+
+
+/** ============================================================================
+ *  @name   canny_frame_source, canny_frame_sink
+ *
+ *  @desc   Callbacks of canny_edge_ExecuteFrames. The source writes the
+ *          image of a frame (rows x cols, packed) straight into the input
+ *          buffer of its frame slot, which is shared with the DSP, and
+ *          returns FALSE on failure. The sink receives the edge image or the
+ *          edge chains of a frame, they are valid until the sink returns.
+ *          The frames are requested and received in order.
+ *  ============================================================================
+ */
+typedef Bool (*canny_frame_source) (void * arg, int frame, unsigned char * image) ;
+typedef Void (*canny_frame_sink) (void * arg, int frame, unsigned char * edge, edge_chains * chains) ;
+
+
+/** ============================================================================
+ *  @name   canny_request
+ *
+ *  @desc   An image in flight, from canny_edge_Submit to canny_edge_Wait.
+ *          Every request has a frame slot of its own, up to pipelineDepth
+ *          requests can be in flight.
+ *
+ *  @field  slot
+ *              The frame slot of the buffers, -1 when not in flight.
+ *  @field  seq
+ *              The DSP command queued for the image, 0 for none.
+ *  ============================================================================
+ */
+typedef struct canny_request {
+    int slot;
+    Uint32 seq;
+} canny_request;
+
+
+/** ============================================================================
+ *  @func   canny_edge_DefaultConfig
+ *
+ *  @desc   Fill a configuration with the defaults (GPP only).
+ *
+ *  @arg    config
+ *              The configuration to fill.
+ *
+ *  @ret    None
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Create
+ *  ============================================================================
+ */
+NORMAL_API
+Void
+canny_edge_DefaultConfig (OUT canny_config * config) ;
+
+
 /** ============================================================================
  *  @func   canny_edge_Create
  *
- *  @desc   This function allocates and initializes resources used by
- *          this application.
+ *  @desc   This function allocates and initializes the resources of a canny
+ *          edge context for images of the given size.
  *
- *  @arg    dspExecutable
- *              DSP executable name.
- *  @arg    strImage
- *              Path to the image that the canny edge must be applied to
- *  @arg    processorId
- *             Id of the DSP Processor. 
+ *  @arg    ctx
+ *              Returns the context. It is also returned when the creation
+ *              failed and must always be passed to canny_edge_Delete.
+ *  @arg    config
+ *              The configuration of the context.
+ *  @arg    rows
+ *              Height of the images.
+ *  @arg    cols
+ *              Width of the images.
  *
  *  @ret    DSP_SOK
  *              Operation successfully completed.
  *          DSP_EFAIL
- *              Resource allocation failed.
+ *              Resource allocation failed or the DSP is used by another
+ *              context.
  *
  *  @enter  None
  *
@@ -42,23 +166,64 @@ extern int gaussianPerc, derivativePerc, magnitudePerc;
  */
 NORMAL_API
 DSP_STATUS
-canny_edge_Create (IN Char8 * dspExecutable,
-                   IN Char8 * strImage,
-                   IN Uint8   processorId) ;
+canny_edge_Create (OUT canny_ctx ** ctx,
+                   IN  canny_config * config,
+                   IN  int rows,
+                   IN  int cols) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_SetSize
+ *
+ *  @desc   This function sets the size of the next images of a context. The
+ *          DSP stays loaded and the buffers are reused, so the size must not
+ *          be larger than the size the context was created with.
+ *
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *  @arg    rows
+ *              Height of the next images.
+ *  @arg    cols
+ *              Width of the next images.
+ *
+ *  @ret    DSP_SOK
+ *              Operation successfully completed.
+ *          DSP_EFAIL
+ *              The size is larger than the context or the DSP did not accept
+ *              the new size.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Create, canny_edge_Execute
+ *  ============================================================================
+ */
+NORMAL_API
+DSP_STATUS
+canny_edge_SetSize (IN canny_ctx * ctx,
+                    IN int rows,
+                    IN int cols) ;
 
 
 /** ============================================================================
  *  @func   canny_edge_Execute
  *
- *  @desc   This function implements the execute phase for this application.
+ *  @desc   This function runs the canny edge detection on an image.
  *
- *  @arg    processorId
- *             Id of the DSP Processor. 
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *  @arg    image
+ *              The input image of rows x cols.
+ *  @arg    edge
+ *              The output edge image of rows x cols (unused with chains).
+ *  @arg    chains
+ *              Output edge chains, NULL to output the edge image.
  *
  *  @ret    DSP_SOK
  *              Operation successfully completed.
  *          DSP_EFAIL
- *              MESSAGE execution failed.
+ *              Execution failed.
  *
  *  @enter  None
  *
@@ -69,7 +234,282 @@ canny_edge_Create (IN Char8 * dspExecutable,
  */
 NORMAL_API
 DSP_STATUS
-canny_edge_Execute (IN Uint8 processorId, IN Char8 * strImage) ;
+canny_edge_Execute (IN  canny_ctx * ctx,
+                    IN  unsigned char * image,
+                    OUT unsigned char * edge,
+                    OUT edge_chains * chains) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_ExecuteFrames
+ *
+ *  @desc   This function runs the canny edge detection on a sequence of
+ *          frames. Up to pipelineDepth frames are in flight: the DSP runs
+ *          the gaussian band of the next frames while the GPP does the non
+ *          maximum suppression and hysteresis of the current frame.
+ *
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *  @arg    source
+ *              Returns the image of a frame.
+ *  @arg    sink
+ *              Receives the edges of a frame.
+ *  @arg    arg
+ *              Argument of the source and sink.
+ *  @arg    numFrames
+ *              The amount of frames.
+ *  @arg    chains
+ *              Output edge chains instead of edge images.
+ *
+ *  @ret    DSP_SOK
+ *              Operation successfully completed.
+ *          DSP_EFAIL
+ *              Execution failed or the source did not return a frame.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Execute
+ *  ============================================================================
+ */
+NORMAL_API
+DSP_STATUS
+canny_edge_ExecuteFrames (IN canny_ctx * ctx,
+                          IN canny_frame_source source,
+                          IN canny_frame_sink sink,
+                          IN void * arg,
+                          IN int numFrames,
+                          IN Bool chains) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_Submit
+ *
+ *  @desc   This function puts an image in flight without waiting for it:
+ *          it is copied into a free frame slot and the DSP band of the first
+ *          stages is queued. The caller can do other work, like the I/O or
+ *          the hysteresis of another image, and submit more images until the
+ *          slots run out.
+ *
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *  @arg    image
+ *              The input image of rows x cols, it can be reused on return.
+ *  @arg    request
+ *              Returns the request, to poll and wait for.
+ *
+ *  @ret    DSP_SOK
+ *              The image is in flight.
+ *          DSP_EFAIL
+ *              All pipelineDepth frame slots have a request in flight.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Poll, canny_edge_Wait
+ *  ============================================================================
+ */
+NORMAL_API
+DSP_STATUS
+canny_edge_Submit (IN  canny_ctx * ctx,
+                   IN  unsigned char * image,
+                   OUT canny_request * request) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_SubmitRgb
+ *
+ *  @desc   This function puts a color image in flight, like a PPM mapped
+ *          with map_pnm_image. The luminance of the pixels is computed
+ *          straight into the input buffer of a free frame slot, there is no
+ *          gray copy of the image. The rest is as for canny_edge_Submit.
+ *
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *  @arg    rgb
+ *              The input image of rows x cols pixels of interleaved red,
+ *              green and blue samples, one byte each.
+ *  @arg    request
+ *              Returns the request, to poll and wait for.
+ *
+ *  @ret    DSP_SOK
+ *              The image is in flight.
+ *          DSP_EFAIL
+ *              All pipelineDepth frame slots have a request in flight.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Submit, canny_edge_Wait
+ *  ============================================================================
+ */
+NORMAL_API
+DSP_STATUS
+canny_edge_SubmitRgb (IN  canny_ctx * ctx,
+                      IN  unsigned char * rgb,
+                      OUT canny_request * request) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_Submit16
+ *
+ *  @desc   This function puts an image with up to 16 bits per pixel in
+ *          flight, like a PGM of read_pgm_image16. The samples are scaled
+ *          by 255 / maxval in the gaussian, which the GPP does for all rows
+ *          when the request is waited for (the DSP gaussian takes 8-bit
+ *          images). The later stages are split with the DSP as usual.
+ *
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *  @arg    image
+ *              The input image of rows x cols, it is read until the request
+ *              is waited for.
+ *  @arg    maxval
+ *              The largest sample value of the image, 1 to 65535.
+ *  @arg    request
+ *              Returns the request, to poll and wait for.
+ *
+ *  @ret    DSP_SOK
+ *              The image is in flight.
+ *          DSP_EFAIL
+ *              All frame slots have a request in flight, maxval is out of
+ *              range or the context runs the FUSED_PIPELINE.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Submit, canny_edge_Wait
+ *  ============================================================================
+ */
+NORMAL_API
+DSP_STATUS
+canny_edge_Submit16 (IN  canny_ctx * ctx,
+                     IN  unsigned short int * image,
+                     IN  int maxval,
+                     OUT canny_request * request) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_Poll
+ *
+ *  @desc   This function checks without blocking if the DSP finished the
+ *          work queued for a request.
+ *
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *  @arg    request
+ *              A request of canny_edge_Submit.
+ *
+ *  @ret    TRUE
+ *              The DSP is done, canny_edge_Wait starts on the GPP right away.
+ *          FALSE
+ *              The DSP is still busy with the request or the ones before it.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Submit, canny_edge_Wait
+ *  ============================================================================
+ */
+NORMAL_API
+Bool
+canny_edge_Poll (IN canny_ctx * ctx,
+                 IN canny_request * request) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_Wait
+ *
+ *  @desc   This function completes a request: the GPP does its part of the
+ *          stages, with the DSP where it is used, and the edges are written.
+ *          Requests can be waited for in any order, the frame slot is free
+ *          again on return. canny_edge_ExecuteFrames can not run while
+ *          requests are in flight.
+ *
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *  @arg    request
+ *              A request of canny_edge_Submit.
+ *  @arg    edge
+ *              The output edge image of rows x cols (unused with chains).
+ *  @arg    chains
+ *              Output edge chains, NULL to output the edge image.
+ *
+ *  @ret    DSP_SOK
+ *              Operation successfully completed.
+ *          DSP_EFAIL
+ *              The request is not in flight or execution failed.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Submit, canny_edge_Execute
+ *  ============================================================================
+ */
+NORMAL_API
+DSP_STATUS
+canny_edge_Wait (IN  canny_ctx * ctx,
+                 IN  canny_request * request,
+                 OUT unsigned char * edge,
+                 OUT edge_chains * chains) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_Backends
+ *
+ *  @desc   This function returns the backends the context selected for its
+ *          stages, in the format of canny_config.backends.
+ *
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *
+ *  @ret    The backends, valid until the context is deleted.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Create
+ *  ============================================================================
+ */
+NORMAL_API
+Char8 *
+canny_edge_Backends (IN canny_ctx * ctx) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_GetSplit
+ *
+ *  @desc   This function returns the percentage of the rows the next frame
+ *          does on the GPP per stage. It changes over the frames for the
+ *          stages that are balanced online.
+ *
+ *  @arg    ctx
+ *              The context created by canny_edge_Create.
+ *  @arg    gaussianPerc, derivativePerc, magnitudePerc
+ *              The percentages.
+ *
+ *  @ret    None
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_config
+ *  ============================================================================
+ */
+NORMAL_API
+Void
+canny_edge_GetSplit (IN canny_ctx * ctx,
+                     OUT int * gaussianPerc,
+                     OUT int * derivativePerc,
+                     OUT int * magnitudePerc) ;
 
 
 /** ============================================================================
@@ -81,37 +521,187 @@ canny_edge_Execute (IN Uint8 processorId, IN Char8 * strImage) ;
  *          unconditionally. Actual applications may require stricter check
  *          against return values for robustness.
  *
- *  @arg    processorId
- *             Id of the DSP Processor. 
+ *  @arg    ctx
+ *              The context to delete.
+ *
+ *  @ret    None
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Create
+ *  ============================================================================
+ */
+NORMAL_API
+Void
+canny_edge_Delete (IN canny_ctx * ctx) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_Stream
+ *
+ *  @desc   Canny edge detection on the GPP that reads and writes the image in
+ *          strips of rows, so the memory used does not depend on the height
+ *          of the image. The DSP is not used.
+ *
+ *  @arg    strImage
+ *              The PGM image that is used for canny edge
  *
  *  @ret    DSP_SOK
  *              Operation successfully completed.
  *          DSP_EFAIL
- *              Resource deallocation failed.
+ *              Reading, writing or allocating failed.
  *
  *  @enter  None
  *
  *  @leave  None
  *
- *  @see    pool_notify_Create
+ *  @see    canny_edge_Main
  *  ============================================================================
  */
 NORMAL_API
-Void
-canny_edge_Delete (IN Uint8 processorId) ;
+DSP_STATUS
+canny_edge_Stream (IN Char8 * strImage) ;
 
 
 /** ============================================================================
- *  @func   canny_edge_Main
+ *  @func   canny_edge_Autotune
  *
- *  @desc   The OS independent driver function for the canny edge detector
+ *  @desc   Search the fastest GPP/DSP split of every stage with the DSP for
+ *          an image with a golden-section search per stage, timing each probe
+ *          over a number of repetitions. The stages are tuned jointly, in
+ *          rounds until none moves. The result is stored in the profile file,
+ *          the stages with a CANNY_PERC_AUTO percentage start from it.
  *
  *  @arg    dspExecutable
  *              Name of the DSP executable file.
  *  @arg    strImage
- *              The PGM image that is used for canny edge
- *  @arg    strProcessorId
- *             ID of the DSP Processor in string format. 
+ *              The PGM image that is timed.
+ *  @arg    reps
+ *              Timed repetitions per probe, the median is used. 0 for the
+ *              default.
+ *  @arg    backends
+ *              Backend per stage, NULL for the defaults (see canny_config).
+ *
+ *  @ret    DSP_SOK
+ *              Operation successfully completed.
+ *          DSP_EFAIL
+ *              Loading the DSP, reading the image or writing the profile
+ *              failed.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Main
+ *  ============================================================================
+ */
+NORMAL_API
+DSP_STATUS
+canny_edge_Autotune (IN Char8 * dspExecutable,
+                     IN Char8 * strImage,
+                     IN int reps,
+                     IN Char8 * backends) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_IpcBench
+ *
+ *  @desc   Measure the cost of the communication with the DSP on the buffers
+ *          of an image: the round trip of an empty command, the pool
+ *          writeback and invalidate per size and the round trip of a command
+ *          that takes over a band of rows and gives it back, per band size.
+ *          Every measurement is repeated and printed as the median, 90th and
+ *          99th percentile and the maximum.
+ *
+ *  @arg    dspExecutable
+ *              Name of the DSP executable file.
+ *  @arg    strImage
+ *              The PGM image that gives the size of the buffers.
+ *  @arg    iterations
+ *              Timed repetitions per measurement, 0 for the default.
+ *
+ *  @ret    DSP_SOK
+ *              Operation successfully completed.
+ *          DSP_EFAIL
+ *              Loading the DSP, reading the image or allocating failed.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Autotune
+ *  ============================================================================
+ */
+NORMAL_API
+DSP_STATUS
+canny_edge_IpcBench (IN Char8 * dspExecutable,
+                     IN Char8 * strImage,
+                     IN int iterations) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_Batch
+ *
+ *  @desc   Run the canny edge detector over a batch of images on a pool of
+ *          BATCH_WORKERS threads (or CANNY_BATCH_WORKERS). Every worker takes
+ *          the most advanced work there is: writing the edges of an image,
+ *          computing an image with a free context, or reading the next image
+ *          ahead. There is a context per worker but one, the first one has
+ *          the DSP and the others are GPP only. The edges are written to
+ *          "<image>_out.pgm" (or the chains with EDGE_CHAINS). The images per
+ *          second and the percentiles of the latency from the start of the
+ *          read to the end of the write are printed.
+ *
+ *  @arg    dspExecutable
+ *              Name of the DSP executable file.
+ *  @arg    strImages
+ *              The PGM images, or a single directory whose PGM images
+ *              (without the "_out.pgm" outputs) are run in name order.
+ *  @arg    numImages
+ *              The amount of images.
+ *  @arg    backends
+ *              Backend per stage, NULL for the defaults (see canny_config).
+ *
+ *  @ret    DSP_SOK
+ *              Every image is done.
+ *          DSP_EFAIL
+ *              A context could not be created, or an image failed.
+ *
+ *  @enter  None
+ *
+ *  @leave  None
+ *
+ *  @see    canny_edge_Main
+ *  ============================================================================
+ */
+NORMAL_API
+DSP_STATUS
+canny_edge_Batch (IN Char8 * dspExecutable,
+                  IN Char8 ** strImages,
+                  IN int numImages,
+                  IN Char8 * backends) ;
+
+
+/** ============================================================================
+ *  @func   canny_edge_Main
+ *
+ *  @desc   The OS independent driver function for the canny edge detector.
+ *          The DSP is loaded once for the whole session of images, the
+ *          startup time is reported separately from the time per image.
+ *
+ *  @arg    dspExecutable
+ *              Name of the DSP executable file.
+ *  @arg    strImages
+ *              The PGM images that are used for canny edge
+ *  @arg    numImages
+ *              The amount of images.
+ *  @arg    gaussianPerc, derivativePerc, magnitudePerc
+ *              Percentage of the rows done on the GPP/NEON per stage, or
+ *              CANNY_PERC_AUTO to balance it online.
+ *  @arg    backends
+ *              Backend per stage, NULL for the defaults (see canny_config).
  *
  *  @ret    None
  *
@@ -125,7 +715,12 @@ canny_edge_Delete (IN Uint8 processorId) ;
 NORMAL_API
 Void
 canny_edge_Main (IN Char8 * dspExecutable,
-               IN Char8 * strBufferSize) ;
+                 IN Char8 ** strImages,
+                 IN int numImages,
+                 IN int gaussianPerc,
+                 IN int derivativePerc,
+                 IN int magnitudePerc,
+                 IN Char8 * backends) ;
 
 
 #endif /* !defined (canny_edge_H) */
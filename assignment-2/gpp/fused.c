@@ -0,0 +1,365 @@
+/*******************************************************************************
+* FILE: fused.c
+* Cache-tiled canny edge pipeline. The Gaussian smoothing, derivatives,
+* magnitude and non maximum suppression are run strip by strip, so the
+* intermediate images never leave the cache. Only the magnitude and non
+* maximum suppression rows are handed out, for the (global) hysteresis.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined (__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "fused.h"
+#include "hysteresis.h"
+
+#define NOEDGE 255
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+/* Row 'row' of a ring buffer of the pipeline */
+#define RING(p, buf, row) ((buf) + ((row) % (p)->ring_rows) * (p)->cols)
+
+/* Full image source and sink used by canny_fused */
+typedef struct fused_frame {
+    unsigned char *image;
+    short int *magnitude;
+    unsigned char *nms;
+    int cols;
+} fused_frame;
+
+/*******************************************************************************
+* PROCEDURE: gaussian_x_row
+* PURPOSE: Blur one image row in the x-direction. The result is equal to the
+* x-direction blur of gaussian_smooth. row_buf must hold cols floats.
+*******************************************************************************/
+void gaussian_x_row(unsigned char *image_row, int cols, float *kernel, int windowsize,
+                    float *row_buf, float *temp_row)
+{
+    int c, cc, k, center = windowsize / 2;
+    float dot, sum, full_sum;
+#if defined (__ARM_NEON__)
+    float32x4_t neon_dot;
+#endif
+
+    /* The borders, where the kernel is cut off */
+    for (c = 0; c < cols; c++) {
+        if (c == center && cols - center > center) {
+            c = cols - center;
+        }
+        dot = 0.0;
+        sum = 0.0;
+        for (cc = (-center); cc <= center; cc++) {
+            if (((c + cc) >= 0) && ((c + cc) < cols)) {
+                dot += (float)image_row[c + cc] * kernel[center + cc];
+                sum += kernel[center + cc];
+            }
+        }
+        temp_row[c] = dot / sum;
+    }
+
+    /* The middle, where the full kernel is used */
+    full_sum = 0.0;
+    for (k = 0; k < windowsize; k++) { full_sum += kernel[k]; }
+
+    c = center;
+#if defined (__ARM_NEON__)
+    for (k = 0; k < cols; k++) { row_buf[k] = (float)image_row[k]; }
+    for (; c + 4 <= cols - center; c += 4) {
+        neon_dot = vdupq_n_f32(0);
+        for (k = 0; k < windowsize; k++) {
+            neon_dot = vmlaq_n_f32(neon_dot, vld1q_f32(&row_buf[c - center + k]), kernel[k]);
+        }
+        vst1q_f32(&temp_row[c], neon_dot);
+        temp_row[c] /= full_sum;
+        temp_row[c + 1] /= full_sum;
+        temp_row[c + 2] /= full_sum;
+        temp_row[c + 3] /= full_sum;
+    }
+#else
+    (void) row_buf;
+#endif
+    for (; c < cols - center; c++) {
+        dot = 0.0;
+        for (k = 0; k < windowsize; k++) {
+            dot += (float)image_row[c - center + k] * kernel[k];
+        }
+        temp_row[c] = dot / full_sum;
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: gaussian_y_row
+* PURPOSE: Blur one row in the y-direction. temp_rows holds the windowsize
+* x-direction blurred rows around the row, NULL for the rows outside the
+* image. The result is equal to the y-direction blur of gaussian_smooth.
+*******************************************************************************/
+void gaussian_y_row(float **temp_rows, int cols, float *kernel, int windowsize, double boost,
+                    short int *smoothed_row)
+{
+    int c, k, first, last;
+    float dot, sum;
+#if defined (__ARM_NEON__)
+    float32x4_t neon_dot;
+    float dots[4];
+#endif
+
+    /* Only the rows inside the image are used */
+    for (first = 0; temp_rows[first] == NULL; first++);
+    for (last = windowsize - 1; temp_rows[last] == NULL; last--);
+
+    sum = 0.0;
+    for (k = first; k <= last; k++) { sum += kernel[k]; }
+
+    c = 0;
+#if defined (__ARM_NEON__)
+    for (; c + 4 <= cols; c += 4) {
+        neon_dot = vdupq_n_f32(0);
+        for (k = first; k <= last; k++) {
+            neon_dot = vmlaq_n_f32(neon_dot, vld1q_f32(&temp_rows[k][c]), kernel[k]);
+        }
+        vst1q_f32(dots, neon_dot);
+        smoothed_row[c] = (short int)(dots[0] * boost / sum + 0.5);
+        smoothed_row[c + 1] = (short int)(dots[1] * boost / sum + 0.5);
+        smoothed_row[c + 2] = (short int)(dots[2] * boost / sum + 0.5);
+        smoothed_row[c + 3] = (short int)(dots[3] * boost / sum + 0.5);
+    }
+#endif
+    for (; c < cols; c++) {
+        dot = 0.0;
+        for (k = first; k <= last; k++) {
+            dot += temp_rows[k][c] * kernel[k];
+        }
+        smoothed_row[c] = (short int)(dot * boost / sum + 0.5);
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: derivative_row
+* PURPOSE: Compute the x and y derivatives of one row of the smoothed image.
+* For the first and last row of the image prev respectively next must be the
+* row itself, as in derivative_x_y.
+*******************************************************************************/
+void derivative_row(short int *prev, short int *cur, short int *next, int cols,
+                    short int *delta_x, short int *delta_y)
+{
+    int c;
+
+    delta_x[0] = cur[1] - cur[0];
+    for (c = 1; c < (cols - 1); c++) {
+        delta_x[c] = cur[c + 1] - cur[c - 1];
+    }
+    delta_x[cols - 1] = cur[cols - 1] - cur[cols - 2];
+
+    for (c = 0; c < cols; c++) {
+        delta_y[c] = next[c] - prev[c];
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: magnitude_row
+* PURPOSE: Compute the magnitude of the gradient of one row.
+*******************************************************************************/
+void magnitude_row(short int *delta_x, short int *delta_y, int cols, short int *magnitude)
+{
+    int c, sq1, sq2;
+
+    for (c = 0; c < cols; c++) {
+        sq1 = (int)delta_x[c] * (int)delta_x[c];
+        sq2 = (int)delta_y[c] * (int)delta_y[c];
+        magnitude[c] = (short)(0.5 + sqrt((float)sq1 + (float)sq2));
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: fused_strip_rows
+* PURPOSE: Get the amount of rows per strip such that all the ring buffers of
+* the pipeline fit in cache_bytes.
+*******************************************************************************/
+int fused_strip_rows(int cols, int windowsize, int cache_bytes)
+{
+    int row_bytes = cols * (sizeof(float) + 5 * sizeof(short int));
+    int strip_rows = cache_bytes / row_bytes - windowsize - 4;
+
+    return (strip_rows < 4) ? 4 : strip_rows;
+}
+
+/*******************************************************************************
+* PROCEDURE: fused_init
+* PURPOSE: Initialize the pipeline and allocate its ring buffers. Each ring
+* holds the rows of a strip plus the rows that a strip needs from the
+* previous one. Upon failure, this function returns 0, upon sucess it
+* returns 1.
+*******************************************************************************/
+int fused_init(fused_pipeline *p, int rows, int cols, float *kernel, int windowsize,
+               double boost, int strip_rows)
+{
+    memset(p, 0, sizeof(fused_pipeline));
+    p->rows = rows;
+    p->cols = cols;
+    p->strip_rows = strip_rows;
+    p->ring_rows = MIN(strip_rows + windowsize + 4, rows);
+    p->kernel = kernel;
+    p->windowsize = windowsize;
+    p->center = windowsize / 2;
+    p->boost = boost;
+
+    p->temp = (float *)malloc(p->ring_rows * cols * sizeof(float));
+    p->temp_rows = (float **)malloc(windowsize * sizeof(float *));
+    p->smooth = (short int *)malloc(p->ring_rows * cols * sizeof(short int));
+    p->delta_x = (short int *)malloc(p->ring_rows * cols * sizeof(short int));
+    p->delta_y = (short int *)malloc(p->ring_rows * cols * sizeof(short int));
+    p->mag = (short int *)malloc(p->ring_rows * cols * sizeof(short int));
+    p->nms = (unsigned char *)malloc(cols * sizeof(unsigned char));
+    p->row_buf = (float *)malloc(cols * sizeof(float));
+
+    if (p->temp == NULL || p->temp_rows == NULL || p->smooth == NULL || p->delta_x == NULL ||
+            p->delta_y == NULL || p->mag == NULL || p->nms == NULL || p->row_buf == NULL) {
+        fprintf(stderr, "Error allocating the fused pipeline buffers.\n");
+        fused_free(p);
+        return (0);
+    }
+    return (1);
+}
+
+/*******************************************************************************
+* PROCEDURE: fused_run
+* PURPOSE: Run the pipeline over an image. Every iteration blurs a strip of
+* rows in the x-direction and then advances each following stage as far as
+* the rows it depends on are available.
+*******************************************************************************/
+void fused_run(fused_pipeline *p, fused_source source, fused_sink sink, void *arg)
+{
+    int rows = p->rows, cols = p->cols;
+    int end, k, r;
+
+    p->next_temp = p->next_smooth = p->next_delta = p->next_nms = 0;
+
+    while (p->next_nms < rows) {
+        /* Blur a strip in the x-direction */
+        end = MIN(p->next_temp + p->strip_rows, rows);
+        for (; p->next_temp < end; p->next_temp++) {
+            gaussian_x_row(source(arg, p->next_temp), cols, p->kernel, p->windowsize, p->row_buf,
+                           RING(p, p->temp, p->next_temp));
+        }
+
+        /* Blur in the y-direction when all rows of the window are available */
+        end = (p->next_temp == rows) ? rows : p->next_temp - p->center;
+        for (; p->next_smooth < end; p->next_smooth++) {
+            for (k = 0; k < p->windowsize; k++) {
+                r = p->next_smooth - p->center + k;
+                p->temp_rows[k] = (r >= 0 && r < rows) ? RING(p, p->temp, r) : NULL;
+            }
+            gaussian_y_row(p->temp_rows, cols, p->kernel, p->windowsize, p->boost,
+                           RING(p, p->smooth, p->next_smooth));
+        }
+
+        /* Derivatives and magnitude need the smoothed rows above and below */
+        end = (p->next_smooth == rows) ? rows : p->next_smooth - 1;
+        for (; p->next_delta < end; p->next_delta++) {
+            r = p->next_delta;
+            derivative_row(RING(p, p->smooth, (r > 0) ? r - 1 : r), RING(p, p->smooth, r),
+                           RING(p, p->smooth, (r < rows - 1) ? r + 1 : r), cols,
+                           RING(p, p->delta_x, r), RING(p, p->delta_y, r));
+            magnitude_row(RING(p, p->delta_x, r), RING(p, p->delta_y, r), cols, RING(p, p->mag, r));
+        }
+
+        /* Non maximum suppression needs the magnitude rows above and below */
+        end = (p->next_delta == rows) ? rows : p->next_delta - 1;
+        for (; p->next_nms < end; p->next_nms++) {
+            r = p->next_nms;
+            if (r == 0 || r >= rows - 2) {
+                memset(p->nms, NOEDGE, cols);
+            } else {
+                non_max_supp_row(RING(p, p->mag, r - 1), RING(p, p->mag, r), RING(p, p->mag, r + 1),
+                                 RING(p, p->delta_x, r), RING(p, p->delta_y, r), cols, p->nms);
+            }
+            sink(arg, r, RING(p, p->mag, r), p->nms);
+        }
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: fused_resize
+* PURPOSE: Run the pipeline on images of a different size without reallocating.
+* The size must not be larger than the size the pipeline was initialized with.
+*******************************************************************************/
+void fused_resize(fused_pipeline *p, int rows, int cols)
+{
+    p->rows = rows;
+    p->cols = cols;
+}
+
+/*******************************************************************************
+* PROCEDURE: fused_free
+* PURPOSE: Free the ring buffers of the pipeline.
+*******************************************************************************/
+void fused_free(fused_pipeline *p)
+{
+    free(p->temp);
+    free(p->temp_rows);
+    free(p->smooth);
+    free(p->delta_x);
+    free(p->delta_y);
+    free(p->mag);
+    free(p->nms);
+    free(p->row_buf);
+    memset(p, 0, sizeof(fused_pipeline));
+}
+
+/* Source of canny_fused, the rows of the full image */
+static unsigned char *fused_frame_source(void *arg, int row)
+{
+    fused_frame *frame = (fused_frame *)arg;
+    return (frame->image + row * frame->cols);
+}
+
+/* Sink of canny_fused, copies the rows into the full images */
+static void fused_frame_sink(void *arg, int row, short int *mag_row, unsigned char *nms_row)
+{
+    fused_frame *frame = (fused_frame *)arg;
+    memcpy(frame->magnitude + row * frame->cols, mag_row, frame->cols * sizeof(short int));
+    memcpy(frame->nms + row * frame->cols, nms_row, frame->cols * sizeof(unsigned char));
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_fused_run
+* PURPOSE: Run an initialized pipeline on a full image into full magnitude and
+* nms images, so the ring buffers are reused over the frames.
+*******************************************************************************/
+void canny_fused_run(fused_pipeline *p, unsigned char *image, short int *magnitude, unsigned char *nms)
+{
+    fused_frame frame;
+
+    frame.image = image;
+    frame.magnitude = magnitude;
+    frame.nms = nms;
+    frame.cols = p->cols;
+    fused_run(p, fused_frame_source, fused_frame_sink, &frame);
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_fused
+* PURPOSE: Run the fused pipeline on a full image, with strips that fit in
+* cache_bytes. The results are equal to gaussian_smooth, derivative_x_y,
+* magnitude_x_y and non_max_supp run one after the other. Upon failure, this
+* function returns 0, upon sucess it returns 1.
+*******************************************************************************/
+int canny_fused(unsigned char *image, int rows, int cols, float *kernel, int windowsize,
+                double boost, int cache_bytes, short int *magnitude, unsigned char *nms)
+{
+    fused_pipeline p;
+
+    if (!fused_init(&p, rows, cols, kernel, windowsize, boost, fused_strip_rows(cols, windowsize, cache_bytes))) {
+        return (0);
+    }
+
+    canny_fused_run(&p, image, magnitude, nms);
+
+    fused_free(&p);
+    return (1);
+}
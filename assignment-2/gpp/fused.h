@@ -0,0 +1,64 @@
+#if !defined (fused_H)
+#define fused_H
+
+/* Returns a pointer to image row 'row', rows are requested in order */
+typedef unsigned char *(*fused_source)(void *arg, int row);
+
+/* Receives the magnitude and non maximum suppression of row 'row' in order */
+typedef void (*fused_sink)(void *arg, int row, short int *mag_row, unsigned char *nms_row);
+
+/* Gaussian -> derivative -> magnitude -> NMS pipeline working on strips of
+ * rows. Each stage keeps only a ring of the rows that the next stage still
+ * needs, so a strip travels through all stages while it is in the cache. */
+typedef struct fused_pipeline {
+    int rows, cols;                 ///< Image size
+    int strip_rows;                 ///< Rows per strip
+    int ring_rows;                  ///< Rows in each ring buffer
+    float *kernel;                  ///< Gaussian kernel
+    int windowsize, center;         ///< Gaussian kernel size and half size
+    double boost;                   ///< Boost factor of the smoothed image
+    float *temp;                    ///< Ring of x-direction blurred rows
+    float **temp_rows;              ///< Blurred rows in the window of the y-direction blur
+    short int *smooth;              ///< Ring of smoothed rows
+    short int *delta_x, *delta_y;   ///< Ring of derivative rows
+    short int *mag;                 ///< Ring of magnitude rows
+    unsigned char *nms;             ///< Non maximum suppression row
+    float *row_buf;                 ///< Float copy of the image row being blurred
+    int next_temp, next_smooth;     ///< Next row of the blur stages
+    int next_delta, next_nms;       ///< Next row of the derivative/magnitude and NMS stages
+} fused_pipeline;
+
+/* Rows per strip such that the ring buffers fit in cache_bytes */
+int fused_strip_rows(int cols, int windowsize, int cache_bytes);
+
+/* Allocate the ring buffers of the pipeline */
+int fused_init(fused_pipeline *p, int rows, int cols, float *kernel, int windowsize,
+               double boost, int strip_rows);
+
+/* Run the pipeline over the image, can be called again for a new image */
+void fused_run(fused_pipeline *p, fused_source source, fused_sink sink, void *arg);
+
+/* Use the ring buffers for a smaller (or the same) image size */
+void fused_resize(fused_pipeline *p, int rows, int cols);
+
+/* Free the ring buffers of the pipeline */
+void fused_free(fused_pipeline *p);
+
+/* Run an initialized pipeline on a full image into full magnitude and nms images */
+void canny_fused_run(fused_pipeline *p, unsigned char *image, short int *magnitude, unsigned char *nms);
+
+/* Run the fused pipeline on a full image into full magnitude and nms images */
+int canny_fused(unsigned char *image, int rows, int cols, float *kernel, int windowsize,
+                double boost, int cache_bytes, short int *magnitude, unsigned char *nms);
+
+/* Single row stages of the pipeline */
+void gaussian_x_row(unsigned char *image_row, int cols, float *kernel, int windowsize,
+                    float *row_buf, float *temp_row);
+void gaussian_y_row(float **temp_rows, int cols, float *kernel, int windowsize, double boost,
+                    short int *smoothed_row);
+void derivative_row(short int *prev, short int *cur, short int *next, int cols,
+                    short int *delta_x, short int *delta_y);
+void magnitude_row(short int *delta_x, short int *delta_y, int cols, short int *magnitude);
+
+
+#endif /* !defined (fused_H) */
@@ -1,6 +1,7 @@
 /*  ----------------------------------- OS Specific Headers           */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*  ----------------------------------- DSP/BIOS Link                 */
 #include <dsplink.h>
@@ -8,7 +9,11 @@
 /*  ----------------------------------- Application Header            */
 #include <canny_edge.h>
 
-int gaussianPerc, derivativePerc, magnitudePerc;
+/* A percentage argument, "auto" to balance the stage online */
+static int parse_perc(char *arg)
+{
+    return (strcmp(arg, "auto") == 0) ? CANNY_PERC_AUTO : atoi(arg);
+}
 
 /** ============================================================================
  *  @func   main
@@ -22,20 +27,76 @@ int main(int argc, char **argv)
 {
     Char8 *dspExecutable    = NULL;
     Char8 *strImage         = NULL;
+    Char8 **strImages       = NULL;
+    Char8 *backends         = NULL;
+    DSP_STATUS status       = DSP_SOK;
+    int numImages;
+    int gaussianPerc, derivativePerc, magnitudePerc;
+
+    /* Backend override per stage */
+    if (argc >= 3 && strcmp(argv[1], "-b") == 0) {
+        backends         = argv[2];
+        argv            += 2;
+        argc            -= 2;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+        strImage         = argv[2];
+
+        status = canny_edge_Stream(strImage);
+    } else if ((argc == 4 || argc == 5) && strcmp(argv[1], "-t") == 0) {
+        dspExecutable    = argv[2];
+        strImage         = argv[3];
+
+        status = canny_edge_Autotune(dspExecutable, strImage, (argc == 5) ? atoi(argv[4]) : 0, backends);
+    } else if ((argc == 4 || argc == 5) && strcmp(argv[1], "-i") == 0) {
+        dspExecutable    = argv[2];
+        strImage         = argv[3];
 
-    if (argc != 6) {
-        printf("Usage : %s <absolute path of DSP executable> "
-               "<Image path> <Gaussian percentage> <Derivative percentage> <Magnitude percentage>\n",
-               argv [0]) ;
+        status = canny_edge_IpcBench(dspExecutable, strImage, (argc == 5) ? atoi(argv[4]) : 0);
+    } else if (argc >= 4 && strcmp(argv[1], "-d") == 0) {
+        /* A directory of images or a list of them, on the worker threads */
+        status = canny_edge_Batch(argv[2], &argv[3], argc - 3, backends);
+    } else if (argc == 3) {
+        /* Without percentages every stage starts from the profile and is balanced online */
+        canny_edge_Main(argv[1], &argv[2], 1, CANNY_PERC_AUTO, CANNY_PERC_AUTO, CANNY_PERC_AUTO, backends);
+    } else if (argc < 6) {
+        printf("Usage : %s [-b <backends>] <absolute path of DSP executable> "
+               "<Image path> <Gaussian percentage> <Derivative percentage> <Magnitude percentage> "
+               "[<Image path> ...]\n"
+               "        %s [-b <backends>] <absolute path of DSP executable> <Image path> "
+               "(all percentages auto)\n"
+               "        %s [-b <backends>] -t <absolute path of DSP executable> <Image path> [<repetitions>] "
+               "(tune the percentages into canny_profile.txt)\n"
+               "        %s -i <absolute path of DSP executable> <Image path> [<iterations>] "
+               "(benchmark the communication with the DSP)\n"
+               "        %s [-b <backends>] -d <absolute path of DSP executable> <Image directory> | <Image path> ... "
+               "(batch on worker threads)\n"
+               "        %s -s <Image path> (streaming on the GPP with bounded memory)\n"
+               "        <percentage>: 0 to 100 on the GPP, or auto to balance it online (kept in canny_profile.txt)\n"
+               "        <backends>: [gaussian=|derivative=|magnitude=]scalar|neon|sse4|avx2|auto[+dsp],...\n"
+               "        (also read from CANNY_BACKEND)\n",
+               argv [0], argv [0], argv [0], argv [0], argv [0], argv [0]) ;
     } else {
         dspExecutable    = argv[1];
-        strImage         = argv[2];
-        gaussianPerc     = atoi(argv[3]);
-        derivativePerc   = atoi(argv[4]);
-        magnitudePerc    = atoi(argv[5]);
+        gaussianPerc     = parse_perc(argv[3]);
+        derivativePerc   = parse_perc(argv[4]);
+        magnitudePerc    = parse_perc(argv[5]);
+
+        /* The first image and any images after the percentages form one session */
+        numImages        = argc - 5;
+        strImages        = (Char8 **)malloc(numImages * sizeof(Char8 *));
+        if (strImages == NULL) {
+            return 1;
+        }
+        strImages[0]     = argv[2];
+        memcpy(&strImages[1], &argv[6], (numImages - 1) * sizeof(Char8 *));
 
-        canny_edge_Main(dspExecutable, strImage);
+        canny_edge_Main(dspExecutable, strImages, numImages, gaussianPerc, derivativePerc, magnitudePerc,
+                        backends);
+        free(strImages);
     }
 
-    return 0 ;
+    /* A failed mode is reported to the shell, so scripts can stop on it */
+    return DSP_SUCCEEDED(status) ? 0 : 1 ;
 }
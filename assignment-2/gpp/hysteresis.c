@@ -6,6 +6,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "hysteresis.h"
 
 #define VERBOSE 0
 
@@ -41,26 +44,17 @@ static void follow_edges(unsigned char *edgemapptr, short *edgemagptr, short low
 }
 
 /*******************************************************************************
-* PROCEDURE: apply_hysteresis
-* PURPOSE: This routine finds edges that are above some high threshhold or
-* are connected to a high pixel by a path of pixels greater than a low
-* threshold.
-* NAME: Mike Heath
-* DATE: 2/15/96
+* PROCEDURE: init_edge_map
+* PURPOSE: Initialize the edge map to possible edges everywhere the non-maximal
+* suppression suggested there could be an edge except for the border. At
+* the border we say there can not be an edge because it makes the
+* follow_edges algorithm more efficient to not worry about tracking an
+* edge off the side of the image. The nms and edge image may be the same.
 *******************************************************************************/
-void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
-                      float tlow, float thigh, unsigned char *edge)
+static void init_edge_map(unsigned char *nms, int rows, int cols, unsigned char *edge)
 {
-    int r, c, pos, numedges, highcount, lowthreshold, highthreshold, hist[32768];
-    short int maximum_mag = 0;
+    int r, c, pos;
 
-    /****************************************************************************
-    * Initialize the edge map to possible edges everywhere the non-maximal
-    * suppression suggested there could be an edge except for the border. At
-    * the border we say there can not be an edge because it makes the
-    * follow_edges algorithm more efficient to not worry about tracking an
-    * edge off the side of the image.
-    ****************************************************************************/
     for (r = 0, pos = 0; r < rows; r++) {
         for (c = 0; c < cols; c++, pos++) {
             if (nms[pos] == POSSIBLE_EDGE) { edge[pos] = POSSIBLE_EDGE; }
@@ -77,19 +71,17 @@ void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
         edge[c] = NOEDGE;
         edge[pos] = NOEDGE;
     }
+}
 
-    /****************************************************************************
-    * Compute the histogram of the magnitude image. Then use the histogram to
-    * compute hysteresis thresholds.
-    ****************************************************************************/
-    for (r = 0; r < 32768; r++) { hist[r] = 0; }
-    for (r = 0, pos = 0; r < rows; r++) {
-        for (c = 0; c < cols; c++, pos++) {
-            if (edge[pos] == POSSIBLE_EDGE) {
-                hist[mag[pos]]++;
-            }
-        }
-    }
+/*******************************************************************************
+* PROCEDURE: histogram_thresholds
+* PURPOSE: Compute the hysteresis thresholds from the histogram (32768 bins)
+* of the magnitude of all the possible edges.
+*******************************************************************************/
+void histogram_thresholds(int *hist, float tlow, float thigh, int *lowthreshold, int *highthreshold)
+{
+    int r, numedges, highcount;
+    short int maximum_mag = 0;
 
     /****************************************************************************
     * Compute the number of pixels that passed the nonmaximal suppression.
@@ -117,15 +109,132 @@ void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
         r++;
         numedges += hist[r];
     }
-    highthreshold = r;
-    lowthreshold = (int)(highthreshold * tlow + 0.5);
+    *highthreshold = r;
+    *lowthreshold = (int)(*highthreshold * tlow + 0.5);
+}
+
+/*******************************************************************************
+* PROCEDURE: hysteresis_thresholds
+* PURPOSE: Compute the histogram of the magnitude image for all the possible
+* edges in the edge map. Then use the histogram to compute the hysteresis
+* thresholds. Only every step-th row and column is used for the histogram,
+* which gives a cheap estimate of the thresholds when step > 1.
+*******************************************************************************/
+static void hysteresis_thresholds(short int *mag, unsigned char *edge, int rows, int cols, int step,
+                                  float tlow, float thigh, int *lowthreshold, int *highthreshold)
+{
+    int r, c, pos, hist[32768];
+
+    for (r = 0; r < 32768; r++) { hist[r] = 0; }
+    for (r = 0; r < rows; r += step) {
+        for (c = 0, pos = r * cols; c < cols; c += step, pos += step) {
+            if (edge[pos] == POSSIBLE_EDGE) {
+                hist[mag[pos]]++;
+            }
+        }
+    }
+
+    histogram_thresholds(hist, tlow, thigh, lowthreshold, highthreshold);
 
     if (VERBOSE) {
         printf("The input low and high fractions of %f and %f computed to\n",
                tlow, thigh);
-        printf("magnitude of the gradient threshold values of: %d %d\n",
-               lowthreshold, highthreshold);
+        printf("magnitude of the gradient threshold values of: %d %d (step %d)\n",
+               *lowthreshold, *highthreshold, step);
     }
+}
+
+/*******************************************************************************
+* PROCEDURE: init_hysteresis_stream
+* PURPOSE: Initialize the state used to reuse the hysteresis thresholds over
+* the frames of a stream. The full histogram is recomputed every refresh
+* frames, or earlier when the high threshold of a histogram over every
+* subsample-th row and column drifts more than max_drift (relative) from the
+* one at the last refresh. New thresholds are blended with the previous ones
+* using the smoothing weight (1.0 takes the new thresholds as they are).
+*******************************************************************************/
+void init_hysteresis_stream(hysteresis_stream *stream, int refresh, int subsample,
+                            float max_drift, float smoothing)
+{
+    stream->refresh = refresh;
+    stream->subsample = (subsample > 1) ? subsample : 2;
+    stream->max_drift = max_drift;
+    stream->smoothing = smoothing;
+    stream->frames = 0;
+    stream->valid = 0;
+}
+
+/*******************************************************************************
+* PROCEDURE: stream_thresholds
+* PURPOSE: Get the hysteresis thresholds for the next frame of a stream. They
+* are reused from the previous frame unless a refresh is due or the drift
+* detector fires. When stream is NULL the full histogram is always used.
+*******************************************************************************/
+static void stream_thresholds(hysteresis_stream *stream, short int *mag, unsigned char *edge,
+                              int rows, int cols, float tlow, float thigh,
+                              int *lowthreshold, int *highthreshold)
+{
+    int sublow, subhigh, drift;
+
+    if (stream == NULL) {
+        hysteresis_thresholds(mag, edge, rows, cols, 1, tlow, thigh, lowthreshold, highthreshold);
+        return;
+    }
+
+    /* Check the drift of the subsampled threshold since the last refresh */
+    if (stream->valid && (stream->frames < stream->refresh)) {
+        hysteresis_thresholds(mag, edge, rows, cols, stream->subsample, tlow, thigh, &sublow, &subhigh);
+        drift = abs(subhigh - stream->reference);
+        if (drift <= (int)(stream->max_drift * stream->reference + 0.5)) {
+            stream->frames++;
+            *lowthreshold = stream->lowthreshold;
+            *highthreshold = stream->highthreshold;
+            return;
+        }
+        if (VERBOSE) { printf("Hysteresis threshold drifted by %d, refreshing\n", drift); }
+    }
+
+    /* Refresh the thresholds using the full histogram */
+    hysteresis_thresholds(mag, edge, rows, cols, 1, tlow, thigh, lowthreshold, highthreshold);
+    hysteresis_thresholds(mag, edge, rows, cols, stream->subsample, tlow, thigh, &sublow, &stream->reference);
+    if (stream->valid) {
+        *highthreshold = (int)(stream->smoothing * *highthreshold +
+                               (1.0 - stream->smoothing) * stream->highthreshold + 0.5);
+        *lowthreshold = (int)(*highthreshold * tlow + 0.5);
+    }
+
+    stream->lowthreshold = *lowthreshold;
+    stream->highthreshold = *highthreshold;
+    stream->frames = 1;
+    stream->valid = 1;
+}
+
+/*******************************************************************************
+* PROCEDURE: apply_hysteresis
+* PURPOSE: This routine finds edges that are above some high threshhold or
+* are connected to a high pixel by a path of pixels greater than a low
+* threshold.
+* NAME: Mike Heath
+* DATE: 2/15/96
+*******************************************************************************/
+void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
+                      float tlow, float thigh, unsigned char *edge)
+{
+    apply_hysteresis_stream(NULL, mag, nms, rows, cols, tlow, thigh, edge);
+}
+
+/*******************************************************************************
+* PROCEDURE: apply_hysteresis_stream
+* PURPOSE: Same as apply_hysteresis, but the thresholds are reused over the
+* frames of a stream as described at init_hysteresis_stream.
+*******************************************************************************/
+void apply_hysteresis_stream(hysteresis_stream *stream, short int *mag, unsigned char *nms,
+                             int rows, int cols, float tlow, float thigh, unsigned char *edge)
+{
+    int r, c, pos, lowthreshold, highthreshold;
+
+    init_edge_map(nms, rows, cols, edge);
+    stream_thresholds(stream, mag, edge, rows, cols, tlow, thigh, &lowthreshold, &highthreshold);
 
     /****************************************************************************
     * This loop looks for pixels above the highthreshold to locate edges and
@@ -149,184 +258,395 @@ void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
 }
 
 /*******************************************************************************
-* PROCEDURE: non_max_supp
-* PURPOSE: This routine applies non-maximal suppression to the magnitude of
-* the gradient image.
-* NAME: Mike Heath
-* DATE: 2/15/96
+* PROCEDURE: chains_reserve
+* PURPOSE: Make sure there is room for at least one more point, one more chain
+* and one more pending branch in the edge chains buffers. Returns 0 when the
+* buffers could not be grown.
 *******************************************************************************/
-void non_max_supp(short *mag, short *gradx, short *grady, int nrows, int ncols, unsigned char *result)
+static int chains_reserve(edge_chains *chains)
 {
-    int rowcount, colcount, count;
-    short *magrowptr, *magptr;
-    short *gxrowptr, *gxptr;
-    short *gyrowptr, *gyptr, z1, z2;
-    short m00, gx = 0, gy = 0;
-    float mag1, mag2, xperp = 0.0, yperp = 0.0;
-    unsigned char *resultrowptr, *resultptr;
+    void *tmp;
+
+    if (chains->num_points >= chains->max_points) {
+        chains->max_points = (chains->max_points > 0) ? chains->max_points * 2 : 1024;
+        if ((tmp = realloc(chains->points, chains->max_points * sizeof(edge_point))) == NULL) { return (0); }
+        chains->points = (edge_point *)tmp;
+    }
+    if (chains->num_chains + 1 >= chains->max_chains) {
+        chains->max_chains = (chains->max_chains > 0) ? chains->max_chains * 2 : 256;
+        if ((tmp = realloc(chains->offsets, chains->max_chains * sizeof(int))) == NULL) { return (0); }
+        chains->offsets = (int *)tmp;
+    }
+    if (chains->num_stack >= chains->max_stack) {
+        chains->max_stack = (chains->max_stack > 0) ? chains->max_stack * 2 : 256;
+        if ((tmp = realloc(chains->stack, chains->max_stack * sizeof(int))) == NULL) { return (0); }
+        chains->stack = (int *)tmp;
+    }
+    return (1);
+}
 
+/*******************************************************************************
+* PROCEDURE: next_chain_point
+* PURPOSE: Find the first neighbour of pos that is a possible edge with a
+* magnitude above lowval (mag can be NULL to skip the magnitude test). The
+* neighbour is marked as an edge and its position is returned, or -1 when
+* there is no such neighbour. The neighbour order is the one of follow_edges.
+*******************************************************************************/
+static int next_chain_point(unsigned char *map, short *mag, short lowval, int cols, int pos)
+{
+    static const int x[8] = {1,  1,  0, -1, -1, -1,  0,  1},
+                     y[8] = {0,  1,  1,  1,  0, -1, -1, -1};
+    int i, npos;
 
-    /****************************************************************************
-    * Zero the edges of the result image.
-    ****************************************************************************/
-    for (count = 0, resultrowptr = result, resultptr = result + ncols * (nrows - 1);
-            count < ncols; resultptr++, resultrowptr++, count++) {
-        *resultrowptr = *resultptr = (unsigned char) NOEDGE;
+    for (i = 0; i < 8; i++) {
+        npos = pos - y[i] * cols + x[i];
+        if ((map[npos] == POSSIBLE_EDGE) && ((mag == NULL) || (mag[npos] > lowval))) {
+            map[npos] = (unsigned char) EDGE;
+            return (npos);
+        }
     }
+    return (-1);
+}
 
-    for (count = 0, resultptr = result, resultrowptr = result + ncols - 1;
-            count < nrows; count++, resultptr += ncols, resultrowptr += ncols) {
-        *resultptr = *resultrowptr = (unsigned char) NOEDGE;
+/*******************************************************************************
+* PROCEDURE: trace_chains
+* PURPOSE: The iterative counterpart of follow_edges. It traces all paths from
+* the (already marked) seed and appends them to the chains as polylines. A
+* path continues at the first unvisited neighbour, when it ends a new chain
+* is started at the most recent branch point that still has an unvisited
+* neighbour. Returns 0 on an allocation failure.
+*******************************************************************************/
+static int trace_chains(unsigned char *map, short *mag, short lowval, int cols, int seed,
+                        edge_chains *chains)
+{
+    int pos, npos;
+
+    if (!chains_reserve(chains)) { return (0); }
+    chains->points[chains->num_points].x = (unsigned short)(seed % cols);
+    chains->points[chains->num_points].y = (unsigned short)(seed / cols);
+    chains->num_points++;
+    chains->num_stack = 0;
+    pos = seed;
+
+    while (1) {
+        if ((npos = next_chain_point(map, mag, lowval, cols, pos)) < 0) {
+            /* End of this path, close the chain and look for a branch */
+            chains->num_chains++;
+            chains->offsets[chains->num_chains] = chains->num_points;
+
+            while ((chains->num_stack > 0) &&
+                    ((npos = next_chain_point(map, mag, lowval, cols, chains->stack[chains->num_stack - 1])) < 0)) {
+                chains->num_stack--;
+            }
+            if (chains->num_stack == 0) { return (1); }
+
+            /* Start the new chain at the branch point */
+            pos = chains->stack[--chains->num_stack];
+            if (!chains_reserve(chains)) { return (0); }
+            chains->points[chains->num_points].x = (unsigned short)(pos % cols);
+            chains->points[chains->num_points].y = (unsigned short)(pos / cols);
+            chains->num_points++;
+        }
+
+        if (!chains_reserve(chains)) { return (0); }
+        chains->stack[chains->num_stack++] = pos;
+        chains->points[chains->num_points].x = (unsigned short)(npos % cols);
+        chains->points[chains->num_points].y = (unsigned short)(npos / cols);
+        chains->num_points++;
+        pos = npos;
     }
+}
 
-    /****************************************************************************
-    * Suppress non-maximum points.
-    ****************************************************************************/
-    for (rowcount = 1, magrowptr = mag + ncols + 1, gxrowptr = gradx + ncols + 1,
-            gyrowptr = grady + ncols + 1, resultrowptr = result + ncols + 1;
-            rowcount < nrows - 2;
-            rowcount++, magrowptr += ncols, gyrowptr += ncols, gxrowptr += ncols,
-            resultrowptr += ncols) {
-        for (colcount = 1, magptr = magrowptr, gxptr = gxrowptr, gyptr = gyrowptr,
-                resultptr = resultrowptr; colcount < ncols - 2;
-                colcount++, magptr++, gxptr++, gyptr++, resultptr++) {
-            m00 = *magptr;
-            if (m00 == 0) {
-                *resultptr = (unsigned char) NOEDGE;
-            } else {
-                xperp = -(gx = *gxptr) / ((float)m00);
-                yperp = (gy = *gyptr) / ((float)m00);
+/*******************************************************************************
+* PROCEDURE: apply_hysteresis_chains
+* PURPOSE: Same as apply_hysteresis, but instead of producing an edge image the
+* edges are emitted as chains of points while they are traced. The nms image
+* is used as the work map and is overwritten. The thresholds are reused over
+* the frames of a stream when stream is not NULL. Returns 0 on an allocation
+* failure.
+*******************************************************************************/
+int apply_hysteresis_chains(hysteresis_stream *stream, short int *mag, unsigned char *nms,
+                            int rows, int cols, float tlow, float thigh, edge_chains *chains)
+{
+    int r, c, pos, lowthreshold, highthreshold;
+
+    init_edge_map(nms, rows, cols, nms);
+    stream_thresholds(stream, mag, nms, rows, cols, tlow, thigh, &lowthreshold, &highthreshold);
+
+    chains->num_points = 0;
+    chains->num_chains = 0;
+    if (!chains_reserve(chains)) { return (0); }
+    chains->offsets[0] = 0;
+
+    for (r = 0, pos = 0; r < rows; r++) {
+        for (c = 0; c < cols; c++, pos++) {
+            if ((nms[pos] == POSSIBLE_EDGE) && (mag[pos] >= highthreshold)) {
+                nms[pos] = EDGE;
+                if (!trace_chains(nms, mag, lowthreshold, cols, pos, chains)) { return (0); }
             }
+        }
+    }
+    return (1);
+}
+
+/*******************************************************************************
+* PROCEDURE: trace_edge_chains
+* PURPOSE: Scan an edge image (as produced by apply_hysteresis) and trace its
+* contours into chains. Edges on the image border are ignored. The edge image
+* is left unchanged. Returns 0 on an allocation failure.
+*******************************************************************************/
+int trace_edge_chains(unsigned char *edge, int rows, int cols, edge_chains *chains)
+{
+    int r, c, pos, status = 1;
+
+    /* Turn all the inner edges into possible edges that can be traced */
+    for (r = 1; r < rows - 1; r++) {
+        for (c = 1, pos = r * cols + 1; c < cols - 1; c++, pos++) {
+            if (edge[pos] == EDGE) { edge[pos] = POSSIBLE_EDGE; }
+        }
+    }
 
-            if (gx >= 0) {
-                if (gy >= 0) {
-                    if (gx >= gy) {
-                        /* 111 */
-                        /* Left point */
-                        z1 = *(magptr - 1);
-                        z2 = *(magptr - ncols - 1);
+    chains->num_points = 0;
+    chains->num_chains = 0;
+    if (!chains_reserve(chains)) { status = 0; }
+    else { chains->offsets[0] = 0; }
 
-                        mag1 = (m00 - z1) * xperp + (z2 - z1) * yperp;
+    for (r = 1; (r < rows - 1) && status; r++) {
+        for (c = 1, pos = r * cols + 1; (c < cols - 1) && status; c++, pos++) {
+            if (edge[pos] == POSSIBLE_EDGE) {
+                edge[pos] = EDGE;
+                status = trace_chains(edge, NULL, 0, cols, pos, chains);
+            }
+        }
+    }
+    return (status);
+}
 
-                        /* Right point */
-                        z1 = *(magptr + 1);
-                        z2 = *(magptr + ncols + 1);
+/*******************************************************************************
+* PROCEDURE: free_edge_chains
+* PURPOSE: Free the buffers of the edge chains and reset them to empty.
+*******************************************************************************/
+void free_edge_chains(edge_chains *chains)
+{
+    free(chains->points);
+    free(chains->offsets);
+    free(chains->stack);
+    memset(chains, 0, sizeof(edge_chains));
+}
 
-                        mag2 = (m00 - z1) * xperp + (z2 - z1) * yperp;
-                    } else {
-                        /* 110 */
-                        /* Left point */
-                        z1 = *(magptr - ncols);
-                        z2 = *(magptr - ncols - 1);
+/*******************************************************************************
+* PROCEDURE: write_edge_chains
+* PURPOSE: Write the edge chains as text. The first line holds the number of
+* chains and points, followed by one line per chain with its number of points
+* and the x y coordinates of the points. Upon failure, this function returns
+* 0, upon sucess it returns 1.
+*******************************************************************************/
+int write_edge_chains(char *outfilename, edge_chains *chains)
+{
+    FILE *fp;
+    int i, p;
 
-                        mag1 = (z1 - z2) * xperp + (z1 - m00) * yperp;
+    if ((fp = fopen(outfilename, "w")) == NULL) {
+        fprintf(stderr, "Error writing the file %s in write_edge_chains().\n",
+                outfilename);
+        return (0);
+    }
 
-                        /* Right point */
-                        z1 = *(magptr + ncols);
-                        z2 = *(magptr + ncols + 1);
+    fprintf(fp, "%d %d\n", chains->num_chains, chains->num_points);
+    for (i = 0; i < chains->num_chains; i++) {
+        fprintf(fp, "%d", chains->offsets[i + 1] - chains->offsets[i]);
+        for (p = chains->offsets[i]; p < chains->offsets[i + 1]; p++) {
+            fprintf(fp, " %d %d", chains->points[p].x, chains->points[p].y);
+        }
+        fprintf(fp, "\n");
+    }
 
-                        mag2 = (z1 - z2) * xperp + (z1 - m00) * yperp;
-                    }
-                } else {
-                    if (gx >= -gy) {
-                        /* 101 */
-                        /* Left point */
-                        z1 = *(magptr - 1);
-                        z2 = *(magptr + ncols - 1);
+    fclose(fp);
+    return (1);
+}
 
-                        mag1 = (m00 - z1) * xperp + (z1 - z2) * yperp;
+/*******************************************************************************
+* PROCEDURE: non_max_supp_row
+* PURPOSE: This routine applies non-maximal suppression to a single row of the
+* magnitude of the gradient image, given the magnitude rows above and below
+* it. The first and the last two columns are not suppressed but zeroed.
+*******************************************************************************/
+void non_max_supp_row(short *magup, short *mag, short *magdown, short *gradx, short *grady,
+                      int ncols, unsigned char *result)
+{
+    int colcount;
+    short *magptr, *upptr, *downptr, *gxptr, *gyptr, z1, z2;
+    short m00, gx, gy;
+    float mag1, mag2, xperp, yperp;
+    unsigned char *resultptr;
+
+    result[0] = result[ncols - 2] = result[ncols - 1] = (unsigned char) NOEDGE;
+
+    for (colcount = 1, magptr = mag + 1, upptr = magup + 1, downptr = magdown + 1,
+            gxptr = gradx + 1, gyptr = grady + 1, resultptr = result + 1; colcount < ncols - 2;
+            colcount++, magptr++, upptr++, downptr++, gxptr++, gyptr++, resultptr++) {
+        m00 = *magptr;
+        if (m00 == 0) {
+            *resultptr = (unsigned char) NOEDGE;
+            continue;
+        }
+        xperp = -(gx = *gxptr) / ((float)m00);
+        yperp = (gy = *gyptr) / ((float)m00);
+
+        if (gx >= 0) {
+            if (gy >= 0) {
+                if (gx >= gy) {
+                    /* 111 */
+                    /* Left point */
+                    z1 = *(magptr - 1);
+                    z2 = *(upptr - 1);
+
+                    mag1 = (m00 - z1) * xperp + (z2 - z1) * yperp;
 
-                        /* Right point */
-                        z1 = *(magptr + 1);
-                        z2 = *(magptr - ncols + 1);
+                    /* Right point */
+                    z1 = *(magptr + 1);
+                    z2 = *(downptr + 1);
 
-                        mag2 = (m00 - z1) * xperp + (z1 - z2) * yperp;
-                    } else {
-                        /* 100 */
-                        /* Left point */
-                        z1 = *(magptr + ncols);
-                        z2 = *(magptr + ncols - 1);
+                    mag2 = (m00 - z1) * xperp + (z2 - z1) * yperp;
+                } else {
+                    /* 110 */
+                    /* Left point */
+                    z1 = *upptr;
+                    z2 = *(upptr - 1);
 
-                        mag1 = (z1 - z2) * xperp + (m00 - z1) * yperp;
+                    mag1 = (z1 - z2) * xperp + (z1 - m00) * yperp;
 
-                        /* Right point */
-                        z1 = *(magptr - ncols);
-                        z2 = *(magptr - ncols + 1);
+                    /* Right point */
+                    z1 = *downptr;
+                    z2 = *(downptr + 1);
 
-                        mag2 = (z1 - z2) * xperp  + (m00 - z1) * yperp;
-                    }
+                    mag2 = (z1 - z2) * xperp + (z1 - m00) * yperp;
                 }
             } else {
-                if ((gy = *gyptr) >= 0) {
-                    if (-gx >= gy) {
-                        /* 011 */
-                        /* Left point */
-                        z1 = *(magptr + 1);
-                        z2 = *(magptr - ncols + 1);
-
-                        mag1 = (z1 - m00) * xperp + (z2 - z1) * yperp;
-
-                        /* Right point */
-                        z1 = *(magptr - 1);
-                        z2 = *(magptr + ncols - 1);
-
-                        mag2 = (z1 - m00) * xperp + (z2 - z1) * yperp;
-                    } else {
-                        /* 010 */
-                        /* Left point */
-                        z1 = *(magptr - ncols);
-                        z2 = *(magptr - ncols + 1);
-
-                        mag1 = (z2 - z1) * xperp + (z1 - m00) * yperp;
-
-                        /* Right point */
-                        z1 = *(magptr + ncols);
-                        z2 = *(magptr + ncols - 1);
-
-                        mag2 = (z2 - z1) * xperp + (z1 - m00) * yperp;
-                    }
-                } else {
-                    if (-gx > -gy) {
-                        /* 001 */
-                        /* Left point */
-                        z1 = *(magptr + 1);
-                        z2 = *(magptr + ncols + 1);
+                if (gx >= -gy) {
+                    /* 101 */
+                    /* Left point */
+                    z1 = *(magptr - 1);
+                    z2 = *(downptr - 1);
 
-                        mag1 = (z1 - m00) * xperp + (z1 - z2) * yperp;
+                    mag1 = (m00 - z1) * xperp + (z1 - z2) * yperp;
 
-                        /* Right point */
-                        z1 = *(magptr - 1);
-                        z2 = *(magptr - ncols - 1);
+                    /* Right point */
+                    z1 = *(magptr + 1);
+                    z2 = *(upptr + 1);
 
-                        mag2 = (z1 - m00) * xperp + (z1 - z2) * yperp;
-                    } else {
-                        /* 000 */
-                        /* Left point */
-                        z1 = *(magptr + ncols);
-                        z2 = *(magptr + ncols + 1);
+                    mag2 = (m00 - z1) * xperp + (z1 - z2) * yperp;
+                } else {
+                    /* 100 */
+                    /* Left point */
+                    z1 = *downptr;
+                    z2 = *(downptr - 1);
 
-                        mag1 = (z2 - z1) * xperp + (m00 - z1) * yperp;
+                    mag1 = (z1 - z2) * xperp + (m00 - z1) * yperp;
 
-                        /* Right point */
-                        z1 = *(magptr - ncols);
-                        z2 = *(magptr - ncols - 1);
+                    /* Right point */
+                    z1 = *upptr;
+                    z2 = *(upptr + 1);
 
-                        mag2 = (z2 - z1) * xperp + (m00 - z1) * yperp;
-                    }
+                    mag2 = (z1 - z2) * xperp  + (m00 - z1) * yperp;
                 }
             }
+        } else {
+            if ((gy = *gyptr) >= 0) {
+                if (-gx >= gy) {
+                    /* 011 */
+                    /* Left point */
+                    z1 = *(magptr + 1);
+                    z2 = *(upptr + 1);
 
-            /* Now determine if the current point is a maximum point */
+                    mag1 = (z1 - m00) * xperp + (z2 - z1) * yperp;
 
-            if ((mag1 > 0.0) || (mag2 > 0.0)) {
-                *resultptr = (unsigned char) NOEDGE;
+                    /* Right point */
+                    z1 = *(magptr - 1);
+                    z2 = *(downptr - 1);
+
+                    mag2 = (z1 - m00) * xperp + (z2 - z1) * yperp;
+                } else {
+                    /* 010 */
+                    /* Left point */
+                    z1 = *upptr;
+                    z2 = *(upptr + 1);
+
+                    mag1 = (z2 - z1) * xperp + (z1 - m00) * yperp;
+
+                    /* Right point */
+                    z1 = *downptr;
+                    z2 = *(downptr - 1);
+
+                    mag2 = (z2 - z1) * xperp + (z1 - m00) * yperp;
+                }
             } else {
-                if (mag2 == 0.0) {
-                    *resultptr = (unsigned char) NOEDGE;
+                if (-gx > -gy) {
+                    /* 001 */
+                    /* Left point */
+                    z1 = *(magptr + 1);
+                    z2 = *(downptr + 1);
+
+                    mag1 = (z1 - m00) * xperp + (z1 - z2) * yperp;
+
+                    /* Right point */
+                    z1 = *(magptr - 1);
+                    z2 = *(upptr - 1);
+
+                    mag2 = (z1 - m00) * xperp + (z1 - z2) * yperp;
                 } else {
-                    *resultptr = (unsigned char) POSSIBLE_EDGE;
+                    /* 000 */
+                    /* Left point */
+                    z1 = *downptr;
+                    z2 = *(downptr + 1);
+
+                    mag1 = (z2 - z1) * xperp + (m00 - z1) * yperp;
+
+                    /* Right point */
+                    z1 = *upptr;
+                    z2 = *(upptr - 1);
+
+                    mag2 = (z2 - z1) * xperp + (m00 - z1) * yperp;
                 }
             }
         }
+
+        /* Now determine if the current point is a maximum point */
+
+        if ((mag1 > 0.0) || (mag2 > 0.0)) {
+            *resultptr = (unsigned char) NOEDGE;
+        } else {
+            if (mag2 == 0.0) {
+                *resultptr = (unsigned char) NOEDGE;
+            } else {
+                *resultptr = (unsigned char) POSSIBLE_EDGE;
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: non_max_supp
+* PURPOSE: This routine applies non-maximal suppression to the magnitude of
+* the gradient image.
+* NAME: Mike Heath
+* DATE: 2/15/96
+*******************************************************************************/
+void non_max_supp(short *mag, short *gradx, short *grady, int nrows, int ncols, unsigned char *result)
+{
+    int rowcount;
+
+    /****************************************************************************
+    * Zero the edges of the result image.
+    ****************************************************************************/
+    memset(result, NOEDGE, ncols);
+    memset(result + ncols * (nrows - 2), NOEDGE, 2 * ncols);
+
+    /****************************************************************************
+    * Suppress non-maximum points.
+    ****************************************************************************/
+    for (rowcount = 1; rowcount < nrows - 2; rowcount++) {
+        non_max_supp_row(mag + (rowcount - 1) * ncols, mag + rowcount * ncols, mag + (rowcount + 1) * ncols,
+                         gradx + rowcount * ncols, grady + rowcount * ncols, ncols, result + rowcount * ncols);
     }
 }
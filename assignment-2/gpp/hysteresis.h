@@ -1,13 +1,68 @@
 #if !defined (hysteresis_H)
 #define hysteresis_H
 
+/* A single point of an edge chain */
+typedef struct edge_point {
+    unsigned short x, y;
+} edge_point;
+
+/* Edge chains stored in one contiguous point buffer. Chain i consists of
+ * points[offsets[i]] up to (not including) points[offsets[i + 1]]. */
+typedef struct edge_chains {
+    edge_point *points;             ///< The points of all chains
+    int *offsets;                   ///< Start of each chain (num_chains + 1 entries)
+    int num_points, max_points;     ///< Used and allocated points
+    int num_chains, max_chains;     ///< Used chains and allocated offsets
+    int *stack, num_stack, max_stack; ///< Branch points used while tracing
+} edge_chains;
+
+/* Hysteresis thresholds that are reused over the frames of a stream */
+typedef struct hysteresis_stream {
+    int lowthreshold, highthreshold;    ///< The thresholds in use
+    int reference;                      ///< Subsampled high threshold at the last refresh
+    int frames;                         ///< Frames since the last refresh
+    int refresh;                        ///< Refresh the thresholds every refresh frames
+    int subsample;                      ///< Row and column step of the drift detector
+    float max_drift;                    ///< Relative drift that forces a refresh
+    float smoothing;                    ///< Weight of new thresholds on a refresh
+    int valid;                          ///< Thresholds have been computed
+} hysteresis_stream;
+
 /* Apply hysteresis */
 void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
                       float tlow, float thigh, unsigned char *edge);
 
+/* Compute the hysteresis thresholds from a magnitude histogram of the possible edges */
+void histogram_thresholds(int *hist, float tlow, float thigh, int *lowthreshold, int *highthreshold);
+
+/* Initialize the threshold reuse for a stream */
+void init_hysteresis_stream(hysteresis_stream *stream, int refresh, int subsample,
+                            float max_drift, float smoothing);
+
+/* Apply hysteresis reusing the thresholds of the previous frames */
+void apply_hysteresis_stream(hysteresis_stream *stream, short int *mag, unsigned char *nms,
+                             int rows, int cols, float tlow, float thigh, unsigned char *edge);
+
+/* Apply hysteresis and output the edges as chains (overwrites nms) */
+int apply_hysteresis_chains(hysteresis_stream *stream, short int *mag, unsigned char *nms,
+                            int rows, int cols, float tlow, float thigh, edge_chains *chains);
+
+/* Trace the edges of an edge image into chains */
+int trace_edge_chains(unsigned char *edge, int rows, int cols, edge_chains *chains);
+
+/* Free the edge chains buffers */
+void free_edge_chains(edge_chains *chains);
+
+/* Write the edge chains to a text file */
+int write_edge_chains(char *outfilename, edge_chains *chains);
+
 /* Do a non maximum supression */
 void non_max_supp(short *mag, short *gradx, short *grady, int nrows,
                   int ncols, unsigned char *result);
 
+/* Do a non maximum supression of a single row */
+void non_max_supp_row(short *magup, short *mag, short *magdown, short *gradx, short *grady,
+                      int ncols, unsigned char *result);
+
 
 #endif /* !defined (hysteresis_H) */
@@ -6,40 +6,33 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pgm_io.h"
+
+#define PNM_MAX_SIDE (1 << 20)          /* Most rows or columns of an image, also when it is streamed */
+#define PNM_MAX_PIXELS (INT_MAX / 8)    /* Most pixels of an image in memory, so rows * cols times the
+                                           bytes of a sample or of an int buffer fits an int */
+
+static int pnm_size_valid(long rows, long cols, long maxval, int in_memory);
+static int map_pgm_image(char *infilename, pnm_image *pnm);
+static int copy_pnm_gray(char *infilename, pnm_image *pnm, unsigned char *image,
+                         int rows, int cols, int stride, pnm_gray_fn to_gray);
 
 /******************************************************************************
-* Function: read_pgm_image
-* Purpose: This function reads in an image in PGM format. The image can be
-* read in from either a file or from standard input. The image is only read
-* from standard input when infilename = NULL. Because the PGM format includes
-* the number of columns and the number of rows in the image, these are read
-* from the file. Memory to store the image is allocated in this function.
-* All comments in the header are discarded in the process of reading the
-* image. Upon failure, this function returns 0, upon sucess it returns 1.
+* Function: read_pgm_header
+* Purpose: Verify that the image is in PGM format, read in the number of
+* columns and rows in the image and scan past all of the header information.
+* Upon failure, this function returns 0, upon sucess it returns 1.
 ******************************************************************************/
-int read_pgm_image(char *infilename, unsigned char **image, int *rows,
-                   int *cols)
+static int read_pgm_header(FILE *fp, char *infilename, int *rows, int *cols)
 {
-    FILE *fp;
     char buf[71];
 
-    /***************************************************************************
-    * Open the input image file for reading if a filename was given. If no
-    * filename was provided, set fp to read from standard input.
-    ***************************************************************************/
-    if (infilename == NULL) { fp = stdin; }
-    else {
-        if ((fp = fopen(infilename, "r")) == NULL) {
-            fprintf(stderr, "Error reading the file %s in read_pgm_image().\n",
-                    infilename);
-            return (0);
-        }
-    }
-
-    /***************************************************************************
-    * Verify that the image is in PGM format, read in the number of columns
-    * and rows in the image and scan past all of the header information.
-    ***************************************************************************/
     if (fgets(buf, 70, fp) == NULL) {
         fprintf(stderr, "fgets error");
     }
@@ -47,7 +40,6 @@ int read_pgm_image(char *infilename, unsigned char **image, int *rows,
     if (strncmp(buf, "P5", 2) != 0) {
         fprintf(stderr, "The file %s is not in PGM format in ", infilename);
         fprintf(stderr, "read_pgm_image().\n");
-        if (fp != stdin) { fclose(fp); }
         return (0);
     }
     do {
@@ -55,29 +47,215 @@ int read_pgm_image(char *infilename, unsigned char **image, int *rows,
             fprintf(stderr, "fgets error");
         }
     } while (buf[0] == '#'); /* skip all comment lines */
-    sscanf(buf, "%d %d", cols, rows);
+    if (sscanf(buf, "%d %d", cols, rows) != 2 || !pnm_size_valid(*rows, *cols, 255, 0)) {
+        fprintf(stderr, "The header of %s is not valid in read_pgm_image().\n",
+                (infilename != NULL) ? infilename : "the standard input");
+        return (0);
+    }
     do {
         if (fgets(buf, 70, fp) == NULL) {
             fprintf(stderr, "fgets error");
         }
     } while (buf[0] == '#'); /* skip all comment lines */
+    return (1);
+}
+
+/******************************************************************************
+* Function: write_pgm_header
+* Purpose: Write the header information of a PGM image. A comment is written
+* to the header if comment != NULL.
+******************************************************************************/
+static void write_pgm_header(FILE *fp, int rows, int cols, char *comment, int maxval)
+{
+    fprintf(fp, "P5\n%d %d\n", cols, rows);
+    if (comment != NULL)
+        if (strlen(comment) <= 70) { fprintf(fp, "# %s\n", comment); }
+    fprintf(fp, "%d\n", maxval);
+}
+
+/******************************************************************************
+* Function: read_pgm_image
+* Purpose: This function reads in an image in PGM format. The image can be
+* read in from either a file or from standard input. The image is only read
+* from standard input when infilename = NULL. Because the PGM format includes
+* the number of columns and the number of rows in the image, these are read
+* from the file. Memory to store the image is allocated in this function.
+* All comments in the header are discarded in the process of reading the
+* image. Upon failure, this function returns 0, upon sucess it returns 1.
+******************************************************************************/
+int read_pgm_image(char *infilename, unsigned char **image, int *rows,
+                   int *cols)
+{
+    FILE *fp;
+    pnm_image pnm;
+
+    /***************************************************************************
+    * A file is mapped and its raster copied once, standard input is read
+    * when infilename = NULL.
+    ***************************************************************************/
+    if (infilename != NULL) {
+        if (!map_pgm_image(infilename, &pnm)) { return (0); }
+        *rows = pnm.rows;
+        *cols = pnm.cols;
+        if (((*image) = (unsigned char *) malloc((*rows) * (*cols))) == NULL) {
+            fprintf(stderr, "Memory allocation failure in read_pgm_image().\n");
+            unmap_pnm_image(&pnm);
+            return (0);
+        }
+        memcpy(*image, pnm.raster, (*rows) * (*cols));
+        unmap_pnm_image(&pnm);
+        return (1);
+    }
+    fp = stdin;
+
+    if (!read_pgm_header(fp, infilename, rows, cols)) {
+        return (0);
+    }
+    if (!pnm_size_valid(*rows, *cols, 255, 1)) {
+        fprintf(stderr, "The image on the standard input is too large in read_pgm_image().\n");
+        return (0);
+    }
 
     /***************************************************************************
     * Allocate memory to store the image then read the image from the file.
     ***************************************************************************/
     if (((*image) = (unsigned char *) malloc((*rows) * (*cols))) == NULL) {
         fprintf(stderr, "Memory allocation failure in read_pgm_image().\n");
-        if (fp != stdin) { fclose(fp); }
         return (0);
     }
     if ((*rows) != fread((*image), (*cols), (*rows), fp)) {
         fprintf(stderr, "Error reading the image data in read_pgm_image().\n");
-        if (fp != stdin) { fclose(fp); }
         free((*image));
         return (0);
     }
+    return (1);
+}
 
-    if (fp != stdin) { fclose(fp); }
+/******************************************************************************
+* Function: read_pgm_into
+* Purpose: This function reads a PGM image of rows x cols into a buffer the
+* caller provides, like a shared buffer of the DSP, instead of allocating
+* one. Row r of the image starts at image + r * stride. Upon failure, or when
+* the image has another size, this function returns 0, upon sucess it
+* returns 1.
+******************************************************************************/
+int read_pgm_into(char *infilename, unsigned char *image, int rows, int cols,
+                  int stride)
+{
+    pnm_image pnm;
+
+    if (!map_pgm_image(infilename, &pnm)) { return (0); }
+    return (copy_pnm_gray(infilename, &pnm, image, rows, cols, stride, NULL));
+}
+
+/******************************************************************************
+* Function: read_pnm_gray_into
+* Purpose: This function reads a PGM image, or a PPM image with one byte per
+* sample, of rows x cols as gray into a buffer the caller provides, like
+* read_pgm_into. The interleaved samples of a PPM are converted by to_gray
+* straight from the mapping into the buffer, there is no separate gray or
+* color image. Upon failure, or when the image has another size, this
+* function returns 0, upon sucess it returns 1.
+******************************************************************************/
+int read_pnm_gray_into(char *infilename, unsigned char *image, int rows,
+                       int cols, int stride, pnm_gray_fn to_gray)
+{
+    pnm_image pnm;
+
+    if (!map_pnm_image(infilename, &pnm)) { return (0); }
+    if (pnm.maxval > 255 || (pnm.channels == 3 && to_gray == NULL)) {
+        fprintf(stderr, "The file %s is not an 8-bit PGM or PPM image.\n", infilename);
+        unmap_pnm_image(&pnm);
+        return (0);
+    }
+    return (copy_pnm_gray(infilename, &pnm, image, rows, cols, stride,
+                          (pnm.channels == 3) ? to_gray : NULL));
+}
+
+/******************************************************************************
+* Function: copy_pnm_gray
+* Purpose: Copy the raster of a mapped 8-bit image into image, rows stride
+* bytes apart, converting the pixels with to_gray when it is not NULL, and
+* unmap the image. Upon failure, or when the image has another size, this
+* function returns 0, upon sucess it returns 1.
+******************************************************************************/
+static int copy_pnm_gray(char *infilename, pnm_image *pnm, unsigned char *image,
+                         int rows, int cols, int stride, pnm_gray_fn to_gray)
+{
+    int r;
+
+    if (pnm->rows != rows || pnm->cols != cols) {
+        fprintf(stderr, "The image %s is %d x %d instead of %d x %d.\n",
+                infilename, pnm->cols, pnm->rows, cols, rows);
+        unmap_pnm_image(pnm);
+        return (0);
+    }
+
+    /***************************************************************************
+    * The raster is copied from the mapping, a packed buffer at once,
+    * otherwise row by row.
+    ***************************************************************************/
+    if (stride == cols && to_gray != NULL) {
+        to_gray(pnm->raster, image, rows * cols);
+    } else if (stride == cols) {
+        memcpy(image, pnm->raster, (size_t)rows * cols);
+    } else {
+        for (r = 0; r < rows; r++) {
+            if (to_gray != NULL) {
+                to_gray(pnm->raster + (size_t)r * cols * 3, image + r * stride, cols);
+            } else {
+                memcpy(image + r * stride, pnm->raster + r * cols, cols);
+            }
+        }
+    }
+    unmap_pnm_image(pnm);
+    return (1);
+}
+
+/******************************************************************************
+* Function: read_pgm_image16
+* Purpose: This function reads in a PGM image with any maxval up to 65535
+* into 16 bits per pixel. Above maxval 255 the samples are two bytes, most
+* significant first, below it they are one byte and widened. The maxval is
+* returned, so the caller can scale the samples. Memory to store the image is
+* allocated in this function. Upon failure, this function returns 0, upon
+* sucess it returns 1.
+******************************************************************************/
+int read_pgm_image16(char *infilename, unsigned short int **image, int *rows,
+                     int *cols, int *maxval)
+{
+    pnm_image pnm;
+    size_t p, size;
+
+    if (!map_pnm_image(infilename, &pnm)) { return (0); }
+    if (pnm.channels != 1) {
+        fprintf(stderr, "The file %s is not in PGM format in read_pgm_image16().\n", infilename);
+        unmap_pnm_image(&pnm);
+        return (0);
+    }
+    *rows = pnm.rows;
+    *cols = pnm.cols;
+    *maxval = pnm.maxval;
+    size = (size_t)pnm.rows * pnm.cols;
+    if (((*image) = (unsigned short int *) malloc(size * sizeof(unsigned short int))) == NULL) {
+        fprintf(stderr, "Memory allocation failure in read_pgm_image16().\n");
+        unmap_pnm_image(&pnm);
+        return (0);
+    }
+
+    /***************************************************************************
+    * The samples are converted from the mapping in one pass.
+    ***************************************************************************/
+    if (pnm.maxval > 255) {
+        for (p = 0; p < size; p++) {
+            (*image)[p] = (unsigned short int)((pnm.raster[2 * p] << 8) | pnm.raster[2 * p + 1]);
+        }
+    } else {
+        for (p = 0; p < size; p++) {
+            (*image)[p] = pnm.raster[p];
+        }
+    }
+    unmap_pnm_image(&pnm);
     return (1);
 }
 
@@ -91,41 +269,281 @@ int write_pgm_image(char *outfilename, unsigned char *image, int rows,
                     int cols, char *comment, int maxval)
 {
     FILE *fp;
+    pnm_image pnm;
 
     /***************************************************************************
-    * Open the output image file for writing if a filename was given. If no
-    * filename was provided, set fp to write to standard output.
+    * A file is created at its final size and the image copied into its
+    * mapping, standard output is written when outfilename = NULL.
     ***************************************************************************/
-    if (outfilename == NULL) { fp = stdout; }
-    else {
-        if ((fp = fopen(outfilename, "w")) == NULL) {
-            fprintf(stderr, "Error writing the file %s in write_pgm_image().\n",
-                    outfilename);
-            return (0);
-        }
+    if (outfilename != NULL) {
+        if (!create_pnm_image(outfilename, &pnm, rows, cols, 1, comment, maxval)) { return (0); }
+        memcpy(pnm.raster, image, (size_t)rows * cols);
+        unmap_pnm_image(&pnm);
+        return (1);
     }
+    fp = stdout;
 
     /***************************************************************************
     * Write the header information to the PGM file.
     ***************************************************************************/
-    fprintf(fp, "P5\n%d %d\n", cols, rows);
-    if (comment != NULL)
-        if (strlen(comment) <= 70) { fprintf(fp, "# %s\n", comment); }
-    fprintf(fp, "%d\n", maxval);
+    write_pgm_header(fp, rows, cols, comment, maxval);
 
     /***************************************************************************
     * Write the image data to the file.
     ***************************************************************************/
     if (rows != fwrite(image, cols, rows, fp)) {
         fprintf(stderr, "Error writing the image data in write_pgm_image().\n");
-        if (fp != stdout) { fclose(fp); }
         return (0);
     }
+    return (1);
+}
+
+/******************************************************************************
+* Function: parse_pnm_number
+* Purpose: Read the next number of a PNM header at *pos, skipping the white
+* space and the comments (from # to the end of the line) before it. Returns
+* -1 when there is no number before the end of the header, or when it has
+* more digits than any valid size.
+******************************************************************************/
+static long parse_pnm_number(const unsigned char *header, size_t length, size_t *pos)
+{
+    long value = 0;
+    size_t p = *pos;
+
+    while (p < length && (header[p] == '#' || header[p] == ' ' || header[p] == '\t' ||
+                          header[p] == '\n' || header[p] == '\r')) {
+        if (header[p] == '#') {
+            while (p < length && header[p] != '\n') { p++; }
+        } else {
+            p++;
+        }
+    }
+    if (p >= length || header[p] < '0' || header[p] > '9') { return (-1); }
+    while (p < length && header[p] >= '0' && header[p] <= '9' && value <= 0xFFFFFF) {
+        value = value * 10 + (header[p++] - '0');
+    }
+    if (p < length && header[p] >= '0' && header[p] <= '9') { return (-1); }
+    *pos = p;
+    return (value);
+}
+
+/******************************************************************************
+* Function: pnm_size_valid
+* Purpose: Check the size and maxval of an image. The rows and columns are at
+* most PNM_MAX_SIDE, and an image that is held in memory (in_memory != 0) has
+* at most PNM_MAX_PIXELS pixels, so that no size computed from them overflows.
+* Returns 1 when the size is valid, 0 otherwise.
+******************************************************************************/
+static int pnm_size_valid(long rows, long cols, long maxval, int in_memory)
+{
+    if (rows < 1 || cols < 1 || rows > PNM_MAX_SIDE || cols > PNM_MAX_SIDE || maxval < 1 || maxval > 65535) {
+        return (0);
+    }
+    return (!in_memory || rows <= PNM_MAX_PIXELS / cols);
+}
+
+/******************************************************************************
+* Function: map_pnm_image
+* Purpose: Map a PGM (P5) or PPM (P6) image read only and parse its header in
+* place. The raster is not copied, pnm->raster points into the mapping until
+* unmap_pnm_image. The pages are only read when the raster is used. Upon
+* failure, this function returns 0, upon sucess it returns 1.
+******************************************************************************/
+int map_pnm_image(char *infilename, pnm_image *pnm)
+{
+    int fd, channels;
+    struct stat st;
+    unsigned char *base;
+    size_t pos = 2, raster;
+    long cols, rows, maxval;
+
+    memset(pnm, 0, sizeof(pnm_image));
+    if ((fd = open(infilename, O_RDONLY)) < 0) {
+        fprintf(stderr, "Error reading the file %s in map_pnm_image().\n", infilename);
+        return (0);
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < 2) {
+        fprintf(stderr, "The file %s is empty in map_pnm_image().\n", infilename);
+        close(fd);
+        return (0);
+    }
+    base = (unsigned char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error mapping the file %s in map_pnm_image().\n", infilename);
+        return (0);
+    }
+    pnm->base = base;
+    pnm->length = st.st_size;
+
+    /***************************************************************************
+    * The magic number, the size and maxval, then a single white space.
+    ***************************************************************************/
+    if (base[0] != 'P' || (base[1] != '5' && base[1] != '6')) {
+        fprintf(stderr, "The file %s is not in PGM or PPM format in map_pnm_image().\n", infilename);
+        unmap_pnm_image(pnm);
+        return (0);
+    }
+    channels = (base[1] == '5') ? 1 : 3;
+    cols = parse_pnm_number(base, pnm->length, &pos);
+    rows = parse_pnm_number(base, pnm->length, &pos);
+    maxval = parse_pnm_number(base, pnm->length, &pos);
+    if (!pnm_size_valid(rows, cols, maxval, 1) || pos >= pnm->length) {
+        fprintf(stderr, "The header of %s is not valid in map_pnm_image().\n", infilename);
+        unmap_pnm_image(pnm);
+        return (0);
+    }
+    pos++;
+    raster = (size_t)rows * cols * channels * ((maxval > 255) ? 2 : 1);
+    if (raster / rows / cols != (size_t)channels * ((maxval > 255) ? 2 : 1) || pnm->length - pos < raster) {
+        fprintf(stderr, "The raster of %s is truncated in map_pnm_image().\n", infilename);
+        unmap_pnm_image(pnm);
+        return (0);
+    }
+    madvise(base, pnm->length, MADV_SEQUENTIAL);
+
+    pnm->raster = base + pos;
+    pnm->rows = (int)rows;
+    pnm->cols = (int)cols;
+    pnm->channels = channels;
+    pnm->maxval = (int)maxval;
+    return (1);
+}
+
+/******************************************************************************
+* Function: create_pnm_image
+* Purpose: Create a PGM (channels 1) or PPM (channels 3) image of rows x cols.
+* The file is sized for the header and the raster at once and mapped, the
+* header is written and pnm->raster points at the raster in the mapping to be
+* filled in place. The file is complete after unmap_pnm_image. A comment is
+* written to the header if comment != NULL. Upon failure, this function
+* returns 0, upon sucess it returns 1.
+******************************************************************************/
+int create_pnm_image(char *outfilename, pnm_image *pnm, int rows, int cols,
+                     int channels, char *comment, int maxval)
+{
+    char header[128];
+    int fd, header_len;
+    void *base;
+
+    memset(pnm, 0, sizeof(pnm_image));
+    if (!pnm_size_valid(rows, cols, maxval, 1)) {
+        fprintf(stderr, "The size of %s is not valid in create_pnm_image().\n", outfilename);
+        return (0);
+    }
+    if (comment != NULL && strlen(comment) <= 70) {
+        header_len = sprintf(header, "P%c\n%d %d\n# %s\n%d\n", (channels == 3) ? '6' : '5', cols, rows,
+                             comment, maxval);
+    } else {
+        header_len = sprintf(header, "P%c\n%d %d\n%d\n", (channels == 3) ? '6' : '5', cols, rows, maxval);
+    }
+    pnm->length = header_len + (size_t)rows * cols * channels * ((maxval > 255) ? 2 : 1);
+
+    if ((fd = open(outfilename, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        fprintf(stderr, "Error writing the file %s in create_pnm_image().\n", outfilename);
+        return (0);
+    }
+
+    /***************************************************************************
+    * The blocks of the file are allocated before it is mapped, a store into
+    * a sparse file on a full disk would raise SIGBUS instead of this error.
+    ***************************************************************************/
+    if (posix_fallocate(fd, 0, pnm->length) != 0) {
+        fprintf(stderr, "Error allocating the file %s in create_pnm_image().\n", outfilename);
+        close(fd);
+        unlink(outfilename);
+        return (0);
+    }
+    if ((base = mmap(NULL, pnm->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "Error mapping the file %s in create_pnm_image().\n", outfilename);
+        close(fd);
+        return (0);
+    }
+    close(fd);
 
-    if (fp != stdout) { fclose(fp); }
+    memcpy(base, header, header_len);
+    pnm->base = base;
+    pnm->raster = (unsigned char *)base + header_len;
+    pnm->rows = rows;
+    pnm->cols = cols;
+    pnm->channels = channels;
+    pnm->maxval = maxval;
     return (1);
 }
 
+/******************************************************************************
+* Function: unmap_pnm_image
+* Purpose: Unmap an image of map_pnm_image or create_pnm_image. The pages of
+* a created image are written back to the file by the kernel.
+******************************************************************************/
+void unmap_pnm_image(pnm_image *pnm)
+{
+    if (pnm->base != NULL) {
+        munmap(pnm->base, pnm->length);
+    }
+    memset(pnm, 0, sizeof(pnm_image));
+}
+
+/******************************************************************************
+* Function: map_pgm_image
+* Purpose: Map an image with map_pnm_image and check that it is a PGM image
+* with one byte per pixel. Upon failure, this function returns 0, upon sucess
+* it returns 1.
+******************************************************************************/
+static int map_pgm_image(char *infilename, pnm_image *pnm)
+{
+    if (!map_pnm_image(infilename, pnm)) { return (0); }
+    if (pnm->channels != 1 || pnm->maxval > 255) {
+        fprintf(stderr, "The file %s is not an 8-bit PGM image (see read_pgm_image16).\n", infilename);
+        unmap_pnm_image(pnm);
+        return (0);
+    }
+    return (1);
+}
+
+/******************************************************************************
+* Function: open_pgm_stream
+* Purpose: Open a PGM image for reading the raster row by row. The header is
+* read and the returned file is positioned at the first row, so the raster can
+* be read with fread and read again after a seek to ftell of the returned file.
+* Upon failure, this function returns NULL.
+******************************************************************************/
+FILE *open_pgm_stream(char *infilename, int *rows, int *cols)
+{
+    FILE *fp;
+
+    if ((fp = fopen(infilename, "rb")) == NULL) {
+        fprintf(stderr, "Error reading the file %s in open_pgm_stream().\n",
+                infilename);
+        return (NULL);
+    }
+    if (!read_pgm_header(fp, infilename, rows, cols)) {
+        fclose(fp);
+        return (NULL);
+    }
+    return (fp);
+}
+
+/******************************************************************************
+* Function: create_pgm_stream
+* Purpose: Create a PGM image that is written row by row. The header is
+* written and the rows can be appended with fwrite. Upon failure, this
+* function returns NULL.
+******************************************************************************/
+FILE *create_pgm_stream(char *outfilename, int rows, int cols, char *comment,
+                        int maxval)
+{
+    FILE *fp;
+
+    if ((fp = fopen(outfilename, "wb")) == NULL) {
+        fprintf(stderr, "Error writing the file %s in create_pgm_stream().\n",
+                outfilename);
+        return (NULL);
+    }
+    write_pgm_header(fp, rows, cols, comment, maxval);
+    return (fp);
+}
+
 /******************************************************************************
 * Function: read_ppm_image
 * Purpose: This function reads in an image in PPM format. The image can be
@@ -143,19 +561,42 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
     FILE *fp;
     char buf[71];
     int p, size;
+    pnm_image pnm;
 
     /***************************************************************************
-    * Open the input image file for reading if a filename was given. If no
-    * filename was provided, set fp to read from standard input.
+    * A file is mapped and its interleaved raster split into the three
+    * images, standard input is read when infilename = NULL.
     ***************************************************************************/
-    if (infilename == NULL) { fp = stdin; }
-    else {
-        if ((fp = fopen(infilename, "r")) == NULL) {
-            fprintf(stderr, "Error reading the file %s in read_ppm_image().\n",
-                    infilename);
+    if (infilename != NULL) {
+        if (!map_pnm_image(infilename, &pnm)) { return (0); }
+        if (pnm.channels != 3 || pnm.maxval > 255) {
+            fprintf(stderr, "The file %s is not an 8-bit PPM image.\n", infilename);
+            unmap_pnm_image(&pnm);
             return (0);
         }
+        *rows = pnm.rows;
+        *cols = pnm.cols;
+        size = (*rows) * (*cols);
+        (*image_red) = (unsigned char *) malloc(size);
+        (*image_grn) = (unsigned char *) malloc(size);
+        (*image_blu) = (unsigned char *) malloc(size);
+        if ((*image_red) == NULL || (*image_grn) == NULL || (*image_blu) == NULL) {
+            fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
+            free(*image_red);
+            free(*image_grn);
+            free(*image_blu);
+            unmap_pnm_image(&pnm);
+            return (0);
+        }
+        for (p = 0; p < size; p++) {
+            (*image_red)[p] = pnm.raster[3 * p];
+            (*image_grn)[p] = pnm.raster[3 * p + 1];
+            (*image_blu)[p] = pnm.raster[3 * p + 2];
+        }
+        unmap_pnm_image(&pnm);
+        return (1);
     }
+    fp = stdin;
 
     /***************************************************************************
     * Verify that the image is in PPM format, read in the number of columns
@@ -166,9 +607,8 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
     }
 
     if (strncmp(buf, "P6", 2) != 0) {
-        fprintf(stderr, "The file %s is not in PPM format in ", infilename);
+        fprintf(stderr, "The standard input is not in PPM format in ");
         fprintf(stderr, "read_ppm_image().\n");
-        if (fp != stdin) { fclose(fp); }
         return (0);
     }
     do {
@@ -176,7 +616,10 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
             fprintf(stderr, "fgets error");
         }
     } while (buf[0] == '#'); /* skip all comment lines */
-    sscanf(buf, "%d %d", cols, rows);
+    if (sscanf(buf, "%d %d", cols, rows) != 2 || !pnm_size_valid(*rows, *cols, 255, 1)) {
+        fprintf(stderr, "The header of the standard input is not valid in read_ppm_image().\n");
+        return (0);
+    }
     do {
         if (fgets(buf, 70, fp) == NULL) {
             fprintf(stderr, "fgets error");
@@ -188,17 +631,14 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
     ***************************************************************************/
     if (((*image_red) = (unsigned char *) malloc((*rows) * (*cols))) == NULL) {
         fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
-        if (fp != stdin) { fclose(fp); }
         return (0);
     }
     if (((*image_grn) = (unsigned char *) malloc((*rows) * (*cols))) == NULL) {
         fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
-        if (fp != stdin) { fclose(fp); }
         return (0);
     }
     if (((*image_blu) = (unsigned char *) malloc((*rows) * (*cols))) == NULL) {
         fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
-        if (fp != stdin) { fclose(fp); }
         return (0);
     }
 
@@ -208,8 +648,6 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
         (*image_grn)[p] = (unsigned char)fgetc(fp);
         (*image_blu)[p] = (unsigned char)fgetc(fp);
     }
-
-    if (fp != stdin) { fclose(fp); }
     return (1);
 }
 
@@ -225,19 +663,24 @@ int write_ppm_image(char *outfilename, unsigned char *image_red,
 {
     FILE *fp;
     long size, p;
+    pnm_image pnm;
 
     /***************************************************************************
-    * Open the output image file for writing if a filename was given. If no
-    * filename was provided, set fp to write to standard output.
+    * A file is created at its final size and the three images interleaved
+    * into its mapping, standard output is written when outfilename = NULL.
     ***************************************************************************/
-    if (outfilename == NULL) { fp = stdout; }
-    else {
-        if ((fp = fopen(outfilename, "w")) == NULL) {
-            fprintf(stderr, "Error writing the file %s in write_pgm_image().\n",
-                    outfilename);
-            return (0);
+    size = (long)rows * (long)cols;
+    if (outfilename != NULL) {
+        if (!create_pnm_image(outfilename, &pnm, rows, cols, 3, comment, maxval)) { return (0); }
+        for (p = 0; p < size; p++) {
+            pnm.raster[3 * p] = image_red[p];
+            pnm.raster[3 * p + 1] = image_grn[p];
+            pnm.raster[3 * p + 2] = image_blu[p];
         }
+        unmap_pnm_image(&pnm);
+        return (1);
     }
+    fp = stdout;
 
     /***************************************************************************
     * Write the header information to the PGM file.
@@ -250,13 +693,10 @@ int write_ppm_image(char *outfilename, unsigned char *image_red,
     /***************************************************************************
     * Write the image data to the file.
     ***************************************************************************/
-    size = (long)rows * (long)cols;
     for (p = 0; p < size; p++) { /* Write the image in pixel interleaved format. */
         fputc(image_red[p], fp);
         fputc(image_grn[p], fp);
         fputc(image_blu[p], fp);
     }
-
-    if (fp != stdout) { fclose(fp); }
     return (1);
 }
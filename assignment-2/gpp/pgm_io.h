@@ -1,13 +1,69 @@
 #if !defined (pgm_io_H)
 #define pgm_io_H
 
+#include <stdio.h>
+#include <stddef.h>
+
+/* A PGM (P5) or PPM (P6) file mapped into memory. The header is parsed in
+ * place and raster points at the first sample in the mapping, so the pixels
+ * are read or written without a copy. */
+typedef struct pnm_image {
+    unsigned char *raster;              ///< The first sample, rows of cols * channels samples (2 bytes above maxval 255)
+    int rows, cols;                     ///< The image size
+    int channels;                       ///< 1 for PGM, 3 (red, green, blue) for PPM
+    int maxval;                         ///< The largest sample value
+    void *base;                         ///< The mapping of the whole file
+    size_t length;                      ///< Bytes of the mapping
+} pnm_image;
+
+/* The luminance of a red, green, blue pixel in fixed point, the ITU-R BT.601
+ * weights in 8 fractional bits: gray = (77 R + 150 G + 29 B + 128) >> 8 */
+#define LUMA_RED 77
+#define LUMA_GREEN 150
+#define LUMA_BLUE 29
+#define LUMA_SHIFT 8
+
+/* Converts pixels of interleaved red, green and blue samples to gray */
+typedef void (*pnm_gray_fn)(const unsigned char *rgb, unsigned char *gray, int pixels);
+
 /* Read PGM image */
 int read_pgm_image(char *infilename, unsigned char **image, int *rows,
                    int *cols);
 
+/* Read a PGM image of rows x cols into a buffer of the caller, rows stride bytes apart */
+int read_pgm_into(char *infilename, unsigned char *image, int rows, int cols,
+                  int stride);
+
+/* Read a PGM or 8-bit PPM image of rows x cols as gray into a buffer of the
+ * caller, the PPM converted with to_gray while it is copied */
+int read_pnm_gray_into(char *infilename, unsigned char *image, int rows,
+                       int cols, int stride, pnm_gray_fn to_gray);
+
+/* Read a PGM image with a maxval up to 65535, 16 bits per pixel */
+int read_pgm_image16(char *infilename, unsigned short int **image, int *rows,
+                     int *cols, int *maxval);
+
 /* Write PGM image */
 int write_pgm_image(char *outfilename, unsigned char *image, int rows,
                     int cols, char *comment, int maxval);
 
+/* Map a PGM or PPM image to read it in place */
+int map_pnm_image(char *infilename, pnm_image *pnm);
+
+/* Create a PGM (channels 1) or PPM (channels 3) image of its final size and
+ * map it, the raster is filled in place */
+int create_pnm_image(char *outfilename, pnm_image *pnm, int rows, int cols,
+                     int channels, char *comment, int maxval);
+
+/* Unmap an image of map_pnm_image or create_pnm_image */
+void unmap_pnm_image(pnm_image *pnm);
+
+/* Open a PGM image to read the raster row by row */
+FILE *open_pgm_stream(char *infilename, int *rows, int *cols);
+
+/* Create a PGM image to write the raster row by row */
+FILE *create_pgm_stream(char *outfilename, int rows, int cols, char *comment,
+                        int maxval);
+
 
 #endif /* !defined (pgm_io_H) */
@@ -0,0 +1,386 @@
+/*******************************************************************************
+* FILE: stream.c
+* Bounded memory canny edge detection. The image is read in strips of rows
+* and pushed through the fused pipeline (fused.c), so no full size image is
+* ever allocated. The hysteresis is done as a connected component labeling of
+* the possible edges over the strips. A forward pass labels every strip and
+* writes for each strip label whether its component has ended (with or
+* without a pixel above the high threshold) or continues in the next strip.
+* A backward pass over these tables resolves the continuing components, after
+* which the strips are labeled again and the edge rows are written in order.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+#include "fused.h"
+#include "hysteresis.h"
+#include "pgm_io.h"
+
+#define VERBOSE 0
+
+#define NOEDGE 255
+#define POSSIBLE_EDGE 128
+#define EDGE 0
+
+#define LABEL_WEAK -1       ///< Ended component without a pixel above the high threshold
+#define LABEL_STRONG -2     ///< Ended component with a pixel above the high threshold
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+enum {
+    STREAM_HISTOGRAM,       ///< Compute the magnitude histogram of the possible edges
+    STREAM_LABEL,           ///< Label the strips and write the label tables
+    STREAM_OUTPUT           ///< Label the strips again and write the edge rows
+};
+
+typedef struct canny_stream_state {
+    int rows, cols;                     ///< Image size
+    int strip_rows;                     ///< Rows per strip
+    int pass;                           ///< Current pass over the image
+    FILE *in, *out, *tables;            ///< Input image, output image and label tables
+    long raster;                        ///< Offset of the raster in the input image
+    unsigned char *strip;               ///< Strip of input rows
+    int *hist;                          ///< Magnitude histogram of the possible edges
+    int lowthreshold, highthreshold;    ///< Hysteresis thresholds
+    int *prev, *cur;                    ///< Labels of the previous and current row
+    int *parent;                        ///< Union find forest of the strip labels
+    unsigned char *strong;              ///< Component (root) has a pixel above the high threshold
+    int *table;                         ///< Resolution of the strip labels
+    int *carry;                         ///< Label in the next strip of the continuing components
+    unsigned char *carry_strong;        ///< Strong flag of the labels carried to the next strip
+    int num_labels, max_labels;         ///< Used and allocated strip labels
+    unsigned char *edge;                ///< Edge row
+    int error;                          ///< Reading or writing failed
+} canny_stream_state;
+
+/* Source of the pipeline, reads a strip of rows at the start of every strip */
+static unsigned char *stream_source(void *arg, int row)
+{
+    canny_stream_state *s = (canny_stream_state *)arg;
+    int n;
+
+    if (row % s->strip_rows == 0) {
+        n = MIN(s->strip_rows, s->rows - row);
+        if (fread(s->strip, s->cols, n, s->in) != (size_t)n) {
+            fprintf(stderr, "Error reading the image data in canny_stream().\n");
+            memset(s->strip, 0, n * s->cols);
+            s->error = 1;
+        }
+    }
+    return (s->strip + (row % s->strip_rows) * s->cols);
+}
+
+/* Find the root of a label, halving the path on the way */
+static int find_label(int *parent, int label)
+{
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return (label);
+}
+
+/* Merge the components of two labels and return the new root */
+static int union_labels(canny_stream_state *s, int a, int b)
+{
+    int t;
+
+    a = find_label(s->parent, a);
+    b = find_label(s->parent, b);
+    if (a == b) { return (a); }
+    if (a > b) { t = a; a = b; b = t; }
+    s->parent[b] = a;
+    s->strong[a] |= s->strong[b];
+    return (a);
+}
+
+/*******************************************************************************
+* PROCEDURE: label_row
+* PURPOSE: Label the possible edges of a row that are above the low threshold
+* (or are a seed above the high threshold), 8-connected to the labels of the
+* row above. The border is never an edge, as in init_edge_map. A row has at
+* most cols / 2 new labels since a new label has no labeled left neighbour.
+*******************************************************************************/
+static void label_row(canny_stream_state *s, int row, short int *mag, unsigned char *nms)
+{
+    int c, k, label, *tmp, neighbours[4];
+
+    tmp = s->prev;
+    s->prev = s->cur;
+    s->cur = tmp;
+    memset(s->cur, 0, s->cols * sizeof(int));
+    if (row == 0 || row == s->rows - 1) { return; }
+
+    for (c = 1; c < s->cols - 1; c++) {
+        if ((nms[c] != POSSIBLE_EDGE) || ((mag[c] <= s->lowthreshold) && (mag[c] < s->highthreshold))) {
+            continue;
+        }
+
+        neighbours[0] = s->cur[c - 1];
+        neighbours[1] = s->prev[c - 1];
+        neighbours[2] = s->prev[c];
+        neighbours[3] = s->prev[c + 1];
+        for (k = 0, label = 0; k < 4; k++) {
+            if (neighbours[k] != 0) {
+                label = (label == 0) ? neighbours[k] : union_labels(s, label, neighbours[k]);
+            }
+        }
+        if (label == 0) {
+            label = ++s->num_labels;
+            s->parent[label] = label;
+            s->strong[label] = 0;
+        }
+
+        s->cur[c] = label;
+        if (mag[c] >= s->highthreshold) { s->strong[find_label(s->parent, label)] = 1; }
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: finish_strip
+* PURPOSE: Number the components that continue below the last row of the strip
+* as the first labels of the next strip. In the labeling pass the table of the
+* strip is written: for every label the label in the next strip or whether
+* the component ended as strong or weak.
+*******************************************************************************/
+static void finish_strip(canny_stream_state *s, int last)
+{
+    int c, i, root, n = s->num_labels, m = 0;
+
+    for (i = 1; i <= n; i++) { s->carry[i] = 0; }
+    for (c = 0; c < s->cols && !last; c++) {
+        if (s->cur[c] != 0) {
+            root = find_label(s->parent, s->cur[c]);
+            if (s->carry[root] == 0) {
+                s->carry[root] = ++m;
+                s->carry_strong[m] = s->strong[root];
+            }
+            s->cur[c] = s->carry[root];
+        }
+    }
+
+    if (s->pass == STREAM_LABEL) {
+        for (i = 1; i <= n; i++) {
+            root = find_label(s->parent, i);
+            if (s->carry[root] != 0) { s->table[i] = s->carry[root]; }
+            else { s->table[i] = s->strong[root] ? LABEL_STRONG : LABEL_WEAK; }
+        }
+        if (fwrite(&n, sizeof(int), 1, s->tables) != 1 ||
+                fwrite(s->table + 1, sizeof(int), n, s->tables) != (size_t)n ||
+                fwrite(&n, sizeof(int), 1, s->tables) != 1) {
+            fprintf(stderr, "Error writing the label tables in canny_stream().\n");
+            s->error = 1;
+        }
+    } else if (s->table[0] != n) {
+        fprintf(stderr, "Labels differ between passes in canny_stream().\n");
+        s->error = 1;
+    }
+
+    for (i = 1; i <= m; i++) {
+        s->parent[i] = i;
+        s->strong[i] = s->carry_strong[i];
+    }
+    s->num_labels = m;
+}
+
+/* Read the resolved table of the next strip, its label count is kept in table[0] */
+static void read_table(canny_stream_state *s)
+{
+    int n, end;
+
+    if (fread(&n, sizeof(int), 1, s->tables) != 1 || n >= s->max_labels ||
+            fread(s->table + 1, sizeof(int), n, s->tables) != (size_t)n ||
+            fread(&end, sizeof(int), 1, s->tables) != 1 || end != n) {
+        fprintf(stderr, "Error reading the label tables in canny_stream().\n");
+        s->error = 1;
+        n = 0;
+    }
+    s->table[0] = n;
+}
+
+/* Sink of the pipeline, does the work of the current pass on a row */
+static void stream_sink(void *arg, int row, short int *mag, unsigned char *nms)
+{
+    canny_stream_state *s = (canny_stream_state *)arg;
+    int c;
+
+    if (s->pass == STREAM_HISTOGRAM) {
+        if (row == 0 || row == s->rows - 1) { return; }
+        for (c = 1; c < s->cols - 1; c++) {
+            if (nms[c] == POSSIBLE_EDGE) { s->hist[mag[c]]++; }
+        }
+        return;
+    }
+
+    if (s->pass == STREAM_OUTPUT && row % s->strip_rows == 0) { read_table(s); }
+    label_row(s, row, mag, nms);
+
+    if (s->pass == STREAM_OUTPUT) {
+        for (c = 0; c < s->cols; c++) {
+            s->edge[c] = (s->cur[c] != 0 && s->cur[c] <= s->table[0] &&
+                          s->table[s->cur[c]] == LABEL_STRONG) ? EDGE : NOEDGE;
+        }
+        if (fwrite(s->edge, s->cols, 1, s->out) != 1) {
+            fprintf(stderr, "Error writing the image data in canny_stream().\n");
+            s->error = 1;
+        }
+    }
+
+    if ((row + 1) % s->strip_rows == 0 || row == s->rows - 1) {
+        finish_strip(s, row == s->rows - 1);
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: resolve_tables
+* PURPOSE: Walk the label tables from the last strip to the first and replace
+* every label that continues in the next strip by the (already resolved)
+* result of that label. The tables are written back in place.
+*******************************************************************************/
+static int resolve_tables(canny_stream_state *s)
+{
+    long pos;
+    int i, n;
+
+    if (fseek(s->tables, 0, SEEK_END) != 0) { return (0); }
+    pos = ftell(s->tables);
+
+    while (pos > 0) {
+        if (fseek(s->tables, pos - (long)sizeof(int), SEEK_SET) != 0 ||
+                fread(&n, sizeof(int), 1, s->tables) != 1 || n >= s->max_labels) {
+            return (0);
+        }
+        pos -= (n + 2) * (long)sizeof(int);
+        if (fseek(s->tables, pos + (long)sizeof(int), SEEK_SET) != 0 ||
+                fread(s->table + 1, sizeof(int), n, s->tables) != (size_t)n) {
+            return (0);
+        }
+
+        /* carry holds the results of the labels of the next strip */
+        for (i = 1; i <= n; i++) {
+            if (s->table[i] > 0) { s->table[i] = s->carry[s->table[i]]; }
+        }
+        if (fseek(s->tables, pos + (long)sizeof(int), SEEK_SET) != 0 ||
+                fwrite(s->table + 1, sizeof(int), n, s->tables) != (size_t)n) {
+            return (0);
+        }
+        for (i = 1; i <= n; i++) { s->carry[i] = s->table[i]; }
+    }
+
+    return (fflush(s->tables) == 0 && fseek(s->tables, 0, SEEK_SET) == 0);
+}
+
+/* Start a new pass over the image */
+static void start_pass(canny_stream_state *s, int pass)
+{
+    s->pass = pass;
+    s->num_labels = 0;
+    memset(s->prev, 0, s->cols * sizeof(int));
+    memset(s->cur, 0, s->cols * sizeof(int));
+    if (fseek(s->in, s->raster, SEEK_SET) != 0) {
+        fprintf(stderr, "Error seeking the image data in canny_stream().\n");
+        s->error = 1;
+    }
+}
+
+/* Free the buffers and close the files of the stream */
+static void free_stream(canny_stream_state *s)
+{
+    if (s->in != NULL) { fclose(s->in); }
+    if (s->out != NULL) { fclose(s->out); }
+    if (s->tables != NULL) { fclose(s->tables); }
+    free(s->strip);
+    free(s->hist);
+    free(s->prev);
+    free(s->cur);
+    free(s->parent);
+    free(s->strong);
+    free(s->table);
+    free(s->carry);
+    free(s->carry_strong);
+    free(s->edge);
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_stream
+* PURPOSE: Run canny edge detection from the PGM image infilename to the edge
+* image outfilename using strips of rows that fit in cache_bytes. Besides a
+* temporary file with one table entry per strip label, the memory used is
+* proportional to the width of the image times the strip and kernel size.
+* The edges are equal to those of apply_hysteresis on the full image. Upon
+* failure, this function returns 0, upon sucess it returns 1.
+*******************************************************************************/
+int canny_stream(char *infilename, char *outfilename, float *kernel, int windowsize,
+                 double boost, float tlow, float thigh, int cache_bytes)
+{
+    canny_stream_state s;
+    fused_pipeline p;
+    int status = 0;
+
+    memset(&s, 0, sizeof(canny_stream_state));
+    if ((s.in = open_pgm_stream(infilename, &s.rows, &s.cols)) == NULL) { return (0); }
+    s.raster = ftell(s.in);
+
+    if (!fused_init(&p, s.rows, s.cols, kernel, windowsize, boost,
+                    fused_strip_rows(s.cols, windowsize, cache_bytes))) {
+        free_stream(&s);
+        return (0);
+    }
+
+    /****************************************************************************
+    * Allocate the strip buffers, a strip has at most cols / 2 new labels per
+    * row and cols / 2 labels carried from the previous strip.
+    ****************************************************************************/
+    s.strip_rows = p.strip_rows;
+    s.max_labels = (s.strip_rows + 1) * (s.cols / 2 + 1) + 1;
+    s.strip = (unsigned char *)malloc(s.strip_rows * s.cols * sizeof(unsigned char));
+    s.hist = (int *)calloc(32768, sizeof(int));
+    s.prev = (int *)malloc(s.cols * sizeof(int));
+    s.cur = (int *)malloc(s.cols * sizeof(int));
+    s.parent = (int *)malloc(s.max_labels * sizeof(int));
+    s.strong = (unsigned char *)malloc(s.max_labels * sizeof(unsigned char));
+    s.table = (int *)malloc(s.max_labels * sizeof(int));
+    s.carry = (int *)malloc(s.max_labels * sizeof(int));
+    s.carry_strong = (unsigned char *)malloc(s.max_labels * sizeof(unsigned char));
+    s.edge = (unsigned char *)malloc(s.cols * sizeof(unsigned char));
+    s.tables = tmpfile();
+    if (s.strip == NULL || s.hist == NULL || s.prev == NULL || s.cur == NULL || s.parent == NULL ||
+            s.strong == NULL || s.table == NULL || s.carry == NULL || s.carry_strong == NULL ||
+            s.edge == NULL || s.tables == NULL) {
+        fprintf(stderr, "Error allocating the stream buffers.\n");
+        fused_free(&p);
+        free_stream(&s);
+        return (0);
+    }
+
+    if (VERBOSE) {
+        printf("Streaming %dx%d image in strips of %d rows\n", s.cols, s.rows, s.strip_rows);
+    }
+
+    /* Pass 1: hysteresis thresholds from the histogram of the whole image */
+    start_pass(&s, STREAM_HISTOGRAM);
+    fused_run(&p, stream_source, stream_sink, &s);
+    histogram_thresholds(s.hist, tlow, thigh, &s.lowthreshold, &s.highthreshold);
+
+    /* Pass 2: label the components strip by strip and resolve them backwards */
+    start_pass(&s, STREAM_LABEL);
+    fused_run(&p, stream_source, stream_sink, &s);
+    if (!s.error && !resolve_tables(&s)) {
+        fprintf(stderr, "Error resolving the label tables in canny_stream().\n");
+        s.error = 1;
+    }
+
+    /* Pass 3: label again and write the edge rows */
+    if (!s.error && (s.out = create_pgm_stream(outfilename, s.rows, s.cols, "", 255)) != NULL) {
+        start_pass(&s, STREAM_OUTPUT);
+        fused_run(&p, stream_source, stream_sink, &s);
+        status = !s.error;
+    }
+
+    fused_free(&p);
+    free_stream(&s);
+    return (status);
+}
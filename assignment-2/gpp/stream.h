@@ -0,0 +1,12 @@
+#if !defined (stream_H)
+#define stream_H
+
+/* Run canny edge detection on a PGM image that is read and written in strips
+ * of rows, so the memory used only depends on the width of the image and not
+ * on the amount of rows. The input is read three times: for the hysteresis
+ * thresholds, to label the edge components and to write the edge image. */
+int canny_stream(char *infilename, char *outfilename, float *kernel, int windowsize,
+                 double boost, float tlow, float thigh, int cache_bytes);
+
+
+#endif /* !defined (stream_H) */
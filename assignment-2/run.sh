@@ -3,26 +3,13 @@
 ~/home/root/powercycle.sh
 ./canny_edge canny_edge.out pics/$.pgm 50 24 100
 
+# Tune the percentages per image into canny_profile.txt (replaces the 0 to 100 sweeps)
 #for k in klomp tiger square
 #do
-#	for i in `seq 0 100`
-#	do
-#		~/powercycle.sh
-#		echo "Running magnitude $i $k"
-#		./canny_edge canny_edge.out pics/$k.pgm 100 100 $i >> ./mag_$k.csv
-#	done
-#
-#	for i in `seq 0 100`
-#	do
-#		~/powercycle.sh
-#		echo "Running derivative $i $k"
-#		./canny_edge canny_edge.out pics/$k.pgm 100 $i 100 >> ./deriv_$k.csv
-#	done
-#
-#	for i in `seq 0 100`
-#	do
-#		~/powercycle.sh
-#		echo "Running gaussian $i $k"
-#		./canny_edge canny_edge.out pics/$k.pgm $i 100 100 >> ./gaus_$k.csv
-#	done
+#	~/powercycle.sh
+#	echo "Tuning $k"
+#	./canny_edge -t canny_edge.out pics/$k.pgm
 #done
+
+# Run all images as one batch on worker threads instead of one invocation per image
+#./canny_edge -d canny_edge.out pics
@@ -0,0 +1,24 @@
+/** ============================================================================
+ *  @file   bcache.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The BCACHE module of DSP/BIOS, for the host emulation. The host
+ *          caches are coherent, the operations only cost time when
+ *          EMU_CACHE_MBPS is set.
+ *  ============================================================================
+ */
+
+
+#if !defined (BCACHE_)
+#define BCACHE_
+
+#include <std.h>
+
+
+Void BCACHE_inv (Ptr blockPtr, size_t byteCnt, Bool wait) ;
+Void BCACHE_wb (Ptr blockPtr, size_t byteCnt, Bool wait) ;
+Void BCACHE_wbInv (Ptr blockPtr, size_t byteCnt, Bool wait) ;
+
+
+#endif /* !defined (BCACHE_) */
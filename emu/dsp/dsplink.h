@@ -0,0 +1,30 @@
+/** ============================================================================
+ *  @file   dsplink.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The common definitions of the DSP side of DSP/BIOS LINK, for the
+ *          host emulation.
+ *  ============================================================================
+ */
+
+
+#if !defined (DSPLINK_)
+#define DSPLINK_
+
+#include <std.h>
+
+
+#if !defined (ID_GPP)
+#define ID_GPP                  1
+#endif
+
+#define DSP_MAX_STRLEN          32
+#define DSPLINK_SEGID           0
+#define DSPLINK_BUF_ALIGN       128
+#define DSPLINK_ALIGN(a, b)     ((b != 0) ? (((a) + ((b) - 1)) & (~((b) - 1))) : (a))
+
+Void DSPLINK_init (Void) ;
+
+
+#endif /* !defined (DSPLINK_) */
@@ -0,0 +1,25 @@
+/** ============================================================================
+ *  @file   failure.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The failure reporting of DSP/BIOS LINK, for the host emulation.
+ *          The reason is printed when EMU_VERBOSE is set.
+ *  ============================================================================
+ */
+
+
+#if !defined (FAILURE_)
+#define FAILURE_
+
+#include <std.h>
+
+
+#define FID_APP_C               0x100
+
+#define SET_FAILURE_REASON(status)  SetReason (FILEID, __LINE__, (status))
+
+Void SetReason (Int fileId, Int lineNo, Int status) ;
+
+
+#endif /* !defined (FAILURE_) */
@@ -0,0 +1,20 @@
+/** ============================================================================
+ *  @file   gbl.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The GBL module of DSP/BIOS, for the host emulation.
+ *  ============================================================================
+ */
+
+
+#if !defined (GBL_)
+#define GBL_
+
+#include <std.h>
+
+
+Uint16 GBL_getProcId (Void) ;
+
+
+#endif /* !defined (GBL_) */
@@ -0,0 +1,25 @@
+/** ============================================================================
+ *  @file   log.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The LOG module of DSP/BIOS, for the host emulation. LOG_printf
+ *          prints to stderr when EMU_VERBOSE is set.
+ *  ============================================================================
+ */
+
+
+#if !defined (LOG_)
+#define LOG_
+
+#include <std.h>
+
+
+typedef struct LOG_Obj {
+    Int id ;
+} LOG_Obj ;
+
+Void LOG_printf (LOG_Obj * log, String format, ...) ;
+
+
+#endif /* !defined (LOG_) */
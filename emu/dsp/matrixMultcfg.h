@@ -0,0 +1,28 @@
+/** ============================================================================
+ *  @file   matrixMultcfg.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The header tconf generates from matrixMult.tcf, for the host
+ *          emulation: the modules and objects of the configuration.
+ *  ============================================================================
+ */
+
+
+#if !defined (MATRIXMULTCFG_)
+#define MATRIXMULTCFG_
+
+#include <std.h>
+#include <gbl.h>
+#include <log.h>
+#include <mem.h>
+#include <sem.h>
+#include <swi.h>
+#include <sys.h>
+#include <tsk.h>
+
+
+extern LOG_Obj trace ;
+
+
+#endif /* !defined (MATRIXMULTCFG_) */
@@ -0,0 +1,23 @@
+/** ============================================================================
+ *  @file   mem.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The MEM module of DSP/BIOS, for the host emulation. The segments
+ *          are the host heap.
+ *  ============================================================================
+ */
+
+
+#if !defined (MEM_)
+#define MEM_
+
+#include <std.h>
+
+
+Ptr MEM_calloc (Int segid, size_t size, size_t align) ;
+Ptr MEM_alloc (Int segid, size_t size, size_t align) ;
+Bool MEM_free (Int segid, Ptr buf, size_t size) ;
+
+
+#endif /* !defined (MEM_) */
@@ -0,0 +1,38 @@
+/** ============================================================================
+ *  @file   mpcs.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The MPCS API of DSP/BIOS LINK on the DSP, for the host
+ *          emulation.
+ *  ============================================================================
+ */
+
+
+#if !defined (MPCS_)
+#define MPCS_
+
+#include <std.h>
+
+
+#define MPCS_RESV_LOCKNAME      "DSPLINK_MPCS_"
+
+typedef struct MPCS_ShObj_tag {
+    Uint32 lock [8] ;
+} MPCS_ShObj ;
+
+typedef struct MPCS_Attrs_tag {
+    Uint16 poolId ;
+} MPCS_Attrs ;
+
+typedef Ptr MPCS_Handle ;
+
+Int MPCS_create (Uint32 procId, Char * name, MPCS_ShObj * mpcsObj, MPCS_Attrs * attrs) ;
+Int MPCS_delete (Uint32 procId, Char * name) ;
+Int MPCS_open (Uint32 procId, Char * name, MPCS_Handle * mpcsHandle) ;
+Int MPCS_close (Uint32 procId, MPCS_Handle mpcsHandle) ;
+Int MPCS_enter (MPCS_Handle mpcsHandle) ;
+Int MPCS_leave (MPCS_Handle mpcsHandle) ;
+
+
+#endif /* !defined (MPCS_) */
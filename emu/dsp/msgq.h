@@ -0,0 +1,79 @@
+/** ============================================================================
+ *  @file   msgq.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The MSGQ API of DSP/BIOS on the DSP, for the host emulation. The
+ *          queues are shared with the GPP, see emu/gpp/msgq.h.
+ *  ============================================================================
+ */
+
+
+#if !defined (MSGQ_)
+#define MSGQ_
+
+#include <std.h>
+#include <sys.h>
+
+
+#define MSGQ_INVALIDMSGQ        0xFFFFu
+#define MSGQ_INVALIDPROCID      0xFFFFu
+#define MSGQ_ASYNCLOCATEMSGID   0xFFFFu
+#define MSGQ_ASYNCERRORMSGID    0xFFFEu
+#define MSGQ_INVALIDMSGID       0xFFFFu
+
+/* The header in front of every message, the same on the GPP and the DSP */
+typedef struct MSGQ_MsgHeader {
+    Uint32 reserved [2] ;
+    Uint16 srcProcId ;
+    Uint16 poolId ;
+    Uint16 size ;
+    Uint16 dstId ;
+    Uint16 srcId ;
+    Uint16 msgId ;
+} MSGQ_MsgHeader ;
+
+typedef MSGQ_MsgHeader * MSGQ_Msg ;
+typedef Uint32 MSGQ_Queue ;
+
+typedef Bool (*MSGQ_Pend) (Ptr notifyHandle, Uns timeout) ;
+typedef Void (*MSGQ_Post) (Ptr notifyHandle) ;
+
+typedef struct MSGQ_Attrs {
+    Ptr       notifyHandle ;
+    MSGQ_Pend pend ;
+    MSGQ_Post post ;
+} MSGQ_Attrs ;
+
+typedef struct MSGQ_LocateAttrs {
+    Uns timeout ;
+} MSGQ_LocateAttrs ;
+
+typedef struct MSGQ_AsyncErrorMsg {
+    MSGQ_MsgHeader header ;
+    Uint16         errorType ;
+    MSGQ_Queue     msgqQueue ;
+    Ptr            arg1 ;
+    Ptr            arg2 ;
+} MSGQ_AsyncErrorMsg ;
+
+extern MSGQ_Attrs MSGQ_ATTRS ;
+
+#define MSGQ_getMsgId(msg)              (((MSGQ_Msg) (msg))->msgId)
+#define MSGQ_setMsgId(msg, id)          (((MSGQ_Msg) (msg))->msgId = (Uint16) (id))
+#define MSGQ_getMsgSize(msg)            (((MSGQ_Msg) (msg))->size)
+#define MSGQ_getSrcQueue(msg, queue)    (*(queue) = (MSGQ_Queue) ((MSGQ_Msg) (msg))->srcId)
+#define MSGQ_setSrcQueue(msg, queue)    (((MSGQ_Msg) (msg))->srcId = (Uint16) (queue))
+
+Int MSGQ_open (String queueName, MSGQ_Queue * msgqQueue, MSGQ_Attrs * attrs) ;
+Int MSGQ_close (MSGQ_Queue msgqQueue) ;
+Int MSGQ_locate (String queueName, MSGQ_Queue * msgqQueue, MSGQ_LocateAttrs * attrs) ;
+Int MSGQ_release (MSGQ_Queue msgqQueue) ;
+Int MSGQ_alloc (Uint16 poolId, MSGQ_Msg * msg, Uint16 size) ;
+Int MSGQ_free (MSGQ_Msg msg) ;
+Int MSGQ_put (MSGQ_Queue msgqQueue, MSGQ_Msg msg) ;
+Int MSGQ_get (MSGQ_Queue msgqQueue, MSGQ_Msg * msg, Uns timeout) ;
+Int MSGQ_setErrorHandler (MSGQ_Queue errorQueue, Uint16 poolId) ;
+
+
+#endif /* !defined (MSGQ_) */
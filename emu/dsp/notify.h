@@ -0,0 +1,26 @@
+/** ============================================================================
+ *  @file   notify.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The NOTIFY API of DSP/BIOS LINK on the DSP, for the host
+ *          emulation. The callbacks of the events from the GPP run on the
+ *          interrupt thread of the DSP, in the order the GPP sent them.
+ *  ============================================================================
+ */
+
+
+#if !defined (NOTIFY_)
+#define NOTIFY_
+
+#include <std.h>
+
+
+typedef Void (*FnNotifyCbck) (Uint32 eventNo, Ptr arg, Ptr info) ;
+
+Int NOTIFY_register (Uint32 procId, Uint32 ipsId, Uint32 eventNo, FnNotifyCbck fnNotifyCbck, Ptr cbckArg) ;
+Int NOTIFY_unregister (Uint32 procId, Uint32 ipsId, Uint32 eventNo, FnNotifyCbck fnNotifyCbck, Ptr cbckArg) ;
+Int NOTIFY_notify (Uint32 procId, Uint32 ipsId, Uint32 eventNo, Uint32 payload) ;
+
+
+#endif /* !defined (NOTIFY_) */
@@ -0,0 +1,18 @@
+/** ============================================================================
+ *  @file   platform.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The platform definitions of DSP/BIOS LINK, for the host emulation.
+ *          Not used.
+ *  ============================================================================
+ */
+
+
+#if !defined (PLATFORM_)
+#define PLATFORM_
+
+#include <std.h>
+
+
+#endif /* !defined (PLATFORM_) */
@@ -0,0 +1,22 @@
+/** ============================================================================
+ *  @file   pool.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The POOL module of DSP/BIOS LINK on the DSP, for the host
+ *          emulation.
+ *  ============================================================================
+ */
+
+
+#if !defined (POOL_)
+#define POOL_
+
+#include <std.h>
+#include <mem.h>
+
+
+#define POOL_INVALIDID          ((Uint16) -1)
+
+
+#endif /* !defined (POOL_) */
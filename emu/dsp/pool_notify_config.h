@@ -0,0 +1,18 @@
+/** ============================================================================
+ *  @file   pool_notify_config.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The configuration header of the pool_notify sample the canny edge
+ *          DSP task was made from, it is the canny edge configuration.
+ *  ============================================================================
+ */
+
+
+#if !defined (POOL_NOTIFY_CONFIG_)
+#define POOL_NOTIFY_CONFIG_
+
+#include <canny_edge_config.h>
+
+
+#endif /* !defined (POOL_NOTIFY_CONFIG_) */
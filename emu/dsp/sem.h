@@ -0,0 +1,31 @@
+/** ============================================================================
+ *  @file   sem.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The SEM module of DSP/BIOS, for the host emulation.
+ *  ============================================================================
+ */
+
+
+#if !defined (SEM_)
+#define SEM_
+
+#include <std.h>
+#include <semaphore.h>
+
+
+typedef struct SEM_Obj {
+    sem_t sem ;
+} SEM_Obj ;
+
+typedef SEM_Obj * SEM_Handle ;
+
+Void SEM_new (SEM_Handle sem, Int count) ;
+Bool SEM_pend (SEM_Handle sem, Uns timeout) ;
+Void SEM_post (SEM_Handle sem) ;
+Bool SEM_pendBinary (SEM_Handle sem, Uns timeout) ;
+Void SEM_postBinary (SEM_Handle sem) ;
+
+
+#endif /* !defined (SEM_) */
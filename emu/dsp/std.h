@@ -0,0 +1,42 @@
+/** ============================================================================
+ *  @file   std.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The basic types of DSP/BIOS, for the host emulation. Matches the
+ *          sizes of the types on the C64x+.
+ *  ============================================================================
+ */
+
+
+#if !defined (STD_)
+#define STD_
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+typedef int             Int ;
+typedef unsigned int    Uns ;
+typedef char            Char ;
+typedef char *          String ;
+typedef void *          Ptr ;
+typedef int             Bool ;
+typedef void            Void ;
+typedef int32_t         LgInt ;
+typedef uint32_t        LgUns ;
+typedef intptr_t        Arg ;
+typedef Int             (*Fxn) () ;
+
+typedef int8_t          Int8 ;
+typedef int16_t         Int16 ;
+typedef int32_t         Int32 ;
+typedef uint8_t         Uint8 ;
+typedef uint16_t        Uint16 ;
+typedef uint32_t        Uint32 ;
+
+#define TRUE            1
+#define FALSE           0
+
+
+#endif /* !defined (STD_) */
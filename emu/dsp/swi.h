@@ -0,0 +1,17 @@
+/** ============================================================================
+ *  @file   swi.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The SWI module of DSP/BIOS, for the host emulation. Not used.
+ *  ============================================================================
+ */
+
+
+#if !defined (SWI_)
+#define SWI_
+
+#include <std.h>
+
+
+#endif /* !defined (SWI_) */
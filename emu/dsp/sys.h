@@ -0,0 +1,39 @@
+/** ============================================================================
+ *  @file   sys.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The SYS module of DSP/BIOS, for the host emulation.
+ *  ============================================================================
+ */
+
+
+#if !defined (SYS_)
+#define SYS_
+
+#include <std.h>
+
+
+#define SYS_OK          0
+#define SYS_EALLOC      1
+#define SYS_EFREE       2
+#define SYS_ENODEV      3
+#define SYS_EBUSY       4
+#define SYS_EINVAL      5
+#define SYS_EBADIO      6
+#define SYS_EMODE       7
+#define SYS_EDOMAIN     8
+#define SYS_ETIMEOUT    9
+#define SYS_EEOF        10
+#define SYS_EDEAD       11
+#define SYS_EBADOBJ     12
+#define SYS_ENOTIMPL    13
+#define SYS_ENOTFOUND   14
+
+#define SYS_FOREVER     ((Uns) -1)
+#define SYS_POLL        ((Uns) 0)
+
+Int SYS_sprintf (Char * buf, String format, ...) ;
+
+
+#endif /* !defined (SYS_) */
@@ -0,0 +1,31 @@
+/** ============================================================================
+ *  @file   tsk.h
+ *
+ *  @path   emu/dsp
+ *
+ *  @desc   The TSK module of DSP/BIOS, for the host emulation. Every task is
+ *          a thread, it starts right away.
+ *  ============================================================================
+ */
+
+
+#if !defined (TSK_)
+#define TSK_
+
+#include <std.h>
+
+
+typedef struct TSK_Obj * TSK_Handle ;
+
+typedef struct TSK_Attrs {
+    Int priority ;
+    Ptr stack ;
+    size_t stacksize ;
+} TSK_Attrs ;
+
+TSK_Handle TSK_create (Fxn fxn, TSK_Attrs * attrs, ...) ;
+Void TSK_sleep (Uns nticks) ;
+Void TSK_yield (Void) ;
+
+
+#endif /* !defined (TSK_) */
@@ -0,0 +1,891 @@
+/*******************************************************************************
+* FILE: emu.c
+* Host emulation of DSP/BIOS LINK, so the GPP and DSP sides of the programs
+* run together on plain Linux. The DSP image is compiled for the host and
+* linked in, PROC_start runs its main on a thread and every TSK on a thread
+* of its own. The notify events of each direction are delivered in order by a
+* dispatcher thread, the one towards the DSP plays the interrupt context of
+* the DSP. The pools live in memory below 4 GB, so the 32-bit DSP addresses
+* in the payloads are plain pointers.
+*
+* The timing of the target can be approximated with environment variables:
+*
+*   EMU_NOTIFY_USEC   Delivery latency of a notify event or message (us)
+*   EMU_DSP_SLOWDOWN  The DSP takes this many times the host time to compute
+*   EMU_CACHE_MBPS    Speed of a cache writeback or invalidate (MB/s)
+*   EMU_STATS         Print the counts of the link when the DSP stops
+*   EMU_VERBOSE       Print the LOG_printf output and failures of the DSP
+*******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "emu.h"
+
+#define EMU_QUEUE_LEN       4096        ///< Pending events per link
+#define EMU_QUEUE_MSGS      256         ///< Pending messages per queue
+#define EMU_MAX_TASKS       8           ///< Tasks of the DSP
+#define EMU_BUF_ALIGN       128         ///< Alignment of the pool buffers
+#define EMU_ADDR_MAX        0xFFFFFFFFu ///< Highest address the DSP can see
+
+/* The main of the DSP image, renamed when it is compiled */
+extern void emu_dsp_main(int argc, char **argv);
+
+typedef struct emu_event {
+    uint32_t event, payload;
+    long long due;                      ///< Delivery time (us)
+} emu_event;
+
+typedef struct emu_link {
+    emu_event queue[EMU_QUEUE_LEN];
+    unsigned head, tail;
+    emu_callback cb[EMU_MAX_EVENTS];
+    void *arg[EMU_MAX_EVENTS];
+    int running;
+    pthread_t thread;
+    long long events;                   ///< Delivered events
+} emu_link;
+
+typedef struct emu_pool {
+    int open, exact;
+    unsigned char *base;
+    size_t length;
+    uint32_t num_sizes;
+    uint32_t size[EMU_MAX_BUF_SIZES], count[EMU_MAX_BUF_SIZES], first[EMU_MAX_BUF_SIZES];
+    size_t offset[EMU_MAX_BUF_SIZES], stride[EMU_MAX_BUF_SIZES];
+    unsigned char *used;                ///< Per buffer, in the order of the sizes
+} emu_pool;
+
+typedef struct emu_msgq {
+    int open, dsp;                      ///< Open, and opened by the DSP
+    char name[EMU_MAX_NAME];
+    void *msg[EMU_QUEUE_MSGS];
+    long long due[EMU_QUEUE_MSGS];
+    unsigned head, tail;
+} emu_msgq;
+
+typedef struct emu_section {
+    int exists;
+    char name[EMU_MAX_NAME];
+    pthread_mutex_t mutex;
+} emu_section;
+
+static pthread_once_t emu_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t emu_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t emu_cond;
+
+/* The configuration */
+static long long emu_latency;
+static double emu_slowdown = 1.0, emu_cache_mbps;
+static int emu_stats, emu_print;
+
+/* The processor */
+static int emu_argc, emu_started, emu_booted, emu_num_tasks;
+static char **emu_argv;
+static pthread_t emu_boot_thread, emu_task_thread[EMU_MAX_TASKS];
+static int (*emu_task_fxn[EMU_MAX_TASKS])(void);
+static int emu_task_started[EMU_MAX_TASKS];
+
+static emu_link emu_links[EMU_LINKS];
+static emu_pool emu_pools[EMU_MAX_POOLS];
+static emu_msgq emu_queues[EMU_MAX_QUEUES];
+static emu_section emu_locks[EMU_MAX_LOCKS];
+static long long emu_messages, emu_cache_bytes, emu_cache_usec;
+
+/* The DSP threads and the start of their current busy period */
+static __thread int emu_on_dsp;
+static __thread long long emu_dsp_mark;
+
+/*******************************************************************************
+* PROCEDURE: emu_usec
+* PURPOSE: The monotonic time in microseconds.
+*******************************************************************************/
+static long long emu_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_sleep
+* PURPOSE: Sleep a number of microseconds, it is a cancellation point.
+*******************************************************************************/
+static void emu_sleep(long long usec)
+{
+    struct timespec ts;
+
+    if (usec <= 0) return;
+    ts.tv_sec = usec / 1000000LL;
+    ts.tv_nsec = (usec % 1000000LL) * 1000;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_init
+* PURPOSE: Read the configuration from the environment and create the
+* condition variable, on the monotonic clock like emu_usec.
+*******************************************************************************/
+static void emu_init(void)
+{
+    pthread_condattr_t attr;
+    char *value;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&emu_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if ((value = getenv("EMU_NOTIFY_USEC")) != NULL) emu_latency = atoll(value);
+    if ((value = getenv("EMU_DSP_SLOWDOWN")) != NULL) emu_slowdown = atof(value);
+    if ((value = getenv("EMU_CACHE_MBPS")) != NULL) emu_cache_mbps = atof(value);
+    if ((value = getenv("EMU_STATS")) != NULL) emu_stats = atoi(value);
+    if ((value = getenv("EMU_VERBOSE")) != NULL) emu_print = atoi(value);
+    if (emu_latency < 0) emu_latency = 0;
+    if (emu_slowdown < 1.0) emu_slowdown = 1.0;
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_lock / emu_unlock
+* PURPOSE: Take and release the lock of the emulation, initializing it on the
+* first use. All state is protected by the one lock.
+*******************************************************************************/
+static void emu_lock(void)
+{
+    pthread_once(&emu_once, emu_init);
+    pthread_mutex_lock(&emu_mutex);
+}
+
+static void emu_unlock(void *arg)
+{
+    (void)arg;
+    pthread_mutex_unlock(&emu_mutex);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_wait
+* PURPOSE: Wait for a change of the state, until the deadline (us) when it is
+* not negative. Must be called with the lock held. The caller must push
+* emu_unlock as cleanup handler when a DSP task can be cancelled here.
+*******************************************************************************/
+static void emu_wait(long long deadline)
+{
+    struct timespec ts;
+
+    if (deadline < 0) {
+        pthread_cond_wait(&emu_cond, &emu_mutex);
+    } else {
+        ts.tv_sec = deadline / 1000000LL;
+        ts.tv_nsec = (deadline % 1000000LL) * 1000;
+        pthread_cond_timedwait(&emu_cond, &emu_mutex, &ts);
+    }
+}
+
+int emu_verbose(void)
+{
+    pthread_once(&emu_once, emu_init);
+    return (emu_print);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_dsp_wake
+* PURPOSE: Mark the start of a busy period of the DSP, when a thread of the
+* DSP returns from a wait or an event is delivered to it.
+*******************************************************************************/
+void emu_dsp_wake(void)
+{
+    emu_dsp_mark = emu_usec();
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_dsp_busy
+* PURPOSE: End a busy period of the DSP, before it tells the GPP something.
+* With EMU_DSP_SLOWDOWN the thread sleeps so the period takes that many
+* times as long as on the host.
+*******************************************************************************/
+void emu_dsp_busy(void)
+{
+    long long now;
+
+    if (!emu_on_dsp || emu_slowdown <= 1.0) return;
+    now = emu_usec();
+    emu_sleep((long long)((now - emu_dsp_mark) * (emu_slowdown - 1.0)));
+    emu_dsp_mark = emu_usec();
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_cache
+* PURPOSE: The cost of a cache writeback or invalidate of a number of bytes.
+* The host caches are coherent, so it only takes time with EMU_CACHE_MBPS.
+* That time is not stretched by the DSP slowdown.
+*******************************************************************************/
+void emu_cache(size_t bytes)
+{
+    long long usec = 0;
+
+    emu_lock();
+    if (emu_cache_mbps > 0.0) usec = (long long)(bytes / emu_cache_mbps);
+    emu_cache_bytes += bytes;
+    emu_cache_usec += usec;
+    emu_unlock(NULL);
+
+    emu_sleep(usec);
+    if (emu_on_dsp) emu_dsp_mark += usec;
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_dispatch
+* PURPOSE: The thread that delivers the events of a link in order. An event
+* waits for its delivery time and for a callback to be registered, the events
+* behind it wait as well.
+*******************************************************************************/
+static void *emu_dispatch(void *arg)
+{
+    emu_link *link = (emu_link *)arg;
+    emu_event ev;
+    emu_callback cb;
+    void *cb_arg;
+    long long now;
+    int dsp = (link == &emu_links[EMU_TO_DSP]);
+
+    emu_on_dsp = dsp;
+    emu_lock();
+    for (;;) {
+        /* Wait for a deliverable event */
+        while (link->running) {
+            if (link->head == link->tail || link->cb[link->queue[link->head % EMU_QUEUE_LEN].event] == NULL) {
+                emu_wait(-1);
+            } else if (link->queue[link->head % EMU_QUEUE_LEN].due > (now = emu_usec())) {
+                emu_wait(link->queue[link->head % EMU_QUEUE_LEN].due);
+            } else {
+                break;
+            }
+        }
+        if (!link->running) break;
+
+        ev = link->queue[link->head++ % EMU_QUEUE_LEN];
+        cb = link->cb[ev.event];
+        cb_arg = link->arg[ev.event];
+        link->events++;
+        pthread_cond_broadcast(&emu_cond);
+        emu_unlock(NULL);
+
+        if (dsp) emu_dsp_wake();
+        cb(ev.event, cb_arg, (void *)(uintptr_t)ev.payload);
+        if (dsp) emu_dsp_busy();
+
+        emu_lock();
+    }
+    emu_unlock(NULL);
+    return (NULL);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_task_run / emu_boot
+* PURPOSE: The threads of the DSP. The boot thread runs the main of the DSP,
+* like DSP/BIOS the tasks it creates start when main returns.
+*******************************************************************************/
+static void *emu_task_run(void *arg)
+{
+    int (*fxn)(void) = (int (*)(void))arg;
+
+    emu_on_dsp = 1;
+    emu_dsp_wake();
+    fxn();
+    return (NULL);
+}
+
+static void *emu_boot(void *arg)
+{
+    int t;
+
+    (void)arg;
+    emu_on_dsp = 1;
+    emu_dsp_wake();
+    emu_dsp_main(emu_argc, emu_argv);
+
+    emu_lock();
+    emu_booted = 1;
+    for (t = 0; t < emu_num_tasks; t++) {
+        if (!emu_task_started[t] &&
+            pthread_create(&emu_task_thread[t], NULL, emu_task_run, (void *)emu_task_fxn[t]) == 0) {
+            emu_task_started[t] = 1;
+        }
+    }
+    emu_unlock(NULL);
+    return (NULL);
+}
+
+int emu_task_create(int (*fxn)(void))
+{
+    int status = EMU_OK, t;
+
+    emu_lock();
+    if (emu_num_tasks >= EMU_MAX_TASKS) {
+        status = EMU_EMEMORY;
+    } else {
+        t = emu_num_tasks++;
+        emu_task_fxn[t] = fxn;
+        emu_task_started[t] = 0;
+        if (emu_booted) {
+            if (pthread_create(&emu_task_thread[t], NULL, emu_task_run, (void *)fxn) == 0) {
+                emu_task_started[t] = 1;
+            } else {
+                status = EMU_EMEMORY;
+            }
+        }
+    }
+    emu_unlock(NULL);
+    return (status);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_load
+* PURPOSE: Keep the arguments for the main of the DSP. The image itself is
+* linked in, its path is only reported.
+*******************************************************************************/
+int emu_load(const char *image, uint32_t argc, char **argv)
+{
+    uint32_t i;
+    int status = EMU_OK;
+
+    emu_lock();
+    if (emu_started) {
+        status = EMU_ESTATE;
+    } else {
+        for (i = 0; emu_argv != NULL && i < (uint32_t)emu_argc; i++) free(emu_argv[i]);
+        free(emu_argv);
+        emu_argc = 0;
+        if ((emu_argv = (char **)calloc(argc + 1, sizeof(char *))) == NULL) {
+            status = EMU_EMEMORY;
+        } else {
+            for (i = 0; i < argc; i++) {
+                if ((emu_argv[i] = strdup(argv[i])) == NULL) status = EMU_EMEMORY;
+            }
+            emu_argc = argc;
+        }
+    }
+    emu_unlock(NULL);
+
+    if (emu_verbose()) fprintf(stderr, "emu: loading %s with %u arguments\n", image ? image : "", argc);
+    return (status);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_start
+* PURPOSE: Start the dispatchers of both links and boot the DSP.
+*******************************************************************************/
+int emu_start(void)
+{
+    int l;
+
+    emu_lock();
+    if (emu_started) {
+        emu_unlock(NULL);
+        return (EMU_ESTATE);
+    }
+    emu_started = 1;
+    emu_booted = 0;
+    emu_num_tasks = 0;
+    for (l = 0; l < EMU_LINKS; l++) {
+        emu_links[l].running = 1;
+        emu_links[l].events = 0;
+    }
+    emu_messages = emu_cache_bytes = emu_cache_usec = 0;
+    emu_unlock(NULL);
+
+    for (l = 0; l < EMU_LINKS; l++) {
+        if (pthread_create(&emu_links[l].thread, NULL, emu_dispatch, &emu_links[l]) != 0) return (EMU_EFAIL);
+    }
+    if (pthread_create(&emu_boot_thread, NULL, emu_boot, NULL) != 0) return (EMU_EFAIL);
+    return (EMU_OK);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_stop
+* PURPOSE: Halt the DSP: cancel its tasks, stop the dispatchers and forget
+* everything the DSP registered or opened, so it can be started again. The
+* pending events are dropped.
+*******************************************************************************/
+int emu_stop(void)
+{
+    int l, t, e, q;
+
+    emu_lock();
+    if (!emu_started) {
+        emu_unlock(NULL);
+        return (EMU_ESTATE);
+    }
+    emu_started = 0;
+    for (l = 0; l < EMU_LINKS; l++) emu_links[l].running = 0;
+    pthread_cond_broadcast(&emu_cond);
+    emu_unlock(NULL);
+
+    pthread_join(emu_boot_thread, NULL);
+    for (t = 0; t < emu_num_tasks; t++) {
+        if (emu_task_started[t]) {
+            pthread_cancel(emu_task_thread[t]);
+            pthread_join(emu_task_thread[t], NULL);
+        }
+    }
+    for (l = 0; l < EMU_LINKS; l++) pthread_join(emu_links[l].thread, NULL);
+
+    emu_lock();
+    for (l = 0; l < EMU_LINKS; l++) emu_links[l].head = emu_links[l].tail = 0;
+    for (e = 0; e < EMU_MAX_EVENTS; e++) emu_links[EMU_TO_DSP].cb[e] = NULL;
+    for (q = 0; q < EMU_MAX_QUEUES; q++) {
+        if (emu_queues[q].dsp) emu_queues[q].open = 0;
+    }
+    emu_num_tasks = 0;
+    emu_booted = 0;
+    emu_unlock(NULL);
+
+    if (emu_stats) {
+        fprintf(stderr, "emu: %lld events to the DSP, %lld to the GPP, %lld messages, "
+                "%lld bytes of cache maintenance (%lld us)\n",
+                emu_links[EMU_TO_DSP].events, emu_links[EMU_TO_GPP].events, emu_messages,
+                emu_cache_bytes, emu_cache_usec);
+    }
+    return (EMU_OK);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_register / emu_unregister
+* PURPOSE: Set the callback of an event on a link. Events that arrived before
+* the callback are delivered once it is registered.
+*******************************************************************************/
+int emu_register(int link, uint32_t event, emu_callback cb, void *arg)
+{
+    if (link < 0 || link >= EMU_LINKS || event >= EMU_MAX_EVENTS || cb == NULL) return (EMU_EINVAL);
+
+    emu_lock();
+    emu_links[link].cb[event] = cb;
+    emu_links[link].arg[event] = arg;
+    pthread_cond_broadcast(&emu_cond);
+    emu_unlock(NULL);
+    return (EMU_OK);
+}
+
+int emu_unregister(int link, uint32_t event)
+{
+    if (link < 0 || link >= EMU_LINKS || event >= EMU_MAX_EVENTS) return (EMU_EINVAL);
+
+    emu_lock();
+    emu_links[link].cb[event] = NULL;
+    emu_unlock(NULL);
+    return (EMU_OK);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_notify
+* PURPOSE: Send an event with a payload over a link. Blocks while the queue
+* of the link is full. Fails when the DSP is not running.
+*******************************************************************************/
+int emu_notify(int link, uint32_t event, uint32_t payload)
+{
+    emu_link *l;
+    emu_event *ev;
+    int status = EMU_OK;
+
+    if (link < 0 || link >= EMU_LINKS || event >= EMU_MAX_EVENTS) return (EMU_EINVAL);
+    l = &emu_links[link];
+
+    emu_lock();
+    pthread_cleanup_push(emu_unlock, NULL);
+    while (l->running && l->tail - l->head >= EMU_QUEUE_LEN) emu_wait(-1);
+    if (!l->running) {
+        status = EMU_ESTATE;
+    } else {
+        ev = &l->queue[l->tail++ % EMU_QUEUE_LEN];
+        ev->event = event;
+        ev->payload = payload;
+        ev->due = emu_usec() + emu_latency;
+        pthread_cond_broadcast(&emu_cond);
+    }
+    pthread_cleanup_pop(1);
+    return (status);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_pool_open
+* PURPOSE: Create a pool with count[i] buffers of sizes[i] bytes. The memory
+* is mapped below 4 GB where the host allows it, the pool fails when it ends
+* up above, the DSP could not address it.
+*******************************************************************************/
+int emu_pool_open(int pool, uint32_t num_sizes, const uint32_t *sizes, const uint32_t *counts, int exact)
+{
+    emu_pool *p;
+    uint32_t i, total = 0;
+    size_t length = 0;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS, status = EMU_OK;
+    void *base;
+
+    if (pool < 0 || pool >= EMU_MAX_POOLS || num_sizes > EMU_MAX_BUF_SIZES) return (EMU_EINVAL);
+    p = &emu_pools[pool];
+
+    emu_lock();
+    if (p->open) {
+        status = EMU_ESTATE;
+        goto out;
+    }
+    p->num_sizes = num_sizes;
+    p->exact = exact;
+    for (i = 0; i < num_sizes; i++) {
+        p->size[i] = sizes[i];
+        p->count[i] = counts[i];
+        p->stride[i] = (sizes[i] + EMU_BUF_ALIGN - 1) & ~(size_t)(EMU_BUF_ALIGN - 1);
+        p->offset[i] = length;
+        p->first[i] = total;
+        length += p->stride[i] * counts[i];
+        total += counts[i];
+    }
+    if (length == 0) length = EMU_BUF_ALIGN;
+
+#if defined (MAP_32BIT)
+    flags |= MAP_32BIT;
+#endif
+    base = mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (base == MAP_FAILED) {
+        status = EMU_EMEMORY;
+        goto out;
+    }
+    if ((uintptr_t)base + length - 1 > EMU_ADDR_MAX) {
+        fprintf(stderr, "emu: the pool is mapped above 4 GB, the DSP can not address it\n");
+        munmap(base, length);
+        status = EMU_EMEMORY;
+        goto out;
+    }
+    if ((p->used = (unsigned char *)calloc(total + 1, 1)) == NULL) {
+        munmap(base, length);
+        status = EMU_EMEMORY;
+        goto out;
+    }
+    p->base = (unsigned char *)base;
+    p->length = length;
+    p->open = 1;
+
+out:
+    emu_unlock(NULL);
+    return (status);
+}
+
+int emu_pool_close(int pool)
+{
+    emu_pool *p;
+
+    if (pool < 0 || pool >= EMU_MAX_POOLS) return (EMU_EINVAL);
+    p = &emu_pools[pool];
+
+    emu_lock();
+    if (p->open) {
+        munmap(p->base, p->length);
+        free(p->used);
+        p->used = NULL;
+        p->open = 0;
+    }
+    emu_unlock(NULL);
+    return (EMU_OK);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_pool_find
+* PURPOSE: Find a free buffer of one of the sizes of a pool. Returns its
+* index, -1 when all are used.
+*******************************************************************************/
+static int emu_pool_find(emu_pool *p, uint32_t i)
+{
+    uint32_t j;
+
+    for (j = 0; j < p->count[i]; j++) {
+        if (!p->used[p->first[i] + j]) return ((int)j);
+    }
+    return (-1);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_pool_alloc
+* PURPOSE: Take a free buffer of a size from a pool. Several entries can have
+* the same size, any of them will do. Without an exact match the smallest
+* free buffers that are large enough are used.
+*******************************************************************************/
+int emu_pool_alloc(int pool, void **buf, uint32_t size)
+{
+    emu_pool *p;
+    uint32_t i, best;
+    int j = -1;
+
+    if (pool < 0 || pool >= EMU_MAX_POOLS || buf == NULL) return (EMU_EINVAL);
+    p = &emu_pools[pool];
+
+    emu_lock();
+    if (!p->open) {
+        emu_unlock(NULL);
+        return (EMU_ENOTFOUND);
+    }
+    for (i = 0, best = p->num_sizes; i < p->num_sizes; i++) {
+        if (p->size[i] == size && (j = emu_pool_find(p, i)) >= 0) {
+            best = i;
+            break;
+        }
+    }
+    if (best == p->num_sizes && !p->exact) {
+        for (i = 0; i < p->num_sizes; i++) {
+            if (p->size[i] > size && (best == p->num_sizes || p->size[i] < p->size[best]) &&
+                emu_pool_find(p, i) >= 0) {
+                best = i;
+            }
+        }
+        if (best < p->num_sizes) j = emu_pool_find(p, best);
+    }
+    if (best < p->num_sizes) {
+        p->used[p->first[best] + j] = 1;
+        *buf = p->base + p->offset[best] + p->stride[best] * j;
+    }
+    emu_unlock(NULL);
+    return ((best < p->num_sizes) ? EMU_OK : EMU_EMEMORY);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_pool_free
+* PURPOSE: Return a buffer to the pool it came from.
+*******************************************************************************/
+int emu_pool_free(void *buf)
+{
+    emu_pool *p;
+    unsigned char *addr = (unsigned char *)buf;
+    uint32_t i;
+    size_t rel;
+    int pool, status = EMU_ENOTFOUND;
+
+    emu_lock();
+    for (pool = 0; pool < EMU_MAX_POOLS && status == EMU_ENOTFOUND; pool++) {
+        p = &emu_pools[pool];
+        if (!p->open || addr < p->base || addr >= p->base + p->length) continue;
+        for (i = 0; i < p->num_sizes; i++) {
+            rel = addr - (p->base + p->offset[i]);
+            if (addr >= p->base + p->offset[i] && rel < p->stride[i] * p->count[i]) {
+                if (rel % p->stride[i] != 0 || !p->used[p->first[i] + rel / p->stride[i]]) {
+                    status = EMU_EINVAL;
+                } else {
+                    p->used[p->first[i] + rel / p->stride[i]] = 0;
+                    status = EMU_OK;
+                }
+                break;
+            }
+        }
+    }
+    emu_unlock(NULL);
+    return (status);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_msgq_open
+* PURPOSE: Open a named message queue, its index is the queue id.
+*******************************************************************************/
+int emu_msgq_open(const char *name, uint32_t *queue)
+{
+    int q, free_q = -1, status = EMU_OK;
+
+    if (name == NULL || strlen(name) >= EMU_MAX_NAME) return (EMU_EINVAL);
+
+    emu_lock();
+    for (q = 0; q < EMU_MAX_QUEUES; q++) {
+        if (emu_queues[q].open && strcmp(emu_queues[q].name, name) == 0) break;
+        if (!emu_queues[q].open && free_q < 0) free_q = q;
+    }
+    if (q < EMU_MAX_QUEUES) {
+        status = EMU_ESTATE;
+    } else if (free_q < 0) {
+        status = EMU_EMEMORY;
+    } else {
+        strcpy(emu_queues[free_q].name, name);
+        emu_queues[free_q].head = emu_queues[free_q].tail = 0;
+        emu_queues[free_q].dsp = emu_on_dsp;
+        emu_queues[free_q].open = 1;
+        *queue = (uint32_t)free_q;
+    }
+    emu_unlock(NULL);
+    return (status);
+}
+
+int emu_msgq_close(uint32_t queue)
+{
+    if (queue >= EMU_MAX_QUEUES) return (EMU_EINVAL);
+
+    emu_lock();
+    emu_queues[queue].open = 0;
+    pthread_cond_broadcast(&emu_cond);
+    emu_unlock(NULL);
+    return (EMU_OK);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_msgq_locate
+* PURPOSE: Find an open queue by name. Fails with EMU_ENOTFOUND when it is not
+* open (yet), the callers retry.
+*******************************************************************************/
+int emu_msgq_locate(const char *name, uint32_t *queue)
+{
+    int q, status = EMU_ENOTFOUND;
+
+    emu_lock();
+    for (q = 0; q < EMU_MAX_QUEUES; q++) {
+        if (emu_queues[q].open && strcmp(emu_queues[q].name, name) == 0) {
+            *queue = (uint32_t)q;
+            status = EMU_OK;
+            break;
+        }
+    }
+    emu_unlock(NULL);
+    return (status);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_msgq_put
+* PURPOSE: Put a message on a queue, it can be taken after the latency.
+*******************************************************************************/
+int emu_msgq_put(uint32_t queue, void *msg)
+{
+    emu_msgq *q;
+    int status = EMU_OK;
+
+    if (queue >= EMU_MAX_QUEUES || msg == NULL) return (EMU_EINVAL);
+    q = &emu_queues[queue];
+
+    emu_lock();
+    if (!q->open) {
+        status = EMU_ENOTFOUND;
+    } else if (q->tail - q->head >= EMU_QUEUE_MSGS) {
+        status = EMU_EMEMORY;
+    } else {
+        q->due[q->tail % EMU_QUEUE_MSGS] = emu_usec() + emu_latency;
+        q->msg[q->tail++ % EMU_QUEUE_MSGS] = msg;
+        emu_messages++;
+        pthread_cond_broadcast(&emu_cond);
+    }
+    emu_unlock(NULL);
+    return (status);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_msgq_get
+* PURPOSE: Take the first message of a queue, waiting at most timeout_ms
+* milliseconds (EMU_FOREVER to wait without timeout, 0 to poll).
+*******************************************************************************/
+int emu_msgq_get(uint32_t queue, void **msg, uint32_t timeout_ms)
+{
+    emu_msgq *q;
+    long long now, deadline = -1, wake;
+    int status = EMU_OK;
+
+    if (queue >= EMU_MAX_QUEUES || msg == NULL) return (EMU_EINVAL);
+    q = &emu_queues[queue];
+    if (timeout_ms != EMU_FOREVER) deadline = emu_usec() + (long long)timeout_ms * 1000LL;
+
+    emu_lock();
+    pthread_cleanup_push(emu_unlock, NULL);
+    for (;;) {
+        if (!q->open) {
+            status = EMU_ENOTFOUND;
+            break;
+        }
+        now = emu_usec();
+        if (q->head != q->tail && q->due[q->head % EMU_QUEUE_MSGS] <= now) {
+            *msg = q->msg[q->head++ % EMU_QUEUE_MSGS];
+            break;
+        }
+        if (deadline >= 0 && now >= deadline) {
+            status = EMU_ETIMEOUT;
+            break;
+        }
+
+        /* Wake up for the deadline or the next message, whichever is first */
+        wake = deadline;
+        if (q->head != q->tail && (wake < 0 || q->due[q->head % EMU_QUEUE_MSGS] < wake)) {
+            wake = q->due[q->head % EMU_QUEUE_MSGS];
+        }
+        emu_wait(wake);
+    }
+    pthread_cleanup_pop(1);
+    return (status);
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_lock_create / emu_lock_delete / emu_lock_open
+* PURPOSE: The named critical sections, the handle of a section is its entry.
+*******************************************************************************/
+int emu_lock_create(const char *name)
+{
+    int l, free_l = -1, status = EMU_OK;
+
+    if (name == NULL || strlen(name) >= EMU_MAX_NAME) return (EMU_EINVAL);
+
+    emu_lock();
+    for (l = 0; l < EMU_MAX_LOCKS; l++) {
+        if (emu_locks[l].exists && strcmp(emu_locks[l].name, name) == 0) break;
+        if (!emu_locks[l].exists && free_l < 0) free_l = l;
+    }
+    if (l < EMU_MAX_LOCKS) {
+        status = EMU_ESTATE;
+    } else if (free_l < 0) {
+        status = EMU_EMEMORY;
+    } else {
+        strcpy(emu_locks[free_l].name, name);
+        pthread_mutex_init(&emu_locks[free_l].mutex, NULL);
+        emu_locks[free_l].exists = 1;
+    }
+    emu_unlock(NULL);
+    return (status);
+}
+
+int emu_lock_delete(const char *name)
+{
+    int l, status = EMU_ENOTFOUND;
+
+    emu_lock();
+    for (l = 0; l < EMU_MAX_LOCKS; l++) {
+        if (emu_locks[l].exists && strcmp(emu_locks[l].name, name) == 0) {
+            pthread_mutex_destroy(&emu_locks[l].mutex);
+            emu_locks[l].exists = 0;
+            status = EMU_OK;
+            break;
+        }
+    }
+    emu_unlock(NULL);
+    return (status);
+}
+
+int emu_lock_open(const char *name, void **handle)
+{
+    int l, status = EMU_ENOTFOUND;
+
+    emu_lock();
+    for (l = 0; l < EMU_MAX_LOCKS; l++) {
+        if (emu_locks[l].exists && strcmp(emu_locks[l].name, name) == 0) {
+            *handle = &emu_locks[l];
+            status = EMU_OK;
+            break;
+        }
+    }
+    emu_unlock(NULL);
+    return (status);
+}
+
+int emu_lock_enter(void *handle)
+{
+    if (handle == NULL) return (EMU_EINVAL);
+    return (pthread_mutex_lock(&((emu_section *)handle)->mutex) == 0 ? EMU_OK : EMU_EFAIL);
+}
+
+int emu_lock_leave(void *handle)
+{
+    if (handle == NULL) return (EMU_EINVAL);
+    return (pthread_mutex_unlock(&((emu_section *)handle)->mutex) == 0 ? EMU_OK : EMU_EFAIL);
+}
@@ -0,0 +1,82 @@
+#if !defined (emu_H)
+#define emu_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The core of the host emulation of DSP/BIOS LINK. The GPP and DSP APIs
+ * (emu_gpp.c and emu_dsp.c) are thin wrappers around it, they only translate
+ * the types and status codes. The DSP runs as threads of the same process. */
+
+/* Status codes of the core */
+enum {
+    EMU_OK = 0,
+    EMU_EFAIL = -1,                     ///< Any other failure
+    EMU_EINVAL = -2,                    ///< Invalid argument
+    EMU_EMEMORY = -3,                   ///< Out of memory or buffers
+    EMU_ENOTFOUND = -4,                 ///< No such queue, lock or pool
+    EMU_ETIMEOUT = -5,                  ///< The wait timed out
+    EMU_ESTATE = -6                     ///< The DSP is not in the right state
+};
+
+/* The notify links, one per direction */
+enum {
+    EMU_TO_DSP,
+    EMU_TO_GPP,
+    EMU_LINKS
+};
+
+#define EMU_FOREVER         ((uint32_t) -1) ///< Wait without a timeout
+#define EMU_MAX_EVENTS      32              ///< Events per link
+#define EMU_MAX_POOLS       4               ///< Pools that can be open
+#define EMU_MAX_BUF_SIZES   16              ///< Buffer sizes per pool
+#define EMU_MAX_QUEUES      16              ///< Message queues that can be open
+#define EMU_MAX_LOCKS       16              ///< Critical sections that can exist
+#define EMU_MAX_NAME        32              ///< Length of the name of a queue or lock
+
+/* The callback of an event, info carries the 32-bit payload */
+typedef void (*emu_callback)(uint32_t event, void *arg, void *info);
+
+/* The processor: load the arguments of the DSP, start and stop it */
+int emu_load(const char *image, uint32_t argc, char **argv);
+int emu_start(void);
+int emu_stop(void);
+
+/* The DSP side: create a task, started when the main of the DSP returns */
+int emu_task_create(int (*fxn)(void));
+
+/* Notify: events are delivered in order, each link on its own thread */
+int emu_register(int link, uint32_t event, emu_callback cb, void *arg);
+int emu_unregister(int link, uint32_t event);
+int emu_notify(int link, uint32_t event, uint32_t payload);
+
+/* Pools of fixed size buffers, below 4 GB so the DSP address fits in 32 bits */
+int emu_pool_open(int pool, uint32_t num_sizes, const uint32_t *sizes, const uint32_t *counts, int exact);
+int emu_pool_close(int pool);
+int emu_pool_alloc(int pool, void **buf, uint32_t size);
+int emu_pool_free(void *buf);
+
+/* Message queues, by name and by index */
+int emu_msgq_open(const char *name, uint32_t *queue);
+int emu_msgq_close(uint32_t queue);
+int emu_msgq_locate(const char *name, uint32_t *queue);
+int emu_msgq_put(uint32_t queue, void *msg);
+int emu_msgq_get(uint32_t queue, void **msg, uint32_t timeout_ms);
+
+/* Critical sections shared between the GPP and the DSP */
+int emu_lock_create(const char *name);
+int emu_lock_delete(const char *name);
+int emu_lock_open(const char *name, void **handle);
+int emu_lock_enter(void *handle);
+int emu_lock_leave(void *handle);
+
+/* The timing model: cache maintenance, the busy time of the DSP */
+void emu_cache(size_t bytes);
+void emu_dsp_wake(void);
+void emu_dsp_busy(void);
+
+/* Print to stderr when EMU_VERBOSE is set */
+int emu_verbose(void);
+
+
+#endif /* !defined (emu_H) */
@@ -0,0 +1,372 @@
+/*******************************************************************************
+* FILE: emu_dsp.c
+* The DSP side of DSP/BIOS and DSP/BIOS LINK on top of the host emulation,
+* with the signatures of the headers in emu/dsp. It is linked into the DSP
+* image together with the DSP sources, only the main of the image is visible
+* outside, so these functions do not clash with the GPP side of the same name.
+* The tick of TSK_sleep and the timeouts is a millisecond.
+*******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <std.h>
+#include <sys.h>
+#include <log.h>
+#include <tsk.h>
+#include <sem.h>
+#include <gbl.h>
+#include <pool.h>
+#include <msgq.h>
+#include <bcache.h>
+#include <dsplink.h>
+#include <failure.h>
+#include <notify.h>
+#include <mpcs.h>
+
+#include "emu.h"
+
+/* The trace log of the configuration */
+LOG_Obj trace;
+
+MSGQ_Attrs MSGQ_ATTRS = { NULL, NULL, NULL };
+
+/*******************************************************************************
+* PROCEDURE: emu_dsp_status
+* PURPOSE: Translate a status of the emulation to a DSP/BIOS status.
+*******************************************************************************/
+static Int emu_dsp_status(int status)
+{
+    switch (status) {
+    case EMU_OK:        return (SYS_OK);
+    case EMU_EINVAL:    return (SYS_EINVAL);
+    case EMU_EMEMORY:   return (SYS_EALLOC);
+    case EMU_ENOTFOUND: return (SYS_ENOTFOUND);
+    case EMU_ETIMEOUT:  return (SYS_ETIMEOUT);
+    case EMU_ESTATE:    return (SYS_EBUSY);
+    default:            return (SYS_EBADIO);
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: emu_dsp_deadline
+* PURPOSE: The absolute realtime deadline of a timeout in ticks, for the
+* semaphores.
+*******************************************************************************/
+static void emu_dsp_deadline(Uns timeout, struct timespec *ts)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += timeout / 1000;
+    ts->tv_nsec += (long)(timeout % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/* DSP/BIOS */
+
+Int SYS_sprintf(Char *buf, String format, ...)
+{
+    va_list ap;
+    Int n;
+
+    va_start(ap, format);
+    n = vsprintf(buf, format, ap);
+    va_end(ap);
+    return (n);
+}
+
+Void LOG_printf(LOG_Obj *log, String format, ...)
+{
+    va_list ap;
+
+    (void)log;
+    if (!emu_verbose()) return;
+    va_start(ap, format);
+    fprintf(stderr, "dsp: ");
+    vfprintf(stderr, format, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+}
+
+Void SetReason(Int fileId, Int lineNo, Int status)
+{
+    if (emu_verbose()) fprintf(stderr, "dsp: failure 0x%x in file 0x%x line %d\n", status, fileId, lineNo);
+}
+
+Uint16 GBL_getProcId(Void)
+{
+    return (0);
+}
+
+Ptr MEM_alloc(Int segid, size_t size, size_t align)
+{
+    void *buf;
+
+    (void)segid;
+    if (align < sizeof(void *)) align = sizeof(void *);
+    return (posix_memalign(&buf, align, size) == 0 ? buf : NULL);
+}
+
+Ptr MEM_calloc(Int segid, size_t size, size_t align)
+{
+    Ptr buf = MEM_alloc(segid, size, align);
+
+    if (buf != NULL) memset(buf, 0, size);
+    return (buf);
+}
+
+Bool MEM_free(Int segid, Ptr buf, size_t size)
+{
+    (void)segid;
+    (void)size;
+    free(buf);
+    return (TRUE);
+}
+
+TSK_Handle TSK_create(Fxn fxn, TSK_Attrs *attrs, ...)
+{
+    (void)attrs;
+    if (emu_task_create((int (*)(void))fxn) != EMU_OK) return (NULL);
+
+    /* The handle is not used, it only has to be valid */
+    return ((TSK_Handle)fxn);
+}
+
+Void TSK_sleep(Uns nticks)
+{
+    struct timespec ts;
+
+    emu_dsp_busy();
+    ts.tv_sec = nticks / 1000;
+    ts.tv_nsec = (long)(nticks % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+    emu_dsp_wake();
+}
+
+Void TSK_yield(Void)
+{
+    TSK_sleep(0);
+}
+
+Void SEM_new(SEM_Handle sem, Int count)
+{
+    sem_init(&sem->sem, 0, count);
+}
+
+/*******************************************************************************
+* PROCEDURE: SEM_pend
+* PURPOSE: Wait for the semaphore, at most timeout ticks. The wait ends the
+* busy period of the DSP. Returns FALSE on a timeout.
+*******************************************************************************/
+Bool SEM_pend(SEM_Handle sem, Uns timeout)
+{
+    struct timespec ts;
+    int ret;
+
+    emu_dsp_busy();
+    if (timeout == SYS_FOREVER) {
+        while ((ret = sem_wait(&sem->sem)) != 0 && errno == EINTR);
+    } else if (timeout == SYS_POLL) {
+        ret = sem_trywait(&sem->sem);
+    } else {
+        emu_dsp_deadline(timeout, &ts);
+        while ((ret = sem_timedwait(&sem->sem, &ts)) != 0 && errno == EINTR);
+    }
+    emu_dsp_wake();
+    return (ret == 0);
+}
+
+Void SEM_post(SEM_Handle sem)
+{
+    sem_post(&sem->sem);
+}
+
+Bool SEM_pendBinary(SEM_Handle sem, Uns timeout)
+{
+    return (SEM_pend(sem, timeout));
+}
+
+Void SEM_postBinary(SEM_Handle sem)
+{
+    int value;
+
+    /* A binary semaphore counts to one at most */
+    if (sem_getvalue(&sem->sem, &value) == 0 && value > 0) return;
+    sem_post(&sem->sem);
+}
+
+/*******************************************************************************
+* PROCEDURE: BCACHE_inv / BCACHE_wb / BCACHE_wbInv
+* PURPOSE: Cache maintenance of the DSP, the cost of the bytes touched.
+*******************************************************************************/
+Void BCACHE_inv(Ptr blockPtr, size_t byteCnt, Bool wait)
+{
+    (void)blockPtr;
+    (void)wait;
+    emu_cache(byteCnt);
+}
+
+Void BCACHE_wb(Ptr blockPtr, size_t byteCnt, Bool wait)
+{
+    (void)blockPtr;
+    (void)wait;
+    emu_cache(byteCnt);
+}
+
+Void BCACHE_wbInv(Ptr blockPtr, size_t byteCnt, Bool wait)
+{
+    (void)blockPtr;
+    (void)wait;
+    emu_cache(byteCnt);
+}
+
+/* DSP/BIOS LINK */
+
+Void DSPLINK_init(Void)
+{
+}
+
+Int NOTIFY_register(Uint32 procId, Uint32 ipsId, Uint32 eventNo, FnNotifyCbck fnNotifyCbck, Ptr cbckArg)
+{
+    (void)procId;
+    (void)ipsId;
+    return (emu_dsp_status(emu_register(EMU_TO_DSP, eventNo, (emu_callback)fnNotifyCbck, cbckArg)));
+}
+
+Int NOTIFY_unregister(Uint32 procId, Uint32 ipsId, Uint32 eventNo, FnNotifyCbck fnNotifyCbck, Ptr cbckArg)
+{
+    (void)procId;
+    (void)ipsId;
+    (void)fnNotifyCbck;
+    (void)cbckArg;
+    return (emu_dsp_status(emu_unregister(EMU_TO_DSP, eventNo)));
+}
+
+Int NOTIFY_notify(Uint32 procId, Uint32 ipsId, Uint32 eventNo, Uint32 payload)
+{
+    (void)procId;
+    (void)ipsId;
+    emu_dsp_busy();
+    return (emu_dsp_status(emu_notify(EMU_TO_GPP, eventNo, payload)));
+}
+
+Int MPCS_create(Uint32 procId, Char *name, MPCS_ShObj *mpcsObj, MPCS_Attrs *attrs)
+{
+    (void)procId;
+    (void)mpcsObj;
+    (void)attrs;
+    return (emu_dsp_status(emu_lock_create(name)));
+}
+
+Int MPCS_delete(Uint32 procId, Char *name)
+{
+    (void)procId;
+    return (emu_dsp_status(emu_lock_delete(name)));
+}
+
+Int MPCS_open(Uint32 procId, Char *name, MPCS_Handle *mpcsHandle)
+{
+    (void)procId;
+    return (emu_dsp_status(emu_lock_open(name, mpcsHandle)));
+}
+
+Int MPCS_close(Uint32 procId, MPCS_Handle mpcsHandle)
+{
+    (void)procId;
+    (void)mpcsHandle;
+    return (SYS_OK);
+}
+
+Int MPCS_enter(MPCS_Handle mpcsHandle)
+{
+    return (emu_dsp_status(emu_lock_enter(mpcsHandle)));
+}
+
+Int MPCS_leave(MPCS_Handle mpcsHandle)
+{
+    return (emu_dsp_status(emu_lock_leave(mpcsHandle)));
+}
+
+/* The message queues, the pend and post of the attributes are not needed,
+ * the queue itself blocks */
+
+Int MSGQ_open(String queueName, MSGQ_Queue *msgqQueue, MSGQ_Attrs *attrs)
+{
+    (void)attrs;
+    if (msgqQueue == NULL) return (SYS_EINVAL);
+    return (emu_dsp_status(emu_msgq_open(queueName, msgqQueue)));
+}
+
+Int MSGQ_close(MSGQ_Queue msgqQueue)
+{
+    return (emu_dsp_status(emu_msgq_close(msgqQueue)));
+}
+
+Int MSGQ_locate(String queueName, MSGQ_Queue *msgqQueue, MSGQ_LocateAttrs *attrs)
+{
+    (void)attrs;
+    if (queueName == NULL || msgqQueue == NULL) return (SYS_EINVAL);
+    return (emu_dsp_status(emu_msgq_locate(queueName, msgqQueue)));
+}
+
+Int MSGQ_release(MSGQ_Queue msgqQueue)
+{
+    (void)msgqQueue;
+    return (SYS_OK);
+}
+
+Int MSGQ_alloc(Uint16 poolId, MSGQ_Msg *msg, Uint16 size)
+{
+    Int status;
+
+    if (msg == NULL || size < sizeof(MSGQ_MsgHeader)) return (SYS_EINVAL);
+    status = emu_dsp_status(emu_pool_alloc(poolId & 0xFF, (void **)msg, size));
+    if (status == SYS_OK) {
+        memset(*msg, 0, sizeof(MSGQ_MsgHeader));
+        (*msg)->srcProcId = GBL_getProcId();
+        (*msg)->poolId = poolId;
+        (*msg)->size = size;
+        (*msg)->srcId = MSGQ_INVALIDMSGQ;
+        (*msg)->msgId = MSGQ_INVALIDMSGID;
+    }
+    return (status);
+}
+
+Int MSGQ_free(MSGQ_Msg msg)
+{
+    if (msg == NULL) return (SYS_EINVAL);
+    return (emu_dsp_status(emu_pool_free(msg)));
+}
+
+Int MSGQ_put(MSGQ_Queue msgqQueue, MSGQ_Msg msg)
+{
+    if (msg == NULL) return (SYS_EINVAL);
+    emu_dsp_busy();
+    msg->dstId = (Uint16)msgqQueue;
+    return (emu_dsp_status(emu_msgq_put(msgqQueue, msg)));
+}
+
+Int MSGQ_get(MSGQ_Queue msgqQueue, MSGQ_Msg *msg, Uns timeout)
+{
+    Int status;
+
+    emu_dsp_busy();
+    status = emu_dsp_status(emu_msgq_get(msgqQueue, (void **)msg,
+                                         (timeout == SYS_FOREVER) ? EMU_FOREVER : (uint32_t)timeout));
+    emu_dsp_wake();
+    return (status);
+}
+
+Int MSGQ_setErrorHandler(MSGQ_Queue errorQueue, Uint16 poolId)
+{
+    (void)errorQueue;
+    (void)poolId;
+    return (SYS_OK);
+}
@@ -0,0 +1,281 @@
+/*******************************************************************************
+* FILE: emu_gpp.c
+* The GPP side of DSP/BIOS LINK on top of the host emulation: PROC, POOL,
+* NOTIFY, MPCS and MSGQ with the signatures of the GPP headers in emu/gpp.
+* The calls only check their arguments and translate the status codes, the
+* work is done in emu.c.
+*******************************************************************************/
+
+#include <string.h>
+
+#include <dsplink.h>
+#include <proc.h>
+#include <pool.h>
+#include <notify.h>
+#include <mpcs.h>
+#include <msgq.h>
+
+#include "emu.h"
+
+/*******************************************************************************
+* PROCEDURE: emu_gpp_status
+* PURPOSE: Translate a status of the emulation to a DSP/BIOS LINK status.
+*******************************************************************************/
+STATIC DSP_STATUS emu_gpp_status(int status)
+{
+    switch (status) {
+    case EMU_OK:        return (DSP_SOK);
+    case EMU_EINVAL:    return (DSP_EINVALIDARG);
+    case EMU_EMEMORY:   return (DSP_EMEMORY);
+    case EMU_ENOTFOUND: return (DSP_ENOTFOUND);
+    case EMU_ETIMEOUT:  return (DSP_ETIMEOUT);
+    case EMU_ESTATE:    return (DSP_ESTATE);
+    default:            return (DSP_EFAIL);
+    }
+}
+
+/* The processor, there is a single DSP */
+
+NORMAL_API DSP_STATUS PROC_setup(IN Pvoid linkCfg)
+{
+    (void)linkCfg;
+    return (DSP_SOK);
+}
+
+NORMAL_API DSP_STATUS PROC_destroy(Void)
+{
+    return (DSP_SOK);
+}
+
+NORMAL_API DSP_STATUS PROC_attach(IN ProcessorId procId, OPT PROC_Attrs *attr)
+{
+    (void)attr;
+    return ((procId < MAX_DSPS) ? DSP_SOK : DSP_EINVALIDARG);
+}
+
+NORMAL_API DSP_STATUS PROC_detach(IN ProcessorId procId)
+{
+    return ((procId < MAX_DSPS) ? DSP_SOK : DSP_EINVALIDARG);
+}
+
+NORMAL_API DSP_STATUS PROC_load(IN ProcessorId procId, IN Char8 *imagePath, IN Uint32 argc, IN Char8 **argv)
+{
+    if (procId >= MAX_DSPS || (argc > 0 && argv == NULL)) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_load(imagePath, argc, argv)));
+}
+
+NORMAL_API DSP_STATUS PROC_start(IN ProcessorId procId)
+{
+    if (procId >= MAX_DSPS) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_start()));
+}
+
+NORMAL_API DSP_STATUS PROC_stop(IN ProcessorId procId)
+{
+    if (procId >= MAX_DSPS) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_stop()));
+}
+
+/* The pools, the pool number is the lower byte of the pool id */
+
+NORMAL_API DSP_STATUS POOL_open(IN PoolId poolId, IN Pvoid params)
+{
+    SMAPOOL_Attrs *attrs = (SMAPOOL_Attrs *)params;
+
+    if (attrs == NULL || attrs->bufSizes == NULL || attrs->numBuffers == NULL) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_pool_open(poolId & 0xFF, attrs->numBufPools, attrs->bufSizes,
+                                         attrs->numBuffers, attrs->exactMatchReq)));
+}
+
+NORMAL_API DSP_STATUS POOL_close(IN PoolId poolId)
+{
+    return (emu_gpp_status(emu_pool_close(poolId & 0xFF)));
+}
+
+NORMAL_API DSP_STATUS POOL_alloc(IN PoolId poolId, OUT Pvoid *bufPtr, IN Uint32 size)
+{
+    return (emu_gpp_status(emu_pool_alloc(poolId & 0xFF, bufPtr, size)));
+}
+
+NORMAL_API DSP_STATUS POOL_free(IN PoolId poolId, IN Pvoid buf, IN Uint32 size)
+{
+    (void)poolId;
+    (void)size;
+    return (emu_gpp_status(emu_pool_free(buf)));
+}
+
+NORMAL_API DSP_STATUS POOL_translateAddr(IN PoolId poolId, OUT Pvoid *dstAddr, IN AddrType dstAddrType,
+                                         IN Pvoid srcAddr, IN AddrType srcAddrType)
+{
+    (void)poolId;
+    (void)dstAddrType;
+    (void)srcAddrType;
+    if (dstAddr == NULL) return (DSP_EINVALIDARG);
+
+    /* The GPP and the DSP share the address space */
+    *dstAddr = srcAddr;
+    return (DSP_SOK);
+}
+
+NORMAL_API DSP_STATUS POOL_writeback(IN PoolId poolId, IN Pvoid buf, IN Uint32 size)
+{
+    (void)poolId;
+    (void)buf;
+    emu_cache(size);
+    return (DSP_SOK);
+}
+
+NORMAL_API DSP_STATUS POOL_invalidate(IN PoolId poolId, IN Pvoid buf, IN Uint32 size)
+{
+    (void)poolId;
+    (void)buf;
+    emu_cache(size);
+    return (DSP_SOK);
+}
+
+/* Notify, the events from the DSP */
+
+NORMAL_API DSP_STATUS NOTIFY_register(IN ProcessorId procId, IN Uint32 ipsId, IN Uint32 eventNo,
+                                      IN FnNotifyCbck fnNotifyCbck, IN Pvoid cbckArg)
+{
+    (void)ipsId;
+    if (procId >= MAX_DSPS) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_register(EMU_TO_GPP, eventNo, (emu_callback)fnNotifyCbck, cbckArg)));
+}
+
+NORMAL_API DSP_STATUS NOTIFY_unregister(IN ProcessorId procId, IN Uint32 ipsId, IN Uint32 eventNo,
+                                        IN FnNotifyCbck fnNotifyCbck, IN Pvoid cbckArg)
+{
+    (void)ipsId;
+    (void)fnNotifyCbck;
+    (void)cbckArg;
+    if (procId >= MAX_DSPS) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_unregister(EMU_TO_GPP, eventNo)));
+}
+
+NORMAL_API DSP_STATUS NOTIFY_notify(IN ProcessorId procId, IN Uint32 ipsId, IN Uint32 eventNo, IN Uint32 payload)
+{
+    (void)ipsId;
+    if (procId >= MAX_DSPS) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_notify(EMU_TO_DSP, eventNo, payload)));
+}
+
+/* The critical sections */
+
+NORMAL_API DSP_STATUS MPCS_create(IN ProcessorId procId, IN Pstr name, IN MPCS_ShObj *mpcsObj, IN MPCS_Attrs *attrs)
+{
+    (void)procId;
+    (void)mpcsObj;
+    (void)attrs;
+    return (emu_gpp_status(emu_lock_create(name)));
+}
+
+NORMAL_API DSP_STATUS MPCS_delete(IN ProcessorId procId, IN Pstr name)
+{
+    (void)procId;
+    return (emu_gpp_status(emu_lock_delete(name)));
+}
+
+NORMAL_API DSP_STATUS MPCS_open(IN ProcessorId procId, IN Pstr name, OUT MPCS_Handle *mpcsHandle)
+{
+    (void)procId;
+    return (emu_gpp_status(emu_lock_open(name, mpcsHandle)));
+}
+
+NORMAL_API DSP_STATUS MPCS_close(IN ProcessorId procId, IN MPCS_Handle mpcsHandle)
+{
+    (void)procId;
+    (void)mpcsHandle;
+    return (DSP_SOK);
+}
+
+NORMAL_API DSP_STATUS MPCS_enter(IN MPCS_Handle mpcsHandle)
+{
+    return (emu_gpp_status(emu_lock_enter(mpcsHandle)));
+}
+
+NORMAL_API DSP_STATUS MPCS_leave(IN MPCS_Handle mpcsHandle)
+{
+    return (emu_gpp_status(emu_lock_leave(mpcsHandle)));
+}
+
+/* The message queues, messages are pool buffers with a MSGQ_MsgHeader */
+
+NORMAL_API DSP_STATUS MSGQ_transportOpen(IN ProcessorId procId, IN Pvoid attrs)
+{
+    (void)attrs;
+    return ((procId < MAX_DSPS) ? DSP_SOK : DSP_EINVALIDARG);
+}
+
+NORMAL_API DSP_STATUS MSGQ_transportClose(IN ProcessorId procId)
+{
+    return ((procId < MAX_DSPS) ? DSP_SOK : DSP_EINVALIDARG);
+}
+
+NORMAL_API DSP_STATUS MSGQ_open(IN Pstr queueName, OUT MSGQ_Queue *msgqQueue, IN MSGQ_Attrs *attrs)
+{
+    (void)attrs;
+    if (msgqQueue == NULL) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_msgq_open(queueName, msgqQueue)));
+}
+
+NORMAL_API DSP_STATUS MSGQ_close(IN MSGQ_Queue msgqQueue)
+{
+    return (emu_gpp_status(emu_msgq_close(msgqQueue)));
+}
+
+NORMAL_API DSP_STATUS MSGQ_locate(IN Pstr queueName, OUT MSGQ_Queue *msgqQueue, IN MSGQ_LocateAttrs *attrs)
+{
+    (void)attrs;
+    if (queueName == NULL || msgqQueue == NULL) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_msgq_locate(queueName, msgqQueue)));
+}
+
+NORMAL_API DSP_STATUS MSGQ_release(IN MSGQ_Queue msgqQueue)
+{
+    (void)msgqQueue;
+    return (DSP_SOK);
+}
+
+NORMAL_API DSP_STATUS MSGQ_alloc(IN PoolId poolId, IN Uint16 size, OUT MSGQ_Msg *msg)
+{
+    DSP_STATUS status;
+
+    if (msg == NULL || size < sizeof(MSGQ_MsgHeader)) return (DSP_EINVALIDARG);
+    status = emu_gpp_status(emu_pool_alloc(poolId & 0xFF, (void **)msg, size));
+    if (DSP_SUCCEEDED(status)) {
+        memset(*msg, 0, sizeof(MSGQ_MsgHeader));
+        (*msg)->srcProcId = ID_GPP;
+        (*msg)->poolId = poolId;
+        (*msg)->size = size;
+        (*msg)->srcId = MSGQ_INVALIDMSGQ;
+        (*msg)->msgId = MSGQ_INVALIDMSGID;
+    }
+    return (status);
+}
+
+NORMAL_API DSP_STATUS MSGQ_free(IN MSGQ_Msg msg)
+{
+    if (msg == NULL) return (DSP_EINVALIDARG);
+    return (emu_gpp_status(emu_pool_free(msg)));
+}
+
+NORMAL_API DSP_STATUS MSGQ_put(IN MSGQ_Queue msgqQueue, IN MSGQ_Msg msg)
+{
+    if (msg == NULL) return (DSP_EINVALIDARG);
+    msg->dstId = (Uint16)msgqQueue;
+    return (emu_gpp_status(emu_msgq_put(msgqQueue, msg)));
+}
+
+NORMAL_API DSP_STATUS MSGQ_get(IN MSGQ_Queue msgqQueue, IN Uint32 timeout, OUT MSGQ_Msg *msg)
+{
+    return (emu_gpp_status(emu_msgq_get(msgqQueue, (void **)msg, (timeout == WAIT_FOREVER) ? EMU_FOREVER : timeout)));
+}
+
+NORMAL_API DSP_STATUS MSGQ_setErrorHandler(IN MSGQ_Queue errorQueue, IN PoolId poolId)
+{
+    /* The emulated transport does not fail asynchronously */
+    (void)errorQueue;
+    (void)poolId;
+    return (DSP_SOK);
+}
@@ -0,0 +1,55 @@
+/** ============================================================================
+ *  @file   dsplink.h
+ *
+ *  @path   emu/gpp
+ *
+ *  @desc   The common definitions of the GPP side of DSP/BIOS LINK, for the
+ *          host emulation. The DSP runs as threads in the same process, see
+ *          emu/emu.h.
+ *  ============================================================================
+ */
+
+
+#if !defined (DSPLINK_H)
+#define DSPLINK_H
+
+
+#include <gpptypes.h>
+#include <errbase.h>
+
+
+#if defined (__cplusplus)
+extern "C" {
+#endif /* defined (__cplusplus) */
+
+
+#if !defined (MAX_DSPS)
+#define MAX_DSPS                1
+#endif
+#if !defined (MAX_PROCESSORS)
+#define MAX_PROCESSORS          2
+#endif
+#if !defined (ID_GPP)
+#define ID_GPP                  1
+#endif
+
+#define DSP_MAX_STRLEN          32
+#define WAIT_FOREVER            (~((Uint32) 0))
+#define WAIT_NONE               ((Uint32) 0)
+
+/* Alignment of the buffers shared with the DSP (the L2 cache line) */
+#define DSPLINK_BUF_ALIGN       128
+#define DSPLINK_ALIGN(a, b)     ((b != 0) ? (((a) + ((b) - 1)) & (~((b) - 1))) : (a))
+
+/* The link configuration, not used by the emulation */
+typedef struct LINKCFG_Object_tag {
+    Char8 name [DSP_MAX_STRLEN] ;
+} LINKCFG_Object ;
+
+
+#if defined (__cplusplus)
+}
+#endif /* defined (__cplusplus) */
+
+
+#endif /* !defined (DSPLINK_H) */
@@ -0,0 +1,54 @@
+/** ============================================================================
+ *  @file   errbase.h
+ *
+ *  @path   emu/gpp
+ *
+ *  @desc   The status codes of the GPP side of DSP/BIOS LINK, for the host
+ *          emulation.
+ *  ============================================================================
+ */
+
+
+#if !defined (ERRBASE_H)
+#define ERRBASE_H
+
+
+#include <gpptypes.h>
+
+
+#if defined (__cplusplus)
+extern "C" {
+#endif /* defined (__cplusplus) */
+
+
+typedef Int32 DSP_STATUS ;
+
+#define DSP_SBASE               (DSP_STATUS) 0x00008000l
+#define DSP_EBASE               (DSP_STATUS) 0x80008000l
+
+#define DSP_SUCCEEDED(status)   ((Int32) (status) >= 0)
+#define DSP_FAILED(status)      ((Int32) (status) < 0)
+
+#define DSP_SOK                 (DSP_SBASE + 0x0l)
+#define DSP_SALREADYOPENED      (DSP_SBASE + 0x1l)
+#define DSP_SEXISTS             (DSP_SBASE + 0x2l)
+
+#define DSP_EACCESSDENIED       (DSP_EBASE + 0x2l)
+#define DSP_EALREADYCONNECTED   (DSP_EBASE + 0x3l)
+#define DSP_EFAIL               (DSP_EBASE + 0x8l)
+#define DSP_EINVALIDARG         (DSP_EBASE + 0xbl)
+#define DSP_EMEMORY             (DSP_EBASE + 0xcl)
+#define DSP_ENOTFOUND           (DSP_EBASE + 0xdl)
+#define DSP_ENOTIMPL            (DSP_EBASE + 0xel)
+#define DSP_ETIMEOUT            (DSP_EBASE + 0x10l)
+#define DSP_ERESOURCE           (DSP_EBASE + 0x28l)
+#define DSP_ENOTREADY           (DSP_EBASE + 0x2fl)
+#define DSP_ESTATE              (DSP_EBASE + 0x30l)
+
+
+#if defined (__cplusplus)
+}
+#endif /* defined (__cplusplus) */
+
+
+#endif /* !defined (ERRBASE_H) */
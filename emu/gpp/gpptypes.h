@@ -0,0 +1,65 @@
+/** ============================================================================
+ *  @file   gpptypes.h
+ *
+ *  @path   emu/gpp
+ *
+ *  @desc   The basic types of the GPP side of DSP/BIOS LINK, for the host
+ *          emulation. Matches the sizes of the types on the ARM.
+ *  ============================================================================
+ */
+
+
+#if !defined (GPPTYPES_H)
+#define GPPTYPES_H
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#if defined (__cplusplus)
+extern "C" {
+#endif /* defined (__cplusplus) */
+
+
+#define IN                              /* Input argument */
+#define OUT                             /* Output argument */
+#define OPT                             /* Optional argument */
+#define CONST   const
+
+#define STATIC  static
+#define EXTERN  extern
+#define NORMAL_API
+#define IMPORT_API
+#define EXPORT_API
+
+#define TRUE    1
+#define FALSE   0
+
+typedef int32_t         Int32 ;
+typedef int16_t         Int16 ;
+typedef int8_t          Int8 ;
+typedef uint32_t        Uint32 ;
+typedef uint16_t        Uint16 ;
+typedef uint8_t         Uint8 ;
+typedef char            Char8 ;
+typedef uint16_t        Char16 ;
+typedef float           Real32 ;
+typedef double          Real64 ;
+typedef Int32           Bool ;
+typedef void            Void ;
+typedef void *          Pvoid ;
+typedef Char8 *         Pstr ;
+typedef Uint32          ProcessorId ;
+
+#if !defined (NULL)
+#define NULL    ((Void *) 0)
+#endif
+
+
+#if defined (__cplusplus)
+}
+#endif /* defined (__cplusplus) */
+
+
+#endif /* !defined (GPPTYPES_H) */
@@ -0,0 +1,19 @@
+/** ============================================================================
+ *  @file   loaderdefs.h
+ *
+ *  @path   emu/gpp
+ *
+ *  @desc   The definitions of the DSP executable loaders. The emulation has
+ *          a single loader, the DSP image is linked into the GPP program.
+ *  ============================================================================
+ */
+
+
+#if !defined (LOADERDEFS_H)
+#define LOADERDEFS_H
+
+
+#include <dsplink.h>
+
+
+#endif /* !defined (LOADERDEFS_H) */
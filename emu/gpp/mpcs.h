@@ -0,0 +1,51 @@
+/** ============================================================================
+ *  @file   mpcs.h
+ *
+ *  @path   emu/gpp
+ *
+ *  @desc   The MPCS API of DSP/BIOS LINK, for the host emulation. A named
+ *          critical section shared with the DSP threads.
+ *  ============================================================================
+ */
+
+
+#if !defined (MPCS_H)
+#define MPCS_H
+
+
+#include <dsplink.h>
+
+
+#if defined (__cplusplus)
+extern "C" {
+#endif /* defined (__cplusplus) */
+
+
+#define MPCS_RESV_LOCKNAME      "DSPLINK_MPCS_"
+
+/* The shared object of a critical section, its storage in the pool */
+typedef struct MPCS_ShObj_tag {
+    Uint32 lock [8] ;
+} MPCS_ShObj ;
+
+typedef struct MPCS_Attrs_tag {
+    Uint16 poolId ;
+} MPCS_Attrs ;
+
+typedef Pvoid MPCS_Handle ;
+
+NORMAL_API DSP_STATUS MPCS_create (IN ProcessorId procId, IN Pstr name, IN MPCS_ShObj * mpcsObj,
+                                   IN MPCS_Attrs * attrs) ;
+NORMAL_API DSP_STATUS MPCS_delete (IN ProcessorId procId, IN Pstr name) ;
+NORMAL_API DSP_STATUS MPCS_open (IN ProcessorId procId, IN Pstr name, OUT MPCS_Handle * mpcsHandle) ;
+NORMAL_API DSP_STATUS MPCS_close (IN ProcessorId procId, IN MPCS_Handle mpcsHandle) ;
+NORMAL_API DSP_STATUS MPCS_enter (IN MPCS_Handle mpcsHandle) ;
+NORMAL_API DSP_STATUS MPCS_leave (IN MPCS_Handle mpcsHandle) ;
+
+
+#if defined (__cplusplus)
+}
+#endif /* defined (__cplusplus) */
+
+
+#endif /* !defined (MPCS_H) */
@@ -0,0 +1,102 @@
+/** ============================================================================
+ *  @file   msgq.h
+ *
+ *  @path   emu/gpp
+ *
+ *  @desc   The MSGQ API of DSP/BIOS LINK, for the host emulation. The message
+ *          queues of the GPP and the DSP are in one table, a message is put
+ *          by reference (zero copy) like with the shared memory transport.
+ *  ============================================================================
+ */
+
+
+#if !defined (MSGQ_H)
+#define MSGQ_H
+
+
+#include <dsplink.h>
+#include <pool.h>
+
+
+#if defined (__cplusplus)
+extern "C" {
+#endif /* defined (__cplusplus) */
+
+
+#define MSGQ_INVALIDMSGQ        0xFFFFu
+#define MSGQ_INVALIDPROCID      0xFFFFu
+#define MSGQ_ASYNCLOCATEMSGID   0xFFFFu
+#define MSGQ_ASYNCERRORMSGID    0xFFFEu
+#define MSGQ_INVALIDMSGID       0xFFFFu
+
+/* The header in front of every message, the same on the GPP and the DSP */
+typedef struct MSGQ_MsgHeader_tag {
+    Uint32 reserved [2] ;
+    Uint16 srcProcId ;
+    Uint16 poolId ;
+    Uint16 size ;
+    Uint16 dstId ;
+    Uint16 srcId ;
+    Uint16 msgId ;
+} MSGQ_MsgHeader ;
+
+typedef MSGQ_MsgHeader * MSGQ_Msg ;
+typedef MSGQ_Msg MsgqMsg ;
+typedef Uint32 MSGQ_Queue ;
+
+typedef struct MSGQ_Attrs_tag {
+    Pvoid notifyHandle ;
+    Pvoid pend ;
+    Pvoid post ;
+} MSGQ_Attrs ;
+
+typedef struct MSGQ_LocateAttrs_tag {
+    Uint32 timeout ;
+} MSGQ_LocateAttrs ;
+
+typedef struct MSGQ_AsyncLocateMsg_tag {
+    MSGQ_MsgHeader header ;
+    MSGQ_Queue     msgqQueue ;
+    Pvoid          arg ;
+} MSGQ_AsyncLocateMsg ;
+
+typedef struct MSGQ_AsyncErrorMsg_tag {
+    MSGQ_MsgHeader header ;
+    Uint16         errorType ;
+    MSGQ_Queue     msgqQueue ;
+    Pvoid          arg1 ;
+    Pvoid          arg2 ;
+} MSGQ_AsyncErrorMsg ;
+
+/* The zero copy transport */
+#define ZCPYMQT_CTRLMSG_SIZE    128
+
+typedef struct ZCPYMQT_Attrs_tag {
+    PoolId poolId ;
+} ZCPYMQT_Attrs ;
+
+#define MSGQ_getMsgId(msg)              (((MSGQ_Msg) (msg))->msgId)
+#define MSGQ_setMsgId(msg, id)          (((MSGQ_Msg) (msg))->msgId = (Uint16) (id))
+#define MSGQ_getMsgSize(msg)            (((MSGQ_Msg) (msg))->size)
+#define MSGQ_getSrcQueue(msg, queue)    (*(queue) = (MSGQ_Queue) ((MSGQ_Msg) (msg))->srcId)
+#define MSGQ_setSrcQueue(msg, queue)    (((MSGQ_Msg) (msg))->srcId = (Uint16) (queue))
+
+NORMAL_API DSP_STATUS MSGQ_transportOpen (IN ProcessorId procId, IN Pvoid attrs) ;
+NORMAL_API DSP_STATUS MSGQ_transportClose (IN ProcessorId procId) ;
+NORMAL_API DSP_STATUS MSGQ_open (IN Pstr queueName, OUT MSGQ_Queue * msgqQueue, IN MSGQ_Attrs * attrs) ;
+NORMAL_API DSP_STATUS MSGQ_close (IN MSGQ_Queue msgqQueue) ;
+NORMAL_API DSP_STATUS MSGQ_locate (IN Pstr queueName, OUT MSGQ_Queue * msgqQueue, IN MSGQ_LocateAttrs * attrs) ;
+NORMAL_API DSP_STATUS MSGQ_release (IN MSGQ_Queue msgqQueue) ;
+NORMAL_API DSP_STATUS MSGQ_alloc (IN PoolId poolId, IN Uint16 size, OUT MSGQ_Msg * msg) ;
+NORMAL_API DSP_STATUS MSGQ_free (IN MSGQ_Msg msg) ;
+NORMAL_API DSP_STATUS MSGQ_put (IN MSGQ_Queue msgqQueue, IN MSGQ_Msg msg) ;
+NORMAL_API DSP_STATUS MSGQ_get (IN MSGQ_Queue msgqQueue, IN Uint32 timeout, OUT MSGQ_Msg * msg) ;
+NORMAL_API DSP_STATUS MSGQ_setErrorHandler (IN MSGQ_Queue errorQueue, IN PoolId poolId) ;
+
+
+#if defined (__cplusplus)
+}
+#endif /* defined (__cplusplus) */
+
+
+#endif /* !defined (MSGQ_H) */
@@ -0,0 +1,40 @@
+/** ============================================================================
+ *  @file   notify.h
+ *
+ *  @path   emu/gpp
+ *
+ *  @desc   The NOTIFY API of DSP/BIOS LINK, for the host emulation. The
+ *          callbacks of the events from the DSP run on a notify thread, in
+ *          the order the DSP sent them.
+ *  ============================================================================
+ */
+
+
+#if !defined (NOTIFY_H)
+#define NOTIFY_H
+
+
+#include <dsplink.h>
+
+
+#if defined (__cplusplus)
+extern "C" {
+#endif /* defined (__cplusplus) */
+
+
+typedef Void (*FnNotifyCbck) (IN Uint32 eventNo, IN Pvoid arg, IN Pvoid info) ;
+
+NORMAL_API DSP_STATUS NOTIFY_register (IN ProcessorId procId, IN Uint32 ipsId, IN Uint32 eventNo,
+                                       IN FnNotifyCbck fnNotifyCbck, IN Pvoid cbckArg) ;
+NORMAL_API DSP_STATUS NOTIFY_unregister (IN ProcessorId procId, IN Uint32 ipsId, IN Uint32 eventNo,
+                                         IN FnNotifyCbck fnNotifyCbck, IN Pvoid cbckArg) ;
+NORMAL_API DSP_STATUS NOTIFY_notify (IN ProcessorId procId, IN Uint32 ipsId, IN Uint32 eventNo,
+                                     IN Uint32 payload) ;
+
+
+#if defined (__cplusplus)
+}
+#endif /* defined (__cplusplus) */
+
+
+#endif /* !defined (NOTIFY_H) */
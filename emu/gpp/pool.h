@@ -0,0 +1,61 @@
+/** ============================================================================
+ *  @file   pool.h
+ *
+ *  @path   emu/gpp
+ *
+ *  @desc   The POOL API of DSP/BIOS LINK, for the host emulation. The pool
+ *          is memory below 4GB shared by the GPP and DSP threads, so the
+ *          32 bit DSP addresses are the GPP addresses. The host caches are
+ *          coherent, writeback and invalidate only cost time when
+ *          EMU_CACHE_MBPS is set.
+ *  ============================================================================
+ */
+
+
+#if !defined (POOL_H)
+#define POOL_H
+
+
+#include <dsplink.h>
+
+
+#if defined (__cplusplus)
+extern "C" {
+#endif /* defined (__cplusplus) */
+
+
+#define POOL_makePoolId(procId, poolNo)  ((((procId) & 0xFF) << 8u) | ((poolNo) & 0xFF))
+
+typedef Uint16 PoolId ;
+
+typedef enum {
+    AddrType_Usr = 0u,
+    AddrType_Phy = 1u,
+    AddrType_Knl = 2u,
+    AddrType_Dsp = 3u
+} AddrType ;
+
+/* The buffer sizes of a shared memory pool */
+typedef struct SMAPOOL_Attrs_tag {
+    Uint32   numBufPools ;
+    Uint32 * bufSizes ;
+    Uint32 * numBuffers ;
+    Bool     exactMatchReq ;
+} SMAPOOL_Attrs ;
+
+NORMAL_API DSP_STATUS POOL_open (IN PoolId poolId, IN Pvoid params) ;
+NORMAL_API DSP_STATUS POOL_close (IN PoolId poolId) ;
+NORMAL_API DSP_STATUS POOL_alloc (IN PoolId poolId, OUT Pvoid * bufPtr, IN Uint32 size) ;
+NORMAL_API DSP_STATUS POOL_free (IN PoolId poolId, IN Pvoid buf, IN Uint32 size) ;
+NORMAL_API DSP_STATUS POOL_translateAddr (IN PoolId poolId, OUT Pvoid * dstAddr, IN AddrType dstAddrType,
+                                          IN Pvoid srcAddr, IN AddrType srcAddrType) ;
+NORMAL_API DSP_STATUS POOL_writeback (IN PoolId poolId, IN Pvoid buf, IN Uint32 size) ;
+NORMAL_API DSP_STATUS POOL_invalidate (IN PoolId poolId, IN Pvoid buf, IN Uint32 size) ;
+
+
+#if defined (__cplusplus)
+}
+#endif /* defined (__cplusplus) */
+
+
+#endif /* !defined (POOL_H) */
@@ -0,0 +1,43 @@
+/** ============================================================================
+ *  @file   proc.h
+ *
+ *  @path   emu/gpp
+ *
+ *  @desc   The PROC API of DSP/BIOS LINK, for the host emulation. Loading the
+ *          DSP starts the DSP image linked into the executable on a thread,
+ *          the executable file name is only reported.
+ *  ============================================================================
+ */
+
+
+#if !defined (PROC_H)
+#define PROC_H
+
+
+#include <dsplink.h>
+
+
+#if defined (__cplusplus)
+extern "C" {
+#endif /* defined (__cplusplus) */
+
+
+typedef struct PROC_Attrs_tag {
+    Uint32 timeout ;
+} PROC_Attrs ;
+
+NORMAL_API DSP_STATUS PROC_setup (IN Pvoid linkCfg) ;
+NORMAL_API DSP_STATUS PROC_destroy (Void) ;
+NORMAL_API DSP_STATUS PROC_attach (IN ProcessorId procId, OPT PROC_Attrs * attr) ;
+NORMAL_API DSP_STATUS PROC_detach (IN ProcessorId procId) ;
+NORMAL_API DSP_STATUS PROC_load (IN ProcessorId procId, IN Char8 * imagePath, IN Uint32 argc, IN Char8 ** argv) ;
+NORMAL_API DSP_STATUS PROC_start (IN ProcessorId procId) ;
+NORMAL_API DSP_STATUS PROC_stop (IN ProcessorId procId) ;
+
+
+#if defined (__cplusplus)
+}
+#endif /* defined (__cplusplus) */
+
+
+#endif /* !defined (PROC_H) */
@@ -0,0 +1,282 @@
+/*******************************************************************************
+* FILE: kernel_bench.c
+* Runs the DSP compute kernels (assignment-2/dsp/kernels.c and
+* assignment-1/dsp/mult.c) on the host, without the DSP/BIOS LINK emulation:
+* first checks them against plain references and against themselves split
+* in bands, then times them. Returns 1 when a check fails, so a change of a
+* kernel can be checked and measured without the board.
+*******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "kernels.h"
+#include "mult.h"
+
+#define BAND_ROWS 16                    ///< Rows per band of the split runs
+
+/* The weights of the gaussian of kernels.c, for the floating point reference */
+static const double weights[15] = {
+    416,  1177,  2837,  5830, 10206,
+    15226, 19356, 20969, 19356, 15226,
+    10206,  5830,  2837,  1177,  416
+};
+
+/*******************************************************************************
+* PROCEDURE: bench_usec
+* PURPOSE: The monotonic time in us.
+*******************************************************************************/
+static double bench_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1e6 + ts.tv_nsec / 1e3);
+}
+
+/*******************************************************************************
+* PROCEDURE: bench_image
+* PURPOSE: A test image with edges in every direction and noise: rectangles,
+* a disc and a gradient.
+*******************************************************************************/
+static void bench_image(unsigned char *image, int rows, int cols)
+{
+    int r, c, v;
+    unsigned int seed = 12345;
+
+    for (r = 0; r < rows; r++) {
+        for (c = 0; c < cols; c++) {
+            v = 40 + c * 60 / cols;
+            if (r > rows / 4 && r < rows / 2 && c > cols / 8 && c < cols / 2) v += 120;
+            if ((r - rows * 2 / 3) * (r - rows * 2 / 3) + (c - cols * 2 / 3) * (c - cols * 2 / 3) < rows * rows / 25) v += 90;
+            seed = seed * 1103515245 + 12345;
+            v += (int)((seed >> 16) % 16) - 8;
+            image[r * cols + c] = (unsigned char)((v < 0) ? 0 : (v > 255) ? 255 : v);
+        }
+    }
+}
+
+/*******************************************************************************
+* PROCEDURE: bench_compare
+* PURPOSE: Compare two short images, print the first difference. Returns the
+* number of pixels that differ more than tolerance.
+*******************************************************************************/
+static int bench_compare(const char *what, const short int *got, const short int *expected, int n, int tolerance)
+{
+    int i, bad = 0, max = 0, d;
+
+    for (i = 0; i < n; i++) {
+        d = abs(got[i] - expected[i]);
+        if (d > max) max = d;
+        if (d > tolerance) {
+            if (bad == 0) fprintf(stderr, "%s: pixel %d is %d, expected %d\n", what, i, got[i], expected[i]);
+            bad++;
+        }
+    }
+    printf("  %-34s %s (max difference %d)\n", what, bad ? "FAILED" : "ok", max);
+    return (bad);
+}
+
+/*******************************************************************************
+* PROCEDURE: check_canny
+* PURPOSE: Check the canny kernels: the gaussian against a floating point
+* gaussian with the same weights (2 off at most, both fixed point passes
+* truncate), the derivatives and the magnitude exactly against plain
+* references, and every kernel split in bands, and chained with the halo row,
+* against the whole image. Returns the number of failed checks.
+*******************************************************************************/
+static int check_canny(const unsigned char *image, int rows, int cols)
+{
+    int n = rows * cols, r, c, k, pos, failed = 0, start, end;
+    short int *smoothed = malloc(n * sizeof(short int)), *ref = malloc(n * sizeof(short int));
+    short int *dx = malloc(n * sizeof(short int)), *dy = malloc(n * sizeof(short int));
+    short int *out = malloc(n * sizeof(short int)), *out2 = malloc(n * sizeof(short int));
+    short int *halo = malloc(cols * sizeof(short int));
+    unsigned int *tmpim = malloc(n * sizeof(unsigned int));
+    double *tmpf = malloc(n * sizeof(double)), dot, sum;
+
+    /* The gaussian */
+    for (r = 0; r < rows; r++) {
+        for (c = 0; c < cols; c++) {
+            for (k = -7, dot = 0, sum = 0; k <= 7; k++) {
+                if (c + k >= 0 && c + k < cols) {
+                    dot += image[r * cols + c + k] * weights[k + 7];
+                    sum += weights[k + 7];
+                }
+            }
+            tmpf[r * cols + c] = dot * 90 / sum;
+        }
+    }
+    for (r = 0; r < rows; r++) {
+        for (c = 0; c < cols; c++) {
+            for (k = -7, dot = 0, sum = 0; k <= 7; k++) {
+                if (r + k >= 0 && r + k < rows) {
+                    dot += tmpf[(r + k) * cols + c] * weights[k + 7];
+                    sum += weights[k + 7];
+                }
+            }
+            ref[r * cols + c] = (short int)(dot / sum + 0.5);
+        }
+    }
+    kernel_gaussian(image, smoothed, tmpim, rows, cols, 0, rows, NULL);
+    failed += bench_compare("gaussian / floating point", smoothed, ref, n, 2) != 0;
+    memset(out, 0, n * sizeof(short int));
+    for (start = 0; start < rows; start = end) {
+        end = (start + BAND_ROWS < rows) ? start + BAND_ROWS : rows;
+        kernel_gaussian(image, out, tmpim, rows, cols, start, end, NULL);
+    }
+    failed += bench_compare("gaussian / bands", out, smoothed, n, 0) != 0;
+
+    /* The derivatives */
+    for (r = 0; r < rows; r++) {
+        for (c = 0; c < cols; c++) {
+            pos = r * cols + c;
+            out[pos] = smoothed[(c < cols - 1) ? pos + 1 : pos] - smoothed[(c > 0) ? pos - 1 : pos];
+            out2[pos] = smoothed[(r < rows - 1) ? pos + cols : pos] - smoothed[(r > 0) ? pos - cols : pos];
+        }
+    }
+    kernel_derivative(smoothed, dx, dy, rows, cols, 0, rows, NULL);
+    failed += bench_compare("derivative x / reference", dx, out, n, 0) != 0;
+    failed += bench_compare("derivative y / reference", dy, out2, n, 0) != 0;
+    memset(out, 0, n * sizeof(short int));
+    memset(out2, 0, n * sizeof(short int));
+    for (start = 0; start < rows; start = end) {
+        end = (start + BAND_ROWS < rows) ? start + BAND_ROWS : rows;
+        kernel_derivative(smoothed, out, out2, rows, cols, start, end, NULL);
+    }
+    failed += bench_compare("derivative x / bands", out, dx, n, 0) != 0;
+    failed += bench_compare("derivative y / bands", out2, dy, n, 0) != 0;
+
+    /* A chain of the first band, the row below it only goes to the halo */
+    end = (rows > BAND_ROWS) ? rows / 2 : rows;
+    memset(out, 0, n * sizeof(short int));
+    memset(out2, 0, n * sizeof(short int));
+    memset(ref, 0, n * sizeof(short int));
+    kernel_gaussian(image, ref, tmpim, rows, cols, 0, end, halo);
+    kernel_derivative(ref, out, out2, rows, cols, 0, end, halo);
+    failed += bench_compare("gaussian / chain with halo", ref, smoothed, end * cols, 0) != 0;
+    failed += bench_compare("derivative y / chain with halo", out2, dy, end * cols, 0) != 0;
+
+    /* The magnitude */
+    for (pos = 0; pos < n; pos++) {
+        ref[pos] = (short)(0.5 + sqrt((float)((int)dx[pos] * dx[pos]) + (float)((int)dy[pos] * dy[pos])));
+    }
+    kernel_magnitude(dx, dy, out, rows, cols, 0, rows);
+    failed += bench_compare("magnitude / floating point", out, ref, n, 0) != 0;
+    memset(out2, 0, n * sizeof(short int));
+    for (start = 0; start < rows; start = end) {
+        end = (start + BAND_ROWS < rows) ? start + BAND_ROWS : rows;
+        kernel_magnitude(dx, dy, out2, rows, cols, start, end);
+    }
+    failed += bench_compare("magnitude / bands", out2, out, n, 0) != 0;
+
+    free(smoothed); free(ref); free(dx); free(dy); free(out); free(out2); free(halo); free(tmpim); free(tmpf);
+    return (failed);
+}
+
+/*******************************************************************************
+* PROCEDURE: check_mult
+* PURPOSE: Check the matrix multiplication against a plain triple loop, whole
+* and split in two at a percentage like the DSP does. Returns the number of
+* failed checks.
+*******************************************************************************/
+static int check_mult(const int *a, const int *b, int size)
+{
+    int *ref = malloc(size * size * sizeof(int)), *c = malloc(size * size * sizeof(int));
+    int i, j, k, sum, bad = 0, failed = 0;
+
+    for (i = 0; i < size; i++) {
+        for (j = 0; j < size; j++) {
+            for (k = 0, sum = 0; k < size; k++) {
+                sum += a[i * size + k] * b[k * size + j];
+            }
+            ref[i * size + j] = sum;
+        }
+    }
+    mult_rows(a, b, c, size, size, 0, size);
+    bad = memcmp(c, ref, size * size * sizeof(int)) != 0;
+    printf("  %-34s %s\n", "matrix / reference", bad ? "FAILED" : "ok");
+    failed += bad;
+    memset(c, 0, size * size * sizeof(int));
+    mult_rows(a, b, c, size, size, 0, size * 49 / 100);
+    mult_rows(a, b, c, size, size, size * 49 / 100, size);
+    bad = memcmp(c, ref, size * size * sizeof(int)) != 0;
+    printf("  %-34s %s\n", "matrix / split at 49%", bad ? "FAILED" : "ok");
+    failed += bad;
+
+    free(ref); free(c);
+    return (failed);
+}
+
+/* Time iterations runs of a statement, print the mean per run and the rate of
+ * units (pixels or multiply-adds) per second */
+#define BENCH(name, units, statement)                                                       \
+    do {                                                                                    \
+        double start_us = bench_usec(), us;                                                 \
+        int it;                                                                             \
+        for (it = 0; it < iterations; it++) {                                               \
+            statement;                                                                      \
+        }                                                                                   \
+        us = (bench_usec() - start_us) / iterations;                                        \
+        printf("  %-14s %10.1f us %10.2f M/s\n", name, us, (double)(units) / us);           \
+    } while (0)
+
+int main(int argc, char **argv)
+{
+    int rows = 240, cols = 320, size = 100, iterations = 20, i, failed = 0;
+    unsigned char *image;
+    short int *smoothed, *dx, *dy, *magnitude;
+    unsigned int *tmpim;
+    int *a, *b, *c;
+
+    if (argc > 1 && (argc < 3 || argv[1][0] == '-')) {
+        fprintf(stderr, "Usage: %s [rows cols [matrix size [iterations]]]\n", argv[0]);
+        return (1);
+    }
+    if (argc > 2) {
+        rows = atoi(argv[1]);
+        cols = atoi(argv[2]);
+    }
+    if (argc > 3) size = atoi(argv[3]);
+    if (argc > 4) iterations = atoi(argv[4]);
+    if (rows < 2 || cols < 2 || size < 1 || iterations < 1) {
+        fprintf(stderr, "The image must be at least 2 x 2, the matrix and the iterations at least 1.\n");
+        return (1);
+    }
+
+    image = malloc(rows * cols);
+    smoothed = malloc(rows * cols * sizeof(short int));
+    dx = malloc(rows * cols * sizeof(short int));
+    dy = malloc(rows * cols * sizeof(short int));
+    magnitude = malloc(rows * cols * sizeof(short int));
+    tmpim = malloc(rows * cols * sizeof(unsigned int));
+    a = malloc(size * size * sizeof(int));
+    b = malloc(size * size * sizeof(int));
+    c = malloc(size * size * sizeof(int));
+    bench_image(image, rows, cols);
+    for (i = 0; i < size * size; i++) {
+        a[i] = (i * 7 + 3) % 101 - 50;
+        b[i] = (i * 13 + 5) % 97 - 48;
+    }
+
+    printf("Checks (%d x %d image, %d x %d matrix):\n", cols, rows, size, size);
+    failed += check_canny(image, rows, cols);
+    failed += check_mult(a, b, size);
+
+    printf("Timing (mean of %d runs):\n", iterations);
+    BENCH("gaussian", rows * cols, kernel_gaussian(image, smoothed, tmpim, rows, cols, 0, rows, NULL));
+    BENCH("derivative", rows * cols, kernel_derivative(smoothed, dx, dy, rows, cols, 0, rows, NULL));
+    BENCH("magnitude", rows * cols, kernel_magnitude(dx, dy, magnitude, rows, cols, 0, rows));
+    BENCH("matrix", (double)size * size * size, mult_rows(a, b, c, size, size, 0, size));
+
+    free(image); free(smoothed); free(dx); free(dy); free(magnitude); free(tmpim); free(a); free(b); free(c);
+    if (failed) {
+        printf("%d checks FAILED\n", failed);
+        return (1);
+    }
+    return (0);
+}